@@ -12,10 +12,30 @@
 #include "app.hpp"
 #include <chrono>
 #include <thread>
+#include <cstdio>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
 
 App::App() {
     initLogging();
 
+    // Worker count and cores to pin them to, cores as a comma separated list
+    JobConfig jobConfig;
+    if (const char* threads = std::getenv("ROSE_JOB_THREADS")) {
+        jobConfig.workerThreads = (uint32_t) std::strtoul(threads, nullptr, 10);
+    }
+    if (const char* cores = std::getenv("ROSE_JOB_CORES")) {
+        while (*cores != '\0') {
+            char* end;
+            uint32_t core = (uint32_t) std::strtoul(cores, &end, 10);
+            if (end == cores) break;
+            jobConfig.cores.push_back(core);
+            cores = *end == ',' ? end + 1 : end;
+        }
+    }
+    initJobs(jobConfig);
+
     glfwInit();
 
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
@@ -27,6 +47,11 @@ App::App() {
 
     renderEngine = std::make_unique<VulkanEngine>(instanceExt);
     windowOutput = std::make_unique<VkGlfwOutput>(window, *renderEngine);
+
+    // Software rasterizers such as lavapipe need far fewer particles to stay interactive
+    if (const char* particles = std::getenv("ROSE_PARTICLES")) {
+        windowOutput->particleCapacity = (uint32_t) std::strtoul(particles, nullptr, 10);
+    }
     
     try
     {
@@ -38,11 +63,33 @@ App::App() {
         logger->critical(e.what());
         return;
     }
+
+    // Records every frame from here on, for ReplaySession to benchmark
+    if (const char* capture = std::getenv("ROSE_CAPTURE")) {
+        windowOutput->capture = std::make_unique<SessionRecorder>(capture, *renderEngine, windowOutput->getExtent());
+    }
+
+    // The teapot is the first render object loaded by the engine
+    teapot = renderEngine->scene.add(SceneGraph::NO_NODE, 0);
+    addScenery(48);
+
+    // Sustains about a quarter of the capacity with the default two second lifetime
+    ParticleEmitter fountain;
+    fountain.position = glm::vec3(0.f, 2.f, 0.f);
+    fountain.rate = windowOutput->particleCapacity / 8.f;
+    windowOutput->particles->emitters.push_back(fountain);
+
+    // Animated characters from a model with bones, a hundred unless given
+    if (const char* model = std::getenv("ROSE_SKINNED_MODEL")) {
+        const char* count = std::getenv("ROSE_SKINNED_INSTANCES");
+        addCrowd(model, count != nullptr ? (uint32_t) std::strtoul(count, nullptr, 10) : 100);
+    }
 }
 
 App::~App() {
     windowOutput->destroy();
     renderEngine->destroy();
+    shutdownJobs();
 }
 
 void App::run() {
@@ -53,41 +100,359 @@ void App::run() {
     auto lastFrame = std::chrono::system_clock::now();
     std::chrono::duration<double> frameTime = 1.0s / 65.0;
     float speed = 0.3f;
+    float rotation = 0.f;
+
+    View* mainView = windowOutput->views.front().get();
 
     while (!glfwWindowShouldClose(window))
     {
+        // Frame pacing sleeps here, so the input below is as recent as possible when the frame is drawn
+        windowOutput->waitForFrame();
         glfwPollEvents();
 
         // std::this_thread::sleep_until(lastFrame + frameTime);
         // lastFrame = std::chrono::system_clock::now();
         
+        // cameraPos is the eye of a lookAt view, it used to translate the world instead. The vertical signs flipped
+        // with that so Space still rises and Shift sinks, the camera faces +z so the other keys kept theirs.
         if(glfwGetKey(window, GLFW_KEY_W)) {
-            windowOutput->view.cameraPos += glm::vec3(0, 0, speed);
+            mainView->cameraPos += glm::vec3(0, 0, speed);
         } else if(glfwGetKey(window, GLFW_KEY_S)) {
-            windowOutput->view.cameraPos += glm::vec3(0, 0, -speed);
+            mainView->cameraPos += glm::vec3(0, 0, -speed);
         } else if(glfwGetKey(window, GLFW_KEY_A)) {
-            windowOutput->view.cameraPos += glm::vec3(speed, 0, 0);
+            mainView->cameraPos += glm::vec3(speed, 0, 0);
         } else if(glfwGetKey(window, GLFW_KEY_D)) {
-            windowOutput->view.cameraPos += glm::vec3(-speed, 0, 0);
+            mainView->cameraPos += glm::vec3(-speed, 0, 0);
         } else if(glfwGetKey(window, GLFW_KEY_LEFT_SHIFT)) {
-            windowOutput->view.cameraPos += glm::vec3(0, speed, 0);
+            mainView->cameraPos += glm::vec3(0, -speed, 0);
         } else if(glfwGetKey(window, GLFW_KEY_SPACE)) {
-            windowOutput->view.cameraPos += glm::vec3(0, -speed, 0);
+            mainView->cameraPos += glm::vec3(0, speed, 0);
         }
         
         windowOutput->beginImguiFrame();
         ImGui::ShowDemoWindow();
 
         ImGui::Begin("Rose!");
-        ImGui::SliderAngle("FOV", &windowOutput->view.fov.x, 0, 180.0F);
+        ImGui::SliderAngle("FOV", &mainView->fov, 1.0F, 179.0F);
         ImGui::SliderFloat("Speed", &speed, 0, 4.f);
-        ImGui::SliderAngle("Rotation", &windowOutput->view.fov.y, -180.0F, 180.0F);
+        ImGui::SliderAngle("Rotation", &rotation, -180.0F, 180.0F);
         ImGui::End(); 
+
+        renderEngine->scene.setRotation(teapot, glm::angleAxis(rotation, glm::vec3(0, 1, 0)));
+
+        memoryPanel();
+        viewsPanel(mainView);
+        particlesPanel();
+        latencyPanel();
+        lightsPanel();
+        texturesPanel();
+        skinningPanel();
         
         windowOutput->endImguiFrame();
         windowOutput->draw();
+        renderEngine->update();
     }
 
     renderEngine->stop();
 }
 
+
+void App::memoryPanel() {
+    const float MiB = 1024.0f * 1024.0f;
+    auto stats = renderEngine->getMemoryStats();
+
+    ImGui::Begin("Memory");
+    ImGui::Text("Total: %.1f / %.1f MiB%s", stats.totalUsage / MiB, stats.totalBudget / MiB, stats.budgetExtension ? "" : " (estimated budget)");
+
+    for (const auto& heap : stats.heaps)
+    {
+        ImGui::Separator();
+        ImGui::Text("Heap %u%s", heap.heapIndex, (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " (device local)" : "");
+
+        char overlay[64];
+        snprintf(overlay, sizeof(overlay), "%.1f / %.1f MiB", heap.usage / MiB, heap.budget / MiB);
+        ImGui::ProgressBar(heap.budget > 0 ? (float) heap.usage / (float) heap.budget : 0.0f, ImVec2(-1, 0), overlay);
+
+        ImGui::Text("%u allocations in %u blocks, %.1f MiB allocated", heap.allocationCount, heap.blockCount, heap.allocationBytes / MiB);
+        ImGui::Text("Fragmentation: %.0f%%, outside VMA: %.1f MiB", heap.fragmentation * 100.0f,
+            heap.usage > heap.blockBytes ? (heap.usage - heap.blockBytes) / MiB : 0.0f);
+    }
+
+    if (ImGui::CollapsingHeader("By subsystem"))
+    {
+        for (const auto& [tag, tagStats] : stats.tags)
+        {
+            ImGui::Text("%s: %.2f MiB (%u)", tag.c_str(), tagStats.bytes / MiB, tagStats.allocationCount);
+        }
+    }
+
+    auto& geometry = *renderEngine->geometry;
+    auto& geometryStats = geometry.stats;
+    if (ImGui::CollapsingHeader("Geometry"))
+    {
+        ImGui::Text("%u meshes", geometryStats.meshes);
+        ImGui::Text("Vertices: %u / %u", geometryStats.usedVertices, geometryStats.vertexCapacity);
+        ImGui::Text("Indices: %u / %u", geometryStats.usedIndices, geometryStats.indexCapacity);
+        ImGui::Text("%.1f MiB with packed vertices", geometryStats.bytes / MiB);
+        ImGui::Text("Fragmentation: %.0f%%, %u repacks", geometryStats.fragmentation * 100.0f, geometryStats.defragmentations);
+        ImGui::SliderFloat("Repack above", &geometry.defragmentThreshold, 0.f, 1.f);
+        if (ImGui::Button("Defragment")) geometry.requestDefragment();
+    }
+    ImGui::End();
+}
+
+void App::particlesPanel() {
+    auto& particles = *windowOutput->particles;
+    auto& stats = particles.stats;
+
+    ImGui::Begin("Particles");
+    ImGui::Text("%u / %u alive, %u emitted last frame", stats.alive, stats.capacity, stats.emitted);
+    ImGui::SliderFloat("Size", &particles.size, 0.005f, 0.5f);
+    ImGui::SliderFloat("Drag", &particles.drag, 0.f, 2.f);
+
+    for (size_t i = 0; i < particles.emitters.size(); i++) {
+        auto& emitter = particles.emitters[i];
+        ImGui::PushID((int) i);
+        ImGui::Separator();
+        ImGui::Checkbox("Enabled", &emitter.enabled);
+        ImGui::SliderFloat("Rate", &emitter.rate, 0.f, (float) stats.capacity, "%.0f/s");
+        ImGui::SliderFloat("Lifetime", &emitter.lifetime, 0.1f, 10.f, "%.1f s");
+        ImGui::SliderFloat("Spread", &emitter.spread, 0.f, 10.f);
+        ImGui::ColorEdit4("Color", &emitter.color.x);
+        ImGui::PopID();
+    }
+    ImGui::End();
+}
+
+// A ring of teapot copies around the scene that never move, merged into static batches
+void App::addScenery(uint32_t count) {
+    RenderObject source = renderEngine->renderObjects[0];
+    for (uint32_t i = 0; i < count; i++) {
+        float angle = glm::radians(360.f * (float) i / (float) count);
+        RenderObject object;
+        object.meshIndex = source.meshIndex;
+        object.materialIndex = source.materialIndex;
+        object.transform = glm::translate(glm::mat4(1.f), glm::vec3(std::cos(angle) * 24.f, 0.f, std::sin(angle) * 24.f));
+        object.transform = glm::rotate(object.transform, -angle, glm::vec3(0.f, 1.f, 0.f));
+        object.isStatic = true;
+        renderEngine->renderObjects.push_back(object);
+    }
+    renderEngine->buildStaticBatches();
+}
+
+// A square grid next to the teapot, every instance starts at a different time of the first animation
+void App::addCrowd(const std::string& path, uint32_t count) {
+    auto model = renderEngine->modelMan->load(path);
+    if (model == nullptr || model->skeleton.size() == 0) {
+        getLogger("Rose")->warn("No skinned mesh in {}", path);
+        return;
+    }
+
+    renderEngine->meshes.push_back(model->mesh);
+    renderEngine->uploadMesh(renderEngine->meshes.back());
+    uint32_t sourceMesh = (uint32_t) (renderEngine->meshes.size() - 1);
+    float spacing = 2.f * std::max(renderEngine->meshes.back().bounds.w, 0.5f);
+
+    Material material = model->material;
+    if (!model->baseColorTexture.empty()) {
+        material.baseColorTexture = renderEngine->materials->loadTexture(model->baseColorTexture);
+    }
+    uint32_t materialIndex = renderEngine->materials->add(material);
+
+    auto& skinning = *windowOutput->skinning;
+    uint32_t side = (uint32_t) std::ceil(std::sqrt((float) count));
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t instance = skinning.add(model, sourceMesh);
+        skinning.instances[instance].time = (float) i * 0.37f;
+
+        RenderObject object;
+        object.meshIndex = skinning.instances[instance].mesh;
+        object.materialIndex = materialIndex;
+        object.transform = glm::translate(glm::mat4(1.f), glm::vec3((float) (i % side + 2) * spacing, 0.f, (float) (i / side) * spacing));
+        renderEngine->renderObjects.push_back(object);
+    }
+}
+
+void App::skinningPanel() {
+    auto& skinning = *windowOutput->skinning;
+    auto& stats = skinning.stats;
+
+    ImGui::Begin("Skinning");
+    ImGui::Text("%u instances, %u joints", stats.instances, stats.joints);
+    ImGui::Text("%u vertices skinned per frame", stats.vertices);
+    if (ImGui::SliderFloat("Speed", &crowdSpeed, 0.f, 3.f)) {
+        for (auto& instance : skinning.instances) instance.speed = crowdSpeed;
+    }
+    ImGui::End();
+}
+
+void App::lightsPanel() {
+    auto& lighting = *windowOutput->lighting;
+    auto& stats = lighting.stats;
+
+    ImGui::Begin("Lights");
+    ImGui::ColorEdit3("Ambient", &lighting.ambient.x);
+
+    // Scattered over the scene, every fourth light is a spot pointing down
+    int count = (int) lighting.lights.size();
+    if (ImGui::SliderInt("Count", &count, 0, 8192)) {
+        auto random = [] (float min, float max) { return min + (max - min) * ((float) std::rand() / (float) RAND_MAX); };
+
+        std::srand(1);
+        lighting.lights.resize((size_t) count);
+        for (size_t i = 0; i < lighting.lights.size(); i++) {
+            Light& light = lighting.lights[i];
+            light.type = i % 4 == 3 ? LightType::Spot : LightType::Point;
+            light.position = glm::vec3(random(-30.f, 30.f), random(0.5f, 6.f), random(-30.f, 30.f));
+            light.color = glm::vec3(random(0.2f, 1.f), random(0.2f, 1.f), random(0.2f, 1.f));
+            light.intensity = random(5.f, 20.f);
+            light.range = random(2.f, 8.f);
+        }
+    }
+
+    ImGui::Separator();
+    ImGui::Text("%u lights in %u views", stats.lights, stats.views);
+    ImGui::Text("%u / %u clusters lit, %u light references", stats.activeClusters, stats.clusters, stats.lightAssignments);
+    ImGui::Text("Most lights in a cluster: %u", stats.maxLightsPerCluster);
+    if (stats.overflows > 0) {
+        ImGui::Text("%u clusters over the limit of %u lights", stats.overflows, ClusteredLighting::MAX_LIGHTS_PER_CLUSTER);
+    }
+    ImGui::End();
+}
+
+void App::texturesPanel() {
+    const float MiB = 1024.0f * 1024.0f;
+    auto& materials = *renderEngine->materials;
+    auto& streamer = materials.streamer;
+    auto& stats = streamer.stats;
+
+    ImGui::Begin("Textures");
+
+    int budget = (int) (streamer.budget / (1024 * 1024));
+    if (ImGui::SliderInt("Budget (MiB)", &budget, 16, 4096)) streamer.budget = (VkDeviceSize) budget * 1024 * 1024;
+
+    char overlay[64];
+    snprintf(overlay, sizeof(overlay), "%.1f / %.1f MiB", stats.allocatedBytes / MiB, streamer.budget / MiB);
+    ImGui::ProgressBar(streamer.budget > 0 ? (float) stats.allocatedBytes / (float) streamer.budget : 0.0f, ImVec2(-1, 0), overlay);
+
+    ImGui::Text("Resident chains: %.1f MiB", stats.residentBytes / MiB);
+    ImGui::Text("Wanted by screen size: %.1f MiB", stats.wantedBytes / MiB);
+    ImGui::Text("%u textures, %u at full resolution, %u loading", stats.textures, stats.full, stats.loading);
+    ImGui::Text("%u loads, %u evictions", stats.loads, stats.evictions);
+
+    ImGui::Separator();
+    ImGui::Text("%u materials, table uploaded %u times", materials.stats.materials, materials.stats.tableUploads);
+    ImGui::Text("%u texture arrays, %.1f MiB allocated", materials.textures.stats.arrays, materials.textures.stats.bytes / MiB);
+    ImGui::End();
+}
+
+void App::latencyPanel() {
+    ImGui::Begin("Latency");
+
+    int policy = (int) windowOutput->latencyPolicy;
+    const char* policies[] = {latencyPolicyName(LatencyPolicy::Throughput), latencyPolicyName(LatencyPolicy::LowLatency)};
+    if (ImGui::Combo("Policy", &policy, policies, 2)) windowOutput->latencyPolicy = (LatencyPolicy) policy;
+
+    int framesInFlight = (int) windowOutput->framesInFlightOverride;
+    if (ImGui::SliderInt("Frames in flight", &framesInFlight, 0, 3, framesInFlight == 0 ? "Policy default" : "%d")) {
+        windowOutput->framesInFlightOverride = (uint32_t) framesInFlight;
+    }
+    ImGui::Checkbox("Frame pacing", &windowOutput->framePacing);
+
+    auto stats = windowOutput->getLatencyStats();
+    ImGui::Separator();
+    ImGui::Text("%s, %u images, %u frames in flight", presentModeName(stats.presentMode), stats.imageCount, stats.framesInFlight);
+    ImGui::Text("CPU frame: %.2f ms, pacing delay: %.2f ms", stats.cpuFrameTime, stats.pacingSleepMs);
+    ImGui::Text("Submit to GPU done: %.2f ms", stats.submitToGpuMs);
+    if (stats.presentWaitSupported) {
+        ImGui::Text("Submit to present: %.2f ms", stats.submitToPresentMs);
+    } else {
+        ImGui::Text("Submit to present: unavailable (no VK_KHR_present_wait)");
+    }
+
+    ImGui::Separator();
+    auto workers = getJobs().sampleStats();
+    ImGui::Text("Job threads: %u", (uint32_t) workers.size());
+    for (size_t i = 0; i < workers.size(); i++) {
+        char overlay[64];
+        snprintf(overlay, sizeof(overlay), "%zu%s: %llu jobs, %llu stolen", i, i == 0 ? " (main)" : "",
+            (unsigned long long) workers[i].jobs, (unsigned long long) workers[i].steals);
+        ImGui::ProgressBar(workers[i].utilisation, ImVec2(-1, 0), overlay);
+    }
+    ImGui::End();
+}
+
+void App::viewsPanel(View* mainView) {
+    ImGui::Begin("Views");
+
+    bool hasMinimap = minimap != nullptr;
+    if (ImGui::Checkbox("Minimap", &hasMinimap)) {
+        if (hasMinimap) {
+            minimap = windowOutput->newView();
+            minimap->name = "Minimap";
+            minimap->orthographic = true;
+            minimap->orthoHeight = 20.f;
+            minimap->cameraLook = glm::vec3(0, -1, 0);
+            minimap->viewport = glm::vec4(0.75f, 0.f, 0.25f, 0.25f);
+            minimap->clearColor = {{{0.1f, 0.1f, 0.1f, 1.0f}}};
+        } else {
+            windowOutput->destroyView(minimap);
+            minimap = nullptr;
+        }
+    }
+
+    bool split = mainView->viewport.z < 1.f;
+    if (ImGui::Checkbox("Split screen", &split)) {
+        if (split) {
+            mainView->viewport = glm::vec4(0.f, 0.f, 0.5f, 1.f);
+            secondView = windowOutput->newView();
+            secondView->name = "Second";
+            secondView->viewport = glm::vec4(0.5f, 0.f, 0.5f, 1.f);
+            // The minimap stays on top
+            if (minimap != nullptr) std::iter_swap(windowOutput->views.end() - 1, windowOutput->views.end() - 2);
+        } else {
+            mainView->viewport = glm::vec4(0.f, 0.f, 1.f, 1.f);
+            windowOutput->destroyView(secondView);
+            secondView = nullptr;
+        }
+    }
+
+    if (minimap != nullptr) minimap->cameraPos = mainView->cameraPos + glm::vec3(0, 30, 0);
+    if (secondView != nullptr) {
+        ImGui::Checkbox("Second view follows main camera", &secondFollows);
+        if (secondFollows) {
+            secondView->cameraPos = mainView->cameraPos;
+            secondView->cameraLook = mainView->cameraLook;
+            secondView->fov = mainView->fov;
+        }
+    }
+
+    auto& stats = windowOutput->cullStats;
+    ImGui::Separator();
+    ImGui::Text("%u views, %u distinct cameras", stats.views, stats.groups);
+    ImGui::Text("%u objects, %u visible, %u sphere tests", stats.objects, stats.visible, stats.sphereTests);
+    auto& batches = renderEngine->staticBatchStats;
+    ImGui::Text("Draws: %u, %u without static batching", stats.visible, stats.visibleUnbatched);
+    ImGui::Text("%u static objects in %u batches", batches.sourceObjects, batches.batches);
+
+    ImGui::Separator();
+    ImGui::Checkbox("Depth pre-pass", &windowOutput->depthPrepass);
+    ImGui::Checkbox("Occlusion culling", &windowOutput->occlusionCulling);
+    if (windowOutput->occlusionCulling) {
+        auto occlusion = windowOutput->getOcclusionStats();
+        ImGui::Text("%u draws tested, %u occluded", occlusion.tested, occlusion.culled);
+    }
+    ImGui::Checkbox("Vertex pulling", &windowOutput->vertexPulling);
+
+    ImGui::Separator();
+    ImGui::Text("GPU frame time: %.2f ms", windowOutput->getGpuFrameTime());
+    ImGui::Checkbox("Dynamic resolution", &windowOutput->dynamicResolution);
+    if (windowOutput->dynamicResolution) {
+        auto& resolution = windowOutput->resolution;
+        ImGui::SliderFloat("Target frame time", &resolution.targetFrameTime, 4.f, 50.f, "%.1f ms");
+        ImGui::SliderFloat("Min scale", &resolution.minScale, 0.25f, 1.f);
+        ImGui::SliderFloat("Max scale", &resolution.maxScale, 0.25f, 2.f);
+        ImGui::Text("Render scale: %.0f%%", resolution.getScale() * 100.f);
+    }
+    ImGui::End();
+}
@@ -11,9 +11,11 @@
 #pragma once
 
 #include <RoseLogging.hpp>
+#include <RoseJobs.hpp>
 #include <GLFW/glfw3.h>
 #include <VulkanEngine.hpp>
 #include <memory>
+#include <string>
 
 const uint32_t WIDTH = 1620;
 const uint32_t HEIGHT = 900;
@@ -31,5 +33,22 @@ private:
     std::unique_ptr<VulkanEngine> renderEngine;
     Logger logger;
 
+    // Extra views toggled from the views panel, owned by windowOutput
+    View* minimap = nullptr;
+    View* secondView = nullptr;
+    bool secondFollows = true;
+
+    SceneNode teapot = SceneGraph::NO_NODE; // Rotated from the settings window
+    float crowdSpeed = 1.f; // Of every skinned instance
+
     void mainLoop();
+    void memoryPanel();
+    void viewsPanel(View* mainView);
+    void particlesPanel();
+    void latencyPanel();
+    void lightsPanel();
+    void texturesPanel();
+    void skinningPanel();
+    void addCrowd(const std::string& path, uint32_t count);
+    void addScenery(uint32_t count);
 };
\ No newline at end of file
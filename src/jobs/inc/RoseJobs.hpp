@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct Job;
+
+struct JobConfig {
+    uint32_t workerThreads = 0;  // Besides the main thread, 0 starts one per remaining hardware thread, at least one
+    std::vector<uint32_t> cores; // Worker i (from 0) runs on cores[i % size], empty leaves placement to the OS
+};
+
+struct WorkerStats {
+    uint64_t jobs = 0;        // Run by the thread since the last sample
+    uint64_t steals = 0;      // Of those, taken from other threads' queues
+    float utilisation = 0.f;  // Share of the time since the last sample spent running jobs
+};
+
+// Counts unfinished jobs. Jobs submitted with it increment it, wait() returns once it is back at zero and jobs
+// that depend on it are released at that point. Must outlive every job it counts, so only destroy it once wait()
+// returned rather than when done() turns true.
+class JobCounter {
+public:
+    JobCounter() = default;
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class JobSystem;
+
+    std::atomic<uint32_t> pending{0};
+    std::mutex mutex;
+    std::vector<Job*> dependents; // Submitted while jobs were pending, run once they finished
+};
+
+// Fixed worker threads with a lock-free work stealing deque each. Threads push and pop jobs at the bottom of
+// their own deque, idle threads steal from the top of others'. The thread that called initJobs() counts as
+// worker 0: it runs jobs while it waits on a counter, and it alone runs the main thread jobs.
+// Threads that are not workers submit through a shared queue.
+class JobSystem {
+public:
+    JobSystem(const JobConfig& config);
+    ~JobSystem();
+
+    // Runs the job on any thread. With a dependency it is queued only once that counter reached zero.
+    void run(std::function<void()> job, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+    // For work that has to happen on the main thread, such as Vulkan calls on its queues or UI
+    void runOnMainThread(std::function<void()> job, JobCounter* counter = nullptr);
+    // Calls body(begin, end) over [0, count) in batches of batchSize and returns when all are done. The calling
+    // thread works on the batches as well.
+    void parallelFor(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t, uint32_t)>& body);
+
+    // Runs other jobs until the counter is done instead of blocking, never call it from a job the counter counts
+    void wait(JobCounter& counter);
+    // Called by the main thread once per frame, wait() on the main thread runs them too
+    void runMainThreadJobs();
+
+    uint32_t threadCount() const { return (uint32_t) workers.size(); } // Including the main thread
+    bool isMainThread() const;
+
+    // Statistics since the previous call, one entry per thread with the main thread first. Call it from one thread.
+    std::vector<WorkerStats> sampleStats();
+
+private:
+    struct Worker;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<bool> stopping{false};
+
+    std::mutex sharedMutex; // Jobs from threads without a deque, and overflow of full deques
+    std::vector<Job*> sharedJobs;
+    std::atomic<uint32_t> sharedCount{0};
+
+    std::mutex mainMutex;
+    std::vector<Job*> mainJobs;
+
+    // Idle workers sleep until the submission count changes
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<uint64_t> submissions{0};
+    std::atomic<uint32_t> sleepers{0};
+
+    void push(Job* job);
+    void submit(Job* job, JobCounter* dependency);
+    Job* find(int32_t index, bool& stolen);
+    bool runOne(int32_t index);
+    void execute(Job* job);
+    void finish(JobCounter* counter);
+    void workerLoop(int32_t index);
+};
+
+// The engine-wide job system, call initJobs() on the main thread before anything submits jobs
+void initJobs(const JobConfig& config = JobConfig());
+void shutdownJobs();
+JobSystem& getJobs();
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <deque>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+#include "RoseJobs.hpp"
+
+// Lazy coroutine producing a T. It starts when awaited and resumes its awaiter when it returns, on whichever
+// thread it finished on. Exceptions propagate to the awaiter.
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+struct TaskPromiseBase {
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+    std::exception_ptr exception;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            return handle.promise().continuation;
+        }
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() { exception = std::current_exception(); }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+    template <typename U>
+    void return_value(U&& result) { value.emplace(std::forward<U>(result)); }
+
+    T take() {
+        if (exception) std::rethrow_exception(exception);
+        return std::move(*value);
+    }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+
+    void take() {
+        if (exception) std::rethrow_exception(exception);
+    }
+};
+
+} // namespace detail
+
+template <typename T>
+class Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+    Task() = default;
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle) handle.destroy();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (handle) handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return !handle || handle.done(); }
+    // Symmetric transfer, the awaiter suspends and the task runs on the same thread without growing the stack
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+        handle.promise().continuation = awaiter;
+        return handle;
+    }
+    T await_resume() { return handle.promise().take(); }
+
+private:
+    std::coroutine_handle<promise_type> handle = nullptr;
+};
+
+namespace detail {
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+} // namespace detail
+
+// Moves coroutines between threads and resumes them once conditions hold. Coroutines await mainThread() to
+// continue inside update(), background() to continue on a job worker and io() to continue on one of the I/O
+// threads, which may block on files without holding up jobs. until() polls a condition from update(), such as a
+// GPU timeline value, and continues on the main thread once it holds.
+// Nothing here knows about the GPU, a loop calling update() drives it.
+class TaskScheduler {
+public:
+    TaskScheduler(uint32_t ioThreads = 2);
+    ~TaskScheduler();
+
+    struct ThreadAwaiter {
+        TaskScheduler* scheduler;
+        enum class Target { Main, Background, Io } target;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { scheduler->post(target, handle); }
+        void await_resume() const noexcept {}
+    };
+
+    struct ConditionAwaiter {
+        TaskScheduler* scheduler;
+        std::function<bool()> ready;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { scheduler->waitFor(std::move(ready), handle); }
+        void await_resume() const noexcept {}
+    };
+
+    ThreadAwaiter mainThread() { return {this, ThreadAwaiter::Target::Main}; }
+    ThreadAwaiter background() { return {this, ThreadAwaiter::Target::Background}; }
+    ThreadAwaiter io() { return {this, ThreadAwaiter::Target::Io}; }
+    // The condition is only ever called on the main thread
+    ConditionAwaiter until(std::function<bool()> ready) { return {this, std::move(ready)}; }
+
+    // Whole file on an I/O thread, continues there. Empty if the file could not be read.
+    Task<std::optional<std::vector<uint8_t>>> readFile(std::string path);
+
+    // Runs the task to its end without an awaiter, the scheduler keeps it alive. Its exception goes to onError.
+    void spawn(Task<void> task);
+    // Drives the scheduler from the main thread until the task finished, for code that cannot await
+    template <typename T>
+    T wait(Task<T> task);
+
+    // Once per frame on the main thread: resumes coroutines waiting for it and those whose condition holds
+    void update();
+
+    uint32_t running() const { return spawned.load(std::memory_order_acquire); } // Spawned tasks not done yet
+    std::function<void(std::exception_ptr)> onError;
+
+private:
+    struct Waiting {
+        std::function<bool()> ready;
+        std::coroutine_handle<> handle;
+    };
+
+    std::mutex mainMutex;
+    std::vector<std::coroutine_handle<>> mainQueue;
+    std::vector<Waiting> waiting; // Under mainMutex too
+    std::atomic<uint32_t> spawned{0};
+
+    std::vector<std::thread> ioWorkers;
+    std::mutex ioMutex;
+    std::condition_variable ioWake;
+    std::deque<std::coroutine_handle<>> ioQueue;
+    bool stopping = false;
+
+    void post(ThreadAwaiter::Target target, std::coroutine_handle<> handle);
+    void waitFor(std::function<bool()> ready, std::coroutine_handle<> handle);
+    void ioLoop();
+};
+
+namespace detail {
+
+// Starts right away and frees itself at the end, owns the task it drives
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+} // namespace detail
+
+template <typename T>
+T TaskScheduler::wait(Task<T> task) {
+    std::optional<T> result;
+    std::exception_ptr exception;
+    std::atomic<bool> done{false};
+
+    auto drive = [] (Task<T> task, std::optional<T>& result, std::exception_ptr& exception, std::atomic<bool>& done) -> detail::DetachedTask {
+        try {
+            result.emplace(co_await task);
+        } catch (...) {
+            exception = std::current_exception();
+        }
+        done.store(true, std::memory_order_release);
+    };
+    drive(std::move(task), result, exception, done);
+
+    while (!done.load(std::memory_order_acquire)) {
+        update();
+        std::this_thread::yield();
+    }
+    if (exception) std::rethrow_exception(exception);
+    return std::move(*result);
+}
+
+template <>
+inline void TaskScheduler::wait(Task<void> task) {
+    std::exception_ptr exception;
+    std::atomic<bool> done{false};
+
+    auto drive = [] (Task<void> task, std::exception_ptr& exception, std::atomic<bool>& done) -> detail::DetachedTask {
+        try {
+            co_await task;
+        } catch (...) {
+            exception = std::current_exception();
+        }
+        done.store(true, std::memory_order_release);
+    };
+    drive(std::move(task), exception, done);
+
+    while (!done.load(std::memory_order_acquire)) {
+        update();
+        std::this_thread::yield();
+    }
+    if (exception) std::rethrow_exception(exception);
+}
@@ -0,0 +1,302 @@
+#include "inc/RoseJobs.hpp"
+#include "work_deque.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+#if defined(_WIN32)
+    #include <windows.h>
+#elif defined(__linux__)
+    #include <pthread.h>
+    #include <sched.h>
+#endif
+
+#define DEQUE_CAPACITY 4096
+
+struct Job {
+    std::function<void()> run;
+    JobCounter* counter = nullptr;
+};
+
+struct JobSystem::Worker {
+    WorkDeque<Job> deque{DEQUE_CAPACITY};
+    std::thread thread; // Not started for the main thread
+
+    std::atomic<uint64_t> jobs{0};
+    std::atomic<uint64_t> steals{0};
+    std::atomic<uint64_t> busyNs{0};
+
+    // At the previous sampleStats()
+    uint64_t sampledJobs = 0;
+    uint64_t sampledSteals = 0;
+    uint64_t sampledBusyNs = 0;
+
+    uint32_t nextVictim = 0;
+};
+
+// Index into workers of the calling thread, -1 for threads that are not workers
+static thread_local int32_t threadIndex = -1;
+
+static std::unique_ptr<JobSystem> jobSystem;
+static std::chrono::steady_clock::time_point lastSample;
+
+static void pinThread(std::thread& thread, uint32_t core) {
+#if defined(_WIN32)
+    SetThreadAffinityMask(thread.native_handle(), (DWORD_PTR) 1 << core);
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &set);
+#endif
+}
+
+JobSystem::JobSystem(const JobConfig& config) {
+    uint32_t hardware = std::max(std::thread::hardware_concurrency(), 1u);
+    uint32_t workerThreads = config.workerThreads > 0 ? config.workerThreads : std::max(hardware - 1, 1u);
+
+    threadIndex = 0;
+    for (uint32_t i = 0; i <= workerThreads; i++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    lastSample = std::chrono::steady_clock::now();
+
+    // Workers only start once every deque exists, they steal from all of them
+    for (uint32_t i = 1; i <= workerThreads; i++) {
+        workers[i]->thread = std::thread([this, i] () { workerLoop((int32_t) i); });
+        if (!config.cores.empty()) pinThread(workers[i]->thread, config.cores[(i - 1) % config.cores.size()]);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto& worker : workers) {
+        if (worker->thread.joinable()) worker->thread.join();
+    }
+    threadIndex = -1;
+
+    // Left over only if nobody waited on them
+    for (auto& worker : workers) {
+        while (Job* job = worker->deque.pop()) delete job;
+    }
+    for (Job* job : sharedJobs) delete job;
+    for (Job* job : mainJobs) delete job;
+}
+
+bool JobSystem::isMainThread() const {
+    return threadIndex == 0;
+}
+
+void JobSystem::run(std::function<void()> job, JobCounter* counter, JobCounter* dependency) {
+    if (counter != nullptr) counter->pending.fetch_add(1, std::memory_order_relaxed);
+    submit(new Job{std::move(job), counter}, dependency);
+}
+
+void JobSystem::runOnMainThread(std::function<void()> job, JobCounter* counter) {
+    if (counter != nullptr) counter->pending.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mainMutex);
+    mainJobs.push_back(new Job{std::move(job), counter});
+}
+
+// Batches are pushed to the calling thread's deque, other threads steal them while it pops its own
+void JobSystem::parallelFor(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t, uint32_t)>& body) {
+    if (count == 0) return;
+    batchSize = std::max(batchSize, 1u);
+    if (count <= batchSize || workers.size() == 1) {
+        body(0, count);
+        return;
+    }
+
+    JobCounter counter;
+    for (uint32_t begin = batchSize; begin < count; begin += batchSize) {
+        uint32_t end = std::min(begin + batchSize, count);
+        run([&body, begin, end] () { body(begin, end); }, &counter);
+    }
+    body(0, batchSize);
+    wait(counter);
+}
+
+void JobSystem::submit(Job* job, JobCounter* dependency) {
+    if (dependency != nullptr) {
+        std::lock_guard<std::mutex> lock(dependency->mutex);
+        if (!dependency->done()) {
+            dependency->dependents.push_back(job);
+            return;
+        }
+    }
+    push(job);
+}
+
+void JobSystem::push(Job* job) {
+    if (threadIndex < 0 || threadIndex >= (int32_t) workers.size() || !workers[threadIndex]->deque.push(job)) {
+        std::lock_guard<std::mutex> lock(sharedMutex);
+        sharedJobs.push_back(job);
+        sharedCount.fetch_add(1, std::memory_order_release);
+    }
+
+    // Sequentially consistent with the sleepers' increment, either they see this submission or we see them
+    submissions.fetch_add(1, std::memory_order_seq_cst);
+    if (sleepers.load(std::memory_order_seq_cst) > 0) {
+        { std::lock_guard<std::mutex> lock(sleepMutex); }
+        wake.notify_one();
+    }
+}
+
+// Own deque first, newest job first, then the shared queue, then the oldest job of another thread
+Job* JobSystem::find(int32_t index, bool& stolen) {
+    stolen = false;
+    if (index >= 0) {
+        if (Job* job = workers[index]->deque.pop()) return job;
+    }
+
+    if (sharedCount.load(std::memory_order_acquire) > 0) {
+        std::lock_guard<std::mutex> lock(sharedMutex);
+        if (!sharedJobs.empty()) {
+            Job* job = sharedJobs.back();
+            sharedJobs.pop_back();
+            sharedCount.fetch_sub(1, std::memory_order_relaxed);
+            return job;
+        }
+    }
+
+    uint32_t count = (uint32_t) workers.size();
+    uint32_t start = index >= 0 ? workers[index]->nextVictim++ : 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t victim = (start + i) % count;
+        if ((int32_t) victim == index) continue;
+        if (Job* job = workers[victim]->deque.steal()) {
+            stolen = true;
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+bool JobSystem::runOne(int32_t index) {
+    bool stolen;
+    Job* job = find(index, stolen);
+    if (job == nullptr) return false;
+
+    if (index >= 0) {
+        auto start = std::chrono::steady_clock::now();
+        execute(job);
+        auto busy = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+        Worker& worker = *workers[index];
+        worker.busyNs.fetch_add((uint64_t) busy, std::memory_order_relaxed);
+        worker.jobs.fetch_add(1, std::memory_order_relaxed);
+        if (stolen) worker.steals.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        execute(job);
+    }
+    return true;
+}
+
+void JobSystem::execute(Job* job) {
+    job->run();
+    JobCounter* counter = job->counter;
+    delete job;
+    if (counter != nullptr) finish(counter);
+}
+
+// The last job of a counter releases the jobs that depend on it
+void JobSystem::finish(JobCounter* counter) {
+    std::vector<Job*> released;
+    {
+        // The lock orders this against submit(), which checks the count under it
+        std::lock_guard<std::mutex> lock(counter->mutex);
+        if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+        released.swap(counter->dependents);
+    }
+    for (Job* job : released) push(job);
+}
+
+void JobSystem::wait(JobCounter& counter) {
+    int32_t index = threadIndex < (int32_t) workers.size() ? threadIndex : -1;
+    while (!counter.done()) {
+        if (index == 0) runMainThreadJobs();
+        if (!runOne(index)) std::this_thread::yield();
+    }
+
+    // The last job decrements under the lock, once it is free finish() no longer touches the counter
+    std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+void JobSystem::runMainThreadJobs() {
+    if (threadIndex != 0) throw std::runtime_error("main thread jobs run on another thread!");
+
+    std::vector<Job*> jobs;
+    {
+        std::lock_guard<std::mutex> lock(mainMutex);
+        jobs.swap(mainJobs);
+    }
+    for (Job* job : jobs) execute(job);
+}
+
+void JobSystem::workerLoop(int32_t index) {
+    threadIndex = index;
+
+    while (true) {
+        uint64_t seen = submissions.load(std::memory_order_seq_cst);
+        if (runOne(index)) continue;
+
+        // Jobs are often submitted in bursts, a short spin saves the sleep and wake up
+        bool found = false;
+        for (int spin = 0; spin < 64 && !found; spin++) {
+            std::this_thread::yield();
+            found = runOne(index);
+        }
+        if (found) continue;
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        if (stopping) return;
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+        wake.wait(lock, [&] () { return stopping || submissions.load(std::memory_order_seq_cst) != seen; });
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+        if (stopping) return;
+    }
+}
+
+std::vector<WorkerStats> JobSystem::sampleStats() {
+    auto now = std::chrono::steady_clock::now();
+    double elapsedNs = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(now - lastSample).count();
+    lastSample = now;
+
+    std::vector<WorkerStats> stats(workers.size());
+    for (size_t i = 0; i < workers.size(); i++) {
+        Worker& worker = *workers[i];
+        uint64_t jobs = worker.jobs.load(std::memory_order_relaxed);
+        uint64_t steals = worker.steals.load(std::memory_order_relaxed);
+        uint64_t busyNs = worker.busyNs.load(std::memory_order_relaxed);
+
+        stats[i].jobs = jobs - worker.sampledJobs;
+        stats[i].steals = steals - worker.sampledSteals;
+        stats[i].utilisation = elapsedNs > 0.0 ? (float) std::min((double) (busyNs - worker.sampledBusyNs) / elapsedNs, 1.0) : 0.f;
+
+        worker.sampledJobs = jobs;
+        worker.sampledSteals = steals;
+        worker.sampledBusyNs = busyNs;
+    }
+    return stats;
+}
+
+void initJobs(const JobConfig& config) {
+    if (jobSystem) return;
+    jobSystem = std::make_unique<JobSystem>(config);
+}
+
+void shutdownJobs() {
+    jobSystem.reset();
+}
+
+JobSystem& getJobs() {
+    if (!jobSystem) throw std::runtime_error("job system used before initJobs!");
+    return *jobSystem;
+}
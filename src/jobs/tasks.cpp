@@ -0,0 +1,112 @@
+#include "inc/RoseTasks.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+TaskScheduler::TaskScheduler(uint32_t ioThreads) {
+    for (uint32_t i = 0; i < std::max(ioThreads, 1u); i++) {
+        ioWorkers.emplace_back([this] () { ioLoop(); });
+    }
+}
+
+// Coroutines still suspended here are leaked rather than destroyed, their awaiters may still refer to them
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(ioMutex);
+        stopping = true;
+    }
+    ioWake.notify_all();
+    for (auto& worker : ioWorkers) worker.join();
+}
+
+void TaskScheduler::post(ThreadAwaiter::Target target, std::coroutine_handle<> handle) {
+    switch (target) {
+    case ThreadAwaiter::Target::Main: {
+        std::lock_guard<std::mutex> lock(mainMutex);
+        mainQueue.push_back(handle);
+        break;
+    }
+    case ThreadAwaiter::Target::Background:
+        getJobs().run([handle] () { handle.resume(); });
+        break;
+    case ThreadAwaiter::Target::Io: {
+        {
+            std::lock_guard<std::mutex> lock(ioMutex);
+            ioQueue.push_back(handle);
+        }
+        ioWake.notify_one();
+        break;
+    }
+    }
+}
+
+void TaskScheduler::waitFor(std::function<bool()> ready, std::coroutine_handle<> handle) {
+    std::lock_guard<std::mutex> lock(mainMutex);
+    waiting.push_back({std::move(ready), handle});
+}
+
+void TaskScheduler::ioLoop() {
+    while (true) {
+        std::coroutine_handle<> handle;
+        {
+            std::unique_lock<std::mutex> lock(ioMutex);
+            ioWake.wait(lock, [this] () { return stopping || !ioQueue.empty(); });
+            if (stopping) return;
+
+            handle = ioQueue.front();
+            ioQueue.pop_front();
+        }
+        handle.resume();
+    }
+}
+
+// Coroutines resumed here may queue themselves again, those wait for the next call
+void TaskScheduler::update() {
+    std::vector<std::coroutine_handle<>> resume;
+    std::vector<Waiting> pending;
+    {
+        std::lock_guard<std::mutex> lock(mainMutex);
+        resume.swap(mainQueue);
+        pending.swap(waiting);
+    }
+
+    // Conditions are checked outside the lock, they may be slow or await again once resumed
+    std::vector<Waiting> stillWaiting;
+    for (auto& entry : pending) {
+        if (entry.ready()) resume.push_back(entry.handle);
+        else stillWaiting.push_back(std::move(entry));
+    }
+    if (!stillWaiting.empty()) {
+        std::lock_guard<std::mutex> lock(mainMutex);
+        waiting.insert(waiting.begin(), std::make_move_iterator(stillWaiting.begin()), std::make_move_iterator(stillWaiting.end()));
+    }
+
+    for (auto handle : resume) handle.resume();
+}
+
+void TaskScheduler::spawn(Task<void> task) {
+    spawned.fetch_add(1, std::memory_order_relaxed);
+
+    auto drive = [] (TaskScheduler* scheduler, Task<void> task) -> detail::DetachedTask {
+        try {
+            co_await task;
+        } catch (...) {
+            if (scheduler->onError) scheduler->onError(std::current_exception());
+        }
+        scheduler->spawned.fetch_sub(1, std::memory_order_release);
+    };
+    drive(this, std::move(task));
+}
+
+Task<std::optional<std::vector<uint8_t>>> TaskScheduler::readFile(std::string path) {
+    co_await io();
+
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) co_return std::nullopt;
+
+    std::vector<uint8_t> data((size_t) file.tellg());
+    file.seekg(0);
+    file.read((char*) data.data(), (std::streamsize) data.size());
+    if (!file) co_return std::nullopt;
+    co_return std::move(data);
+}
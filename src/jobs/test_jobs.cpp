@@ -0,0 +1,189 @@
+// Headless stress checks of the job system and its work stealing deques, run by ctest
+#include "inc/RoseJobs.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    if (!(condition)) { \
+        std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    }
+
+// Every index is visited exactly once, for batch sizes that do and do not divide the count
+static void testParallelFor() {
+    const uint32_t count = 1000003;
+    std::vector<std::atomic<uint8_t>> visits(count);
+
+    for (uint32_t batchSize : {1u, 7u, 1024u, 65536u, 2000000u}) {
+        for (auto& visit : visits) visit.store(0, std::memory_order_relaxed);
+        std::atomic<uint64_t> sum{0};
+
+        getJobs().parallelFor(count, batchSize, [&] (uint32_t begin, uint32_t end) {
+            uint64_t batchSum = 0;
+            for (uint32_t i = begin; i < end; i++) {
+                visits[i].fetch_add(1, std::memory_order_relaxed);
+                batchSum += i;
+            }
+            sum.fetch_add(batchSum, std::memory_order_relaxed);
+        });
+
+        CHECK(sum.load() == (uint64_t) count * (count - 1) / 2);
+        bool once = true;
+        for (auto& visit : visits) once &= visit.load(std::memory_order_relaxed) == 1;
+        CHECK(once);
+    }
+
+    // Nothing to do returns right away
+    bool called = false;
+    getJobs().parallelFor(0, 16, [&] (uint32_t, uint32_t) { called = true; });
+    CHECK(!called);
+}
+
+// Jobs that submit jobs and wait for them, waiting threads run other jobs meanwhile
+static void testNestedWait() {
+    const uint32_t outerJobs = 64;
+    const uint32_t innerJobs = 64;
+    std::atomic<uint32_t> innerRuns{0};
+    std::atomic<uint32_t> outerDone{0};
+
+    JobCounter outer;
+    for (uint32_t i = 0; i < outerJobs; i++) {
+        getJobs().run([&] () {
+            JobCounter inner;
+            for (uint32_t j = 0; j < innerJobs; j++) {
+                getJobs().run([&] () { innerRuns.fetch_add(1, std::memory_order_relaxed); }, &inner);
+            }
+            getJobs().wait(inner);
+            outerDone.fetch_add(1, std::memory_order_relaxed);
+        }, &outer);
+    }
+    getJobs().wait(outer);
+
+    CHECK(innerRuns.load() == outerJobs * innerJobs);
+    CHECK(outerDone.load() == outerJobs);
+
+    // A parallelFor inside jobs as well
+    std::atomic<uint64_t> sum{0};
+    JobCounter loops;
+    for (uint32_t i = 0; i < 16; i++) {
+        getJobs().run([&] () {
+            getJobs().parallelFor(4096, 64, [&] (uint32_t begin, uint32_t end) {
+                sum.fetch_add(end - begin, std::memory_order_relaxed);
+            });
+        }, &loops);
+    }
+    getJobs().wait(loops);
+    CHECK(sum.load() == 16 * 4096);
+}
+
+// Jobs released by a counter only start once every job it counts finished
+static void testDependencies() {
+    for (uint32_t round = 0; round < 100; round++) {
+        const uint32_t firstJobs = 32;
+        const uint32_t secondJobs = 32;
+        std::atomic<uint32_t> firstDone{0};
+        std::atomic<uint32_t> early{0};
+        std::atomic<uint32_t> secondDone{0};
+        std::atomic<uint32_t> thirdEarly{0};
+
+        JobCounter first, second, third;
+        for (uint32_t i = 0; i < firstJobs; i++) {
+            getJobs().run([&] () {
+                std::this_thread::yield();
+                firstDone.fetch_add(1, std::memory_order_acq_rel);
+            }, &first);
+        }
+        for (uint32_t i = 0; i < secondJobs; i++) {
+            getJobs().run([&] () {
+                if (firstDone.load(std::memory_order_acquire) != firstJobs) early.fetch_add(1);
+                secondDone.fetch_add(1, std::memory_order_acq_rel);
+            }, &second, &first);
+        }
+        // A chain, the third stage depends on the second
+        getJobs().run([&] () {
+            if (secondDone.load(std::memory_order_acquire) != secondJobs) thirdEarly.fetch_add(1);
+        }, &third, &second);
+
+        getJobs().wait(third);
+        getJobs().wait(second);
+        getJobs().wait(first);
+        CHECK(early.load() == 0);
+        CHECK(thirdEarly.load() == 0);
+        CHECK(secondDone.load() == secondJobs);
+
+        // A counter that is already done releases its dependents right away
+        JobCounter fourth;
+        std::atomic<bool> ran{false};
+        getJobs().run([&] () { ran = true; }, &fourth, &first);
+        getJobs().wait(fourth);
+        CHECK(ran.load());
+    }
+}
+
+// More jobs than a deque holds, submitted from the main thread and from workers
+static void testFlood() {
+    const uint32_t jobs = 100000;
+    std::atomic<uint32_t> runs{0};
+
+    JobCounter counter;
+    for (uint32_t i = 0; i < jobs; i++) {
+        getJobs().run([&] () { runs.fetch_add(1, std::memory_order_relaxed); }, &counter);
+    }
+    getJobs().wait(counter);
+    CHECK(runs.load() == jobs);
+
+    // Threads that are not workers go through the shared queue
+    runs = 0;
+    JobCounter outside;
+    std::thread thread([&] () {
+        for (uint32_t i = 0; i < 1000; i++) {
+            getJobs().run([&] () { runs.fetch_add(1, std::memory_order_relaxed); }, &outside);
+        }
+    });
+    thread.join();
+    getJobs().wait(outside);
+    CHECK(runs.load() == 1000);
+
+    // Main thread jobs run on the thread that called initJobs
+    std::thread::id mainId = std::this_thread::get_id();
+    std::atomic<uint32_t> onMain{0};
+    JobCounter main;
+    for (uint32_t i = 0; i < 100; i++) {
+        getJobs().run([&] () {
+            getJobs().runOnMainThread([&] () {
+                if (std::this_thread::get_id() == mainId) onMain.fetch_add(1);
+            }, &main);
+        }, &main);
+    }
+    getJobs().wait(main);
+    CHECK(onMain.load() == 100);
+}
+
+int main() {
+    // Several workers even on machines with few cores, stealing is what is under test
+    JobConfig config;
+    config.workerThreads = std::max(4u, std::thread::hardware_concurrency()) - 1;
+    initJobs(config);
+
+    CHECK(getJobs().threadCount() == config.workerThreads + 1);
+    testParallelFor();
+    testNestedWait();
+    testDependencies();
+    testFlood();
+
+    shutdownJobs();
+
+    if (failures) {
+        std::printf("%d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
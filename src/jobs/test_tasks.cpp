@@ -0,0 +1,128 @@
+// Headless checks of the task scheduler, run by ctest
+#include "inc/RoseTasks.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    if (!(condition)) { \
+        std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    }
+
+// Records where each hop continued
+static Task<int> hop(TaskScheduler& tasks, std::thread::id mainId, std::thread::id& ioId, int& hops) {
+    co_await tasks.io();
+    ioId = std::this_thread::get_id();
+    if (ioId != mainId) hops++;
+
+    co_await tasks.mainThread();
+    if (std::this_thread::get_id() == mainId) hops++;
+
+    co_await tasks.background();
+    co_await tasks.mainThread();
+    if (std::this_thread::get_id() == mainId) hops++;
+    co_return hops;
+}
+
+static void testHops(TaskScheduler& tasks) {
+    std::thread::id ioId;
+    int hops = 0;
+    CHECK(tasks.wait(hop(tasks, std::this_thread::get_id(), ioId, hops)) == 3);
+    CHECK(ioId != std::this_thread::get_id());
+}
+
+static Task<void> waitForFrame(TaskScheduler& tasks, const uint32_t& frame, uint32_t target, uint32_t& resumedOn) {
+    co_await tasks.until([&frame, target] () { return frame >= target; });
+    resumedOn = frame;
+}
+
+static void testUntil(TaskScheduler& tasks) {
+    uint32_t frame = 0;
+    uint32_t resumedOn = UINT32_MAX;
+    tasks.spawn(waitForFrame(tasks, frame, 3, resumedOn));
+
+    // One update per frame, as the engine's loop does
+    for (; frame < 6 && tasks.running() > 0; frame++) {
+        tasks.update();
+        if (frame < 3) CHECK(resumedOn == UINT32_MAX);
+    }
+    CHECK(resumedOn == 3);
+    CHECK(tasks.running() == 0);
+}
+
+static Task<void> failOnIo(TaskScheduler& tasks) {
+    co_await tasks.io();
+    throw std::runtime_error("failed on io!");
+}
+
+static void testSpawnError(TaskScheduler& tasks) {
+    std::string message;
+    tasks.onError = [&message] (std::exception_ptr exception) {
+        try {
+            std::rethrow_exception(exception);
+        } catch (const std::exception& e) {
+            message = e.what();
+        }
+    };
+
+    tasks.spawn(failOnIo(tasks));
+    while (tasks.running() > 0) {
+        tasks.update();
+        std::this_thread::yield();
+    }
+    CHECK(message == "failed on io!");
+    tasks.onError = nullptr;
+}
+
+static Task<int> failInBackground(TaskScheduler& tasks) {
+    co_await tasks.background();
+    throw std::runtime_error("failed in background!");
+    co_return 0;
+}
+
+static Task<void> awaitFailure(TaskScheduler& tasks) {
+    co_await tasks.mainThread();
+    co_await failInBackground(tasks);
+}
+
+static void testWaitRethrows(TaskScheduler& tasks) {
+    bool thrown = false;
+    try {
+        tasks.wait(failInBackground(tasks));
+    } catch (const std::runtime_error& e) {
+        thrown = std::string(e.what()) == "failed in background!";
+    }
+    CHECK(thrown);
+
+    // Through an awaiting task as well
+    thrown = false;
+    try {
+        tasks.wait(awaitFailure(tasks));
+    } catch (const std::runtime_error& e) {
+        thrown = std::string(e.what()) == "failed in background!";
+    }
+    CHECK(thrown);
+}
+
+int main() {
+    initJobs();
+    {
+        TaskScheduler tasks;
+        testHops(tasks);
+        testUntil(tasks);
+        testSpawnError(tasks);
+        testWaitRethrows(tasks);
+    }
+    shutdownJobs();
+
+    if (failures) {
+        std::printf("%d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Batch kernels for the math the engine repeats over every object each frame. Each has a scalar, an SSE4.1 and
+// an AVX2 version, the best one the CPU supports is picked on first use.
+//
+// Matrices are 16 floats in column major order and quaternions x, y, z, w, the memory layouts of glm::mat4 and
+// glm::quat, so arrays of glm types can be passed as they are. Affine transforms are the top three rows of such a
+// matrix, 12 floats in row major order, the bottom row is always 0 0 0 1. Outputs must not overlap the inputs.
+
+enum class SimdLevel {
+    Scalar,
+    Sse4,
+    Avx2
+};
+
+SimdLevel getSimdLevel();
+// Highest level the CPU and OS support
+SimdLevel detectSimdLevel();
+// Levels above detectSimdLevel() fall back to it, meant for benchmarks and comparing results
+void setSimdLevel(SimdLevel level);
+const char* simdLevelName(SimdLevel level);
+
+// out[i] = a[i] * b[i]
+void mulMatrices(const float* a, const float* b, float* out, size_t count);
+
+// Affine matrices from translations (3 floats), rotations (unit quaternions) and scales (3 floats)
+void composeTransforms(const float* positions, const float* rotations, const float* scales, float* out, size_t count);
+
+// out[i] = parents[i] * the affine transform composed like composeTransforms, all of them affine transforms.
+// Without parents (nullptr) the composed transforms themselves.
+void composeAffineTransforms(const float* parents, const float* positions, const float* rotations, const float* scales, float* out, size_t count);
+
+// Axis aligned boxes of 6 floats, min then max, transformed into the boxes enclosing them.
+// matrixStride is the distance between matrices in floats, larger than 16 for matrices inside structs.
+void transformAabbs(const float* matrices, size_t matrixStride, const float* boxes, float* out, size_t count);
+
+// Spheres are center and radius, the radius grows with the largest scale of the matrix
+void transformSpheres(const float* matrices, size_t matrixStride, const float* spheres, float* out, size_t count);
+
+// inside[i] is 1 if the sphere is not entirely behind any of the planes, 0 otherwise.
+// Planes are xyz normal and w distance, normals point inwards and have unit length.
+void spheresInPlanes(const float* spheres, size_t count, const float* planes, uint32_t planeCount, uint8_t* inside);
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// One implementation of every kernel in RoseMath.hpp
+struct MathKernels {
+    void (*mulMatrices)(const float* a, const float* b, float* out, size_t count);
+    void (*composeTransforms)(const float* positions, const float* rotations, const float* scales, float* out, size_t count);
+    void (*composeAffineTransforms)(const float* parents, const float* positions, const float* rotations, const float* scales, float* out, size_t count);
+    void (*transformAabbs)(const float* matrices, size_t matrixStride, const float* boxes, float* out, size_t count);
+    void (*transformSpheres)(const float* matrices, size_t matrixStride, const float* spheres, float* out, size_t count);
+    void (*spheresInPlanes)(const float* spheres, size_t count, const float* planes, uint32_t planeCount, uint8_t* inside);
+};
+
+extern const MathKernels scalarKernels;
+// Compiled with the instruction set enabled and only on x86, only called once the CPU reported it
+extern const MathKernels sse4Kernels;
+extern const MathKernels avx2Kernels;
+
+// The SIMD versions finish the elements that do not fill a register with these
+namespace scalar {
+void mulMatrices(const float* a, const float* b, float* out, size_t count);
+void composeTransforms(const float* positions, const float* rotations, const float* scales, float* out, size_t count);
+void composeAffineTransforms(const float* parents, const float* positions, const float* rotations, const float* scales, float* out, size_t count);
+void transformAabbs(const float* matrices, size_t matrixStride, const float* boxes, float* out, size_t count);
+void transformSpheres(const float* matrices, size_t matrixStride, const float* spheres, float* out, size_t count);
+void spheresInPlanes(const float* spheres, size_t count, const float* planes, uint32_t planeCount, uint8_t* inside);
+}
@@ -0,0 +1,116 @@
+#include "inc/RoseMath.hpp"
+#include "kernels.hpp"
+
+#include <atomic>
+
+#if defined(ROSE_MATH_X86) && defined(_MSC_VER)
+    #include <intrin.h>
+    #include <immintrin.h>
+#endif
+
+static bool cpuSupports(SimdLevel level) {
+#if !defined(ROSE_MATH_X86)
+    return level == SimdLevel::Scalar;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool sse4 = (info[2] & (1 << 19)) != 0;
+    bool fma = (info[2] & (1 << 12)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    // The OS has to save the upper halves of the YMM registers as well
+    bool ymmState = osxsave && (_xgetbv(0) & 6) == 6;
+
+    __cpuid(info, 0);
+    bool avx2 = false;
+    if (info[0] >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+
+    switch (level) {
+    case SimdLevel::Scalar: return true;
+    case SimdLevel::Sse4: return sse4;
+    case SimdLevel::Avx2: return sse4 && avx2 && fma && ymmState;
+    }
+    return false;
+#else
+    __builtin_cpu_init();
+    switch (level) {
+    case SimdLevel::Scalar: return true;
+    case SimdLevel::Sse4: return __builtin_cpu_supports("sse4.1");
+    case SimdLevel::Avx2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+    return false;
+#endif
+}
+
+static const MathKernels* kernelsFor(SimdLevel level) {
+#ifdef ROSE_MATH_X86
+    if (level == SimdLevel::Avx2) return &avx2Kernels;
+    if (level == SimdLevel::Sse4) return &sse4Kernels;
+#endif
+    return &scalarKernels;
+}
+
+SimdLevel detectSimdLevel() {
+    static const SimdLevel detected = cpuSupports(SimdLevel::Avx2) ? SimdLevel::Avx2 : cpuSupports(SimdLevel::Sse4) ? SimdLevel::Sse4 : SimdLevel::Scalar;
+    return detected;
+}
+
+static std::atomic<SimdLevel> level{SimdLevel::Scalar};
+static std::atomic<const MathKernels*> active{nullptr};
+
+static const MathKernels& kernels() {
+    const MathKernels* current = active.load(std::memory_order_acquire);
+    if (current == nullptr) {
+        level.store(detectSimdLevel(), std::memory_order_relaxed);
+        current = kernelsFor(detectSimdLevel());
+        active.store(current, std::memory_order_release);
+    }
+    return *current;
+}
+
+SimdLevel getSimdLevel() {
+    kernels();
+    return level.load(std::memory_order_relaxed);
+}
+
+void setSimdLevel(SimdLevel wanted) {
+    SimdLevel supported = detectSimdLevel();
+    SimdLevel chosen = (int) wanted > (int) supported ? supported : wanted;
+    level.store(chosen, std::memory_order_relaxed);
+    active.store(kernelsFor(chosen), std::memory_order_release);
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::Scalar: return "Scalar";
+    case SimdLevel::Sse4: return "SSE4.1";
+    case SimdLevel::Avx2: return "AVX2";
+    }
+    return "Unknown";
+}
+
+void mulMatrices(const float* a, const float* b, float* out, size_t count) {
+    kernels().mulMatrices(a, b, out, count);
+}
+
+void composeTransforms(const float* positions, const float* rotations, const float* scales, float* out, size_t count) {
+    kernels().composeTransforms(positions, rotations, scales, out, count);
+}
+
+void composeAffineTransforms(const float* parents, const float* positions, const float* rotations, const float* scales, float* out, size_t count) {
+    kernels().composeAffineTransforms(parents, positions, rotations, scales, out, count);
+}
+
+void transformAabbs(const float* matrices, size_t matrixStride, const float* boxes, float* out, size_t count) {
+    kernels().transformAabbs(matrices, matrixStride, boxes, out, count);
+}
+
+void transformSpheres(const float* matrices, size_t matrixStride, const float* spheres, float* out, size_t count) {
+    kernels().transformSpheres(matrices, matrixStride, spheres, out, count);
+}
+
+void spheresInPlanes(const float* spheres, size_t count, const float* planes, uint32_t planeCount, uint8_t* inside) {
+    kernels().spheresInPlanes(spheres, count, planes, planeCount, inside);
+}
@@ -0,0 +1,238 @@
+#include "kernels.hpp"
+
+#include <immintrin.h>
+#include <cstring>
+
+// Two matrices, boxes or spheres per register, one in each 128 bit half, and eight spheres at once for the plane
+// tests. The in-lane shuffles are the SSE4 ones applied to both halves.
+
+#define SPLAT(v, i) _mm256_permute_ps(v, _MM_SHUFFLE(i, i, i, i))
+#define PERMUTE(v, a, b, c, d) _mm256_permute_ps(v, _MM_SHUFFLE(d, c, b, a))
+
+static inline __m256 load2(const float* low, const float* high) {
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(low)), _mm_loadu_ps(high), 1);
+}
+
+static inline void store2(float* low, float* high, __m256 v) {
+    _mm_storeu_ps(low, _mm256_castps256_ps128(v));
+    _mm_storeu_ps(high, _mm256_extractf128_ps(v, 1));
+}
+
+static inline __m256 load2x3(const float* low, const float* high) {
+    return _mm256_setr_ps(low[0], low[1], low[2], 0.f, high[0], high[1], high[2], 0.f);
+}
+
+static inline void store2x3(float* low, float* high, __m256 v) {
+    float lanes[8];
+    _mm256_storeu_ps(lanes, v);
+    memcpy(low, lanes, 3 * sizeof(float));
+    memcpy(high, lanes + 4, 3 * sizeof(float));
+}
+
+static void mulMatrices(const float* a, const float* b, float* out, size_t count) {
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2, a += 32, b += 32, out += 32) {
+        __m256 a0 = load2(a, a + 16);
+        __m256 a1 = load2(a + 4, a + 20);
+        __m256 a2 = load2(a + 8, a + 24);
+        __m256 a3 = load2(a + 12, a + 28);
+        for (int c = 0; c < 4; c++) {
+            __m256 column = load2(b + c * 4, b + 16 + c * 4);
+            __m256 result = _mm256_mul_ps(a0, SPLAT(column, 0));
+            result = _mm256_fmadd_ps(a1, SPLAT(column, 1), result);
+            result = _mm256_fmadd_ps(a2, SPLAT(column, 2), result);
+            result = _mm256_fmadd_ps(a3, SPLAT(column, 3), result);
+            store2(out + c * 4, out + 16 + c * 4, result);
+        }
+    }
+    scalar::mulMatrices(a, b, out, count - i);
+}
+
+static void composeTransforms(const float* positions, const float* rotations, const float* scales, float* out, size_t count) {
+    const __m256 two = _mm256_set1_ps(2.f);
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 e0 = _mm256_setr_ps(1.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f);
+    const __m256 e1 = _mm256_setr_ps(0.f, 1.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f);
+    const __m256 e2 = _mm256_setr_ps(0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 1.f, 0.f);
+    const __m256 signs0a = _mm256_setr_ps(-1.f, 1.f, 1.f, 0.f, -1.f, 1.f, 1.f, 0.f);
+    const __m256 signs0b = _mm256_setr_ps(-1.f, 1.f, -1.f, 0.f, -1.f, 1.f, -1.f, 0.f);
+    const __m256 signs1a = _mm256_setr_ps(1.f, -1.f, 1.f, 0.f, 1.f, -1.f, 1.f, 0.f);
+    const __m256 signs1b = _mm256_setr_ps(-1.f, -1.f, 1.f, 0.f, -1.f, -1.f, 1.f, 0.f);
+    const __m256 signs2a = _mm256_setr_ps(1.f, 1.f, -1.f, 0.f, 1.f, 1.f, -1.f, 0.f);
+    const __m256 signs2b = _mm256_setr_ps(1.f, -1.f, -1.f, 0.f, 1.f, -1.f, -1.f, 0.f);
+
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2, positions += 6, rotations += 8, scales += 6, out += 32) {
+        __m256 q = _mm256_loadu_ps(rotations);
+        __m256 s = load2x3(scales, scales + 3);
+
+        __m256 c0 = _mm256_fmadd_ps(_mm256_mul_ps(PERMUTE(q, 1, 0, 0, 0), signs0a), PERMUTE(q, 1, 1, 2, 0),
+                                    _mm256_mul_ps(_mm256_mul_ps(PERMUTE(q, 2, 3, 3, 0), signs0b), PERMUTE(q, 2, 2, 1, 0)));
+        __m256 c1 = _mm256_fmadd_ps(_mm256_mul_ps(PERMUTE(q, 0, 0, 1, 0), signs1a), PERMUTE(q, 1, 0, 2, 0),
+                                    _mm256_mul_ps(_mm256_mul_ps(PERMUTE(q, 3, 2, 3, 0), signs1b), PERMUTE(q, 2, 2, 0, 0)));
+        __m256 c2 = _mm256_fmadd_ps(_mm256_mul_ps(PERMUTE(q, 0, 1, 0, 0), signs2a), PERMUTE(q, 2, 2, 0, 0),
+                                    _mm256_mul_ps(_mm256_mul_ps(PERMUTE(q, 3, 3, 1, 0), signs2b), PERMUTE(q, 1, 0, 1, 0)));
+
+        store2(out, out + 16, _mm256_mul_ps(_mm256_fmadd_ps(two, c0, e0), SPLAT(s, 0)));
+        store2(out + 4, out + 20, _mm256_mul_ps(_mm256_fmadd_ps(two, c1, e1), SPLAT(s, 1)));
+        store2(out + 8, out + 24, _mm256_mul_ps(_mm256_fmadd_ps(two, c2, e2), SPLAT(s, 2)));
+        store2(out + 12, out + 28, _mm256_blend_ps(load2x3(positions, positions + 3), one, 0x88));
+    }
+    scalar::composeTransforms(positions, rotations, scales, out, count - i);
+}
+
+static void composeAffineTransforms(const float* parents, const float* positions, const float* rotations, const float* scales, float* out, size_t count) {
+    const __m256 two = _mm256_set1_ps(2.f);
+    const __m256 e0 = _mm256_setr_ps(1.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f);
+    const __m256 e1 = _mm256_setr_ps(0.f, 1.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f);
+    const __m256 e2 = _mm256_setr_ps(0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 1.f, 0.f);
+    const __m256 signs0a = _mm256_setr_ps(-1.f, 1.f, 1.f, 0.f, -1.f, 1.f, 1.f, 0.f);
+    const __m256 signs0b = _mm256_setr_ps(-1.f, 1.f, -1.f, 0.f, -1.f, 1.f, -1.f, 0.f);
+    const __m256 signs1a = _mm256_setr_ps(1.f, -1.f, 1.f, 0.f, 1.f, -1.f, 1.f, 0.f);
+    const __m256 signs1b = _mm256_setr_ps(-1.f, -1.f, 1.f, 0.f, -1.f, -1.f, 1.f, 0.f);
+    const __m256 signs2a = _mm256_setr_ps(1.f, 1.f, -1.f, 0.f, 1.f, 1.f, -1.f, 0.f);
+    const __m256 signs2b = _mm256_setr_ps(1.f, -1.f, -1.f, 0.f, 1.f, -1.f, -1.f, 0.f);
+
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2, positions += 6, rotations += 8, scales += 6, out += 24) {
+        __m256 q = _mm256_loadu_ps(rotations);
+        __m256 s = load2x3(scales, scales + 3);
+
+        __m256 c0 = _mm256_fmadd_ps(_mm256_mul_ps(PERMUTE(q, 1, 0, 0, 0), signs0a), PERMUTE(q, 1, 1, 2, 0),
+                                    _mm256_mul_ps(_mm256_mul_ps(PERMUTE(q, 2, 3, 3, 0), signs0b), PERMUTE(q, 2, 2, 1, 0)));
+        __m256 c1 = _mm256_fmadd_ps(_mm256_mul_ps(PERMUTE(q, 0, 0, 1, 0), signs1a), PERMUTE(q, 1, 0, 2, 0),
+                                    _mm256_mul_ps(_mm256_mul_ps(PERMUTE(q, 3, 2, 3, 0), signs1b), PERMUTE(q, 2, 2, 0, 0)));
+        __m256 c2 = _mm256_fmadd_ps(_mm256_mul_ps(PERMUTE(q, 0, 1, 0, 0), signs2a), PERMUTE(q, 2, 2, 0, 0),
+                                    _mm256_mul_ps(_mm256_mul_ps(PERMUTE(q, 3, 3, 1, 0), signs2b), PERMUTE(q, 1, 0, 1, 0)));
+
+        // Columns transposed into rows within each half
+        __m256 col0 = _mm256_mul_ps(_mm256_fmadd_ps(two, c0, e0), SPLAT(s, 0));
+        __m256 col1 = _mm256_mul_ps(_mm256_fmadd_ps(two, c1, e1), SPLAT(s, 1));
+        __m256 col2 = _mm256_mul_ps(_mm256_fmadd_ps(two, c2, e2), SPLAT(s, 2));
+        __m256 col3 = load2x3(positions, positions + 3);
+        __m256 t0 = _mm256_unpacklo_ps(col0, col1);
+        __m256 t1 = _mm256_unpackhi_ps(col0, col1);
+        __m256 t2 = _mm256_unpacklo_ps(col2, col3);
+        __m256 t3 = _mm256_unpackhi_ps(col2, col3);
+        __m256 r0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 r1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 r2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+
+        if (parents == nullptr) {
+            store2(out, out + 12, r0);
+            store2(out + 4, out + 16, r1);
+            store2(out + 8, out + 20, r2);
+            continue;
+        }
+
+        const float* parent = parents + i * 12;
+        for (int r = 0; r < 3; r++) {
+            __m256 row = load2(parent + r * 4, parent + 12 + r * 4);
+            __m256 result = _mm256_blend_ps(_mm256_setzero_ps(), row, 0x88);
+            result = _mm256_fmadd_ps(SPLAT(row, 0), r0, result);
+            result = _mm256_fmadd_ps(SPLAT(row, 1), r1, result);
+            result = _mm256_fmadd_ps(SPLAT(row, 2), r2, result);
+            store2(out + r * 4, out + 12 + r * 4, result);
+        }
+    }
+    scalar::composeAffineTransforms(parents == nullptr ? nullptr : parents + i * 12, positions, rotations, scales, out, count - i);
+}
+
+static void transformAabbs(const float* matrices, size_t matrixStride, const float* boxes, float* out, size_t count) {
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2, matrices += 2 * matrixStride, boxes += 12, out += 12) {
+        const float* next = matrices + matrixStride;
+        __m256 min = load2x3(boxes, boxes + 6);
+        __m256 max = load2x3(boxes + 3, boxes + 9);
+        __m256 center = _mm256_mul_ps(_mm256_add_ps(min, max), half);
+        __m256 extent = _mm256_mul_ps(_mm256_sub_ps(max, min), half);
+
+        __m256 m0 = load2(matrices, next);
+        __m256 m1 = load2(matrices + 4, next + 4);
+        __m256 m2 = load2(matrices + 8, next + 8);
+        __m256 m3 = load2(matrices + 12, next + 12);
+
+        __m256 newCenter = _mm256_fmadd_ps(m0, SPLAT(center, 0), m3);
+        newCenter = _mm256_fmadd_ps(m1, SPLAT(center, 1), newCenter);
+        newCenter = _mm256_fmadd_ps(m2, SPLAT(center, 2), newCenter);
+
+        __m256 newExtent = _mm256_mul_ps(_mm256_and_ps(m0, absMask), SPLAT(extent, 0));
+        newExtent = _mm256_fmadd_ps(_mm256_and_ps(m1, absMask), SPLAT(extent, 1), newExtent);
+        newExtent = _mm256_fmadd_ps(_mm256_and_ps(m2, absMask), SPLAT(extent, 2), newExtent);
+
+        store2x3(out, out + 6, _mm256_sub_ps(newCenter, newExtent));
+        store2x3(out + 3, out + 9, _mm256_add_ps(newCenter, newExtent));
+    }
+    scalar::transformAabbs(matrices, matrixStride, boxes, out, count - i);
+}
+
+static void transformSpheres(const float* matrices, size_t matrixStride, const float* spheres, float* out, size_t count) {
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2, matrices += 2 * matrixStride, spheres += 8, out += 8) {
+        const float* next = matrices + matrixStride;
+        __m256 sphere = _mm256_loadu_ps(spheres);
+        __m256 m0 = load2(matrices, next);
+        __m256 m1 = load2(matrices + 4, next + 4);
+        __m256 m2 = load2(matrices + 8, next + 8);
+        __m256 m3 = load2(matrices + 12, next + 12);
+
+        __m256 center = _mm256_fmadd_ps(m0, SPLAT(sphere, 0), m3);
+        center = _mm256_fmadd_ps(m1, SPLAT(sphere, 1), center);
+        center = _mm256_fmadd_ps(m2, SPLAT(sphere, 2), center);
+
+        // Squared column lengths in the first lane of each half
+        __m256 scale2 = _mm256_max_ps(_mm256_dp_ps(m0, m0, 0x71), _mm256_max_ps(_mm256_dp_ps(m1, m1, 0x71), _mm256_dp_ps(m2, m2, 0x71)));
+        __m256 radius = _mm256_mul_ps(SPLAT(_mm256_sqrt_ps(scale2), 0), SPLAT(sphere, 3));
+
+        _mm256_storeu_ps(out, _mm256_blend_ps(center, radius, 0x88));
+    }
+    scalar::transformSpheres(matrices, matrixStride, spheres, out, count - i);
+}
+
+static void spheresInPlanes(const float* spheres, size_t count, const float* planes, uint32_t planeCount, uint8_t* inside) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        // Spheres 0 to 3 in the low halves and 4 to 7 in the high halves, transposed within each half
+        const float* s = spheres + i * 4;
+        __m256 r0 = load2(s, s + 16);
+        __m256 r1 = load2(s + 4, s + 20);
+        __m256 r2 = load2(s + 8, s + 24);
+        __m256 r3 = load2(s + 12, s + 28);
+        __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+        __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+        __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+        __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+        __m256 x = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 y = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 z = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 negR = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2)));
+
+        __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (uint32_t p = 0; p < planeCount; p++) {
+            const float* plane = planes + p * 4;
+            __m256 distance = _mm256_fmadd_ps(_mm256_set1_ps(plane[0]), x, _mm256_set1_ps(plane[3]));
+            distance = _mm256_fmadd_ps(_mm256_set1_ps(plane[1]), y, distance);
+            distance = _mm256_fmadd_ps(_mm256_set1_ps(plane[2]), z, distance);
+            mask = _mm256_and_ps(mask, _mm256_cmp_ps(distance, negR, _CMP_GE_OQ));
+            if (_mm256_movemask_ps(mask) == 0) break;
+        }
+
+        int bits = _mm256_movemask_ps(mask);
+        for (int k = 0; k < 8; k++) {
+            inside[i + k] = (uint8_t) ((bits >> k) & 1);
+        }
+    }
+    scalar::spheresInPlanes(spheres + i * 4, count - i, planes, planeCount, inside + i);
+}
+
+const MathKernels avx2Kernels = {
+    mulMatrices,
+    composeTransforms,
+    composeAffineTransforms,
+    transformAabbs,
+    transformSpheres,
+    spheresInPlanes,
+};
@@ -0,0 +1,131 @@
+#include "kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace scalar {
+
+void mulMatrices(const float* a, const float* b, float* out, size_t count) {
+    for (size_t i = 0; i < count; i++, a += 16, b += 16, out += 16) {
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 4; r++) {
+                out[c * 4 + r] = a[r] * b[c * 4] + a[4 + r] * b[c * 4 + 1] + a[8 + r] * b[c * 4 + 2] + a[12 + r] * b[c * 4 + 3];
+            }
+        }
+    }
+}
+
+void composeTransforms(const float* positions, const float* rotations, const float* scales, float* out, size_t count) {
+    for (size_t i = 0; i < count; i++, positions += 3, rotations += 4, scales += 3, out += 16) {
+        float x = rotations[0], y = rotations[1], z = rotations[2], w = rotations[3];
+        float xx = x * x, yy = y * y, zz = z * z;
+        float xy = x * y, xz = x * z, yz = y * z;
+        float wx = w * x, wy = w * y, wz = w * z;
+
+        out[0] = (1.f - 2.f * (yy + zz)) * scales[0];
+        out[1] = 2.f * (xy + wz) * scales[0];
+        out[2] = 2.f * (xz - wy) * scales[0];
+        out[3] = 0.f;
+        out[4] = 2.f * (xy - wz) * scales[1];
+        out[5] = (1.f - 2.f * (xx + zz)) * scales[1];
+        out[6] = 2.f * (yz + wx) * scales[1];
+        out[7] = 0.f;
+        out[8] = 2.f * (xz + wy) * scales[2];
+        out[9] = 2.f * (yz - wx) * scales[2];
+        out[10] = (1.f - 2.f * (xx + yy)) * scales[2];
+        out[11] = 0.f;
+        out[12] = positions[0];
+        out[13] = positions[1];
+        out[14] = positions[2];
+        out[15] = 1.f;
+    }
+}
+
+void composeAffineTransforms(const float* parents, const float* positions, const float* rotations, const float* scales, float* out, size_t count) {
+    for (size_t i = 0; i < count; i++, positions += 3, rotations += 4, scales += 3, out += 12) {
+        float x = rotations[0], y = rotations[1], z = rotations[2], w = rotations[3];
+        float xx = x * x, yy = y * y, zz = z * z;
+        float xy = x * y, xz = x * z, yz = y * z;
+        float wx = w * x, wy = w * y, wz = w * z;
+
+        float local[12] = {
+            (1.f - 2.f * (yy + zz)) * scales[0], 2.f * (xy - wz) * scales[1], 2.f * (xz + wy) * scales[2], positions[0],
+            2.f * (xy + wz) * scales[0], (1.f - 2.f * (xx + zz)) * scales[1], 2.f * (yz - wx) * scales[2], positions[1],
+            2.f * (xz - wy) * scales[0], 2.f * (yz + wx) * scales[1], (1.f - 2.f * (xx + yy)) * scales[2], positions[2],
+        };
+        if (parents == nullptr) {
+            std::copy(local, local + 12, out);
+            continue;
+        }
+
+        const float* parent = parents + i * 12;
+        for (int r = 0; r < 3; r++) {
+            const float* row = parent + r * 4;
+            for (int c = 0; c < 4; c++) {
+                out[r * 4 + c] = row[0] * local[c] + row[1] * local[4 + c] + row[2] * local[8 + c] + (c == 3 ? row[3] : 0.f);
+            }
+        }
+    }
+}
+
+// The new center is the transformed center, the new extents the old ones through the absolute linear part
+void transformAabbs(const float* matrices, size_t matrixStride, const float* boxes, float* out, size_t count) {
+    for (size_t i = 0; i < count; i++, matrices += matrixStride, boxes += 6, out += 6) {
+        float center[3], extent[3];
+        for (int k = 0; k < 3; k++) {
+            center[k] = (boxes[k] + boxes[3 + k]) * 0.5f;
+            extent[k] = (boxes[3 + k] - boxes[k]) * 0.5f;
+        }
+
+        for (int r = 0; r < 3; r++) {
+            float c = matrices[12 + r];
+            float e = 0.f;
+            for (int k = 0; k < 3; k++) {
+                c += matrices[k * 4 + r] * center[k];
+                e += std::fabs(matrices[k * 4 + r]) * extent[k];
+            }
+            out[r] = c - e;
+            out[3 + r] = c + e;
+        }
+    }
+}
+
+void transformSpheres(const float* matrices, size_t matrixStride, const float* spheres, float* out, size_t count) {
+    for (size_t i = 0; i < count; i++, matrices += matrixStride, spheres += 4, out += 4) {
+        float scale2 = 0.f;
+        for (int k = 0; k < 3; k++) {
+            const float* column = matrices + k * 4;
+            scale2 = std::max(scale2, column[0] * column[0] + column[1] * column[1] + column[2] * column[2]);
+        }
+
+        for (int r = 0; r < 3; r++) {
+            out[r] = matrices[r] * spheres[0] + matrices[4 + r] * spheres[1] + matrices[8 + r] * spheres[2] + matrices[12 + r];
+        }
+        out[3] = spheres[3] * std::sqrt(scale2);
+    }
+}
+
+void spheresInPlanes(const float* spheres, size_t count, const float* planes, uint32_t planeCount, uint8_t* inside) {
+    for (size_t i = 0; i < count; i++, spheres += 4) {
+        uint8_t result = 1;
+        for (uint32_t p = 0; p < planeCount; p++) {
+            const float* plane = planes + p * 4;
+            if (plane[0] * spheres[0] + plane[1] * spheres[1] + plane[2] * spheres[2] + plane[3] < -spheres[3]) {
+                result = 0;
+                break;
+            }
+        }
+        inside[i] = result;
+    }
+}
+
+} // namespace scalar
+
+const MathKernels scalarKernels = {
+    scalar::mulMatrices,
+    scalar::composeTransforms,
+    scalar::composeAffineTransforms,
+    scalar::transformAabbs,
+    scalar::transformSpheres,
+    scalar::spheresInPlanes,
+};
@@ -0,0 +1,203 @@
+#include "kernels.hpp"
+
+#include <smmintrin.h>
+#include <cstring>
+
+// One matrix, box or sphere per register, four spheres at once for the plane tests
+
+#define SPLAT(v, i) _mm_shuffle_ps(v, v, _MM_SHUFFLE(i, i, i, i))
+#define PERMUTE(v, a, b, c, d) _mm_shuffle_ps(v, v, _MM_SHUFFLE(d, c, b, a))
+
+static inline __m128 load3(const float* p) {
+    return _mm_set_ps(0.f, p[2], p[1], p[0]);
+}
+
+static inline void store3(float* p, __m128 v) {
+    float lanes[4];
+    _mm_storeu_ps(lanes, v);
+    memcpy(p, lanes, 3 * sizeof(float));
+}
+
+static void mulMatrices(const float* a, const float* b, float* out, size_t count) {
+    for (size_t i = 0; i < count; i++, a += 16, b += 16, out += 16) {
+        __m128 a0 = _mm_loadu_ps(a);
+        __m128 a1 = _mm_loadu_ps(a + 4);
+        __m128 a2 = _mm_loadu_ps(a + 8);
+        __m128 a3 = _mm_loadu_ps(a + 12);
+        for (int c = 0; c < 4; c++) {
+            __m128 column = _mm_loadu_ps(b + c * 4);
+            __m128 result = _mm_mul_ps(a0, SPLAT(column, 0));
+            result = _mm_add_ps(result, _mm_mul_ps(a1, SPLAT(column, 1)));
+            result = _mm_add_ps(result, _mm_mul_ps(a2, SPLAT(column, 2)));
+            result = _mm_add_ps(result, _mm_mul_ps(a3, SPLAT(column, 3)));
+            _mm_storeu_ps(out + c * 4, result);
+        }
+    }
+}
+
+// Every column is its unit axis plus two products of permuted quaternion components, see the scalar version
+static void composeTransforms(const float* positions, const float* rotations, const float* scales, float* out, size_t count) {
+    const __m128 two = _mm_set1_ps(2.f);
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 e0 = _mm_setr_ps(1.f, 0.f, 0.f, 0.f);
+    const __m128 e1 = _mm_setr_ps(0.f, 1.f, 0.f, 0.f);
+    const __m128 e2 = _mm_setr_ps(0.f, 0.f, 1.f, 0.f);
+    const __m128 signs0a = _mm_setr_ps(-1.f, 1.f, 1.f, 0.f);
+    const __m128 signs0b = _mm_setr_ps(-1.f, 1.f, -1.f, 0.f);
+    const __m128 signs1a = _mm_setr_ps(1.f, -1.f, 1.f, 0.f);
+    const __m128 signs1b = _mm_setr_ps(-1.f, -1.f, 1.f, 0.f);
+    const __m128 signs2a = _mm_setr_ps(1.f, 1.f, -1.f, 0.f);
+    const __m128 signs2b = _mm_setr_ps(1.f, -1.f, -1.f, 0.f);
+
+    for (size_t i = 0; i < count; i++, positions += 3, rotations += 4, scales += 3, out += 16) {
+        __m128 q = _mm_loadu_ps(rotations);
+        __m128 s = load3(scales);
+
+        __m128 c0 = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(PERMUTE(q, 1, 0, 0, 0), signs0a), PERMUTE(q, 1, 1, 2, 0)),
+                               _mm_mul_ps(_mm_mul_ps(PERMUTE(q, 2, 3, 3, 0), signs0b), PERMUTE(q, 2, 2, 1, 0)));
+        __m128 c1 = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(PERMUTE(q, 0, 0, 1, 0), signs1a), PERMUTE(q, 1, 0, 2, 0)),
+                               _mm_mul_ps(_mm_mul_ps(PERMUTE(q, 3, 2, 3, 0), signs1b), PERMUTE(q, 2, 2, 0, 0)));
+        __m128 c2 = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(PERMUTE(q, 0, 1, 0, 0), signs2a), PERMUTE(q, 2, 2, 0, 0)),
+                               _mm_mul_ps(_mm_mul_ps(PERMUTE(q, 3, 3, 1, 0), signs2b), PERMUTE(q, 1, 0, 1, 0)));
+
+        _mm_storeu_ps(out, _mm_mul_ps(_mm_add_ps(e0, _mm_mul_ps(two, c0)), SPLAT(s, 0)));
+        _mm_storeu_ps(out + 4, _mm_mul_ps(_mm_add_ps(e1, _mm_mul_ps(two, c1)), SPLAT(s, 1)));
+        _mm_storeu_ps(out + 8, _mm_mul_ps(_mm_add_ps(e2, _mm_mul_ps(two, c2)), SPLAT(s, 2)));
+        _mm_storeu_ps(out + 12, _mm_blend_ps(load3(positions), one, 8));
+    }
+}
+
+// The columns of composeTransforms transposed into rows, then every parent row combines the three
+static void composeAffineTransforms(const float* parents, const float* positions, const float* rotations, const float* scales, float* out, size_t count) {
+    const __m128 two = _mm_set1_ps(2.f);
+    const __m128 e0 = _mm_setr_ps(1.f, 0.f, 0.f, 0.f);
+    const __m128 e1 = _mm_setr_ps(0.f, 1.f, 0.f, 0.f);
+    const __m128 e2 = _mm_setr_ps(0.f, 0.f, 1.f, 0.f);
+    const __m128 signs0a = _mm_setr_ps(-1.f, 1.f, 1.f, 0.f);
+    const __m128 signs0b = _mm_setr_ps(-1.f, 1.f, -1.f, 0.f);
+    const __m128 signs1a = _mm_setr_ps(1.f, -1.f, 1.f, 0.f);
+    const __m128 signs1b = _mm_setr_ps(-1.f, -1.f, 1.f, 0.f);
+    const __m128 signs2a = _mm_setr_ps(1.f, 1.f, -1.f, 0.f);
+    const __m128 signs2b = _mm_setr_ps(1.f, -1.f, -1.f, 0.f);
+
+    for (size_t i = 0; i < count; i++, positions += 3, rotations += 4, scales += 3, out += 12) {
+        __m128 q = _mm_loadu_ps(rotations);
+        __m128 s = load3(scales);
+
+        __m128 c0 = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(PERMUTE(q, 1, 0, 0, 0), signs0a), PERMUTE(q, 1, 1, 2, 0)),
+                               _mm_mul_ps(_mm_mul_ps(PERMUTE(q, 2, 3, 3, 0), signs0b), PERMUTE(q, 2, 2, 1, 0)));
+        __m128 c1 = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(PERMUTE(q, 0, 0, 1, 0), signs1a), PERMUTE(q, 1, 0, 2, 0)),
+                               _mm_mul_ps(_mm_mul_ps(PERMUTE(q, 3, 2, 3, 0), signs1b), PERMUTE(q, 2, 2, 0, 0)));
+        __m128 c2 = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(PERMUTE(q, 0, 1, 0, 0), signs2a), PERMUTE(q, 2, 2, 0, 0)),
+                               _mm_mul_ps(_mm_mul_ps(PERMUTE(q, 3, 3, 1, 0), signs2b), PERMUTE(q, 1, 0, 1, 0)));
+
+        __m128 r0 = _mm_mul_ps(_mm_add_ps(e0, _mm_mul_ps(two, c0)), SPLAT(s, 0));
+        __m128 r1 = _mm_mul_ps(_mm_add_ps(e1, _mm_mul_ps(two, c1)), SPLAT(s, 1));
+        __m128 r2 = _mm_mul_ps(_mm_add_ps(e2, _mm_mul_ps(two, c2)), SPLAT(s, 2));
+        __m128 r3 = load3(positions);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+        if (parents == nullptr) {
+            _mm_storeu_ps(out, r0);
+            _mm_storeu_ps(out + 4, r1);
+            _mm_storeu_ps(out + 8, r2);
+            continue;
+        }
+
+        // The local bottom row is 0 0 0 1, only the translation picks up the parent's
+        const float* parent = parents + i * 12;
+        for (int r = 0; r < 3; r++) {
+            __m128 row = _mm_loadu_ps(parent + r * 4);
+            __m128 result = _mm_mul_ps(SPLAT(row, 0), r0);
+            result = _mm_add_ps(result, _mm_mul_ps(SPLAT(row, 1), r1));
+            result = _mm_add_ps(result, _mm_mul_ps(SPLAT(row, 2), r2));
+            result = _mm_add_ps(result, _mm_blend_ps(_mm_setzero_ps(), row, 8));
+            _mm_storeu_ps(out + r * 4, result);
+        }
+    }
+}
+
+static void transformAabbs(const float* matrices, size_t matrixStride, const float* boxes, float* out, size_t count) {
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+    for (size_t i = 0; i < count; i++, matrices += matrixStride, boxes += 6, out += 6) {
+        __m128 min = load3(boxes);
+        __m128 max = load3(boxes + 3);
+        __m128 center = _mm_mul_ps(_mm_add_ps(min, max), half);
+        __m128 extent = _mm_mul_ps(_mm_sub_ps(max, min), half);
+
+        __m128 m0 = _mm_loadu_ps(matrices);
+        __m128 m1 = _mm_loadu_ps(matrices + 4);
+        __m128 m2 = _mm_loadu_ps(matrices + 8);
+        __m128 m3 = _mm_loadu_ps(matrices + 12);
+
+        __m128 newCenter = _mm_add_ps(m3, _mm_mul_ps(m0, SPLAT(center, 0)));
+        newCenter = _mm_add_ps(newCenter, _mm_mul_ps(m1, SPLAT(center, 1)));
+        newCenter = _mm_add_ps(newCenter, _mm_mul_ps(m2, SPLAT(center, 2)));
+
+        __m128 newExtent = _mm_mul_ps(_mm_and_ps(m0, absMask), SPLAT(extent, 0));
+        newExtent = _mm_add_ps(newExtent, _mm_mul_ps(_mm_and_ps(m1, absMask), SPLAT(extent, 1)));
+        newExtent = _mm_add_ps(newExtent, _mm_mul_ps(_mm_and_ps(m2, absMask), SPLAT(extent, 2)));
+
+        store3(out, _mm_sub_ps(newCenter, newExtent));
+        store3(out + 3, _mm_add_ps(newCenter, newExtent));
+    }
+}
+
+static void transformSpheres(const float* matrices, size_t matrixStride, const float* spheres, float* out, size_t count) {
+    for (size_t i = 0; i < count; i++, matrices += matrixStride, spheres += 4, out += 4) {
+        __m128 sphere = _mm_loadu_ps(spheres);
+        __m128 m0 = _mm_loadu_ps(matrices);
+        __m128 m1 = _mm_loadu_ps(matrices + 4);
+        __m128 m2 = _mm_loadu_ps(matrices + 8);
+        __m128 m3 = _mm_loadu_ps(matrices + 12);
+
+        __m128 center = _mm_add_ps(m3, _mm_mul_ps(m0, SPLAT(sphere, 0)));
+        center = _mm_add_ps(center, _mm_mul_ps(m1, SPLAT(sphere, 1)));
+        center = _mm_add_ps(center, _mm_mul_ps(m2, SPLAT(sphere, 2)));
+
+        // Squared column lengths in the first lane
+        __m128 scale2 = _mm_max_ss(_mm_dp_ps(m0, m0, 0x71), _mm_max_ss(_mm_dp_ps(m1, m1, 0x71), _mm_dp_ps(m2, m2, 0x71)));
+        __m128 radius = _mm_mul_ss(_mm_sqrt_ss(scale2), SPLAT(sphere, 3));
+
+        _mm_storeu_ps(out, _mm_blend_ps(center, SPLAT(radius, 0), 8));
+    }
+}
+
+static void spheresInPlanes(const float* spheres, size_t count, const float* planes, uint32_t planeCount, uint8_t* inside) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(spheres + i * 4);
+        __m128 y = _mm_loadu_ps(spheres + i * 4 + 4);
+        __m128 z = _mm_loadu_ps(spheres + i * 4 + 8);
+        __m128 r = _mm_loadu_ps(spheres + i * 4 + 12);
+        _MM_TRANSPOSE4_PS(x, y, z, r);
+        __m128 negR = _mm_sub_ps(_mm_setzero_ps(), r);
+
+        __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (uint32_t p = 0; p < planeCount; p++) {
+            __m128 plane = _mm_loadu_ps(planes + p * 4);
+            __m128 distance = _mm_add_ps(_mm_mul_ps(SPLAT(plane, 0), x), SPLAT(plane, 3));
+            distance = _mm_add_ps(distance, _mm_mul_ps(SPLAT(plane, 1), y));
+            distance = _mm_add_ps(distance, _mm_mul_ps(SPLAT(plane, 2), z));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(distance, negR));
+            if (_mm_movemask_ps(mask) == 0) break;
+        }
+
+        int bits = _mm_movemask_ps(mask);
+        for (int k = 0; k < 4; k++) {
+            inside[i + k] = (uint8_t) ((bits >> k) & 1);
+        }
+    }
+    scalar::spheresInPlanes(spheres + i * 4, count - i, planes, planeCount, inside + i);
+}
+
+const MathKernels sse4Kernels = {
+    mulMatrices,
+    composeTransforms,
+    composeAffineTransforms,
+    transformAabbs,
+    transformSpheres,
+    spheresInPlanes,
+};
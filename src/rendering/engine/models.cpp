@@ -9,9 +9,14 @@
  * 
  */
 #include <RoseLogging.hpp>
+#include <RoseJobs.hpp>
 #include "models.hpp"
 #include <assimp/scene.h>
+#include <assimp/material.h>
 #include <assimp/postprocess.h>
+#include <filesystem>
+#include <cmath>
+#include <glm/gtc/type_ptr.hpp>
 
 
 ModelManager::ModelManager(VmaAllocator alloc, VkDevice device) : allocator(alloc) {
@@ -27,7 +32,8 @@ std::shared_ptr<Model> ModelManager::load(std::string file) {
     aiProcess_Triangulate            |
     aiProcess_JoinIdenticalVertices  |
     aiProcess_SortByPType            |
-    aiProcess_GenNormals             
+    aiProcess_GenNormals             |
+    aiProcess_LimitBoneWeights
     );
 
     // If the import failed, report it
@@ -38,30 +44,224 @@ std::shared_ptr<Model> ModelManager::load(std::string file) {
 
     aiMesh* inMesh = scene->mMeshes[0];
     
+    for (size_t v = 0; v < inMesh->mNumVertices; v++)
+    {
+        aiVector3D& inVtx = inMesh->mVertices[v];
+        aiVector3D& inNorm = inMesh->mNormals[v];
+        Vertex vtx;
+        vtx.pos.x = inVtx.x;
+        vtx.pos.y = inVtx.y;
+        vtx.pos.z = inVtx.z;
+
+        vtx.normal.x = inNorm.x;
+        vtx.normal.y = inNorm.y;
+        vtx.normal.z = inNorm.z;
+
+        vtx.color = vtx.normal;
+
+        if (inMesh->HasTextureCoords(0)) {
+            aiVector3D& inUV = inMesh->mTextureCoords[0][v];
+            vtx.uv.x = inUV.x;
+            vtx.uv.y = 1.0f - inUV.y; // Assimp's origin is the bottom left
+        } else {
+            vtx.uv = glm::vec2(0.f);
+        }
+        model->mesh.vertices.push_back(vtx);
+    }
+
+    // Vertices shared between faces were joined on import, the faces index them
     for (size_t f = 0; f < inMesh->mNumFaces; f++)
     {
+        const aiFace& face = inMesh->mFaces[f];
+        if (face.mNumIndices != 3) continue; // Points and lines sorted into the same mesh
         for (size_t v = 0; v < 3; v++)
         {
-            aiVector3D& inVtx = inMesh->mVertices[inMesh->mFaces[f].mIndices[v]];
-            aiVector3D& inNorm = inMesh->mNormals[inMesh->mFaces[f].mIndices[v]];
-            Vertex vtx;
-            vtx.pos.x = inVtx.x;
-            vtx.pos.y = inVtx.y;
-            vtx.pos.z = inVtx.z;
-
-            vtx.normal.x = inNorm.x;
-            vtx.normal.y = inNorm.y;
-            vtx.normal.z = inNorm.z;
-
-            vtx.color = vtx.normal;
-            model->mesh.vertices.push_back(vtx);
+            model->mesh.indices.push_back(face.mIndices[v]);
         }
     }
+
+    if (inMesh->mMaterialIndex < scene->mNumMaterials) {
+        loadMaterial(scene->mMaterials[inMesh->mMaterialIndex], file, *model);
+    }
+
+    if (inMesh->HasBones()) {
+        loadSkeleton(scene, inMesh, *model);
+        loadAnimations(scene, *model);
+    }
     
+    std::lock_guard<std::mutex> lock(modelsMutex);
+    model->path = file;
     models.insert(model);
     return model;
 }
 
+std::vector<std::shared_ptr<Model>> ModelManager::loadAll(const std::vector<std::string>& files) {
+    std::vector<std::shared_ptr<Model>> loaded(files.size());
+    JobCounter counter;
+    for (size_t i = 0; i < files.size(); i++) {
+        getJobs().run([this, &files, &loaded, i] () { loaded[i] = load(files[i]); }, &counter);
+    }
+    getJobs().wait(counter);
+    return loaded;
+}
+
+// Embedded textures ("*0" paths) are not supported, only files next to the model
+void ModelManager::loadMaterial(const aiMaterial* inMaterial, const std::string& file, Model& model) {
+    model.material.name = inMaterial->GetName().C_Str();
+
+    aiColor4D diffuse;
+    if (inMaterial->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse) == AI_SUCCESS) {
+        model.material.baseColor = glm::vec4(diffuse.r, diffuse.g, diffuse.b, diffuse.a);
+    }
+
+    aiColor3D emissive;
+    if (inMaterial->Get(AI_MATKEY_COLOR_EMISSIVE, emissive) == AI_SUCCESS) {
+        model.material.emissive = glm::vec3(emissive.r, emissive.g, emissive.b);
+    }
+
+    aiString path;
+    if (inMaterial->GetTexture(aiTextureType_DIFFUSE, 0, &path) == AI_SUCCESS && path.C_Str()[0] != '*') {
+        model.baseColorTexture = (std::filesystem::path(file).parent_path() / path.C_Str()).string();
+    }
+}
+
+// Assimp's matrices are row major
+static glm::mat4 toGlm(const aiMatrix4x4& m) {
+    return glm::transpose(glm::make_mat4(&m.a1));
+}
+
+static const aiNode* findMeshNode(const aiNode* node, unsigned int meshIndex) {
+    for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+        if (node->mMeshes[i] == meshIndex) return node;
+    }
+    for (unsigned int i = 0; i < node->mNumChildren; i++) {
+        if (const aiNode* found = findMeshNode(node->mChildren[i], meshIndex)) return found;
+    }
+    return nullptr;
+}
+
+// Joints are the bones and every node above them, so animations of the nodes between bones still apply.
+// Assimp names bones after the nodes they move. load() only imports the first mesh of the file.
+void ModelManager::loadSkeleton(const aiScene* scene, const aiMesh* inMesh, Model& model) {
+    Skeleton& skeleton = model.skeleton;
+
+    std::set<const aiNode*> needed;
+    for (unsigned int b = 0; b < inMesh->mNumBones; b++) {
+        for (const aiNode* node = scene->mRootNode->FindNode(inMesh->mBones[b]->mName); node != nullptr; node = node->mParent) {
+            if (!needed.insert(node).second) break;
+        }
+    }
+
+    // Preorder, children are only pushed once their parent is a joint
+    std::vector<std::pair<const aiNode*, int32_t>> stack = {{scene->mRootNode, NO_JOINT}};
+    while (!stack.empty()) {
+        auto [node, parent] = stack.back();
+        stack.pop_back();
+        if (needed.count(node) == 0) continue;
+
+        aiVector3D scaling, position;
+        aiQuaternion rotation;
+        node->mTransformation.Decompose(scaling, rotation, position);
+
+        skeleton.names.push_back(node->mName.C_Str());
+        skeleton.parents.push_back(parent);
+        skeleton.bindPositions.push_back(glm::vec3(position.x, position.y, position.z));
+        skeleton.bindRotations.push_back(glm::normalize(glm::quat(rotation.w, rotation.x, rotation.y, rotation.z)));
+        skeleton.bindScales.push_back(glm::vec3(scaling.x, scaling.y, scaling.z));
+        skeleton.offsets.push_back(glm::mat4(1.f));
+
+        int32_t joint = (int32_t) (skeleton.names.size() - 1);
+        for (unsigned int i = node->mNumChildren; i > 0; i--) {
+            stack.push_back({node->mChildren[i - 1], joint});
+        }
+    }
+
+    glm::mat4 meshGlobal = glm::mat4(1.f);
+    for (const aiNode* node = findMeshNode(scene->mRootNode, 0); node != nullptr; node = node->mParent) {
+        meshGlobal = toGlm(node->mTransformation) * meshGlobal;
+    }
+    skeleton.meshInverse = glm::inverse(meshGlobal);
+
+    // LimitBoneWeights leaves at most four weights per vertex
+    std::vector<VertexSkin>& skin = model.mesh.skin;
+    skin.assign(model.mesh.vertices.size(), VertexSkin());
+    std::vector<uint32_t> used(skin.size(), 0);
+    for (unsigned int b = 0; b < inMesh->mNumBones; b++) {
+        const aiBone* bone = inMesh->mBones[b];
+        int32_t joint = skeleton.find(bone->mName.C_Str());
+        if (joint == NO_JOINT) continue; // No node of that name, its vertices stay in place
+        skeleton.offsets[joint] = toGlm(bone->mOffsetMatrix);
+
+        for (unsigned int w = 0; w < bone->mNumWeights; w++) {
+            const aiVertexWeight& weight = bone->mWeights[w];
+            uint32_t& slot = used[weight.mVertexId];
+            if (slot == 4 || weight.mWeight <= 0.f) continue;
+            skin[weight.mVertexId].joints[slot] = (uint32_t) joint;
+            skin[weight.mVertexId].weights[slot] = weight.mWeight;
+            slot++;
+        }
+    }
+
+    // Box around each joint's vertices, the sphere around the box is good enough for culling
+    uint32_t jointCount = skeleton.size();
+    std::vector<glm::vec3> mins(jointCount, glm::vec3(INFINITY));
+    std::vector<glm::vec3> maxs(jointCount, glm::vec3(-INFINITY));
+    for (size_t v = 0; v < skin.size(); v++) {
+        float sum = skin[v].weights.x + skin[v].weights.y + skin[v].weights.z + skin[v].weights.w;
+        if (sum > 0.f) skin[v].weights /= sum;
+
+        for (uint32_t i = 0; i < used[v]; i++) {
+            uint32_t joint = skin[v].joints[i];
+            mins[joint] = glm::min(mins[joint], model.mesh.vertices[v].pos);
+            maxs[joint] = glm::max(maxs[joint], model.mesh.vertices[v].pos);
+        }
+    }
+
+    skeleton.bounds.assign(jointCount, glm::vec4(0.f, 0.f, 0.f, -1.f));
+    for (uint32_t j = 0; j < jointCount; j++) {
+        if (mins[j].x > maxs[j].x) continue;
+        skeleton.bounds[j] = glm::vec4((mins[j] + maxs[j]) * 0.5f, glm::length(maxs[j] - mins[j]) * 0.5f);
+    }
+}
+
+// Channels of nodes outside the skeleton have nothing to move and are dropped
+void ModelManager::loadAnimations(const aiScene* scene, Model& model) {
+    for (unsigned int a = 0; a < scene->mNumAnimations; a++) {
+        const aiAnimation* inAnimation = scene->mAnimations[a];
+        double ticksPerSecond = inAnimation->mTicksPerSecond > 0.0 ? inAnimation->mTicksPerSecond : 25.0; // Assimp's default for files without a rate
+
+        AnimationClip clip;
+        clip.name = inAnimation->mName.C_Str();
+        clip.duration = (float) (inAnimation->mDuration / ticksPerSecond);
+
+        for (unsigned int c = 0; c < inAnimation->mNumChannels; c++) {
+            const aiNodeAnim* channel = inAnimation->mChannels[c];
+            int32_t joint = model.skeleton.find(channel->mNodeName.C_Str());
+            if (joint == NO_JOINT) continue;
+
+            JointTrack track;
+            track.joint = (uint32_t) joint;
+            for (unsigned int k = 0; k < channel->mNumPositionKeys; k++) {
+                const aiVectorKey& key = channel->mPositionKeys[k];
+                track.positionTimes.push_back((float) (key.mTime / ticksPerSecond));
+                track.positions.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+            }
+            for (unsigned int k = 0; k < channel->mNumRotationKeys; k++) {
+                const aiQuatKey& key = channel->mRotationKeys[k];
+                track.rotationTimes.push_back((float) (key.mTime / ticksPerSecond));
+                track.rotations.push_back(glm::normalize(glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z)));
+            }
+            for (unsigned int k = 0; k < channel->mNumScalingKeys; k++) {
+                const aiVectorKey& key = channel->mScalingKeys[k];
+                track.scaleTimes.push_back((float) (key.mTime / ticksPerSecond));
+                track.scales.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+            }
+            clip.tracks.push_back(std::move(track));
+        }
+        model.animations.push_back(std::move(clip));
+    }
+}
+
 void ModelManager::upload(Model& model) {
 
 }
\ No newline at end of file
@@ -14,29 +14,47 @@
 #include <set>
 #include <fstream>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include <vulkan/vulkan.h>
 #include <vk_mem_alloc.h>
 #include <assimp/Importer.hpp>
 #include <assimp/mesh.h>
+#include <assimp/material.h>
+#include <assimp/scene.h>
 
 #include "vk_mesh.hpp"
+#include "ve_materials.hpp"
+#include "ve_animation.hpp"
 
 struct Model {
     public:
     Mesh mesh;
-    // Texture
-    // Material
+    Material material;             // Its texture is resolved by whoever registers the material
+    std::string baseColorTexture;  // Path of the diffuse texture file, empty without one
+    std::string path;              // Of the file it was loaded from
+
+    // Empty unless the mesh has bones, mesh.skin then refers to these joints
+    Skeleton skeleton;
+    std::vector<AnimationClip> animations;
 };
 
 class ModelManager {
     private:
     VmaAllocator allocator;    
+    void loadMaterial(const aiMaterial* inMaterial, const std::string& file, Model& model);
+    void loadSkeleton(const aiScene* scene, const aiMesh* inMesh, Model& model);
+    void loadAnimations(const aiScene* scene, Model& model);
     public:
     ModelManager(VmaAllocator alloc, VkDevice device);
 
     void upload(Model& model);
+    // Safe to call from several threads at once, each import has its own Assimp importer
     std::shared_ptr<Model> load(std::string file);
+    // Imports the files as parallel jobs, results in the same order with nullptr for failed imports
+    std::vector<std::shared_ptr<Model>> loadAll(const std::vector<std::string>& files);
     std::set<std::shared_ptr<Model>> models;
+    std::mutex modelsMutex; // Guards models while loads run
 };
 
@@ -0,0 +1,496 @@
+#include "ve_capture.hpp"
+#include "vk_output.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+static bool sameObject(const RenderObject& a, const RenderObject& b) {
+    return a.meshIndex == b.meshIndex && a.materialIndex == b.materialIndex && a.transform == b.transform &&
+        a.isStatic == b.isStatic && a.batched == b.batched && a.batchedObjects == b.batchedObjects;
+}
+
+static bool sameAnimation(const SkinnedInstance& a, const SkinnedInstance& b) {
+    return a.clip == b.clip && a.speed == b.speed && a.playing == b.playing;
+}
+
+static bool sameMaterial(const Material& a, const Material& b) {
+    return a.name == b.name && a.baseColor == b.baseColor && a.emissive == b.emissive && a.baseColorTexture == b.baseColorTexture;
+}
+
+SessionRecorder::SessionRecorder(const std::string& path, VulkanEngine& engine, VkExtent2D extent)
+    : engine(engine), file(path, std::ios::binary | std::ios::trunc) {
+    if (!file) {
+        throw std::runtime_error("failed to open capture file " + path + "!");
+    }
+
+    CaptureHeader header;
+    header.width = extent.width;
+    header.height = extent.height;
+    header.meshes = (uint32_t) engine.meshes.size();
+    header.materials = engine.materials->count();
+    header.objects = (uint32_t) engine.renderObjects.size();
+    file.write((const char*) &header, sizeof(header));
+    bytes = sizeof(header);
+
+    // Changes to what the engine starts with are recorded like any other
+    meshCount = header.meshes;
+    for (uint32_t i = 0; i < header.materials; i++) {
+        materials.push_back(engine.materials->get(i));
+    }
+    objects = engine.renderObjects;
+
+    lastFrame = std::chrono::steady_clock::now();
+    engine.vkLogger->info("Recording session to {}", path);
+}
+
+SessionRecorder::~SessionRecorder() {
+    file.close();
+}
+
+template <typename T>
+void SessionRecorder::put(const T& value) {
+    putBytes(&value, sizeof(T));
+}
+
+void SessionRecorder::putBytes(const void* data, size_t size) {
+    const char* source = (const char*) data;
+    payload.insert(payload.end(), source, source + size);
+}
+
+void SessionRecorder::putString(const std::string& value) {
+    put((uint32_t) value.size());
+    putBytes(value.data(), value.size());
+}
+
+void SessionRecorder::writeChunk(CaptureChunk type) {
+    uint32_t chunk[2] = {(uint32_t) type, (uint32_t) payload.size()};
+    file.write((const char*) chunk, sizeof(chunk));
+    file.write(payload.data(), payload.size());
+    if (!file) {
+        throw std::runtime_error("failed to write capture file!");
+    }
+    bytes += sizeof(chunk) + payload.size();
+}
+
+void SessionRecorder::writeIfChanged(CaptureChunk type, std::vector<char>& last) {
+    if (payload == last) return;
+    writeChunk(type);
+    last = payload;
+}
+
+void SessionRecorder::record(const VkGlfwOutput& output) {
+    auto now = std::chrono::steady_clock::now();
+    payload.clear();
+    put(std::chrono::duration<float>(now - lastFrame).count());
+    writeChunk(CaptureChunk::Frame);
+    lastFrame = now;
+
+    // Meshes are never changed once added, static batches arrive as plain meshes. Instances have increasing meshes,
+    // those from before recording started are skipped.
+    const SkinningSystem& skinning = *output.skinning;
+    for (; meshCount < engine.meshes.size(); meshCount++) {
+        while (instanceCount < skinning.instances.size() && skinning.instances[instanceCount].mesh < meshCount) instanceCount++;
+
+        payload.clear();
+        put(meshCount);
+        if (instanceCount < skinning.instances.size() && skinning.instances[instanceCount].mesh == meshCount) {
+            putString(skinning.getModel(instanceCount)->path);
+            put(skinning.instances[instanceCount].sourceMesh);
+            writeChunk(CaptureChunk::Skinned);
+            instanceCount++;
+            continue;
+        }
+
+        const Mesh& mesh = engine.meshes[meshCount];
+        put((uint32_t) mesh.vertices.size());
+        put((uint32_t) mesh.indices.size());
+        put((uint32_t) mesh.skin.size());
+        putBytes(mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+        putBytes(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+        putBytes(mesh.skin.data(), mesh.skin.size() * sizeof(VertexSkin));
+        writeChunk(CaptureChunk::Mesh);
+    }
+
+    const MaterialSystem& materialSystem = *engine.materials;
+    for (uint32_t i = 0; i < materialSystem.count(); i++) {
+        const Material& material = materialSystem.get(i);
+        if (i < materials.size() && sameMaterial(materials[i], material)) continue;
+
+        payload.clear();
+        put(i);
+        putString(material.name);
+        put(material.baseColor);
+        put(material.emissive);
+        putString(materialSystem.texturePath(material.baseColorTexture));
+        writeChunk(CaptureChunk::Material);
+
+        if (i < materials.size()) materials[i] = material;
+        else materials.push_back(material);
+    }
+
+    // The count of changed objects is filled in once known. Objects a scene graph node places are recorded with
+    // their world, replays have no graph.
+    const auto& renderObjects = engine.renderObjects;
+    payload.clear();
+    put((uint32_t) renderObjects.size());
+    put((uint32_t) 0);
+    uint32_t changed = 0;
+    size_t recorded = objects.size();
+    objects.resize(renderObjects.size());
+    for (uint32_t i = 0; i < renderObjects.size(); i++) {
+        RenderObject object = renderObjects[i];
+        if (const AffineTransform* world = engine.scene.getObjectWorld(i)) object.transform = world->toMatrix();
+        if (i < recorded && sameObject(objects[i], object)) continue;
+        objects[i] = object;
+
+        put(i);
+        put(object.meshIndex);
+        put(object.materialIndex);
+        put(object.transform);
+        put((uint8_t) object.isStatic);
+        put((uint8_t) object.batched);
+        put(object.batchedObjects);
+        changed++;
+    }
+    if (changed > 0 || renderObjects.size() != recorded) {
+        memcpy(payload.data() + sizeof(uint32_t), &changed, sizeof(changed));
+        writeChunk(CaptureChunk::Objects);
+    }
+
+    // Times as sampled this frame, the count of changed instances is filled in once known
+    payload.clear();
+    put((uint32_t) 0);
+    uint32_t animated = 0;
+    for (uint32_t i = 0; i < skinning.instances.size(); i++) {
+        const SkinnedInstance& instance = skinning.instances[i];
+        if (i < animations.size() && sameAnimation(animations[i], instance)) continue;
+
+        put(i);
+        put(instance.clip);
+        put(instance.time);
+        put(instance.speed);
+        put((uint8_t) instance.playing);
+        animated++;
+    }
+    if (animated > 0) {
+        memcpy(payload.data(), &animated, sizeof(animated));
+        writeChunk(CaptureChunk::Animation);
+        animations = skinning.instances;
+    }
+
+    payload.clear();
+    put((uint32_t) output.views.size());
+    for (const auto& view : output.views) {
+        putString(view->name);
+        put((uint8_t) view->enabled);
+        put(view->cameraPos);
+        put(view->cameraLook);
+        put(view->fov);
+        put((uint8_t) view->orthographic);
+        put(view->orthoHeight);
+        put(view->nearPlane);
+        put(view->farPlane);
+        put(view->viewport);
+        put(view->clearColor);
+    }
+    writeChunk(CaptureChunk::Views);
+
+    payload.clear();
+    put(output.lighting->ambient);
+    put((uint32_t) output.lighting->lights.size());
+    for (const auto& light : output.lighting->lights) {
+        put(light.type);
+        put(light.position);
+        put(light.color);
+        put(light.intensity);
+        put(light.range);
+        put(light.direction);
+        put(light.innerAngle);
+        put(light.outerAngle);
+    }
+    writeIfChanged(CaptureChunk::Lights, lights);
+
+    // Without the carried over fraction, which changes every frame
+    payload.clear();
+    put((uint32_t) output.particles->emitters.size());
+    for (const auto& emitter : output.particles->emitters) {
+        put((uint8_t) emitter.enabled);
+        put(emitter.position);
+        put(emitter.radius);
+        put(emitter.rate);
+        put(emitter.lifetime);
+        put(emitter.velocity);
+        put(emitter.spread);
+        put(emitter.color);
+    }
+    writeIfChanged(CaptureChunk::Emitters, emitters);
+
+    payload.clear();
+    put((uint8_t) output.depthPrepass);
+    put((uint8_t) output.occlusionCulling);
+    put((uint8_t) output.vertexPulling);
+    put((uint8_t) output.dynamicResolution);
+    writeIfChanged(CaptureChunk::Settings, settings);
+
+    frames++;
+}
+
+SessionPlayer::SessionPlayer(const std::string& path) : file(path, std::ios::binary) {
+    if (!file) {
+        throw std::runtime_error("failed to open capture file " + path + "!");
+    }
+
+    file.read((char*) &header, sizeof(header));
+    if (!file || header.magic != CAPTURE_MAGIC) {
+        throw std::runtime_error("failed to read capture file " + path + ", it is not a session!");
+    }
+    if (header.version != CAPTURE_VERSION) {
+        throw std::runtime_error("failed to read capture file " + path + ", version " + std::to_string(header.version) + " is not supported!");
+    }
+}
+
+void SessionPlayer::begin(VulkanEngine& engine) {
+    if (engine.meshes.size() != header.meshes || engine.materials->count() != header.materials ||
+        engine.renderObjects.size() != header.objects) {
+        throw std::runtime_error("failed to replay capture, it was recorded with a different startup scene!");
+    }
+}
+
+bool SessionPlayer::readChunk(CaptureChunk& type) {
+    uint32_t chunk[2];
+    file.read((char*) chunk, sizeof(chunk));
+    if (file.gcount() == 0 && file.eof()) return false;
+
+    if (file) {
+        payload.resize(chunk[1]);
+        file.read(payload.data(), chunk[1]);
+    }
+    if (!file) {
+        throw std::runtime_error("failed to read capture, the file is truncated!");
+    }
+
+    type = (CaptureChunk) chunk[0];
+    cursor = 0;
+    return true;
+}
+
+void SessionPlayer::rewindChunk() {
+    file.seekg(-(std::streamoff) (sizeof(uint32_t) * 2 + payload.size()), std::ios::cur);
+}
+
+template <typename T>
+T SessionPlayer::get() {
+    T value;
+    getBytes(&value, sizeof(T));
+    return value;
+}
+
+void SessionPlayer::getBytes(void* data, size_t size) {
+    if (cursor + size > payload.size()) {
+        throw std::runtime_error("failed to read capture, a chunk is shorter than its contents!");
+    }
+    memcpy(data, payload.data() + cursor, size);
+    cursor += size;
+}
+
+std::string SessionPlayer::getString() {
+    std::string value(get<uint32_t>(), '\0');
+    getBytes(value.data(), value.size());
+    return value;
+}
+
+bool SessionPlayer::nextFrame(VulkanEngine& engine, VkGlfwOutput& output) {
+    CaptureChunk type;
+    if (!readChunk(type)) return false;
+    if (type != CaptureChunk::Frame) {
+        throw std::runtime_error("failed to read capture, a frame's changes come before the frame!");
+    }
+    frameTime = get<float>();
+
+    while (readChunk(type)) {
+        if (type == CaptureChunk::Frame) {
+            rewindChunk();
+            break;
+        }
+
+        switch (type) {
+            case CaptureChunk::Mesh: applyMesh(engine); break;
+            case CaptureChunk::Material: applyMaterial(engine); break;
+            case CaptureChunk::Objects: applyObjects(engine); break;
+            case CaptureChunk::Views: applyViews(output); break;
+            case CaptureChunk::Lights: applyLights(output); break;
+            case CaptureChunk::Emitters: applyEmitters(output); break;
+            case CaptureChunk::Settings: applySettings(output); break;
+            case CaptureChunk::Skinned: applySkinned(engine, output); break;
+            case CaptureChunk::Animation: applyAnimation(output); break;
+            default: break; // From a newer recorder
+        }
+    }
+
+    // Particles and animations advance as far as they did when recorded, however fast the frame is replayed
+    output.particles->fixedTimeStep = frameTime;
+    output.skinning->fixedTimeStep = frameTime;
+    frames++;
+    return true;
+}
+
+void SessionPlayer::applyMesh(VulkanEngine& engine) {
+    uint32_t index = get<uint32_t>();
+    if (index != engine.meshes.size()) {
+        throw std::runtime_error("failed to replay capture, mesh " + std::to_string(index) + " is out of order!");
+    }
+
+    Mesh mesh;
+    mesh.vertices.resize(get<uint32_t>());
+    mesh.indices.resize(get<uint32_t>());
+    mesh.skin.resize(get<uint32_t>());
+    getBytes(mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+    getBytes(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+    getBytes(mesh.skin.data(), mesh.skin.size() * sizeof(VertexSkin));
+
+    engine.meshes.push_back(std::move(mesh));
+    engine.uploadMesh(engine.meshes.back());
+}
+
+void SessionPlayer::applyMaterial(VulkanEngine& engine) {
+    uint32_t index = get<uint32_t>();
+    Material material;
+    material.name = getString();
+    material.baseColor = get<glm::vec4>();
+    material.emissive = get<glm::vec3>();
+    std::string texture = getString();
+
+    // Relative paths resolve against the working directory, as they did when recorded
+    MaterialSystem& materials = *engine.materials;
+    if (!texture.empty()) material.baseColorTexture = materials.loadTexture(texture);
+
+    if (index < materials.count()) {
+        materials.set(index, material);
+    } else if (index == materials.count()) {
+        materials.add(material);
+    } else {
+        throw std::runtime_error("failed to replay capture, material " + std::to_string(index) + " is out of order!");
+    }
+}
+
+void SessionPlayer::applyObjects(VulkanEngine& engine) {
+    auto& renderObjects = engine.renderObjects;
+    renderObjects.resize(get<uint32_t>());
+
+    uint32_t changed = get<uint32_t>();
+    for (uint32_t i = 0; i < changed; i++) {
+        uint32_t index = get<uint32_t>();
+        if (index >= renderObjects.size()) {
+            throw std::runtime_error("failed to replay capture, object " + std::to_string(index) + " does not exist!");
+        }
+
+        RenderObject& object = renderObjects[index];
+        object.meshIndex = get<uint32_t>();
+        object.materialIndex = get<uint32_t>();
+        object.transform = get<glm::mat4>();
+        object.isStatic = get<uint8_t>() != 0;
+        object.batched = get<uint8_t>() != 0;
+        object.batchedObjects = get<uint32_t>();
+    }
+}
+
+void SessionPlayer::applyViews(VkGlfwOutput& output) {
+    uint32_t count = get<uint32_t>();
+    auto& views = output.views;
+    while (views.size() < count) output.newView();
+    while (views.size() > count) output.destroyView(views.back().get());
+
+    for (auto& view : views) {
+        view->name = getString();
+        view->enabled = get<uint8_t>() != 0;
+        view->cameraPos = get<glm::vec3>();
+        view->cameraLook = get<glm::vec3>();
+        view->fov = get<float>();
+        view->orthographic = get<uint8_t>() != 0;
+        view->orthoHeight = get<float>();
+        view->nearPlane = get<float>();
+        view->farPlane = get<float>();
+        view->viewport = get<glm::vec4>();
+        view->clearColor = get<VkClearValue>();
+    }
+}
+
+void SessionPlayer::applyLights(VkGlfwOutput& output) {
+    ClusteredLighting& lighting = *output.lighting;
+    lighting.ambient = get<glm::vec3>();
+    lighting.lights.resize(get<uint32_t>());
+
+    for (auto& light : lighting.lights) {
+        light.type = get<LightType>();
+        light.position = get<glm::vec3>();
+        light.color = get<glm::vec3>();
+        light.intensity = get<float>();
+        light.range = get<float>();
+        light.direction = get<glm::vec3>();
+        light.innerAngle = get<float>();
+        light.outerAngle = get<float>();
+    }
+}
+
+void SessionPlayer::applyEmitters(VkGlfwOutput& output) {
+    auto& emitters = output.particles->emitters;
+    emitters.resize(get<uint32_t>());
+
+    for (auto& emitter : emitters) {
+        emitter.enabled = get<uint8_t>() != 0;
+        emitter.position = get<glm::vec3>();
+        emitter.radius = get<float>();
+        emitter.rate = get<float>();
+        emitter.lifetime = get<float>();
+        emitter.velocity = get<glm::vec3>();
+        emitter.spread = get<float>();
+        emitter.color = get<glm::vec4>();
+    }
+}
+
+// The output rebuilds its render graph before drawing if any changed
+void SessionPlayer::applySettings(VkGlfwOutput& output) {
+    output.depthPrepass = get<uint8_t>() != 0;
+    output.occlusionCulling = get<uint8_t>() != 0;
+    output.vertexPulling = get<uint8_t>() != 0;
+    output.dynamicResolution = get<uint8_t>() != 0;
+}
+
+// Relative paths resolve against the working directory, as they did when recorded
+void SessionPlayer::applySkinned(VulkanEngine& engine, VkGlfwOutput& output) {
+    uint32_t index = get<uint32_t>();
+    std::string path = getString();
+    uint32_t sourceMesh = get<uint32_t>();
+    if (index != engine.meshes.size() || sourceMesh >= engine.meshes.size()) {
+        throw std::runtime_error("failed to replay capture, skinned mesh " + std::to_string(index) + " is out of order!");
+    }
+
+    auto& model = models[path];
+    if (model == nullptr) model = engine.modelMan->load(path);
+    if (model == nullptr || model->skeleton.size() == 0) {
+        throw std::runtime_error("failed to replay capture, " + path + " has no skinned mesh!");
+    }
+    output.skinning->add(model, sourceMesh);
+}
+
+// The frame advances the times once more before sampling, they are set back by that step
+void SessionPlayer::applyAnimation(VkGlfwOutput& output) {
+    auto& instances = output.skinning->instances;
+    float step = std::min(frameTime, 0.1f);
+
+    uint32_t changed = get<uint32_t>();
+    for (uint32_t i = 0; i < changed; i++) {
+        uint32_t index = get<uint32_t>();
+        if (index >= instances.size()) {
+            throw std::runtime_error("failed to replay capture, skinned instance " + std::to_string(index) + " does not exist!");
+        }
+
+        SkinnedInstance& instance = instances[index];
+        instance.clip = get<uint32_t>();
+        float time = get<float>();
+        instance.speed = get<float>();
+        instance.playing = get<uint8_t>() != 0;
+        instance.time = instance.playing ? time - step * instance.speed : time;
+    }
+}
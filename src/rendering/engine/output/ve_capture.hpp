@@ -0,0 +1,135 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+
+#include "ve_scene.hpp"
+#include "ve_materials.hpp"
+#include "ve_skinning.hpp"
+
+class VulkanEngine;
+class VkGlfwOutput;
+struct Model;
+
+const uint32_t CAPTURE_MAGIC = 0x53455352; // "RSES"
+const uint32_t CAPTURE_VERSION = 2;
+
+// A session file is this header followed by chunks, each a CaptureChunk type, the payload's size in bytes and the
+// payload. Every frame starts with a Frame chunk, the chunks after it up to the next one are that frame's changes.
+// Values are stored in the machine's byte order, unknown chunk types are skipped.
+struct CaptureHeader {
+    uint32_t magic = CAPTURE_MAGIC;
+    uint32_t version = CAPTURE_VERSION;
+    uint32_t width = 0;  // Of the recorded output
+    uint32_t height = 0;
+    // What the engine held when recording started, a replaying engine has to start out the same
+    uint32_t meshes = 0;
+    uint32_t materials = 0;
+    uint32_t objects = 0;
+};
+
+enum class CaptureChunk : uint32_t {
+    Frame = 1, // Seconds since the previous frame
+    Mesh,      // Appended to the engine's meshes, vertices, indices and skin
+    Material,  // Added or replaced, textures by path
+    Objects,   // Render object count and the objects that were added or changed
+    Views,     // Every frame, the camera path
+    Lights,    // Ambient and all lights, when any changed
+    Emitters,  // Particle emitters, when any changed
+    Settings,  // Output options that change the render graph, when any changed
+    Skinned,   // In place of a skinned instance's mesh, the model's path and the source mesh
+    Animation, // Skinned instances that were added or whose clip, speed or playing changed, with their times
+};
+
+// Records the high level stream an output draws: geometry and materials as they are added, render objects as
+// they are added or move, and every frame's views, lights and settings. UI state is not recorded. Unchanged
+// state is not written again, so long sessions stay small. Skinned instances are recorded as such, their models
+// reloaded from the same paths at replay, and animation times only with the other animation state: in between
+// the replay advances them by the recorded frame times.
+class SessionRecorder {
+public:
+    // Only what the engine gets after this is written, it is expected to exist at replay already
+    SessionRecorder(const std::string& path, VulkanEngine& engine, VkExtent2D extent);
+    ~SessionRecorder();
+
+    // Called by the output once per drawn frame, after the scene was updated
+    void record(const VkGlfwOutput& output);
+
+    uint32_t frames = 0;
+    uint64_t bytes = 0; // Written so far
+
+private:
+    VulkanEngine& engine;
+    std::ofstream file;
+    std::vector<char> payload;
+    std::chrono::steady_clock::time_point lastFrame;
+
+    // Last written state, compared against to find changes
+    uint32_t meshCount = 0;
+    std::vector<Material> materials;
+    std::vector<RenderObject> objects;
+    std::vector<char> lights; // Payloads of the last chunks
+    std::vector<char> emitters;
+    std::vector<char> settings;
+    uint32_t instanceCount = 0; // Skinned instances written
+    std::vector<SkinnedInstance> animations;
+
+    void writeChunk(CaptureChunk type);
+    // Writes the payload unless it equals the last one, which it replaces
+    void writeIfChanged(CaptureChunk type, std::vector<char>& last);
+
+    template <typename T>
+    void put(const T& value);
+    void putBytes(const void* data, size_t size);
+    void putString(const std::string& value);
+};
+
+// Reads a recorded session back and applies it to an engine and output, one frame at a time
+class SessionPlayer {
+public:
+    SessionPlayer(const std::string& path);
+
+    const CaptureHeader& getHeader() const { return header; }
+
+    // Throws if the engine does not start out as it did when recording began
+    void begin(VulkanEngine& engine);
+    // Applies the next frame's changes before it is drawn, false once the session is over
+    bool nextFrame(VulkanEngine& engine, VkGlfwOutput& output);
+
+    uint32_t frames = 0;    // Applied so far
+    float frameTime = 0.f;  // Seconds the last applied frame took when recorded
+
+private:
+    std::ifstream file;
+    CaptureHeader header;
+    std::vector<char> payload;
+    size_t cursor = 0;
+    std::map<std::string, std::shared_ptr<const Model>> models; // Of skinned instances, by path
+
+    // Next chunk into payload, false at the end of the file
+    bool readChunk(CaptureChunk& type);
+    // Leaves the file at the chunk, for the next frame to start with
+    void rewindChunk();
+
+    template <typename T>
+    T get();
+    void getBytes(void* data, size_t size);
+    std::string getString();
+
+    void applyMesh(VulkanEngine& engine);
+    void applyMaterial(VulkanEngine& engine);
+    void applyObjects(VulkanEngine& engine);
+    void applyViews(VkGlfwOutput& output);
+    void applyLights(VkGlfwOutput& output);
+    void applyEmitters(VkGlfwOutput& output);
+    void applySettings(VkGlfwOutput& output);
+    void applySkinned(VulkanEngine& engine, VkGlfwOutput& output);
+    void applyAnimation(VkGlfwOutput& output);
+};
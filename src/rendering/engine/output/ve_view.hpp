@@ -1,17 +1,44 @@
 #pragma once
 #include <vector>
+#include <string>
 #include <vulkan/vulkan.h>
 #include <glm/glm.hpp>
-#include "ve_pipeline.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+
+// A camera rendered into a region of an output. Pipelines belong to the output and are shared by all of its views.
 struct View {
 public:
-    glm::vec3 cameraPos;
-    glm::vec3 cameraLook;
-    glm::vec2 fov;
-    VkRenderPass renderPass;
-    PipelineBuilder graphicsPipelineBuilder;
-    VkPipeline graphicsPipeline;
-    VkPipelineLayout graphicsPipelineLayout;
-    std::vector<VkCommandBuffer> commandBuffers;
+    std::string name;
+    bool enabled = true;
+
+    glm::vec3 cameraPos = glm::vec3(0.f, 0.f, -10.f);
+    glm::vec3 cameraLook = glm::vec3(0.f, 0.f, 1.f); // Direction, does not need to be normalized
+    float fov = glm::radians(70.f);                  // Vertical, radians
+
+    bool orthographic = false;
+    float orthoHeight = 10.f; // World units covered vertically by an orthographic view
+    float nearPlane = 0.1f;
+    float farPlane = 200.f;
+
+    glm::vec4 viewport = glm::vec4(0.f, 0.f, 1.f, 1.f); // x, y, width, height as fractions of the output
     VkClearValue clearColor = {{{0.2f, 0.2f, 0.2f, 1.0f}}};
-};
\ No newline at end of file
+
+    glm::mat4 viewMatrix() const {
+        glm::vec3 forward = glm::normalize(cameraLook);
+        glm::vec3 up = glm::abs(forward.y) > 0.999f ? glm::vec3(0.f, 0.f, 1.f) : glm::vec3(0.f, 1.f, 0.f);
+        return glm::lookAt(cameraPos, cameraPos + forward, up);
+    }
+
+    glm::mat4 projectionMatrix(float aspect) const {
+        glm::mat4 projection;
+        if (orthographic) {
+            float halfHeight = orthoHeight * 0.5f;
+            float halfWidth = halfHeight * aspect;
+            projection = glm::orthoRH_ZO(-halfWidth, halfWidth, -halfHeight, halfHeight, nearPlane, farPlane);
+        } else {
+            projection = glm::perspectiveRH_ZO(fov, aspect, nearPlane, farPlane);
+        }
+        projection[1][1] *= -1;
+        return projection;
+    }
+};
@@ -4,11 +4,14 @@
 #include <glm/gtx/transform.hpp>
 
 #include <algorithm>
+#include <cmath>
 #include <stdexcept>
+#include <thread>
 
-const int MAX_FRAMES_IN_FLIGHT = 2;
+// Upper bound of the latency policies, per frame resources are created for all of them
+const uint32_t MAX_FRAMES_IN_FLIGHT = 3;
 
-VkGlfwOutput::VkGlfwOutput(GLFWwindow* window, VulkanEngine& engine) : window(window), VkOutput(engine) {
+VkGlfwOutput::VkGlfwOutput(GLFWwindow* window, VulkanEngine& engine) : window(window), VkOutput(engine), graph(engine) {
     glfwCreateWindowSurface(engine.vkInstance, window, nullptr, &surface);
     registerRequirements();
     if (!engine.isInit()) {
@@ -18,6 +21,16 @@ VkGlfwOutput::VkGlfwOutput(GLFWwindow* window, VulkanEngine& engine) : window(wi
     }
 }
 
+VkGlfwOutput::VkGlfwOutput(VkExtent2D extent, VulkanEngine& engine) : window(nullptr), surface(VK_NULL_HANDLE), VkOutput(engine), graph(engine) {
+    this->extent = extent;
+    registerRequirements();
+    if (!engine.isInit()) {
+        engine.requestPostInitialization(this);
+    } else {
+        init();
+    }
+}
+
 void VkGlfwOutput::destroy() {
   
     if (isInit)
@@ -25,24 +38,55 @@ void VkGlfwOutput::destroy() {
         for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
             vkDestroySemaphore(engine.device, renderFinishedSemaphores[i], nullptr);
             vkDestroySemaphore(engine.device, imageAvailableSemaphores[i], nullptr);
-            vkDestroyFence(engine.device, inFlightFences[i], nullptr);
         }
 
-        for (auto framebuffer : framebuffers) {
-            vkDestroyFramebuffer(engine.device, framebuffer, nullptr);
+        graph.destroy();
+        occlusion->destroy();
+        particles->destroy();
+        lighting->destroy();
+        objects->destroy();
+        skinning->destroy();
+        frameTimer->destroy();
+        views.clear();
+
+        VkDevice device = engine.device;
+        VkPipeline pipelines[3] = {graphicsPipeline, graphicsPipelineDepthRead, depthPrepassPipeline};
+        VkPipelineLayout layout = graphicsPipelineLayout;
+        engine.retire([=] () {
+            for (auto pipeline : pipelines) {
+                if (pipeline != VK_NULL_HANDLE) vkDestroyPipeline(device, pipeline, nullptr);
+            }
+            vkDestroyPipelineLayout(device, layout, nullptr);
+        });
+
+        VkPipeline upscale = upscalePipeline;
+        VkPipelineLayout upscaleLayout = upscalePipelineLayout;
+        VkDescriptorSetLayout setLayout = upscaleSetLayout;
+        VkDescriptorSet set = upscaleSet;
+        VkSampler sampler = upscaleSampler;
+        VkDescriptorPool pool = engine.descriptorPool;
+        engine.retire([=] () {
+            vkDestroyPipeline(device, upscale, nullptr);
+            vkDestroyPipelineLayout(device, upscaleLayout, nullptr);
+            vkFreeDescriptorSets(device, pool, 1, &set);
+            vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+            vkDestroySampler(device, sampler, nullptr);
+        });
+        if (!isHeadless()) {
+            vkDestroySwapchainKHR(engine.device, swapChain, nullptr);
+            ImGui_ImplVulkan_Shutdown();
+            ImGui_ImplGlfw_Shutdown();
         }
-        
-        destroyView(view);
-        vkDestroyImageView(engine.device, depthImageView, nullptr);
-        vmaDestroyImage(engine.allocator, depthImage._image, depthImage._allocation);
-        vkDestroySwapchainKHR(engine.device, swapChain, nullptr);
 
         for(auto imageView : swapChainImageViews)
         {
             vkDestroyImageView(engine.device, imageView, nullptr);
         }
+        for (auto& image : offscreenImages) {
+            engine.destroyImage(image);
+        }
      }   
-    vkDestroySurfaceKHR(engine.vkInstance, surface, nullptr);
+    if (!isHeadless()) vkDestroySurfaceKHR(engine.vkInstance, surface, nullptr);
 }
 
 VkGlfwOutput::~VkGlfwOutput() {
@@ -63,20 +107,48 @@ const std::set<std::string> VkGlfwOutput::getRequiredInstanceExtensions() {
 }
 
 void VkGlfwOutput::registerRequirements() {
+    engine.requestQueue([&] (const VkQueueFamilyProperties& prop, uint32_t idx, VkPhysicalDevice device) -> bool {return isGraphicsFamily(prop);}, &graphicsQueueFamily, &graphicsQueue);
+    // Nothing to present to, any device with a graphics queue will do
+    if (isHeadless()) return;
+
     engine.requestDeviceExtensions(getRequiredDeviceExtensions());
+    // Measures when frames reach the display, pacing and latency stats fall back to the timeline without it
+    engine.requestOptionalDeviceExtensions({VK_KHR_PRESENT_ID_EXTENSION_NAME, VK_KHR_PRESENT_WAIT_EXTENSION_NAME});
     engine.requestDeviceRequirement([&] (VkPhysicalDevice device) -> bool {return this->checkDeviceRequirements(device);});
-    engine.requestQueue([&] (const VkQueueFamilyProperties& prop, uint32_t idx, VkPhysicalDevice device) -> bool {return isGraphicsFamily(prop);}, &graphicsQueueFamily, &graphicsQueue);
     engine.requestQueue([&] (const VkQueueFamilyProperties& prop, uint32_t idx, VkPhysicalDevice device) -> bool {return isPresentFamily(prop, idx, device);}, &presentQueueFamily, &presentQueue);
 }
 
 void VkGlfwOutput::init() {
-    createSwapChain();
+    if (engine.presentWait && !isHeadless()) {
+        waitForPresent = (PFN_vkWaitForPresentKHR) vkGetDeviceProcAddr(engine.device, "vkWaitForPresentKHR");
+    }
+
+    if (isHeadless()) {
+        presentQueue = graphicsQueue;
+        presentQueueFamily = graphicsQueueFamily;
+        createOffscreenImages();
+    } else {
+        createSwapChain();
+    }
     createImageViews();
-    newView();
-    createFramebuffers();
+
+    occlusion = std::make_unique<OcclusionCuller>(engine, MAX_FRAMES_IN_FLIGHT);
+    particles = std::make_unique<ParticleSystem>(engine, particleCapacity, MAX_FRAMES_IN_FLIGHT);
+    lighting = std::make_unique<ClusteredLighting>(engine, MAX_FRAMES_IN_FLIGHT);
+    objects = std::make_unique<ObjectBuffer>(engine, MAX_FRAMES_IN_FLIGHT);
+    skinning = std::make_unique<SkinningSystem>(engine, MAX_FRAMES_IN_FLIGHT);
+    frameTimer = std::make_unique<GpuFrameTimer>(engine, graphicsQueueFamily, MAX_FRAMES_IN_FLIGHT);
+    lastDraw = std::chrono::steady_clock::now();
+    frameScales.assign(MAX_FRAMES_IN_FLIGHT, 1.f);
+
+    createPipelineBuilder();
+    createUpscaleLayout();
+    buildRenderGraph();
+    createGraphicsPipelines();
+    newView()->name = "Main";
     createCommandBuffers();
     createSyncObjects();
-    initImgui();
+    if (!isHeadless()) initImgui();
     
     isInit = true;
 }
@@ -110,19 +182,19 @@ void VkGlfwOutput::createImageViews()
     }
 }
 
-void VkGlfwOutput::createSwapChain()
+void VkGlfwOutput::createSwapChain(VkSwapchainKHR oldSwapchain)
 {
     swapChainSupport = querySwapChainSupport(engine.physicalDevice, surface);
 
     VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
-    VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
+    presentConfig = choosePresentConfig(latencyPolicy, swapChainSupport, framesInFlightOverride, MAX_FRAMES_IN_FLIGHT);
+    swapchainPolicy = latencyPolicy;
+    swapchainFramesOverride = framesInFlightOverride;
+    framesInFlight = presentConfig.framesInFlight;
+    resolution.setFramesInFlight(framesInFlight);
     updateExtent();
 
-    uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
-    if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount)
-    {
-        imageCount = swapChainSupport.capabilities.maxImageCount;
-    }
+    uint32_t imageCount = presentConfig.imageCount;
 
     VkSwapchainCreateInfoKHR createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -154,10 +226,10 @@ void VkGlfwOutput::createSwapChain()
     createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
     createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 
-    createInfo.presentMode = presentMode;
+    createInfo.presentMode = presentConfig.presentMode;
     createInfo.clipped = VK_TRUE;
 
-    createInfo.oldSwapchain = VK_NULL_HANDLE;
+    createInfo.oldSwapchain = oldSwapchain;
 
     if (vkCreateSwapchainKHR(engine.device, &createInfo, nullptr, &swapChain) != VK_SUCCESS)
     {
@@ -170,59 +242,82 @@ void VkGlfwOutput::createSwapChain()
 
     imageFormat = surfaceFormat.format;
 
-    VkExtent3D depthImageExtent = {
-        extent.width,
-        extent.height,
-        1
-    };
-
-    //hardcoding the depth format to 32 bit float
+    //hardcoding the depth format to 32 bit float, the image itself is a transient of the render graph
 	depthFormat = VK_FORMAT_D32_SFLOAT;
 
-	//the depth image will be an image with the format we selected and Depth Attachment usage flag
-	VkImageCreateInfo dimg_info = {};
+    engine.vkLogger->info("Swapchain: {} images, {}, {} frames in flight ({})", imageCount,
+        presentModeName(presentConfig.presentMode), framesInFlight, latencyPolicyName(latencyPolicy));
+}
 
-    dimg_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    dimg_info.pNext = nullptr;
+// One image per frame in flight, so a frame never waits for another one's target
+void VkGlfwOutput::createOffscreenImages()
+{
+    imageFormat = VK_FORMAT_B8G8R8A8_UNORM;
+    depthFormat = VK_FORMAT_D32_SFLOAT;
+
+    presentConfig.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+    presentConfig.imageCount = MAX_FRAMES_IN_FLIGHT;
+    presentConfig.framesInFlight = MAX_FRAMES_IN_FLIGHT;
+    framesInFlight = MAX_FRAMES_IN_FLIGHT;
+    resolution.setFramesInFlight(framesInFlight);
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = imageFormat;
+    imageInfo.extent = {extent.width, extent.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+    VmaAllocationCreateInfo allocInfo = {};
+    allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        offscreenImages.push_back(engine.createImage(imageInfo, allocInfo, "Output"));
+        swapChainImages.push_back(offscreenImages.back()._image);
+    }
 
-    dimg_info.imageType = VK_IMAGE_TYPE_2D;
+    engine.vkLogger->info("Headless output: {} images of {}x{}, {} frames in flight", MAX_FRAMES_IN_FLIGHT,
+        extent.width, extent.height, framesInFlight);
+}
 
-    dimg_info.format = depthFormat;
-    dimg_info.extent = depthImageExtent;
+// Same surface and extent, only the present mode, image count and frames in flight change
+void VkGlfwOutput::recreateSwapChain()
+{
+    GpuTimeline& timeline = engine.timeline(graphicsQueue);
+    timeline.wait(timeline.lastSubmitted());
+    vkQueueWaitIdle(presentQueue);
 
-    dimg_info.mipLevels = 1;
-    dimg_info.arrayLayers = 1;
-    dimg_info.samples = VK_SAMPLE_COUNT_1_BIT;
-    dimg_info.tiling = VK_IMAGE_TILING_OPTIMAL;
-    dimg_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    for (auto imageView : swapChainImageViews) {
+        vkDestroyImageView(engine.device, imageView, nullptr);
+    }
 
-	//for the depth image, we want to allocate it from GPU local memory
-	VmaAllocationCreateInfo dimg_allocinfo = {};
-	dimg_allocinfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-	dimg_allocinfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    VkSwapchainKHR oldSwapchain = swapChain;
+    createSwapChain(oldSwapchain);
+    vkDestroySwapchainKHR(engine.device, oldSwapchain, nullptr);
+    createImageViews();
 
-	//allocate and create the image
-	vmaCreateImage(engine.allocator, &dimg_info, &dimg_allocinfo, &depthImage._image, &depthImage._allocation, nullptr);
+    vkFreeCommandBuffers(engine.device, engine.commandPool, (uint32_t) commandBuffers.size(), commandBuffers.data());
+    createCommandBuffers();
 
-	//build an image-view for the depth image to use for rendering
-	VkImageViewCreateInfo dview_info = {};
-    dview_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	dview_info.pNext = nullptr;
+    imageTimelineValues.assign(swapChainImages.size(), 0);
+    currentFrame = 0;
 
-	dview_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-	dview_info.image = depthImage._image;
-	dview_info.format = depthFormat;
-	dview_info.subresourceRange.baseMipLevel = 0;
-	dview_info.subresourceRange.levelCount = 1;
-	dview_info.subresourceRange.baseArrayLayer = 0;
-	dview_info.subresourceRange.layerCount = 1;
-	dview_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    presentId = 0;
+    lastPresentId = 0;
+    pendingPresents.clear();
 
-	vkCreateImageView(engine.device, &dview_info, nullptr, &depthImageView);
+    // Framebuffers of the graph reference the old image views
+    rebuildRenderGraph();
 }
 
 bool VkGlfwOutput::checkDeviceRequirements(VkPhysicalDevice device) const 
 {
+    if (isHeadless()) return true;
+
     SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device, surface);
     if (swapChainSupport.formats.empty() || swapChainSupport.presentModes.empty()) return false; 
 
@@ -231,85 +326,205 @@ bool VkGlfwOutput::checkDeviceRequirements(VkPhysicalDevice device) const
 
 const std::set<std::string> VkGlfwOutput::getRequiredDeviceExtensions() const 
 {  
+    if (isHeadless()) return {};
     return requiredDeviceExtensions; 
 }
 
-void VkGlfwOutput::createRenderPass(View& view)
+// The main pass clears and draws the scene, the UI pass draws dear imgui on top of it in the swapchain image.
+// With dynamic resolution the scene goes to an offscreen target instead, which the UI pass upscales first.
+// Without the optional depth pre-pass and occlusion culling, depth only lives within the main pass.
+void VkGlfwOutput::buildRenderGraph()
 {
-   VkAttachmentDescription colorAttachment{};
-    colorAttachment.format = imageFormat;
-    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-    VkAttachmentDescription depth_attachment = {};
-    // Depth attachment
-    depth_attachment.flags = 0;
-    depth_attachment.format = depthFormat;
-    depth_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    depth_attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    VkAttachmentReference depth_attachment_ref = {};
-    depth_attachment_ref.attachment = 1;
-    depth_attachment_ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    VkAttachmentReference colorAttachmentRef{};
-    colorAttachmentRef.attachment = 0;
-    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    VkSubpassDescription subpass{};
-    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass.colorAttachmentCount = 1;
-    subpass.pColorAttachments = &colorAttachmentRef;
-    subpass.pDepthStencilAttachment = &depth_attachment_ref;
-
-    VkSubpassDependency dependency{};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-    VkSubpassDependency depth_dependency = {};
-    depth_dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    depth_dependency.dstSubpass = 0;
-    depth_dependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-    depth_dependency.srcAccessMask = 0;
-    depth_dependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-    depth_dependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-
-    VkSubpassDependency dependencies[2] = { dependency, depth_dependency };
-
-    VkAttachmentDescription attachments[2] = { colorAttachment,depth_attachment };
-
-    VkRenderPassCreateInfo renderPassInfo{};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = 2;
-    renderPassInfo.pAttachments = attachments;
-    renderPassInfo.subpassCount = 1;
-    renderPassInfo.pSubpasses = &subpass;
-    renderPassInfo.dependencyCount = 2;
-    renderPassInfo.pDependencies = dependencies;
-
-    if (vkCreateRenderPass(engine.device, &renderPassInfo, nullptr, &view.renderPass) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to create render pass!");
-    } 
+    graphDepthPrepass = depthPrepass;
+    graphOcclusionCulling = occlusionCulling;
+    graphDynamicResolution = dynamicResolution;
+    graphVertexPulling = vertexPulling;
+    graphTargetScale = std::max(resolution.minScale, resolution.maxScale);
+
+    if (graphDynamicResolution) {
+        resolution.reset();
+        targetExtent = resolution.targetExtent(extent);
+        renderExtent = resolution.renderExtent(extent);
+    } else {
+        targetExtent = extent;
+        renderExtent = extent;
+    }
+
+    RGImageDesc colorDesc;
+    colorDesc.format = imageFormat;
+    colorDesc.extent = extent;
+    VkImageLayout finalLayout = isHeadless() ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    swapchainTarget = graph.importImage("Swapchain", colorDesc, VK_IMAGE_LAYOUT_UNDEFINED, finalLayout);
+    graph.markOutput(swapchainTarget);
+
+    // Same format as the swapchain, so the scene pipelines work with either target
+    RGResource sceneColor = swapchainTarget;
+    if (graphDynamicResolution) {
+        RGImageDesc sceneDesc;
+        sceneDesc.format = imageFormat;
+        sceneDesc.extent = targetExtent;
+        sceneTarget = graph.createImage("Scene", sceneDesc);
+        sceneColor = sceneTarget;
+    }
+
+    RGImageDesc depthDesc;
+    depthDesc.format = depthFormat;
+    depthDesc.extent = targetExtent;
+    depthDesc.aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+    depthTarget = graph.createImage("Depth", depthDesc);
+
+    if (graphOcclusionCulling) {
+        occlusion->resize(targetExtent);
+        occlusion->addCullPass(graph);
+    }
+
+    skinning->addPass(graph);
+
+    if (graphDepthPrepass) {
+        auto prepass = graph.addPass("depth_prepass", RGPassType::Graphics)
+            .depth(depthTarget)
+            .execute([this] (VkCommandBuffer cmd, const RGPassContext& context) { recordViews(cmd, depthPrepassPipeline, false, true); });
+        if (graphOcclusionCulling) prepass.read(occlusion->drawsResource, RGAccess::IndirectBuffer);
+        skinning->readForDraw(prepass);
+    }
+
+    particles->addSimulationPass(graph);
+    lighting->addCullPass(graph);
+
+    auto main = graph.addPass("main", RGPassType::Graphics)
+        .color(sceneColor, VK_ATTACHMENT_LOAD_OP_CLEAR, clearColor)
+        .depth(depthTarget, graphDepthPrepass ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR, !graphDepthPrepass)
+        .execute([this] (VkCommandBuffer cmd, const RGPassContext& context) { recordMainPass(cmd); });
+    if (graphOcclusionCulling) main.read(occlusion->drawsResource, RGAccess::IndirectBuffer);
+    particles->readForDraw(main);
+    lighting->readForDraw(main);
+    skinning->readForDraw(main);
+
+    // Built from this frame's depth, tested against by the next frame
+    if (graphOcclusionCulling) occlusion->addPyramidPass(graph, depthTarget);
+
+    // The upscale covers the whole image, otherwise the scene is already in it.
+    // The imgui backend builds its pipeline against a render pass, so this pass keeps one with dynamic rendering.
+    auto ui = graph.addPass("ui", RGPassType::Graphics)
+        .color(swapchainTarget, graphDynamicResolution ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_LOAD)
+        .legacyRenderPass()
+        .execute([this] (VkCommandBuffer cmd, const RGPassContext& context) { recordUiPass(cmd); });
+    if (graphDynamicResolution) ui.read(sceneTarget, RGAccess::SampledFragment);
+
+    graph.compile();
+
+    if (graphOcclusionCulling) occlusion->updateDescriptors(graph, depthTarget);
+    if (graphDynamicResolution) updateUpscaleDescriptor();
 }
 
-void VkGlfwOutput::createPipelineBuilder(View& view) {
-    view.graphicsPipelineBuilder = PipelineBuilder();
-    view.graphicsPipelineBuilder.initBasic();
+// Waits for the graphics queue, the graph's passes and descriptors are replaced
+void VkGlfwOutput::rebuildRenderGraph()
+{
+    GpuTimeline& timeline = engine.timeline(graphicsQueue);
+    timeline.wait(timeline.lastSubmitted());
+
+    // The mesh pipelines are built for one way of fetching vertices, the GPU is idle after the wait above
+    if (vertexPulling != graphVertexPulling) destroyMeshPipelines();
+
+    graph.reset();
+    buildRenderGraph();
+    createGraphicsPipelines();
+}
+
+void VkGlfwOutput::destroyMeshPipelines() {
+    VkPipeline* pipelines[3] = {&graphicsPipeline, &graphicsPipelineDepthRead, &depthPrepassPipeline};
+    for (auto pipeline : pipelines) {
+        if (*pipeline != VK_NULL_HANDLE) vkDestroyPipeline(engine.device, *pipeline, nullptr);
+        *pipeline = VK_NULL_HANDLE;
+    }
+}
+
+OcclusionStats VkGlfwOutput::getOcclusionStats() const {
+    return graphOcclusionCulling ? occlusion->stats : OcclusionStats();
+}
+
+void VkGlfwOutput::createUpscaleLayout() {
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    check_vk_result(vkCreateSampler(engine.device, &samplerInfo, nullptr, &upscaleSampler));
+
+    VkDescriptorSetLayoutBinding binding = {};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutCreateInfo setLayoutInfo = {};
+    setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    setLayoutInfo.bindingCount = 1;
+    setLayoutInfo.pBindings = &binding;
+    check_vk_result(vkCreateDescriptorSetLayout(engine.device, &setLayoutInfo, nullptr, &upscaleSetLayout));
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = engine.descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &upscaleSetLayout;
+    check_vk_result(vkAllocateDescriptorSets(engine.device, &allocInfo, &upscaleSet));
+
+    VkPushConstantRange range = {};
+    range.offset = 0;
+    range.size = sizeof(glm::vec4);
+    range.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &upscaleSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &range;
+    if (vkCreatePipelineLayout(engine.device, &pipelineLayoutInfo, nullptr, &upscalePipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+}
+
+void VkGlfwOutput::updateUpscaleDescriptor() {
+    VkDescriptorImageInfo imageInfo = {upscaleSampler, graph.getImageView(sceneTarget), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = upscaleSet;
+    write.dstBinding = 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(engine.device, 1, &write, 0, nullptr);
+}
+
+// Picks up the last finished frame's GPU time, the scale applies to the frame about to be recorded
+void VkGlfwOutput::updateRenderScale() {
+    float frameTime;
+    if (frameTimer->isSupported()) {
+        if (!frameTimer->read((uint32_t) currentFrame, frameTime)) return;
+    } else {
+        auto now = std::chrono::steady_clock::now();
+        frameTime = std::chrono::duration<float, std::milli>(now - lastDraw).count();
+        lastDraw = now;
+    }
+    gpuFrameTime = frameTime;
+
+    if (!graphDynamicResolution || !resolution.update(frameTime, frameScales[currentFrame])) return;
+
+    renderExtent = resolution.renderExtent(extent);
+    // The pyramid was built at the previous scale
+    if (graphOcclusionCulling) occlusion->pyramidValid = false;
+}
+
+void VkGlfwOutput::createPipelineBuilder() {
+    graphicsPipelineBuilder = PipelineBuilder();
+    graphicsPipelineBuilder.initBasic();
+    graphicsPipelineBuilder.dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
 }
 
 void VkGlfwOutput::updateExtent() {
@@ -335,73 +550,99 @@ void VkGlfwOutput::updateExtent() {
     }
 }
 
-void VkGlfwOutput::createGraphicsPipeline(View& view) {
+// Builds the pipeline variants the current graph needs, the render passes of later rebuilds stay compatible
+void VkGlfwOutput::createGraphicsPipelines() {
+    bool needsDepthVariants = graphDepthPrepass && (graphicsPipelineDepthRead == VK_NULL_HANDLE || depthPrepassPipeline == VK_NULL_HANDLE);
+    if (graphicsPipeline != VK_NULL_HANDLE && !needsDepthVariants) return;
 
-    VertexInputDescription description = Vertex::getVertexDescription();
+    // Pulled vertices need no vertex input state, the shader reads them from the geometry set
+    VertexInputDescription description;
+    if (!graphVertexPulling) description = Vertex::getVertexDescription();
 
-    view.graphicsPipelineBuilder.vertexInputInfo.pVertexBindingDescriptions = description.bindings.data();
-    view.graphicsPipelineBuilder.vertexInputInfo.vertexBindingDescriptionCount = (uint32_t) description.bindings.size();
+    graphicsPipelineBuilder.vertexInputInfo.pVertexBindingDescriptions = description.bindings.data();
+    graphicsPipelineBuilder.vertexInputInfo.vertexBindingDescriptionCount = (uint32_t) description.bindings.size();
 
-    view.graphicsPipelineBuilder.vertexInputInfo.pVertexAttributeDescriptions = description.attributes.data();
-    view.graphicsPipelineBuilder.vertexInputInfo.vertexAttributeDescriptionCount = (uint32_t) description.attributes.size();
+    graphicsPipelineBuilder.vertexInputInfo.pVertexAttributeDescriptions = description.attributes.data();
+    graphicsPipelineBuilder.vertexInputInfo.vertexAttributeDescriptionCount = (uint32_t) description.attributes.size();
 
-    VkShaderModule vertexShader = loadCompiledShader("../shaders/basic_mesh.vert.spv", engine.device);
-    VkShaderModule fragmentShader = loadCompiledShader("../shaders/triangle.frag.spv", engine.device);
+    const char* vertexShaderPath = graphVertexPulling ? "../shaders/pulled_mesh.vert.spv" : "../shaders/basic_mesh.vert.spv";
+    VkShaderModule vertexShader = loadCompiledShader(vertexShaderPath, engine.device);
+    VkShaderModule fragmentShader = loadCompiledShader("../shaders/lit_mesh.frag.spv", engine.device);
 
-    view.graphicsPipelineBuilder.shaderStages.clear();
-    view.graphicsPipelineBuilder.shaderStages.push_back(shaderStageInfo(vertexShader, VkShaderStageFlagBits::VK_SHADER_STAGE_VERTEX_BIT));
-    view.graphicsPipelineBuilder.shaderStages.push_back(shaderStageInfo(fragmentShader, VkShaderStageFlagBits::VK_SHADER_STAGE_FRAGMENT_BIT));
+    graphicsPipelineBuilder.shaderStages.clear();
+    graphicsPipelineBuilder.shaderStages.push_back(shaderStageInfo(vertexShader, VkShaderStageFlagBits::VK_SHADER_STAGE_VERTEX_BIT));
+    graphicsPipelineBuilder.shaderStages.push_back(shaderStageInfo(fragmentShader, VkShaderStageFlagBits::VK_SHADER_STAGE_FRAGMENT_BIT));
 
-    VkPushConstantRange range;
-    range.offset = 0;
-    range.size = sizeof(MeshPushConstants);
-    range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo {};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.pNext = nullptr;
-    pipelineLayoutInfo.setLayoutCount = 0;            // Optional
-    pipelineLayoutInfo.pSetLayouts = nullptr;         // Optional
-    pipelineLayoutInfo.pushConstantRangeCount = 1;    
-    pipelineLayoutInfo.pPushConstantRanges = &range; 
+    if (graphicsPipelineLayout == VK_NULL_HANDLE) {
+        VkPushConstantRange range;
+        range.offset = 0;
+        range.size = sizeof(MeshPushConstants);
+        range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
-    if (vkCreatePipelineLayout(engine.device, &pipelineLayoutInfo, nullptr, &view.graphicsPipelineLayout) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create pipeline layout!");
-    }
+        // Both vertex paths share the layout, pipelines with vertex bindings leave the geometry set unused
+        VkDescriptorSetLayout setLayouts[4] = {lighting->getSetLayout(), engine.materials->getSetLayout(), engine.geometry->getSetLayout(), objects->getSetLayout()};
 
-    view.graphicsPipelineBuilder.viewport.height = (float) extent.height;
-    view.graphicsPipelineBuilder.viewport.width = (float) extent.width;
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo {};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.pNext = nullptr;
+        pipelineLayoutInfo.setLayoutCount = 4;
+        pipelineLayoutInfo.pSetLayouts = setLayouts;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;    
+        pipelineLayoutInfo.pPushConstantRanges = &range; 
 
-    view.graphicsPipelineBuilder.scissor.extent = extent;
+        if (vkCreatePipelineLayout(engine.device, &pipelineLayoutInfo, nullptr, &graphicsPipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
+    }
 
-    view.graphicsPipeline = view.graphicsPipelineBuilder.buildPipeline(engine.device, view.renderPass, view.graphicsPipelineLayout);
+    // Only used for the viewport count, views set their region when recording
+    graphicsPipelineBuilder.viewport.height = (float) extent.height;
+    graphicsPipelineBuilder.viewport.width = (float) extent.width;
 
-    vkDestroyShaderModule(engine.device, vertexShader, nullptr);
-    vkDestroyShaderModule(engine.device, fragmentShader, nullptr);
-}
+    graphicsPipelineBuilder.scissor.extent = extent;
 
-void VkGlfwOutput::createFramebuffers() {
-    framebuffers.resize(swapChainImageViews.size());
-
-    for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-        VkImageView attachments[] = {
-            swapChainImageViews[i],
-            depthImageView
-        };
+    if (graphicsPipeline == VK_NULL_HANDLE) {
+        graphicsPipeline = graphicsPipelineBuilder.buildPipeline(engine.device, graph.getPipelineTarget("main"), graphicsPipelineLayout);
+    }
 
-        VkFramebufferCreateInfo framebufferInfo{};
-        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebufferInfo.renderPass = view.renderPass;
-        framebufferInfo.attachmentCount = 2;
-        framebufferInfo.pAttachments = attachments;
-        framebufferInfo.width = extent.width;
-        framebufferInfo.height = extent.height;
-        framebufferInfo.layers = 1;
+    if (needsDepthVariants) {
+        // Depth is complete after the pre-pass, the main pass only tests against it
+        graphicsPipelineBuilder.depthStencil.depthWriteEnable = VK_FALSE;
+        graphicsPipelineDepthRead = graphicsPipelineBuilder.buildPipeline(engine.device, graph.getPipelineTarget("main"), graphicsPipelineLayout);
+
+        // The pre-pass has no color attachment and no fragment shader
+        graphicsPipelineBuilder.depthStencil.depthWriteEnable = VK_TRUE;
+        graphicsPipelineBuilder.shaderStages.pop_back();
+        graphicsPipelineBuilder.colorBlending.attachmentCount = 0;
+        depthPrepassPipeline = graphicsPipelineBuilder.buildPipeline(engine.device, graph.getPipelineTarget("depth_prepass"), graphicsPipelineLayout);
+        graphicsPipelineBuilder.colorBlending.attachmentCount = 1;
+    }
 
-        if (vkCreateFramebuffer(engine.device, &framebufferInfo, nullptr, &framebuffers[i]) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create framebuffer!");
-        }
+    particles->createPipeline(graphicsPipelineBuilder, graph.getPipelineTarget("main"));
+
+    if (upscalePipeline == VK_NULL_HANDLE) {
+        PipelineBuilder builder = graphicsPipelineBuilder;
+        VkShaderModule fullscreenShader = loadCompiledShader("../shaders/fullscreen.vert.spv", engine.device);
+        VkShaderModule upscaleShader = loadCompiledShader("../shaders/upscale.frag.spv", engine.device);
+
+        builder.shaderStages.clear();
+        builder.shaderStages.push_back(shaderStageInfo(fullscreenShader, VK_SHADER_STAGE_VERTEX_BIT));
+        builder.shaderStages.push_back(shaderStageInfo(upscaleShader, VK_SHADER_STAGE_FRAGMENT_BIT));
+        builder.vertexInputInfo.vertexBindingDescriptionCount = 0;
+        builder.vertexInputInfo.vertexAttributeDescriptionCount = 0;
+        builder.rasterizer.cullMode = VK_CULL_MODE_NONE;
+        builder.depthStencil.depthTestEnable = VK_FALSE;
+        builder.depthStencil.depthWriteEnable = VK_FALSE;
+        builder.colorBlendAttachment.blendEnable = VK_FALSE;
+        builder.colorBlending.attachmentCount = 1;
+        upscalePipeline = builder.buildPipeline(engine.device, graph.getPipelineTarget("ui"), upscalePipelineLayout);
+
+        vkDestroyShaderModule(engine.device, fullscreenShader, nullptr);
+        vkDestroyShaderModule(engine.device, upscaleShader, nullptr);
     }
+
+    vkDestroyShaderModule(engine.device, vertexShader, nullptr);
+    vkDestroyShaderModule(engine.device, fragmentShader, nullptr);
 }
 
 void VkGlfwOutput::aquireNextImage(uint64_t timeout, VkSemaphore semaphore, VkFence fence, uint32_t *pImageIndex){
@@ -409,7 +650,7 @@ void VkGlfwOutput::aquireNextImage(uint64_t timeout, VkSemaphore semaphore, VkFe
 }
 
 void VkGlfwOutput::createCommandBuffers() {
-    commandBuffers.resize(framebuffers.size());
+    commandBuffers.resize(swapChainImages.size());
 
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -422,41 +663,123 @@ void VkGlfwOutput::createCommandBuffers() {
     }
 }
 
+void VkGlfwOutput::waitForFrame() {
+    if (!isHeadless() && (latencyPolicy != swapchainPolicy || framesInFlightOverride != swapchainFramesOverride)) {
+        recreateSwapChain();
+    }
+
+    bool targetScaleChanged = dynamicResolution && std::max(resolution.minScale, resolution.maxScale) != graphTargetScale;
+    if (depthPrepass != graphDepthPrepass || occlusionCulling != graphOcclusionCulling ||
+        dynamicResolution != graphDynamicResolution || vertexPulling != graphVertexPulling || targetScaleChanged) rebuildRenderGraph();
+
+    GpuTimeline& timeline = engine.timeline(graphicsQueue);
+    timeline.wait(frameTimelineValues[currentFrame]);
+
+    bool pacing = framePacing && latencyPolicy == LatencyPolicy::LowLatency;
+    collectPresents(pacing);
+    pacingSleep = 0.f;
+    if (pacing) paceFrame();
+
+    updateRenderScale();
+    frameScales[currentFrame] = graphDynamicResolution ? resolution.getScale() : 1.f;
+    if (graphOcclusionCulling) occlusion->beginFrame((uint32_t) currentFrame);
+    particles->beginFrame((uint32_t) currentFrame);
+    lighting->beginFrame((uint32_t) currentFrame);
+    objects->beginFrame((uint32_t) currentFrame);
+    skinning->beginFrame((uint32_t) currentFrame);
+
+    frameStart = std::chrono::steady_clock::now();
+    frameWaited = true;
+}
+
+// Records when frames reached the display. Blocking keeps at most framesInFlight presents queued, which also
+// makes the observed time of the oldest one exact for pacing.
+void VkGlfwOutput::collectPresents(bool block) {
+    if (waitForPresent == nullptr) return;
+
+    while (!pendingPresents.empty()) {
+        auto [id, submitted] = pendingPresents.front();
+        bool mustWait = block && pendingPresents.size() >= framesInFlight;
+
+        VkResult result = waitForPresent(engine.device, swapChain, id, mustWait ? UINT64_MAX : 0);
+        if (result == VK_TIMEOUT) break;
+        pendingPresents.pop_front();
+        if (result != VK_SUCCESS) continue; // Out of date or suboptimal, no timing
+
+        auto now = std::chrono::steady_clock::now();
+        float latency = std::chrono::duration<float, std::milli>(now - submitted).count();
+        submitToPresent = submitToPresent == 0.f ? latency : submitToPresent * 0.9f + latency * 0.1f;
+
+        if (lastPresentId != 0 && mustWait) {
+            float period = std::chrono::duration<float, std::milli>(now - lastPresent).count() / (float) (id - lastPresentId);
+            presentPeriod = presentPeriod == 0.f ? period : presentPeriod * 0.9f + period * 0.1f;
+        }
+        lastPresent = now;
+        lastPresentId = id;
+    }
+}
+
+// Starts the frame so that it is done just before the presentation after the last one, leaving a margin for
+// variance. Without present timing there is nothing to aim for, the slot wait alone limits the queue.
+void VkGlfwOutput::paceFrame() {
+    if (waitForPresent == nullptr || presentPeriod == 0.f || lastPresentId == 0) return;
+
+    const float margin = 1.f;
+    float budget = cpuFrameTime + gpuFrameTime + margin;
+    auto start = lastPresent + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<float, std::milli>(presentPeriod - budget));
+
+    auto now = std::chrono::steady_clock::now();
+    if (start > now) {
+        std::this_thread::sleep_until(start);
+        pacingSleep = std::chrono::duration<float, std::milli>(start - now).count();
+    }
+}
+
+LatencyStats VkGlfwOutput::getLatencyStats() const {
+    LatencyStats stats;
+    stats.presentMode = presentConfig.presentMode;
+    stats.imageCount = (uint32_t) swapChainImages.size();
+    stats.framesInFlight = framesInFlight;
+    stats.cpuFrameTime = cpuFrameTime;
+    stats.submitToGpuMs = (float) engine.timeline(graphicsQueue).averageLatencyMs();
+    stats.submitToPresentMs = submitToPresent;
+    stats.pacingSleepMs = pacingSleep;
+    stats.presentWaitSupported = waitForPresent != nullptr;
+    return stats;
+}
+
 void VkGlfwOutput::draw() {
-    vkWaitForFences(engine.device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    if (!frameWaited) waitForFrame();
+    frameWaited = false;
+
+    // Culling and the object buffer read the worlds, further outputs find nothing changed
+    engine.scene.update();
+    // Moves the bounds of skinned meshes, before culling reads them
+    skinning->update();
+    if (capture) capture->record(*this);
 
-    uint32_t imageIndex;
-    vkAcquireNextImageKHR(engine.device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+    GpuTimeline& timeline = engine.timeline(graphicsQueue);
 
-    // Check if a previous frame is using this image (i.e. there is its fence to wait on)
-    if (imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
-        vkWaitForFences(engine.device, 1, &imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+    // Headless images belong to their frame slot
+    uint32_t imageIndex = (uint32_t) currentFrame;
+    if (!isHeadless()) {
+        vkAcquireNextImageKHR(engine.device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
     }
-    // Mark the image as now being in use by this frame
-    imagesInFlight[imageIndex] = inFlightFences[currentFrame];
+
+    // A previous frame may still be rendering to this image (and using its command buffer)
+    timeline.wait(imageTimelineValues[imageIndex]);
 
     VkCommandBufferBeginInfo beginInfo{};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     beginInfo.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT; 
     beginInfo.pInheritanceInfo = nullptr; // Optional
 
-    VkClearValue depthClear;
-	depthClear.depthStencil.depth = 1.f;
-    VkClearValue clearValues[] = { view.clearColor, depthClear };
-
     VkCommandBuffer& cmd = commandBuffers[imageIndex];
 
-    ImGui::Render();
-
-    glm::mat4 camView = glm::translate(glm::mat4(1.0f), view.cameraPos);
-    //camera projection
-    glm::mat4 projection = glm::perspective(glm::radians(view.fov.x), 1700.f / 900.f, 0.1f, 200.0f);
-    projection[1][1] *= -1;
-    //model rotation
-    glm::mat4 model = glm::rotate(glm::mat4(1.0f), glm::radians(glm::radians(view.fov.y)) , glm::vec3(0, 1, 0));
+    if (!isHeadless()) ImGui::Render();
 
-    pushConstants.render_matrix = projection * camView * model;
-    pushConstants.offset = glm::vec4(1);
+    cullViews();
 
     // ============== BEGIN COMMAND BUFFER ==============
 
@@ -464,31 +787,27 @@ void VkGlfwOutput::draw() {
         throw std::runtime_error("failed to begin recording command buffer!");
     }
 
-    VkRenderPassBeginInfo renderPassInfo{};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = view.renderPass;
-    renderPassInfo.framebuffer = framebuffers[imageIndex];
-    renderPassInfo.renderArea.offset = {0, 0};
-    renderPassInfo.renderArea.extent = extent;
-
-    renderPassInfo.clearValueCount = 2;
-    renderPassInfo.pClearValues = clearValues;
-
-    vkCmdBeginRenderPass(cmd, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, view.graphicsPipeline);
-
-    VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(cmd, 0, 1, &engine.meshes[0].vertexBuffer.buffer, offsets);
-
-    vkCmdPushConstants(cmd, view.graphicsPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants), &pushConstants);
+    std::vector<VkSemaphore> waitSemaphores;
+    std::vector<uint64_t> waitValues;
+    std::vector<VkPipelineStageFlags> waitStages;
+    if (!isHeadless()) {
+        waitSemaphores.push_back(imageAvailableSemaphores[currentFrame]);
+        waitValues.push_back(0);
+        waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+    }
 
-    vkCmdDraw(cmd, (uint32_t) engine.meshes[0].vertices.size(), 1, 0, 0);
-    
-    // Record dear imgui primitives into command buffer
-    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
+    // Take ownership of buffers uploaded since the last frame
+    engine.transfer->acquire(cmd, waitSemaphores, waitValues, waitStages);
 
-    vkCmdEndRenderPass(cmd);
+    if (graphOcclusionCulling) occlusion->bindFrame(graph, cmd);
+    particles->bindFrame(graph);
+    lighting->bindFrame(graph);
+    skinning->bindFrame(graph);
+    objects->update(engine.renderObjects, engine.scene);
+    graph.setImage(swapchainTarget, swapChainImages[imageIndex], swapChainImageViews[imageIndex]);
+    frameTimer->begin(cmd, (uint32_t) currentFrame);
+    graph.execute(cmd);
+    frameTimer->end(cmd, (uint32_t) currentFrame);
 
     if (vkEndCommandBuffer(cmd) != VK_SUCCESS) {
         throw std::runtime_error("failed to record command buffer!");
@@ -496,33 +815,53 @@ void VkGlfwOutput::draw() {
 
     // ============== END COMMAND BUFFER ==============
 
+    uint64_t frameValue = timeline.nextValue();
+    frameTimelineValues[currentFrame] = frameValue;
+    imageTimelineValues[imageIndex] = frameValue;
+
+    // The binary semaphore only orders the present
+    std::vector<VkSemaphore> signalSemaphores = {renderFinishedSemaphores[currentFrame], timeline.semaphore};
+    std::vector<uint64_t> signalValues = {0, frameValue};
+    if (isHeadless()) {
+        signalSemaphores.erase(signalSemaphores.begin());
+        signalValues.erase(signalValues.begin());
+    }
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo;
+    timelineSubmitInfo(timelineInfo, waitValues, signalValues);
+
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
 
-    VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphores;
-    submitInfo.pWaitDstStageMask = waitStages;
+    submitInfo.waitSemaphoreCount = (uint32_t) waitSemaphores.size();
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+    submitInfo.pWaitDstStageMask = waitStages.data();
 
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &cmd;
 
-    VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = signalSemaphores;
-
-    vkResetFences(engine.device, 1, &inFlightFences[currentFrame]);
+    submitInfo.signalSemaphoreCount = (uint32_t) signalSemaphores.size();
+    submitInfo.pSignalSemaphores = signalSemaphores.data();
     
-    if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+    if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
         throw std::runtime_error("failed to submit draw command buffer!");
     }
 
+    auto submitted = std::chrono::steady_clock::now();
+    float frameTime = std::chrono::duration<float, std::milli>(submitted - frameStart).count();
+    cpuFrameTime = cpuFrameTime == 0.f ? frameTime : cpuFrameTime * 0.9f + frameTime * 0.1f;
+
+    if (isHeadless()) {
+        currentFrame = (currentFrame + 1) % framesInFlight;
+        return;
+    }
+
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
     presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = signalSemaphores;
+    presentInfo.pWaitSemaphores = signalSemaphores.data();
 
     VkSwapchainKHR swapChains[] = {swapChain};
     presentInfo.swapchainCount = 1;
@@ -531,9 +870,206 @@ void VkGlfwOutput::draw() {
 
     presentInfo.pResults = nullptr; // Optional
 
+    VkPresentIdKHR presentIdInfo = {};
+    if (waitForPresent != nullptr) {
+        presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+        presentIdInfo.swapchainCount = 1;
+        presentIdInfo.pPresentIds = &(++presentId);
+        presentInfo.pNext = &presentIdInfo;
+        pendingPresents.emplace_back(presentId, submitted);
+    }
+
     vkQueuePresentKHR(presentQueue, &presentInfo);
 
-    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    currentFrame = (currentFrame + 1) % framesInFlight;
+}
+
+void VkGlfwOutput::recordMainPass(VkCommandBuffer cmd) {
+    // With a pre-pass the depth is complete already, the main pass only tests against it
+    recordViews(cmd, graphDepthPrepass ? graphicsPipelineDepthRead : graphicsPipeline, true, !graphDepthPrepass);
+
+    // Blended after all opaque geometry of every view
+    for (size_t i = 0; i < views.size(); i++) {
+        if (viewCullGroups[i] == UINT32_MAX) continue;
+
+        setViewRegion(cmd, viewRect(*views[i]));
+        particles->recordDraw(cmd, cullGroups[viewCullGroups[i]].viewProj, views[i]->viewMatrix());
+    }
+}
+
+void VkGlfwOutput::recordUiPass(VkCommandBuffer cmd) {
+    if (graphDynamicResolution) {
+        glm::vec2 target = glm::vec2(targetExtent.width, targetExtent.height);
+        glm::vec2 rendered = glm::vec2(renderExtent.width, renderExtent.height);
+        glm::vec4 constants = glm::vec4(rendered / target, (rendered - 0.5f) / target);
+
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, upscalePipeline);
+        setViewRegion(cmd, {{0, 0}, extent});
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, upscalePipelineLayout, 0, 1, &upscaleSet, 0, nullptr);
+        vkCmdPushConstants(cmd, upscalePipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(glm::vec4), &constants);
+        vkCmdDraw(cmd, 3, 1, 0, 0);
+    }
+
+    // Record dear imgui primitives into command buffer, it sets its own viewport
+    if (!isHeadless()) ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
+}
+
+void VkGlfwOutput::recordViews(VkCommandBuffer cmd, VkPipeline pipeline, bool clearColor, bool clearDepth) {
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    engine.materials->bind(cmd, graphicsPipelineLayout, 1);
+    engine.geometry->bind(cmd, graphicsPipelineLayout, 2);
+    pushConstants.objectOffset = 0;
+    vkCmdPushConstants(cmd, graphicsPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants), &pushConstants);
+    // Without the feature indirect draws start at instance 0 and take their object from the push constant
+    bool pushObjects = graphOcclusionCulling && !engine.enabledFeatures.drawIndirectFirstInstance;
+
+    for (size_t i = 0; i < views.size(); i++) {
+        View& v = *views[i];
+        if (viewCullGroups[i] == UINT32_MAX) continue;
+
+        VkRect2D rect = viewRect(v);
+        setViewRegion(cmd, rect);
+        lighting->bindView(cmd, graphicsPipelineLayout, viewLightSlots[i]);
+        objects->bindView(cmd, graphicsPipelineLayout, 3, viewCameraSlots[i]);
+
+        // Views drawn over others (minimaps, split screen borders) start from a clean region
+        if ((clearColor || clearDepth) && (rect.extent.width != renderExtent.width || rect.extent.height != renderExtent.height)) {
+            VkClearAttachment clears[2] = {};
+            uint32_t clearCount = 0;
+            if (clearColor) {
+                clears[clearCount].aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                clears[clearCount].colorAttachment = 0;
+                clears[clearCount].clearValue = v.clearColor;
+                clearCount++;
+            }
+            if (clearDepth) {
+                clears[clearCount].aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+                clears[clearCount].clearValue.depthStencil = {1.f, 0};
+                clearCount++;
+            }
+
+            VkClearRect clearRect = {};
+            clearRect.rect = rect;
+            clearRect.baseArrayLayer = 0;
+            clearRect.layerCount = 1;
+            vkCmdClearAttachments(cmd, clearCount, clears, 1, &clearRect);
+        }
+
+        const CullGroup& group = cullGroups[viewCullGroups[i]];
+
+        // The instance index selects the object, the view's camera is already bound
+        for (size_t j = 0; j < group.visible.size(); j++) {
+            uint32_t objectIdx = group.visible[j];
+
+            if (graphOcclusionCulling) {
+                if (pushObjects) {
+                    pushConstants.objectOffset = objectIdx;
+                    vkCmdPushConstants(cmd, graphicsPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants), &pushConstants);
+                }
+                occlusion->recordDraw(cmd, viewDrawOffsets[i] + (uint32_t) j);
+            } else {
+                const RenderObject& object = engine.renderObjects[objectIdx];
+                const GeometryRange& range = engine.geometry->get(engine.meshes[object.meshIndex].geometry);
+                vkCmdDrawIndexed(cmd, range.indexCount, 1, range.firstIndex, (int32_t) range.vertexOffset, objectIdx);
+            }
+        }
+    }
+}
+
+VkRect2D VkGlfwOutput::viewRect(const View& v) const {
+    glm::vec4 clamped = glm::clamp(v.viewport, glm::vec4(0.f), glm::vec4(1.f));
+
+    VkRect2D rect;
+    rect.offset.x = (int32_t) (clamped.x * renderExtent.width);
+    rect.offset.y = (int32_t) (clamped.y * renderExtent.height);
+    rect.extent.width = std::min((uint32_t) (clamped.z * renderExtent.width), renderExtent.width - (uint32_t) rect.offset.x);
+    rect.extent.height = std::min((uint32_t) (clamped.w * renderExtent.height), renderExtent.height - (uint32_t) rect.offset.y);
+    return rect;
+}
+
+void VkGlfwOutput::setViewRegion(VkCommandBuffer cmd, const VkRect2D& rect) {
+    VkViewport viewport = {};
+    viewport.x = (float) rect.offset.x;
+    viewport.y = (float) rect.offset.y;
+    viewport.width = (float) rect.extent.width;
+    viewport.height = (float) rect.extent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
+    vkCmdSetScissor(cmd, 0, 1, &rect);
+}
+
+// Views with identical cameras share their visibility list, object bounds are transformed once for all views
+void VkGlfwOutput::cullViews() {
+    cullGroups.clear();
+    viewCullGroups.assign(views.size(), UINT32_MAX);
+    viewDrawOffsets.assign(views.size(), 0);
+    viewLightSlots.assign(views.size(), UINT32_MAX);
+    viewCameraSlots.assign(views.size(), UINT32_MAX);
+
+    // View matrix and pixels per unit at distance 1, for the screen sizes texture streaming is driven by
+    std::vector<glm::mat4> viewMatrices(views.size());
+    std::vector<float> viewScales(views.size());
+
+    uint32_t enabledViews = 0;
+    for (size_t i = 0; i < views.size(); i++) {
+        View& v = *views[i];
+        if (!v.enabled) continue;
+
+        VkRect2D rect = viewRect(v);
+        if (rect.extent.width == 0 || rect.extent.height == 0) continue;
+        float aspect = (float) rect.extent.width / (float) rect.extent.height;
+
+        glm::mat4 view = v.viewMatrix();
+        glm::mat4 projection = v.projectionMatrix(aspect);
+        viewCullGroups[i] = findCullGroup(cullGroups, projection * view);
+        // Clusters depend on the view's region, so views sharing a camera still get their own grid
+        viewLightSlots[i] = lighting->addView(view, projection, rect, v.nearPlane, v.farPlane);
+        viewCameraSlots[i] = objects->addView(projection * view);
+        viewMatrices[i] = view;
+        viewScales[i] = std::abs(projection[1][1]) * 0.5f * (float) rect.extent.height;
+        enabledViews++;
+    }
+
+    cullObjects(engine.renderObjects, engine.scene, engine.meshes, cullGroups, cullStats, objectSpheres);
+    cullStats.views = enabledViews;
+
+    for (size_t i = 0; i < views.size(); i++) {
+        if (viewCullGroups[i] == UINT32_MAX) continue;
+
+        for (uint32_t objectIdx : cullGroups[viewCullGroups[i]].visible) {
+            const glm::vec4& sphere = objectSpheres[objectIdx];
+            float depth = -(viewMatrices[i] * glm::vec4(glm::vec3(sphere), 1.f)).z;
+            float pixels = 2.f * sphere.w * viewScales[i] / std::max(depth, sphere.w);
+            engine.materials->requestSize(engine.renderObjects[objectIdx].materialIndex, pixels);
+        }
+    }
+
+    if (!graphOcclusionCulling) return;
+
+    // Occlusion tests run per draw, in the order the views record them
+    for (size_t i = 0; i < views.size(); i++) {
+        if (viewCullGroups[i] == UINT32_MAX) continue;
+
+        VkRect2D rect = viewRect(*views[i]);
+        glm::vec4 region = glm::vec4(
+            (float) rect.offset.x / (float) targetExtent.width,
+            (float) rect.offset.y / (float) targetExtent.height,
+            (float) rect.extent.width / (float) targetExtent.width,
+            (float) rect.extent.height / (float) targetExtent.height);
+
+        const CullGroup& group = cullGroups[viewCullGroups[i]];
+        for (size_t j = 0; j < group.visible.size(); j++) {
+            uint32_t objectIdx = group.visible[j];
+            const RenderObject& object = engine.renderObjects[objectIdx];
+            const GeometryRange& range = engine.geometry->get(engine.meshes[object.meshIndex].geometry);
+
+            // Without the feature indirect draws have to start at instance 0, recordViews pushes the object instead
+            uint32_t firstInstance = engine.enabledFeatures.drawIndirectFirstInstance ? objectIdx : 0;
+            uint32_t draw = occlusion->addDraw(objectSpheres[objectIdx], group.viewProj, region, range, firstInstance);
+            if (j == 0) viewDrawOffsets[i] = draw;
+        }
+    }
 }
 
 bool VkGlfwOutput::isPresentFamily(const VkQueueFamilyProperties& prop, uint32_t idx, VkPhysicalDevice device) {
@@ -543,36 +1079,27 @@ bool VkGlfwOutput::isPresentFamily(const VkQueueFamilyProperties& prop, uint32_t
 }
 
 View* VkGlfwOutput::newView() {
-    view = View();
-    createRenderPass(view);
-    createPipelineBuilder(view);
-    createGraphicsPipeline(view);
-    return &view;
+    views.push_back(std::make_unique<View>());
+    return views.back().get();
 }
 
-void VkGlfwOutput::destroyView(View& v) {
-    vkDestroyPipeline(engine.device, v.graphicsPipeline, nullptr);
-    vkDestroyPipelineLayout(engine.device, v.graphicsPipelineLayout, nullptr);
-    vkDestroyRenderPass(engine.device, v.renderPass, nullptr);
+// Views own no GPU objects, so they can be removed between any two frames
+void VkGlfwOutput::destroyView(View* v) {
+    views.erase(std::remove_if(views.begin(), views.end(), [v] (const std::unique_ptr<View>& view) { return view.get() == v; }), views.end());
 }
 
 void VkGlfwOutput::createSyncObjects() {
     imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
     renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-    imagesInFlight.resize(swapChainImages.size(), VK_NULL_HANDLE);
+    frameTimelineValues.resize(MAX_FRAMES_IN_FLIGHT, 0);
+    imageTimelineValues.resize(swapChainImages.size(), 0);
 
     VkSemaphoreCreateInfo semaphoreInfo{};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    VkFenceCreateInfo fenceInfo{};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         if (vkCreateSemaphore(engine.device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-            vkCreateSemaphore(engine.device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-            vkCreateFence(engine.device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+            vkCreateSemaphore(engine.device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS) {
 
             throw std::runtime_error("failed to create synchronization objects for a frame!");
         }
@@ -593,11 +1120,12 @@ void VkGlfwOutput::initImgui() {
     init_info.DescriptorPool = engine.descriptorPool;
     init_info.Subpass = 0;
     init_info.MinImageCount = 2;
-    init_info.ImageCount = (uint32_t) swapChainImages.size();
+    // Only sizes imgui's per frame buffers, fixed so changing the swapchain does not need a new backend
+    init_info.ImageCount = MAX_FRAMES_IN_FLIGHT + 1;
     init_info.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
     init_info.Allocator = nullptr;
     init_info.CheckVkResultFn = check_vk_result;
-    ImGui_ImplVulkan_Init(&init_info, view.renderPass);
+    ImGui_ImplVulkan_Init(&init_info, graph.getRenderPass("ui"));
 
      // Upload Fonts
     VkCommandBuffer commandBuffer;
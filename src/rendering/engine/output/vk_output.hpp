@@ -6,14 +6,38 @@
 #include <set>
 #include <memory>
 #include <string>
+#include <chrono>
+#include <deque>
 
 #include "ve_view.hpp"
 #include "vk_swapchain.hpp"
 #include "vk_engine.hpp"
+#include "ve_render_graph.hpp"
+#include "ve_culling.hpp"
+#include "ve_occlusion.hpp"
+#include "ve_particles.hpp"
+#include "ve_lighting.hpp"
+#include "ve_objects.hpp"
+#include "ve_skinning.hpp"
+#include "ve_frame_timer.hpp"
+#include "ve_dynamic_resolution.hpp"
+#include "ve_capture.hpp"
 
+// Transforms and materials come from the object buffer by instance index, the offset is only set for indirect
+// draws on devices that cannot start them at an instance other than 0
 struct MeshPushConstants {
-	glm::vec4 offset = glm::vec4();
-	glm::mat4 render_matrix = glm::mat4();
+	uint32_t objectOffset = 0;
+};
+
+struct LatencyStats {
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    uint32_t imageCount = 0;
+    uint32_t framesInFlight = 0;
+    float cpuFrameTime = 0.f;      // Milliseconds from the frame's start to its submit
+    float submitToGpuMs = 0.f;     // Until the GPU completed the frame
+    float submitToPresentMs = 0.f; // Until the frame was presented, 0 without VK_KHR_present_wait
+    float pacingSleepMs = 0.f;     // Delay inserted before the frame's start
+    bool presentWaitSupported = false;
 };
 
 class VkOutput : public Initializable {
@@ -36,7 +60,50 @@ class VkGlfwOutput : public virtual VkOutput {
 public:
     ImGui_ImplVulkanH_Window imguiWindow;
     MeshPushConstants pushConstants;
-    View view;
+
+    // Drawn in order into the same frame, later views draw over earlier ones
+    std::vector<std::unique_ptr<View>> views;
+    CullStats cullStats;
+    VkClearValue clearColor = {{{0.2f, 0.2f, 0.2f, 1.0f}}}; // Views covering only part of the output clear their own region
+
+    // Changing these rebuilds the render graph before the next frame
+    bool depthPrepass = false;
+    bool occlusionCulling = false;
+    // Mesh pipelines fetch compressed vertices from a storage buffer instead of vertex input bindings
+    bool vertexPulling = false;
+
+    OcclusionStats getOcclusionStats() const;
+
+    // Renders the scene at a fraction of the output resolution chosen from the measured GPU frame time and
+    // upscales it before the UI. Toggling it or changing the upper scale bound rebuilds the render graph.
+    bool dynamicResolution = false;
+    DynamicResolution resolution;
+    float getGpuFrameTime() const { return gpuFrameTime; } // Milliseconds, whole frame
+
+    // Present mode, swapchain image count and frames in flight follow the policy, changing it or the override
+    // recreates the swapchain before the next frame. With pacing, low latency frames start as late as the
+    // measured frame times allow before the next presentation.
+    LatencyPolicy latencyPolicy = LatencyPolicy::Throughput;
+    uint32_t framesInFlightOverride = 0; // 0 uses the policy's default
+    bool framePacing = true;
+
+    // Blocks until the next frame may start, call it right before sampling input. draw() calls it otherwise.
+    void waitForFrame();
+    LatencyStats getLatencyStats() const;
+
+    uint32_t particleCapacity = 1u << 20; // Read at init
+    std::unique_ptr<ParticleSystem> particles;
+
+    std::unique_ptr<ClusteredLighting> lighting;
+    std::unique_ptr<ObjectBuffer> objects;
+    std::unique_ptr<SkinningSystem> skinning;
+
+    // Records every drawn frame while set
+    std::unique_ptr<SessionRecorder> capture;
+
+    // Without a window frames go to offscreen images, nothing is presented and there is no UI
+    bool isHeadless() const { return window == nullptr; }
+    VkExtent2D getExtent() const { return extent; }
 
 private:
 
@@ -53,8 +120,11 @@ private:
     VkSwapchainKHR swapChain;
     std::vector<VkImage> swapChainImages;
     std::vector<VkImageView> swapChainImageViews;
-    std::vector<VkFramebuffer> framebuffers;
+    std::vector<AllocatedImage> offscreenImages; // Stand in for the swapchain's images when headless
     VkFormat imageFormat;
+    PresentConfig presentConfig;
+    LatencyPolicy swapchainPolicy = LatencyPolicy::Throughput; // Settings the swapchain was created with
+    uint32_t swapchainFramesOverride = 0;
 
     std::vector<uint32_t> queueFamilyIndicies;
     std::vector<VkQueue> queues;
@@ -65,27 +135,99 @@ private:
     uint32_t graphicsQueueFamily;
 
 	VkFormat depthFormat;
-	AllocatedImage depthImage;
-    VkImageView depthImageView;
+
+    // Frame passes, the swapchain image is imported and rebound after every acquire
+    RenderGraph graph;
+    RGResource swapchainTarget = RG_NONE;
+    RGResource depthTarget = RG_NONE;
+    bool graphDepthPrepass = false; // Options the graph was built with
+    bool graphOcclusionCulling = false;
+    bool graphDynamicResolution = false;
+    bool graphVertexPulling = false;
+    float graphTargetScale = 1.f;
+
+    // Scene passes render into the top left renderExtent of targets sized targetExtent, both equal extent
+    // without dynamic resolution
+    RGResource sceneTarget = RG_NONE;
+    VkExtent2D renderExtent;
+    VkExtent2D targetExtent;
+
+    std::unique_ptr<GpuFrameTimer> frameTimer;
+    float gpuFrameTime = 0.f;
+    std::vector<float> frameScales; // Render scale of the last frame of each frame slot, the one its GPU time is for
+    std::chrono::steady_clock::time_point lastDraw; // CPU fallback without timestamp support
+
+    std::unique_ptr<OcclusionCuller> occlusion;
 
     std::vector<VkCommandBuffer> commandBuffers;
 
+    // Shared by all views, viewport and scissor are dynamic
+    PipelineBuilder graphicsPipelineBuilder;
+    VkPipeline graphicsPipeline = VK_NULL_HANDLE;
+    VkPipeline graphicsPipelineDepthRead = VK_NULL_HANDLE; // Main pass after a depth pre-pass, compares without writing
+    VkPipeline depthPrepassPipeline = VK_NULL_HANDLE;
+    VkPipelineLayout graphicsPipelineLayout = VK_NULL_HANDLE;
+
+    VkPipeline upscalePipeline = VK_NULL_HANDLE;
+    VkPipelineLayout upscalePipelineLayout;
+    VkDescriptorSetLayout upscaleSetLayout;
+    VkDescriptorSet upscaleSet;
+    VkSampler upscaleSampler;
+
+    std::vector<CullGroup> cullGroups;
+    std::vector<uint32_t> viewCullGroups;  // Cull group of each view, UINT32_MAX if the view is not drawn
+    std::vector<uint32_t> viewDrawOffsets; // First occlusion draw of each view
+    std::vector<uint32_t> viewLightSlots;  // Cluster grid of each view
+    std::vector<uint32_t> viewCameraSlots; // Camera uniform of each view
+    std::vector<glm::vec4> objectSpheres;
+
     // Sync
+    // Binary semaphores are still needed for the swapchain, CPU side waits use the graphics queue's timeline
     std::vector<VkSemaphore> imageAvailableSemaphores;
     std::vector<VkSemaphore> renderFinishedSemaphores;
-    std::vector<VkFence> inFlightFences;
-    std::vector<VkFence> imagesInFlight;
+    std::vector<uint64_t> frameTimelineValues; // Graphics timeline value signaled by the last submit of each frame in flight
+    std::vector<uint64_t> imageTimelineValues; // Graphics timeline value signaled by the last submit rendering to each swapchain image
     size_t currentFrame = 0;
+    uint32_t framesInFlight = 1; // Active frame slots, per frame resources exist for MAX_FRAMES_IN_FLIGHT
+
+    // Latency
+    bool frameWaited = false;
+    std::chrono::steady_clock::time_point frameStart;
+    float cpuFrameTime = 0.f;
+    float pacingSleep = 0.f;
+
+    // Presentation timing with VK_KHR_present_wait, ids restart with every swapchain
+    PFN_vkWaitForPresentKHR waitForPresent = nullptr;
+    uint64_t presentId = 0;
+    std::deque<std::pair<uint64_t, std::chrono::steady_clock::time_point>> pendingPresents; // Id and submit time
+    std::chrono::steady_clock::time_point lastPresent;
+    uint64_t lastPresentId = 0;
+    float submitToPresent = 0.f;
+    float presentPeriod = 0.f; // Milliseconds between presentations
 
     std::vector<std::optional<uint32_t>> _getRequiredQueueFamilies(VkPhysicalDevice physicalDevice) const;
     
     void registerRequirements();
-    void createSwapChain();
+    void createSwapChain(VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE);
+    void createOffscreenImages();
+    void recreateSwapChain();
+    void collectPresents(bool block);
+    void paceFrame();
     void createImageViews();
-    void createRenderPass(View& view);
-    void createPipelineBuilder(View& view);
-    void createGraphicsPipeline(View& view);
-    void createFramebuffers();
+    void buildRenderGraph();
+    void rebuildRenderGraph();
+    void recordMainPass(VkCommandBuffer cmd);
+    void recordUiPass(VkCommandBuffer cmd);
+    void recordViews(VkCommandBuffer cmd, VkPipeline pipeline, bool clearColor, bool clearDepth);
+    void cullViews();
+    VkRect2D viewRect(const View& view) const;
+    void setViewRegion(VkCommandBuffer cmd, const VkRect2D& rect);
+    void createPipelineBuilder();
+    void createGraphicsPipelines();
+    void destroyMeshPipelines();
+    void createUpscaleLayout();
+    void updateUpscaleDescriptor();
+    void updateRenderScale();
     void createCommandBuffers();
     void createSyncObjects();
     void initImgui();
@@ -94,6 +236,8 @@ private:
 
 public:
     VkGlfwOutput(GLFWwindow* window, VulkanEngine& engine);
+    // Headless, renders at the extent on any device with a graphics queue. The engine needs no instance extensions.
+    VkGlfwOutput(VkExtent2D extent, VulkanEngine& engine);
     ~VkGlfwOutput();
 
     void init();
@@ -111,8 +255,9 @@ public:
     bool isPresentFamily(const VkQueueFamilyProperties& prop, uint32_t idx, VkPhysicalDevice device); 
 
     View* newView();
-    void destroyView(View& v);
+    void destroyView(View* v);
 
+    // Windowed outputs only
     void beginImguiFrame();
     void endImguiFrame();
 };
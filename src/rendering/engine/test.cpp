@@ -1,4 +1,5 @@
 #include "VulkanEngine.hpp"
+#include <RoseJobs.hpp>
 #include <chrono>
 #include <thread>
 
@@ -7,6 +8,7 @@ const uint32_t HEIGHT = 600;
 
 int main() {
     initLogging();
+    initJobs();
 
     glfwInit();
 
@@ -37,6 +39,7 @@ int main() {
     while (!glfwWindowShouldClose(window))
     {
         windowOutput.draw();
+        engine.update();
         glfwPollEvents();
     }
 
@@ -45,6 +48,7 @@ int main() {
     windowOutput.destroy();
 
     engine.destroy();
+    shutdownJobs();
 
     return EXIT_SUCCESS;
 }
\ No newline at end of file
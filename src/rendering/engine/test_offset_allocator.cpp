@@ -0,0 +1,117 @@
+// Headless checks of OffsetAllocator, run by ctest
+#include "ve_offset_allocator.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    if (!(condition)) { \
+        std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    }
+
+static void testAllocate() {
+    OffsetAllocator allocator(1024);
+    CHECK(allocator.getSize() == 1024);
+    CHECK(allocator.getFree() == 1024);
+    CHECK(allocator.largestFree() == 1024);
+
+    auto a = allocator.allocate(100);
+    auto b = allocator.allocate(3);
+    auto c = allocator.allocate(200);
+    CHECK(a.offset == 0);
+    CHECK(b.offset == 100);
+    CHECK(c.offset == 103);
+    CHECK(allocator.getFree() == 1024 - 303);
+    CHECK(allocator.largestFree() == 1024 - 303);
+
+    // Nothing to hand out for an empty request
+    CHECK(allocator.allocate(0).offset == OffsetAllocator::NO_SPACE);
+}
+
+static void testFree() {
+    OffsetAllocator allocator(1024);
+    auto a = allocator.allocate(256);
+    auto b = allocator.allocate(256);
+    allocator.allocate(512);
+    CHECK(allocator.getFree() == 0);
+
+    // The freed range is handed out again
+    allocator.free(b.node);
+    CHECK(allocator.getFree() == 256);
+    auto d = allocator.allocate(256);
+    CHECK(d.offset == 256);
+
+    allocator.free(a.node);
+    auto e = allocator.allocate(100);
+    CHECK(e.offset == 0);
+    CHECK(allocator.getFree() == 156);
+}
+
+static void testMerge() {
+    OffsetAllocator allocator(1024);
+    auto a = allocator.allocate(256);
+    auto b = allocator.allocate(256);
+    auto c = allocator.allocate(256);
+    auto d = allocator.allocate(256);
+
+    // Freed out of order, the middle range joins both neighbours
+    allocator.free(a.node);
+    allocator.free(c.node);
+    CHECK(allocator.largestFree() == 256);
+    allocator.free(b.node);
+    CHECK(allocator.largestFree() == 768);
+
+    auto merged = allocator.allocate(768);
+    CHECK(merged.offset == 0);
+    CHECK(allocator.getFree() == 0);
+
+    allocator.free(merged.node);
+    allocator.free(d.node);
+    CHECK(allocator.getFree() == 1024);
+    CHECK(allocator.largestFree() == 1024);
+    CHECK(allocator.allocate(1024).offset == 0);
+}
+
+static void testOutOfSpace() {
+    OffsetAllocator allocator(1024);
+    CHECK(allocator.allocate(1025).offset == OffsetAllocator::NO_SPACE);
+
+    auto a = allocator.allocate(256);
+    allocator.allocate(256);
+    auto c = allocator.allocate(256);
+    allocator.allocate(256);
+    CHECK(allocator.allocate(1).offset == OffsetAllocator::NO_SPACE);
+
+    // Enough space in total, but not in one range
+    allocator.free(a.node);
+    allocator.free(c.node);
+    CHECK(allocator.getFree() == 512);
+    CHECK(allocator.allocate(512).offset == OffsetAllocator::NO_SPACE);
+    CHECK(allocator.allocate(256).offset != OffsetAllocator::NO_SPACE);
+
+    // An empty allocator has nothing to give
+    OffsetAllocator empty;
+    CHECK(empty.allocate(1).offset == OffsetAllocator::NO_SPACE);
+    CHECK(empty.largestFree() == 0);
+
+    // Reset forgets everything that was handed out
+    allocator.reset(2048);
+    CHECK(allocator.getFree() == 2048);
+    CHECK(allocator.allocate(2048).offset == 0);
+}
+
+int main() {
+    testAllocate();
+    testFree();
+    testMerge();
+    testOutOfSpace();
+
+    if (failures) {
+        std::printf("%d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,66 @@
+#include "ve_animation.hpp"
+
+#include <RoseMath.hpp>
+#include <algorithm>
+#include <cmath>
+
+int32_t Skeleton::find(const std::string& name) const {
+    for (size_t i = 0; i < names.size(); i++) {
+        if (names[i] == name) return (int32_t) i;
+    }
+    return NO_JOINT;
+}
+
+// Interpolated between the keys around the time, clamped to the first and last key
+template <typename T, typename Mix>
+static void sampleKeys(const std::vector<float>& times, const std::vector<T>& values, float time, T& out, Mix mix) {
+    if (values.empty()) return;
+
+    auto next = std::upper_bound(times.begin(), times.end(), time);
+    if (next == times.begin()) {
+        out = values.front();
+    } else if (next == times.end()) {
+        out = values.back();
+    } else {
+        size_t i = (size_t) (next - times.begin());
+        float span = times[i] - times[i - 1];
+        float t = span > 0.f ? (time - times[i - 1]) / span : 0.f;
+        out = mix(values[i - 1], values[i], t);
+    }
+}
+
+void samplePose(const Skeleton& skeleton, const AnimationClip* clip, float time, PoseScratch& scratch, glm::mat4* palette) {
+    uint32_t count = skeleton.size();
+    if (count == 0) return;
+
+    scratch.positions.assign(skeleton.bindPositions.begin(), skeleton.bindPositions.end());
+    scratch.rotations.assign(skeleton.bindRotations.begin(), skeleton.bindRotations.end());
+    scratch.scales.assign(skeleton.bindScales.begin(), skeleton.bindScales.end());
+    scratch.locals.resize(count);
+    scratch.globals.resize(count);
+
+    if (clip != nullptr) {
+        if (clip->duration > 0.f) {
+            time = std::fmod(time, clip->duration);
+            if (time < 0.f) time += clip->duration;
+        }
+
+        auto lerp = [] (const glm::vec3& a, const glm::vec3& b, float t) { return glm::mix(a, b, t); };
+        auto slerp = [] (const glm::quat& a, const glm::quat& b, float t) { return glm::slerp(a, b, t); };
+        for (auto& track : clip->tracks) {
+            sampleKeys(track.positionTimes, track.positions, time, scratch.positions[track.joint], lerp);
+            sampleKeys(track.rotationTimes, track.rotations, time, scratch.rotations[track.joint], slerp);
+            sampleKeys(track.scaleTimes, track.scales, time, scratch.scales[track.joint], lerp);
+        }
+    }
+
+    composeTransforms(&scratch.positions[0].x, &scratch.rotations[0].x, &scratch.scales[0].x, &scratch.locals[0][0][0], count);
+
+    // Parents come first, the mesh node's inverse goes in at the roots so it is part of every global
+    for (uint32_t i = 0; i < count; i++) {
+        int32_t parent = skeleton.parents[i];
+        scratch.globals[i] = (parent == NO_JOINT ? skeleton.meshInverse : scratch.globals[parent]) * scratch.locals[i];
+    }
+
+    mulMatrices(&scratch.globals[0][0][0], &skeleton.offsets[0][0][0], &palette[0][0][0], count);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+const int32_t NO_JOINT = -1;
+
+// Joints of a skinned mesh as parallel arrays, parents always before their children
+struct Skeleton {
+    std::vector<std::string> names;
+    std::vector<int32_t> parents; // NO_JOINT for roots
+
+    // Transform relative to the parent for joints no track animates
+    std::vector<glm::vec3> bindPositions;
+    std::vector<glm::quat> bindRotations;
+    std::vector<glm::vec3> bindScales;
+
+    // From mesh space into the joint's space in the bind pose, identity for joints no vertex follows
+    std::vector<glm::mat4> offsets;
+    // Bind pose mesh space sphere around the vertices each joint moves, negative radius for joints without any
+    std::vector<glm::vec4> bounds;
+
+    glm::mat4 meshInverse = glm::mat4(1.f); // Undoes the transform of the node the mesh hangs from
+
+    uint32_t size() const { return (uint32_t) parents.size(); }
+    int32_t find(const std::string& name) const;
+};
+
+// Keys of one joint, times in seconds and ascending. Kinds without keys keep the bind pose.
+struct JointTrack {
+    uint32_t joint = 0;
+    std::vector<float> positionTimes;
+    std::vector<glm::vec3> positions;
+    std::vector<float> rotationTimes;
+    std::vector<glm::quat> rotations;
+    std::vector<float> scaleTimes;
+    std::vector<glm::vec3> scales;
+};
+
+struct AnimationClip {
+    std::string name;
+    float duration = 0.f; // Seconds
+    std::vector<JointTrack> tracks;
+};
+
+// Scratch space of samplePose, reused between calls on the same thread
+struct PoseScratch {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+    std::vector<glm::mat4> locals;
+    std::vector<glm::mat4> globals;
+};
+
+// Skinning matrices of every joint at the time into the clip, looped, taking bind pose vertices to posed ones.
+// Without a clip the skeleton stays in its bind pose. palette has room for skeleton.size() matrices.
+void samplePose(const Skeleton& skeleton, const AnimationClip* clip, float time, PoseScratch& scratch, glm::mat4* palette);
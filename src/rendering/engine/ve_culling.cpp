@@ -0,0 +1,142 @@
+#include "ve_culling.hpp"
+
+#include <RoseJobs.hpp>
+#include <RoseMath.hpp>
+#include <algorithm>
+
+// The batch kernels read the transforms straight out of the render objects
+static_assert(sizeof(RenderObject) % sizeof(float) == 0, "RenderObject must be a whole number of floats apart");
+
+Frustum extractFrustum(const glm::mat4& viewProj) {
+    // Rows of the matrix, glm is column major
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; i++) {
+        row[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+    }
+
+    Frustum frustum;
+    frustum.planes[0] = row[3] + row[0]; // Left
+    frustum.planes[1] = row[3] - row[0]; // Right
+    frustum.planes[2] = row[3] + row[1]; // Bottom
+    frustum.planes[3] = row[3] - row[1]; // Top
+    frustum.planes[4] = row[2];          // Near
+    frustum.planes[5] = row[3] - row[2]; // Far
+
+    for (auto& plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+bool sphereInFrustum(const Frustum& frustum, const glm::vec4& sphere) {
+    glm::vec3 center = glm::vec3(sphere);
+    for (auto& plane : frustum.planes) {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -sphere.w) return false;
+    }
+    return true;
+}
+
+glm::vec4 transformSphere(const glm::mat4& transform, const glm::vec4& sphere) {
+    glm::vec3 center = glm::vec3(transform * glm::vec4(glm::vec3(sphere), 1.f));
+
+    float scale = std::max({
+        glm::length(glm::vec3(transform[0])),
+        glm::length(glm::vec3(transform[1])),
+        glm::length(glm::vec3(transform[2]))
+    });
+
+    return glm::vec4(center, sphere.w * scale);
+}
+
+glm::vec4 transformSphere(const AffineTransform& transform, const glm::vec4& sphere) {
+    glm::vec4 center = glm::vec4(glm::vec3(sphere), 1.f);
+
+    // Columns of the matrix are the rows' x, y and z
+    float scale = std::max({
+        glm::length(glm::vec3(transform.rows[0].x, transform.rows[1].x, transform.rows[2].x)),
+        glm::length(glm::vec3(transform.rows[0].y, transform.rows[1].y, transform.rows[2].y)),
+        glm::length(glm::vec3(transform.rows[0].z, transform.rows[1].z, transform.rows[2].z))
+    });
+
+    return glm::vec4(glm::dot(transform.rows[0], center), glm::dot(transform.rows[1], center), glm::dot(transform.rows[2], center), sphere.w * scale);
+}
+
+uint32_t findCullGroup(std::vector<CullGroup>& groups, const glm::mat4& viewProj) {
+    for (uint32_t i = 0; i < groups.size(); i++) {
+        if (groups[i].viewProj == viewProj) return i;
+    }
+
+    CullGroup group;
+    group.viewProj = viewProj;
+    group.frustum = extractFrustum(viewProj);
+    groups.push_back(group);
+    return (uint32_t) (groups.size() - 1);
+}
+
+// Objects per culling job, each job keeps its own visibility lists that are joined in object order afterwards
+#define CULL_BATCH 1024
+
+struct CullBatch {
+    std::vector<std::vector<uint32_t>> lists; // Visible objects per group
+    uint32_t sphereTests = 0;
+    uint32_t visible = 0;
+    uint32_t visibleUnbatched = 0;
+};
+
+void cullObjects(const std::vector<RenderObject>& objects, const SceneGraph& scene, const std::vector<Mesh>& meshes, std::vector<CullGroup>& groups, CullStats& stats, std::vector<glm::vec4>& worldSpheres) {
+    stats.objects = (uint32_t) objects.size();
+    stats.groups = (uint32_t) groups.size();
+    stats.sphereTests = 0;
+    stats.visible = 0;
+    stats.visibleUnbatched = 0;
+
+    for (auto& group : groups) {
+        group.visible.clear();
+    }
+    worldSpheres.resize(objects.size());
+
+    std::vector<CullBatch> batches((objects.size() + CULL_BATCH - 1) / CULL_BATCH);
+    getJobs().parallelFor((uint32_t) objects.size(), CULL_BATCH, [&] (uint32_t begin, uint32_t end) {
+        CullBatch& batch = batches[begin / CULL_BATCH];
+        batch.lists.resize(groups.size());
+        uint32_t count = end - begin;
+
+        // Batched objects are transformed and tested along with the rest, their results are ignored
+        std::vector<glm::vec4> localSpheres(count);
+        for (uint32_t i = begin; i < end; i++) {
+            localSpheres[i - begin] = meshes[objects[i].meshIndex].bounds;
+        }
+        transformSpheres(&objects[begin].transform[0][0], sizeof(RenderObject) / sizeof(float), &localSpheres[0].x, &worldSpheres[begin].x, count);
+        for (uint32_t i = begin; i < end; i++) {
+            if (const AffineTransform* world = scene.getObjectWorld(i)) {
+                worldSpheres[i] = transformSphere(*world, localSpheres[i - begin]);
+            }
+        }
+
+        std::vector<uint8_t> inside(count);
+        for (size_t g = 0; g < groups.size(); g++) {
+            spheresInPlanes(&worldSpheres[begin].x, count, &groups[g].frustum.planes[0].x, 6, inside.data());
+
+            for (uint32_t i = begin; i < end; i++) {
+                const RenderObject& object = objects[i];
+                if (object.batched) continue;
+
+                batch.sphereTests++;
+                if (inside[i - begin]) {
+                    batch.lists[g].push_back(i);
+                    batch.visible++;
+                    batch.visibleUnbatched += object.batchedObjects;
+                }
+            }
+        }
+    });
+
+    for (auto& batch : batches) {
+        for (size_t g = 0; g < groups.size(); g++) {
+            groups[g].visible.insert(groups[g].visible.end(), batch.lists[g].begin(), batch.lists[g].end());
+        }
+        stats.sphereTests += batch.sphereTests;
+        stats.visible += batch.visible;
+        stats.visibleUnbatched += batch.visibleUnbatched;
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+#include "ve_scene.hpp"
+#include "ve_scene_graph.hpp"
+#include "vk_mesh.hpp"
+
+// Planes point inwards, xyz normal and w distance
+struct Frustum {
+    glm::vec4 planes[6];
+};
+
+// Works for Vulkan's [0, 1] depth range, a flipped y axis does not change the planes
+Frustum extractFrustum(const glm::mat4& viewProj);
+bool sphereInFrustum(const Frustum& frustum, const glm::vec4& sphere);
+glm::vec4 transformSphere(const glm::mat4& transform, const glm::vec4& sphere);
+glm::vec4 transformSphere(const AffineTransform& transform, const glm::vec4& sphere);
+
+// Views with the same camera matrices share one group and its visibility list
+struct CullGroup {
+    glm::mat4 viewProj;
+    Frustum frustum;
+    std::vector<uint32_t> visible; // Indices into the object list
+};
+
+struct CullStats {
+    uint32_t objects = 0;
+    uint32_t views = 0;
+    uint32_t groups = 0;
+    uint32_t sphereTests = 0;
+    uint32_t visible = 0; // Summed over all groups
+    uint32_t visibleUnbatched = 0; // Visible objects had static batches not been merged, the draws saved by batching
+};
+
+// Returns the group for viewProj, creating it if no view with the same matrix was added this frame
+uint32_t findCullGroup(std::vector<CullGroup>& groups, const glm::mat4& viewProj);
+
+// World space bounds are computed once, tested against every group and kept in worldSpheres for later passes.
+// Runs as jobs over batches of objects through the RoseMath batch kernels, the visibility lists keep the object order.
+// Objects merged into a static batch are skipped, the batch stands in for them. Objects a node of the scene graph
+// places are bounded by the node's world.
+void cullObjects(const std::vector<RenderObject>& objects, const SceneGraph& scene, const std::vector<Mesh>& meshes, std::vector<CullGroup>& groups, CullStats& stats, std::vector<glm::vec4>& worldSpheres);
@@ -0,0 +1,39 @@
+#include "ve_deletion.hpp"
+
+void DeletionQueue::push(std::function<void()> destroy, std::vector<TimelinePoint> waits, uint32_t frame)
+{
+    pending.push_back({std::move(waits), std::move(destroy), frame});
+}
+
+size_t DeletionQueue::collect()
+{
+    size_t count = 0;
+    while (!pending.empty())
+    {
+        auto& front = pending.front();
+
+        for (auto& [timeline, value] : front.waits)
+        {
+            if (!timeline->isComplete(value)) return count;
+        }
+
+        front.destroy();
+        pending.pop_front();
+        count++;
+    }
+    return count;
+}
+
+void DeletionQueue::flush()
+{
+    while (!pending.empty())
+    {
+        pending.front().destroy();
+        pending.pop_front();
+    }
+}
+
+size_t DeletionQueue::size() const
+{
+    return pending.size();
+}
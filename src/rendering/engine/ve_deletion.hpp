@@ -0,0 +1,36 @@
+#pragma once
+
+#include <functional>
+#include <deque>
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+#include "vk_timeline.hpp"
+
+// Timeline value a retired resource may still be referenced by
+typedef std::pair<GpuTimeline*, uint64_t> TimelinePoint;
+
+struct RetiredResource {
+    std::vector<TimelinePoint> waits;
+    std::function<void()> destroy;
+    uint32_t frame; // Engine frame the resource was retired in
+};
+
+// Destroys resources once every queue has passed the work that was submitted before they were retired.
+// Entries are pushed with non-decreasing timeline values, so collection can stop at the first pending entry.
+class DeletionQueue {
+public:
+    void push(std::function<void()> destroy, std::vector<TimelinePoint> waits, uint32_t frame);
+
+    // Runs the callbacks of all entries the GPU is done with, returns how many ran
+    size_t collect();
+
+    // Runs every callback, only valid once the device is idle
+    void flush();
+
+    size_t size() const;
+
+private:
+    std::deque<RetiredResource> pending;
+};
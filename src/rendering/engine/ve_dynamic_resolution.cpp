@@ -0,0 +1,54 @@
+#include "ve_dynamic_resolution.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+static VkExtent2D scaleExtent(VkExtent2D extent, float scale) {
+    return {
+        std::max((uint32_t) std::ceil(extent.width * scale), 1u),
+        std::max((uint32_t) std::ceil(extent.height * scale), 1u),
+    };
+}
+
+// GPU time grows roughly with the pixel count, so each sample is turned into the time of a full resolution frame
+// using the scale it was rendered at, and the scale is chosen from that. Samples arrive frames late, deriving the
+// scale from the current one instead would apply the same correction again with every stale sample.
+// Small corrections are ignored, every change invalidates temporal data such as the occlusion pyramid.
+bool DynamicResolution::update(float frameTime, float renderedScale) {
+    if (frameTime <= 0.f || renderedScale <= 0.f) return false;
+
+    smoothedFrameTime = smoothedFrameTime > 0.f ? smoothedFrameTime * 0.9f + frameTime * 0.1f : frameTime;
+
+    if (settling > 0) {
+        settling--;
+        return false;
+    }
+
+    float fullCost = frameTime / (renderedScale * renderedScale);
+    smoothedFullCost = smoothedFullCost > 0.f ? smoothedFullCost * 0.9f + fullCost * 0.1f : fullCost;
+
+    float desired = std::sqrt(targetFrameTime / smoothedFullCost);
+    desired = std::clamp(desired, minScale, std::max(minScale, maxScale));
+
+    if (std::abs(desired - scale) < 0.025f && desired != minScale && desired != maxScale) return false;
+    if (desired == scale) return false;
+
+    scale = desired;
+    settling = settleFrames;
+    return true;
+}
+
+void DynamicResolution::reset() {
+    scale = std::clamp(1.f, minScale, std::max(minScale, maxScale));
+    smoothedFrameTime = 0.f;
+    smoothedFullCost = 0.f;
+    settling = 0;
+}
+
+VkExtent2D DynamicResolution::renderExtent(VkExtent2D output) const {
+    return scaleExtent(output, scale);
+}
+
+VkExtent2D DynamicResolution::targetExtent(VkExtent2D output) const {
+    return scaleExtent(output, std::max(minScale, maxScale));
+}
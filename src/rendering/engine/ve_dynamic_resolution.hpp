@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+
+// Picks the fraction of the output resolution the scene renders at from measured GPU frame times.
+// The scene target is allocated for maxScale, lower scales render into a part of it.
+class DynamicResolution {
+public:
+    float targetFrameTime = 1000.f / 60.f; // Milliseconds
+    float minScale = 0.5f;
+    float maxScale = 1.f;
+
+    // The frame time was measured for a frame rendered at renderedScale, returns true if the scale changed
+    bool update(float frameTime, float renderedScale);
+    void reset();
+    // Samples ignored after a change are those of the frames already in flight when it happened
+    void setFramesInFlight(uint32_t frames) { settleFrames = frames; }
+
+    float getScale() const { return scale; }
+    float getFrameTime() const { return smoothedFrameTime; }
+
+    // Size of the rendered region and of the target backing every scale up to maxScale
+    VkExtent2D renderExtent(VkExtent2D output) const;
+    VkExtent2D targetExtent(VkExtent2D output) const;
+
+private:
+    float scale = 1.f;
+    uint32_t settleFrames = 3;
+    float smoothedFrameTime = 0.f;
+    float smoothedFullCost = 0.f; // Frame time estimated for the full output resolution
+    uint32_t settling = 0;
+};
@@ -0,0 +1,67 @@
+#include "ve_frame_timer.hpp"
+#include "vk_engine.hpp"
+
+GpuFrameTimer::GpuFrameTimer(VulkanEngine& engine, uint32_t queueFamily, uint32_t framesInFlight) : engine(engine) {
+    pending.assign(framesInFlight, false);
+
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(engine.physicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(engine.physicalDevice, &familyCount, families.data());
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(engine.physicalDevice, &properties);
+
+    uint32_t validBits = queueFamily < familyCount ? families[queueFamily].timestampValidBits : 0;
+    supported = validBits > 0 && properties.limits.timestampPeriod > 0.f;
+    if (!supported) {
+        engine.vkLogger->info("Queue family {} has no timestamp support, GPU frame times are unavailable", queueFamily);
+        return;
+    }
+
+    period = properties.limits.timestampPeriod;
+    validMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    VkQueryPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = 2 * framesInFlight;
+    check_vk_result(vkCreateQueryPool(engine.device, &poolInfo, nullptr, &pool));
+}
+
+void GpuFrameTimer::destroy() {
+    if (pool == VK_NULL_HANDLE) return;
+
+    VkDevice device = engine.device;
+    VkQueryPool queryPool = pool;
+    engine.retire([=] () { vkDestroyQueryPool(device, queryPool, nullptr); });
+    pool = VK_NULL_HANDLE;
+}
+
+void GpuFrameTimer::begin(VkCommandBuffer cmd, uint32_t frame) {
+    if (!supported) return;
+
+    vkCmdResetQueryPool(cmd, pool, 2 * frame, 2);
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, pool, 2 * frame);
+}
+
+void GpuFrameTimer::end(VkCommandBuffer cmd, uint32_t frame) {
+    if (!supported) return;
+
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pool, 2 * frame + 1);
+    pending[frame] = true;
+}
+
+bool GpuFrameTimer::read(uint32_t frame, float& milliseconds) {
+    if (!supported || !pending[frame]) return false;
+    pending[frame] = false;
+
+    uint64_t timestamps[2];
+    VkResult result = vkGetQueryPoolResults(engine.device, pool, 2 * frame, 2, sizeof(timestamps), timestamps,
+        sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS) return false;
+
+    uint64_t ticks = ((timestamps[1] & validMask) - (timestamps[0] & validMask)) & validMask;
+    milliseconds = (float) (ticks * (double) period / 1e6);
+    return true;
+}
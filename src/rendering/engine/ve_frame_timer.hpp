@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <cstdint>
+
+class VulkanEngine;
+
+// GPU time between two points of a frame's command buffer, measured with timestamp queries. One query pair
+// per frame in flight, results are read once the frame's slot is reused.
+class GpuFrameTimer {
+public:
+    GpuFrameTimer(VulkanEngine& engine, uint32_t queueFamily, uint32_t framesInFlight);
+    void destroy();
+
+    // False if the queue family has no timestamp support, begin / end then record nothing
+    bool isSupported() const { return supported; }
+
+    // Outside of render passes
+    void begin(VkCommandBuffer cmd, uint32_t frame);
+    void end(VkCommandBuffer cmd, uint32_t frame);
+
+    // The frame's slot must not be in use by the GPU anymore, false if it holds no finished measurement
+    bool read(uint32_t frame, float& milliseconds);
+
+private:
+    VulkanEngine& engine;
+    bool supported = false;
+    float period = 1.f;     // Nanoseconds per tick
+    uint64_t validMask = 0; // Bits of a timestamp the queue writes
+    VkQueryPool pool = VK_NULL_HANDLE;
+    std::vector<bool> pending;
+};
@@ -0,0 +1,205 @@
+#include "ve_geometry.hpp"
+#include "vk_engine.hpp"
+
+#include <algorithm>
+
+GeometryPool::GeometryPool(VulkanEngine& engine) : engine(engine) {
+    VkDescriptorSetLayoutBinding binding = {};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &binding;
+    check_vk_result(vkCreateDescriptorSetLayout(engine.device, &layoutInfo, nullptr, &setLayout));
+
+    createBuffers(INITIAL_VERTICES, INITIAL_INDICES);
+}
+
+void GeometryPool::destroy() {
+    retireBuffers();
+
+    VulkanEngine* eng = &engine;
+    VkDescriptorSetLayout layout = setLayout;
+    engine.retire([=] () {
+        vkDestroyDescriptorSetLayout(eng->device, layout, nullptr);
+    });
+}
+
+// Frames in flight keep drawing from the old buffers until they are retired
+void GeometryPool::retireBuffers() {
+    if (vertexBuffer.buffer == VK_NULL_HANDLE) return;
+
+    VulkanEngine* eng = &engine;
+    AllocatedBuffer buffers[3] = {vertexBuffer, indexBuffer, packedBuffer};
+    VkDescriptorSet oldSet = set;
+    engine.retire([=] () mutable {
+        vkFreeDescriptorSets(eng->device, eng->descriptorPool, 1, &oldSet);
+        for (auto& buffer : buffers) eng->destroyBuffer(buffer);
+    });
+
+    vertexBuffer = AllocatedBuffer{VK_NULL_HANDLE, VK_NULL_HANDLE};
+    indexBuffer = AllocatedBuffer{VK_NULL_HANDLE, VK_NULL_HANDLE};
+    packedBuffer = AllocatedBuffer{VK_NULL_HANDLE, VK_NULL_HANDLE};
+    set = VK_NULL_HANDLE;
+}
+
+void GeometryPool::createBuffers(uint32_t vertexCapacity, uint32_t indexCapacity) {
+    retireBuffers();
+
+    // Compute passes such as skinning read and write the vertices in place
+    vertexBuffer = engine.createBuffer((VkDeviceSize) vertexCapacity * sizeof(Vertex), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY, "Geometry");
+    indexBuffer = engine.createBuffer((VkDeviceSize) indexCapacity * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY, "Geometry");
+    packedBuffer = engine.createBuffer((VkDeviceSize) vertexCapacity * sizeof(PackedVertex), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY, "Geometry");
+    vertexSpace.reset(vertexCapacity);
+    indexSpace.reset(indexCapacity);
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = engine.descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &setLayout;
+    check_vk_result(vkAllocateDescriptorSets(engine.device, &allocInfo, &set));
+
+    VkDescriptorBufferInfo bufferInfo = {packedBuffer.buffer, 0, VK_WHOLE_SIZE};
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = set;
+    write.dstBinding = 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pBufferInfo = &bufferInfo;
+    vkUpdateDescriptorSets(engine.device, 1, &write, 0, nullptr);
+
+    engine.vkLogger->debug("Geometry buffers for {} vertices and {} indices", vertexCapacity, indexCapacity);
+}
+
+bool GeometryPool::place(Mesh& mesh, uint32_t slot) {
+    uint32_t vertexCount = (uint32_t) mesh.vertices.size();
+    uint32_t indexCount = (uint32_t) mesh.indices.size();
+
+    OffsetAllocator::Allocation vertices = vertexSpace.allocate(vertexCount);
+    if (vertices.offset == OffsetAllocator::NO_SPACE) return false;
+    OffsetAllocator::Allocation indices = indexSpace.allocate(indexCount);
+    if (indices.offset == OffsetAllocator::NO_SPACE) {
+        vertexSpace.free(vertices.node);
+        return false;
+    }
+
+    Slot& s = slots[slot];
+    s.range.vertexOffset = vertices.offset;
+    s.range.vertexCount = vertexCount;
+    s.range.firstIndex = indices.offset;
+    s.range.indexCount = indexCount;
+    s.vertexNode = vertices.node;
+    s.indexNode = indices.node;
+
+    // Vertices are also read and written by compute passes, the uploads have to finish before those too
+    const VkPipelineStageFlags computeStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    const VkAccessFlags computeAccess = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    engine.transfer->uploadBuffer(mesh.vertices.data(), (VkDeviceSize) vertexCount * sizeof(Vertex), vertexBuffer.buffer,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | computeStage, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | computeAccess, (VkDeviceSize) vertices.offset * sizeof(Vertex));
+    engine.transfer->uploadBuffer(mesh.indices.data(), (VkDeviceSize) indexCount * sizeof(uint32_t), indexBuffer.buffer,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT, (VkDeviceSize) indices.offset * sizeof(uint32_t));
+
+    std::vector<PackedVertex> packed(vertexCount);
+    for (uint32_t i = 0; i < vertexCount; i++) {
+        packed[i] = PackedVertex::pack(mesh.vertices[i]);
+    }
+    engine.transfer->uploadBuffer(packed.data(), (VkDeviceSize) vertexCount * sizeof(PackedVertex), packedBuffer.buffer,
+        VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | computeStage, computeAccess, (VkDeviceSize) vertices.offset * sizeof(PackedVertex));
+    return true;
+}
+
+void GeometryPool::add(Mesh& mesh) {
+    if (mesh.vertices.empty() || mesh.indices.empty()) {
+        throw std::runtime_error("failed to add mesh without geometry!");
+    }
+
+    uint32_t slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        slots.emplace_back();
+        slot = (uint32_t) (slots.size() - 1);
+    }
+    mesh.geometry = slot;
+
+    if (!place(mesh, slot)) {
+        // The mesh is already registered with the engine, so the repack places it along with all others
+        uint32_t vertexCapacity = std::max(vertexSpace.getSize() * 2, stats.usedVertices + (uint32_t) mesh.vertices.size());
+        uint32_t indexCapacity = std::max(indexSpace.getSize() * 2, stats.usedIndices + (uint32_t) mesh.indices.size());
+        defragment(vertexCapacity, indexCapacity);
+    }
+    updateStats();
+}
+
+void GeometryPool::remove(Mesh& mesh) {
+    if (mesh.geometry == NO_GEOMETRY) return;
+
+    Slot& slot = slots[mesh.geometry];
+    uint32_t vertexNode = slot.vertexNode;
+    uint32_t indexNode = slot.indexNode;
+    uint32_t freedGeneration = generation;
+    engine.retire([this, vertexNode, indexNode, freedGeneration] () {
+        if (freedGeneration != generation) return;
+        vertexSpace.free(vertexNode);
+        indexSpace.free(indexNode);
+        removed = true;
+    });
+
+    slot = Slot();
+    freeSlots.push_back(mesh.geometry);
+    mesh.geometry = NO_GEOMETRY;
+}
+
+// Freed ranges only return once retired, so this looks at the space after the frees that happened since the last call
+void GeometryPool::update() {
+    if (!removed && !defragmentRequested) return;
+
+    updateStats();
+    if (defragmentRequested || stats.fragmentation > defragmentThreshold) {
+        defragment(vertexSpace.getSize(), indexSpace.getSize());
+    }
+    removed = false;
+    defragmentRequested = false;
+}
+
+// The engine's meshes are the only ones with geometry here, anything else called remove() already
+void GeometryPool::defragment(uint32_t vertexCapacity, uint32_t indexCapacity) {
+    generation++;
+    createBuffers(vertexCapacity, indexCapacity);
+
+    for (auto& mesh : engine.meshes) {
+        if (mesh.geometry == NO_GEOMETRY) continue;
+        if (!place(mesh, mesh.geometry)) {
+            throw std::runtime_error("failed to repack mesh geometry!");
+        }
+    }
+
+    stats.defragmentations++;
+    updateStats();
+}
+
+void GeometryPool::bind(VkCommandBuffer cmd, VkPipelineLayout layout, uint32_t setIndex) {
+    VkDeviceSize offsets[] = {0};
+    vkCmdBindVertexBuffers(cmd, 0, 1, &vertexBuffer.buffer, offsets);
+    vkCmdBindIndexBuffer(cmd, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, setIndex, 1, &set, 0, nullptr);
+}
+
+void GeometryPool::updateStats() {
+    stats.meshes = (uint32_t) (slots.size() - freeSlots.size());
+    stats.vertexCapacity = vertexSpace.getSize();
+    stats.indexCapacity = indexSpace.getSize();
+    stats.usedVertices = vertexSpace.getSize() - vertexSpace.getFree();
+    stats.usedIndices = indexSpace.getSize() - indexSpace.getFree();
+    stats.bytes = (VkDeviceSize) stats.vertexCapacity * (sizeof(Vertex) + sizeof(PackedVertex)) + (VkDeviceSize) stats.indexCapacity * sizeof(uint32_t);
+
+    uint32_t freeVertices = vertexSpace.getFree();
+    stats.fragmentation = freeVertices == 0 ? 0.f : 1.f - (float) vertexSpace.largestFree() / (float) freeVertices;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <cstdint>
+
+#include "ve_types.hpp"
+#include "ve_offset_allocator.hpp"
+#include "vk_mesh.hpp"
+
+class VulkanEngine;
+
+// Where a mesh lives in the shared buffers, in vertices and indices
+struct GeometryRange {
+    uint32_t vertexOffset = 0;
+    uint32_t vertexCount = 0;
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+};
+
+struct GeometryStats {
+    uint32_t meshes = 0;
+    uint32_t vertexCapacity = 0;
+    uint32_t indexCapacity = 0;
+    uint32_t usedVertices = 0;
+    uint32_t usedIndices = 0;
+    VkDeviceSize bytes = 0; // Of all buffers, the packed vertex copy included
+    float fragmentation = 0.f;   // Share of the free vertex space outside the largest free range
+    uint32_t defragmentations = 0; // Since the start, growing counts as one
+};
+
+// All mesh geometry lives in one vertex and one index buffer, meshes are ranges handed out by offset
+// allocators. Every draw of a frame uses the same two bindings and selects its mesh with firstIndex and
+// vertexOffset. Ranges of removed meshes are reused once the frames in flight are done with them.
+// Growing and defragmenting repack every live mesh into new buffers from the copy each mesh keeps on the CPU,
+// through the regular staging uploads, the old buffers are retired.
+// Every vertex is also stored compressed in a storage buffer at the same index, for vertex shaders that
+// fetch their input by gl_VertexIndex instead of going through vertex input bindings.
+class GeometryPool {
+public:
+    static const uint32_t INITIAL_VERTICES = 1 << 20;
+    static const uint32_t INITIAL_INDICES = 3 << 20;
+
+    GeometryPool(VulkanEngine& engine);
+    void destroy();
+
+    // Uploads the mesh's vertices and indices and sets mesh.geometry, grows the buffers when out of space
+    void add(Mesh& mesh);
+    void remove(Mesh& mesh);
+    const GeometryRange& get(uint32_t geometry) const { return slots[geometry].range; }
+
+    // Defragments when requested or when the free space is split up more than defragmentThreshold after removals.
+    // Runs before the frame's transfer flush, like every change here the repack is drawn from the next frame on.
+    void update();
+    void requestDefragment() { defragmentRequested = true; }
+    // Repacks all meshes of the engine to the front of new buffers of at least the given capacities
+    void defragment(uint32_t vertexCapacity, uint32_t indexCapacity);
+
+    // Set with the packed vertices at binding 0, for pipelines that pull their vertices
+    VkDescriptorSetLayout getSetLayout() const { return setLayout; }
+
+    // Vertex binding 0, the index buffer and the packed vertex set, once per command buffer
+    void bind(VkCommandBuffer cmd, VkPipelineLayout layout, uint32_t setIndex);
+
+    // Replaced when growing or defragmenting, users holding descriptors compare them every frame
+    VkBuffer getVertexBuffer() const { return vertexBuffer.buffer; }
+    VkBuffer getPackedBuffer() const { return packedBuffer.buffer; }
+
+    float defragmentThreshold = 0.5f;
+    GeometryStats stats;
+
+private:
+    struct Slot {
+        GeometryRange range;
+        uint32_t vertexNode = OffsetAllocator::NO_SPACE;
+        uint32_t indexNode = OffsetAllocator::NO_SPACE;
+    };
+
+    VulkanEngine& engine;
+    AllocatedBuffer vertexBuffer = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+    AllocatedBuffer indexBuffer = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+    AllocatedBuffer packedBuffer = {VK_NULL_HANDLE, VK_NULL_HANDLE}; // PackedVertex at the same indices
+    VkDescriptorSetLayout setLayout;
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    OffsetAllocator vertexSpace;
+    OffsetAllocator indexSpace;
+
+    std::vector<Slot> slots; // By mesh.geometry
+    std::vector<uint32_t> freeSlots;
+    uint32_t generation = 0; // Frees retired before a repack refer to the old buffers and are dropped
+    bool removed = false; // Ranges were freed since the last update
+    bool defragmentRequested = false;
+
+    bool place(Mesh& mesh, uint32_t slot);
+    void createBuffers(uint32_t vertexCapacity, uint32_t indexCapacity);
+    void retireBuffers();
+    void updateStats();
+};
@@ -0,0 +1,304 @@
+#include "ve_lighting.hpp"
+#include "vk_engine.hpp"
+#include "ve_pipeline.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// std430 layout of light_cull.comp and lit_mesh.frag
+struct GpuLight {
+    glm::vec4 positionRange;  // xyz, w = range
+    glm::vec4 colorIntensity; // rgb premultiplied by the intensity
+    glm::vec4 directionCos;   // xyz, w = cosine of the outer angle
+    glm::vec4 spot;           // x = cosine of the inner angle, y = type
+};
+
+// std140 layout of the ClusterView uniform
+struct GpuClusterView {
+    glm::mat4 view;
+    glm::mat4 invProjection;
+    glm::vec4 viewport; // Pixels within the render target, x, y, width, height
+    glm::vec4 depth;    // Near, far, slice scale and bias for log(view depth)
+    glm::vec4 ambient;
+};
+
+struct LightCullConstants {
+    uint32_t lightCount;
+};
+
+static VkDeviceSize alignUp(VkDeviceSize size, VkDeviceSize alignment) {
+    return alignment > 0 ? (size + alignment - 1) / alignment * alignment : size;
+}
+
+ClusteredLighting::ClusteredLighting(VulkanEngine& engine, uint32_t framesInFlight) : engine(engine) {
+    frames.resize(framesInFlight);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(engine.physicalDevice, &properties);
+    viewStride = alignUp(sizeof(GpuClusterView), properties.limits.minUniformBufferOffsetAlignment);
+    clusterStride = alignUp(CLUSTER_COUNT * (1 + MAX_LIGHTS_PER_CLUSTER) * sizeof(uint32_t), properties.limits.minStorageBufferOffsetAlignment);
+
+    clusters = engine.createBuffer(MAX_VIEWS * clusterStride, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY, "Lighting");
+    engine.vkLogger->debug("Light clusters for {} views: {:.1f} MiB", MAX_VIEWS, (MAX_VIEWS * clusterStride) / (1024.0 * 1024.0));
+
+    createPipeline();
+}
+
+void ClusteredLighting::createPipeline() {
+    VkDescriptorType types[4] = {
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         // Lights
+        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, // View, offset per view
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, // Clusters, offset per view
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         // Counters
+    };
+
+    VkDescriptorSetLayoutBinding bindings[4] = {};
+    for (uint32_t i = 0; i < 4; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = types[i];
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | (i < 3 ? VK_SHADER_STAGE_FRAGMENT_BIT : 0);
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 4;
+    layoutInfo.pBindings = bindings;
+    check_vk_result(vkCreateDescriptorSetLayout(engine.device, &layoutInfo, nullptr, &setLayout));
+
+    VkPushConstantRange range = {};
+    range.offset = 0;
+    range.size = sizeof(LightCullConstants);
+    range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &range;
+
+    if (vkCreatePipelineLayout(engine.device, &pipelineLayoutInfo, nullptr, &cullLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+
+    VkShaderModule shader = loadCompiledShader("../shaders/light_cull.comp.spv", engine.device);
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = shaderStageInfo(shader, VK_SHADER_STAGE_COMPUTE_BIT);
+    pipelineInfo.layout = cullLayout;
+
+    if (vkCreateComputePipelines(engine.device, engine.pipelineCache, 1, &pipelineInfo, nullptr, &cullPipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create light cull pipeline!");
+    }
+
+    vkDestroyShaderModule(engine.device, shader, nullptr);
+}
+
+void ClusteredLighting::destroy() {
+    VulkanEngine* eng = &engine;
+
+    for (auto& data : frames) {
+        VkDescriptorSet set = data.set;
+        AllocatedBuffer lightsBuffer = data.lights;
+        AllocatedBuffer views = data.views;
+        AllocatedBuffer counters = data.counters;
+        engine.retire([=] () mutable {
+            if (set != VK_NULL_HANDLE) vkFreeDescriptorSets(eng->device, eng->descriptorPool, 1, &set);
+            if (lightsBuffer.buffer != VK_NULL_HANDLE) {
+                vmaUnmapMemory(eng->allocator, lightsBuffer.allocation);
+                eng->destroyBuffer(lightsBuffer);
+            }
+            if (views.buffer != VK_NULL_HANDLE) {
+                vmaUnmapMemory(eng->allocator, views.allocation);
+                eng->destroyBuffer(views);
+                vmaUnmapMemory(eng->allocator, counters.allocation);
+                eng->destroyBuffer(counters);
+            }
+        });
+    }
+    frames.clear();
+
+    AllocatedBuffer clusterBuffer = clusters;
+    VkDevice device = engine.device;
+    VkDescriptorSetLayout layout = setLayout;
+    VkPipelineLayout pipelineLayout = cullLayout;
+    VkPipeline pipeline = cullPipeline;
+    engine.retire([=] () mutable {
+        eng->destroyBuffer(clusterBuffer);
+        vkDestroyPipeline(device, pipeline, nullptr);
+        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, layout, nullptr);
+    });
+}
+
+void ClusteredLighting::beginFrame(uint32_t frameIdx) {
+    frame = frameIdx;
+    viewCount = 0;
+
+    FrameData& data = frames[frame];
+    if (data.views.buffer == VK_NULL_HANDLE) {
+        data.views = engine.createBuffer(MAX_VIEWS * viewStride, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, "Lighting");
+        check_vk_result(vmaMapMemory(engine.allocator, data.views.allocation, &data.mappedViews));
+
+        data.counters = engine.createBuffer(4 * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU, "Lighting");
+        void* mapped;
+        check_vk_result(vmaMapMemory(engine.allocator, data.counters.allocation, &mapped));
+        data.mappedCounters = (uint32_t*) mapped;
+    }
+
+    if (data.pending) {
+        vmaInvalidateAllocation(engine.allocator, data.counters.allocation, 0, VK_WHOLE_SIZE);
+        stats.activeClusters = data.mappedCounters[0];
+        stats.lightAssignments = data.mappedCounters[1];
+        stats.maxLightsPerCluster = data.mappedCounters[2];
+        stats.overflows = data.mappedCounters[3];
+        stats.lights = data.lightCount;
+        stats.views = data.viewCount;
+        stats.clusters = data.viewCount * CLUSTER_COUNT;
+        data.pending = false;
+    }
+}
+
+// Cluster depth slices are spaced exponentially between the view's near and far plane
+uint32_t ClusteredLighting::addView(const glm::mat4& view, const glm::mat4& projection, const VkRect2D& rect, float nearPlane, float farPlane) {
+    if (viewCount >= MAX_VIEWS) return UINT32_MAX;
+
+    float logRatio = std::log(farPlane / nearPlane);
+
+    GpuClusterView gpuView;
+    gpuView.view = view;
+    gpuView.invProjection = glm::inverse(projection);
+    gpuView.viewport = glm::vec4((float) rect.offset.x, (float) rect.offset.y, (float) rect.extent.width, (float) rect.extent.height);
+    gpuView.depth = glm::vec4(nearPlane, farPlane, GRID_Z / logRatio, -(float) GRID_Z * std::log(nearPlane) / logRatio);
+    gpuView.ambient = glm::vec4(ambient, 0.f);
+
+    FrameData& data = frames[frame];
+    memcpy((char*) data.mappedViews + viewCount * viewStride, &gpuView, sizeof(GpuClusterView));
+    return viewCount++;
+}
+
+void ClusteredLighting::growFrame(FrameData& data, uint32_t count) {
+    if (count <= data.capacity && data.lights.buffer != VK_NULL_HANDLE) return;
+
+    uint32_t capacity = std::max(count, std::max(data.capacity * 2, 64u));
+    data.mappedLights = engine.growMappedBuffer(data.lights, capacity * sizeof(GpuLight), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, "Lighting");
+    data.capacity = capacity;
+    data.dirty = true;
+}
+
+void ClusteredLighting::writeSet(FrameData& data) {
+    if (data.set == VK_NULL_HANDLE) {
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = engine.descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &setLayout;
+        check_vk_result(vkAllocateDescriptorSets(engine.device, &allocInfo, &data.set));
+    }
+
+    // Dynamic bindings cover one view, the offset selects it
+    VkDescriptorBufferInfo bufferInfos[4] = {
+        {data.lights.buffer, 0, VK_WHOLE_SIZE},
+        {data.views.buffer, 0, sizeof(GpuClusterView)},
+        {clusters.buffer, 0, CLUSTER_COUNT * (1 + MAX_LIGHTS_PER_CLUSTER) * sizeof(uint32_t)},
+        {data.counters.buffer, 0, VK_WHOLE_SIZE},
+    };
+    VkDescriptorType types[4] = {
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    };
+
+    VkWriteDescriptorSet writes[4] = {};
+    for (uint32_t i = 0; i < 4; i++) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = data.set;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = types[i];
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets(engine.device, 4, writes, 0, nullptr);
+    data.dirty = false;
+}
+
+void ClusteredLighting::addCullPass(RenderGraph& graph) {
+    RGBufferDesc clustersDesc;
+    clustersResource = graph.importBuffer("LightClusters", clustersDesc);
+
+    graph.addPass("light_cull", RGPassType::Compute)
+        .write(clustersResource, RGAccess::StorageBufferWrite)
+        .execute([this] (VkCommandBuffer cmd, const RGPassContext& context) { recordCull(cmd); });
+}
+
+void ClusteredLighting::readForDraw(RGPassBuilder& pass) {
+    pass.read(clustersResource, RGAccess::StorageBufferReadGraphics);
+}
+
+void ClusteredLighting::bindFrame(RenderGraph& graph) {
+    FrameData& data = frames[frame];
+
+    growFrame(data, (uint32_t) lights.size());
+    GpuLight* gpuLights = (GpuLight*) data.mappedLights;
+    for (size_t i = 0; i < lights.size(); i++) {
+        const Light& light = lights[i];
+        gpuLights[i].positionRange = glm::vec4(light.position, light.range);
+        gpuLights[i].colorIntensity = glm::vec4(light.color * light.intensity, 0.f);
+        gpuLights[i].directionCos = glm::vec4(glm::normalize(light.direction), std::cos(light.outerAngle));
+        gpuLights[i].spot = glm::vec4(std::cos(std::min(light.innerAngle, light.outerAngle)), (float) light.type, 0.f, 0.f);
+    }
+    if (!lights.empty()) vmaFlushAllocation(engine.allocator, data.lights.allocation, 0, lights.size() * sizeof(GpuLight));
+    if (viewCount > 0) vmaFlushAllocation(engine.allocator, data.views.allocation, 0, viewCount * viewStride);
+    if (data.dirty) writeSet(data);
+
+    data.lightCount = (uint32_t) lights.size();
+    data.viewCount = viewCount;
+    data.pending = true;
+
+    graph.setBuffer(clustersResource, clusters.buffer);
+}
+
+void ClusteredLighting::recordCull(VkCommandBuffer cmd) {
+    FrameData& data = frames[frame];
+
+    vkCmdFillBuffer(cmd, data.counters.buffer, 0, VK_WHOLE_SIZE, 0);
+
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = data.counters.buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    LightCullConstants constants = {data.lightCount};
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+    vkCmdPushConstants(cmd, cullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(LightCullConstants), &constants);
+
+    // Views write disjoint regions of the cluster buffer, no barriers between them
+    for (uint32_t view = 0; view < data.viewCount; view++) {
+        uint32_t offsets[2] = {(uint32_t) (view * viewStride), (uint32_t) (view * clusterStride)};
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cullLayout, 0, 1, &data.set, 2, offsets);
+        vkCmdDispatch(cmd, (CLUSTER_COUNT + 63) / 64, 1, 1);
+    }
+
+    // Counters are read on the host in beginFrame, once the frame's timeline value is reached
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+void ClusteredLighting::bindView(VkCommandBuffer cmd, VkPipelineLayout layout, uint32_t slot) {
+    // Views beyond MAX_VIEWS share the last slot's clusters
+    slot = std::min(slot, MAX_VIEWS - 1);
+    uint32_t offsets[2] = {(uint32_t) (slot * viewStride), (uint32_t) (slot * clusterStride)};
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &frames[frame].set, 2, offsets);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+#include "ve_types.hpp"
+#include "ve_render_graph.hpp"
+
+class VulkanEngine;
+
+enum class LightType : uint32_t {
+    Point = 0,
+    Spot = 1,
+};
+
+struct Light {
+    LightType type = LightType::Point;
+    glm::vec3 position = glm::vec3(0.f);
+    glm::vec3 color = glm::vec3(1.f);
+    float intensity = 1.f;
+    float range = 10.f;                              // Attenuation reaches zero here
+    glm::vec3 direction = glm::vec3(0.f, -1.f, 0.f); // Spot lights only
+    float innerAngle = glm::radians(20.f);           // Half angles of the spot cone, radians
+    float outerAngle = glm::radians(30.f);
+};
+
+struct LightingStats {
+    uint32_t lights = 0;
+    uint32_t views = 0;
+    uint32_t clusters = 0;            // Of all views
+    uint32_t activeClusters = 0;      // With at least one light
+    uint32_t lightAssignments = 0;    // Light references stored in all clusters
+    uint32_t maxLightsPerCluster = 0; // Before clamping to MAX_LIGHTS_PER_CLUSTER
+    uint32_t overflows = 0;           // Clusters that dropped lights
+};
+
+// Clustered forward lighting. A compute pass splits each view's frustum into a grid of view space boxes with
+// exponential depth slices and lists the lights touching each of them. The mesh fragment shader only loops over
+// the lights of its own cluster, which bounds the per pixel cost no matter how many lights the scene has.
+class ClusteredLighting {
+public:
+    static const uint32_t GRID_X = 16;
+    static const uint32_t GRID_Y = 9;
+    static const uint32_t GRID_Z = 24;
+    static const uint32_t CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+    static const uint32_t MAX_LIGHTS_PER_CLUSTER = 64;
+    static const uint32_t MAX_VIEWS = 4;
+
+    ClusteredLighting(VulkanEngine& engine, uint32_t framesInFlight);
+    void destroy();
+
+    // Set 0 of the mesh pipelines
+    VkDescriptorSetLayout getSetLayout() const { return setLayout; }
+
+    // The frame's slot must not be in use by the GPU anymore, reads back its last statistics
+    void beginFrame(uint32_t frame);
+    // Returns the slot to bind the view with. Past MAX_VIEWS it returns UINT32_MAX, bindView then falls back
+    // to the last slot's clusters.
+    uint32_t addView(const glm::mat4& view, const glm::mat4& projection, const VkRect2D& rect, float nearPlane, float farPlane);
+
+    // Graph setup, the cull pass has to come before the passes drawing lit geometry
+    void addCullPass(RenderGraph& graph);
+    void readForDraw(RGPassBuilder& pass);
+    // Uploads the frame's lights and views and binds the cluster buffer to the graph
+    void bindFrame(RenderGraph& graph);
+
+    void bindView(VkCommandBuffer cmd, VkPipelineLayout layout, uint32_t slot);
+
+    std::vector<Light> lights;
+    glm::vec3 ambient = glm::vec3(0.15f);
+
+    LightingStats stats; // Of the most recently completed frame
+
+    RGResource clustersResource = RG_NONE;
+
+private:
+    struct FrameData {
+        AllocatedBuffer lights = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+        void* mappedLights = nullptr;
+        uint32_t capacity = 0;
+        AllocatedBuffer views = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+        void* mappedViews = nullptr;
+        AllocatedBuffer counters = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+        uint32_t* mappedCounters = nullptr;
+
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        bool dirty = true;
+        bool pending = false;
+        uint32_t lightCount = 0; // Uploaded for the frame
+        uint32_t viewCount = 0;
+    };
+
+    VulkanEngine& engine;
+    std::vector<FrameData> frames;
+    uint32_t frame = 0;
+    uint32_t viewCount = 0;
+
+    VkDeviceSize viewStride;    // Dynamic offsets, aligned for the device
+    VkDeviceSize clusterStride;
+    AllocatedBuffer clusters = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+
+    VkDescriptorSetLayout setLayout;
+    VkPipelineLayout cullLayout;
+    VkPipeline cullPipeline;
+
+    void createPipeline();
+    void growFrame(FrameData& data, uint32_t count);
+    void writeSet(FrameData& data);
+    void recordCull(VkCommandBuffer cmd);
+};
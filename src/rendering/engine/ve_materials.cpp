@@ -0,0 +1,163 @@
+#include "ve_materials.hpp"
+#include "ve_texture_container.hpp"
+#include "vk_engine.hpp"
+
+#include <filesystem>
+
+// std430 layout of lit_mesh.frag
+struct GpuMaterial {
+    glm::vec4 baseColor;
+    glm::vec4 emissive;
+    uint32_t baseColorTexture; // Array in the high 16 bits, layer in the low 16 bits
+    uint32_t pad[3];
+};
+
+MaterialSystem::MaterialSystem(VulkanEngine& engine) : textures(engine), streamer(engine, textures), engine(engine) {
+    VkDescriptorType types[3] = {
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, // Material table
+        VK_DESCRIPTOR_TYPE_SAMPLER,
+        VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,  // One per texture array
+    };
+
+    VkDescriptorSetLayoutBinding bindings[3] = {};
+    for (uint32_t i = 0; i < 3; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = types[i];
+        bindings[i].descriptorCount = i == 2 ? TextureArrays::MAX_ARRAYS : 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 3;
+    layoutInfo.pBindings = bindings;
+    check_vk_result(vkCreateDescriptorSetLayout(engine.device, &layoutInfo, nullptr, &setLayout));
+
+    Material defaultMaterial;
+    defaultMaterial.name = "Default";
+    add(defaultMaterial);
+}
+
+void MaterialSystem::destroy() {
+    VulkanEngine* eng = &engine;
+    AllocatedBuffer tableBuffer = table;
+    VkDescriptorSet descriptorSet = set;
+    VkDescriptorSetLayout layout = setLayout;
+    engine.retire([=] () mutable {
+        if (descriptorSet != VK_NULL_HANDLE) vkFreeDescriptorSets(eng->device, eng->descriptorPool, 1, &descriptorSet);
+        if (tableBuffer.buffer != VK_NULL_HANDLE) eng->destroyBuffer(tableBuffer);
+        vkDestroyDescriptorSetLayout(eng->device, layout, nullptr);
+    });
+
+    streamer.destroy();
+    textures.destroy();
+}
+
+uint32_t MaterialSystem::add(const Material& material) {
+    materials.push_back(material);
+    stats.materials = (uint32_t) materials.size();
+    dirty = true;
+    return (uint32_t) (materials.size() - 1);
+}
+
+void MaterialSystem::set(uint32_t index, const Material& material) {
+    materials[index] = material;
+    dirty = true;
+}
+
+uint32_t MaterialSystem::loadTexture(const std::string& path, bool srgb) {
+    auto it = loadedTextures.find(path);
+    if (it != loadedTextures.end()) return it->second;
+
+    // A cooked container next to the source image is preferred, it is smaller on disk and in memory
+    std::string streamedPath = path;
+    std::filesystem::path cooked = std::filesystem::path(path).replace_extension(TEXTURE_CONTAINER_EXTENSION);
+    if (engine.enabledFeatures.textureCompressionBC && std::filesystem::exists(cooked)) {
+        streamedPath = cooked.string();
+    }
+
+    uint32_t texture = streamer.add(streamedPath, srgb);
+    loadedTextures[path] = texture;
+    return texture;
+}
+
+std::string MaterialSystem::texturePath(uint32_t texture) const {
+    for (const auto& [path, loaded] : loadedTextures) {
+        if (loaded == texture) return path;
+    }
+    return "";
+}
+
+void MaterialSystem::requestSize(uint32_t index, float pixels) {
+    const Material& material = materials[index];
+    if (material.baseColorTexture != NO_TEXTURE) streamer.requestSize(material.baseColorTexture, pixels);
+}
+
+// Materials change rarely, a new table and set per change keeps frames in flight untouched without per frame copies.
+// Streaming changes the texture handles only when a load finished.
+void MaterialSystem::update() {
+    if (streamer.update()) dirty = true;
+    if (!dirty && texturesVersion == textures.getVersion()) return;
+
+    std::vector<GpuMaterial> gpuMaterials(materials.size());
+    for (size_t i = 0; i < materials.size(); i++) {
+        const Material& material = materials[i];
+        GpuMaterial& gpu = gpuMaterials[i];
+        gpu.baseColor = material.baseColor;
+        gpu.emissive = glm::vec4(material.emissive, 0.f);
+        gpu.baseColorTexture = material.baseColorTexture == NO_TEXTURE ? 0 : streamer.getHandle(material.baseColorTexture);
+    }
+
+    VulkanEngine* eng = &engine;
+    if (table.buffer != VK_NULL_HANDLE) {
+        AllocatedBuffer oldTable = table;
+        VkDescriptorSet oldSet = set;
+        engine.retire([=] () mutable {
+            vkFreeDescriptorSets(eng->device, eng->descriptorPool, 1, &oldSet);
+            eng->destroyBuffer(oldTable);
+        });
+    }
+
+    VkDeviceSize size = gpuMaterials.size() * sizeof(GpuMaterial);
+    table = engine.createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY, "Materials");
+    engine.transfer->uploadBuffer(gpuMaterials.data(), size, table.buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = engine.descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &setLayout;
+    check_vk_result(vkAllocateDescriptorSets(engine.device, &allocInfo, &set));
+
+    VkDescriptorBufferInfo tableInfo = {table.buffer, 0, VK_WHOLE_SIZE};
+
+    VkDescriptorImageInfo samplerInfo = {};
+    samplerInfo.sampler = textures.getSampler();
+
+    std::vector<VkDescriptorImageInfo> imageInfos;
+    textures.getImageInfos(imageInfos);
+
+    VkWriteDescriptorSet writes[3] = {};
+    for (uint32_t i = 0; i < 3; i++) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = set;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+    }
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[0].pBufferInfo = &tableInfo;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+    writes[1].pImageInfo = &samplerInfo;
+    writes[2].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    writes[2].descriptorCount = (uint32_t) imageInfos.size();
+    writes[2].pImageInfo = imageInfos.data();
+    vkUpdateDescriptorSets(engine.device, 3, writes, 0, nullptr);
+
+    dirty = false;
+    texturesVersion = textures.getVersion();
+    stats.tableUploads++;
+}
+
+void MaterialSystem::bind(VkCommandBuffer cmd, VkPipelineLayout layout, uint32_t setIndex) {
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, setIndex, 1, &set, 0, nullptr);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <map>
+#include <cstdint>
+
+#include "ve_types.hpp"
+#include "ve_textures.hpp"
+#include "ve_texture_streaming.hpp"
+
+class VulkanEngine;
+
+struct Material {
+    std::string name;
+    glm::vec4 baseColor = glm::vec4(1.f);  // Multiplies the texture and the vertex colour
+    glm::vec3 emissive = glm::vec3(0.f);
+    uint32_t baseColorTexture = NO_TEXTURE; // From MaterialSystem::loadTexture
+};
+
+struct MaterialStats {
+    uint32_t materials = 0;
+    uint32_t tableUploads = 0; // Since the start, the table is only uploaded when it changed
+};
+
+// All materials are entries of one storage buffer and all textures layers of the texture arrays, both bound
+// in a single set. The mesh shaders find their entry through the draw's instance index, so switching
+// materials between draws binds neither descriptor sets nor pipelines.
+class MaterialSystem {
+public:
+    MaterialSystem(VulkanEngine& engine);
+    void destroy();
+
+    // Set 1 of the mesh pipelines
+    VkDescriptorSetLayout getSetLayout() const { return setLayout; }
+
+    // Index 0 is the default material, white and untextured
+    uint32_t add(const Material& material);
+    void set(uint32_t index, const Material& material);
+    const Material& get(uint32_t index) const { return materials[index]; }
+    uint32_t count() const { return (uint32_t) materials.size(); }
+
+    // Cached by path. Streamed in the background, materials show white until its first levels arrived.
+    // Uses the .rtex file of the same name instead when the texture cooker produced one.
+    uint32_t loadTexture(const std::string& path, bool srgb = true);
+    // Path a texture was loaded from, empty for NO_TEXTURE
+    std::string texturePath(uint32_t texture) const;
+
+    // Screen space size of an object drawn with the material, decides how many levels its textures stream in
+    void requestSize(uint32_t index, float pixels);
+
+    // Uploads the table and replaces the set after changes, has to run before the frame's transfer flush
+    void update();
+    void bind(VkCommandBuffer cmd, VkPipelineLayout layout, uint32_t setIndex);
+
+    TextureArrays textures;
+    TextureStreamer streamer;
+    MaterialStats stats;
+
+private:
+    VulkanEngine& engine;
+    std::vector<Material> materials;
+    std::map<std::string, uint32_t> loadedTextures;
+
+    bool dirty = true;
+    uint32_t texturesVersion = 0;
+
+    // Replaced as a whole on changes, frames in flight keep reading the old ones until they are retired
+    AllocatedBuffer table = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    VkDescriptorSetLayout setLayout;
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <map>
+#include <string>
+#include <cstdint>
+
+// Snapshot of a single Vulkan memory heap as seen by VMA
+struct HeapStats {
+    uint32_t heapIndex = 0;
+    VkMemoryHeapFlags flags = 0;
+    VkDeviceSize size = 0;
+
+    VkDeviceSize budget = 0; // Estimated bytes the process may use (driver provided with VK_EXT_memory_budget)
+    VkDeviceSize usage = 0;  // Bytes the process currently uses, including memory not allocated through VMA
+
+    VkDeviceSize blockBytes = 0;      // Bytes in VkDeviceMemory blocks owned by VMA
+    VkDeviceSize allocationBytes = 0; // Bytes handed out to allocations within those blocks
+    uint32_t blockCount = 0;
+    uint32_t allocationCount = 0;
+
+    VkDeviceSize largestFreeRange = 0;
+    float fragmentation = 0.0f; // 0 = all free space in one range, towards 1 = free space split into many small ranges
+};
+
+// Bytes and allocation count attributed to one subsystem tag
+struct TagStats {
+    VkDeviceSize bytes = 0;
+    uint32_t allocationCount = 0;
+};
+
+struct MemoryStats {
+    bool budgetExtension = false; // false if budgets are VMA estimates rather than driver values
+    std::vector<HeapStats> heaps;
+    std::map<std::string, TagStats> tags;
+
+    VkDeviceSize totalUsage = 0;
+    VkDeviceSize totalBudget = 0;
+};
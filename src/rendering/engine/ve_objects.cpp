@@ -0,0 +1,161 @@
+#include "ve_objects.hpp"
+#include "vk_engine.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+static_assert(sizeof(GpuObject) == 64, "GpuObject must match the shaders' Object struct");
+
+static VkDeviceSize alignUp(VkDeviceSize size, VkDeviceSize alignment) {
+    return alignment > 0 ? (size + alignment - 1) / alignment * alignment : size;
+}
+
+static_assert(sizeof(AffineTransform) == sizeof(GpuObject::model), "Scene graph worlds are copied as the model rows");
+
+static void writeObjects(const std::vector<RenderObject>& objects, const SceneGraph& scene, GpuObject* gpuObjects, uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; i++) {
+        GpuObject& gpu = gpuObjects[i];
+        if (const AffineTransform* world = scene.getObjectWorld(i)) {
+            memcpy(gpu.model, world->rows, sizeof(gpu.model));
+        } else {
+            const glm::mat4& m = objects[i].transform;
+            for (int r = 0; r < 3; r++) {
+                gpu.model[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+            }
+        }
+        gpu.material = objects[i].materialIndex;
+    }
+}
+
+ObjectBuffer::ObjectBuffer(VulkanEngine& engine, uint32_t framesInFlight) : engine(engine) {
+    frames.resize(framesInFlight);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(engine.physicalDevice, &properties);
+    cameraStride = alignUp(sizeof(GpuCamera), properties.limits.minUniformBufferOffsetAlignment);
+
+    VkDescriptorSetLayoutBinding bindings[2] = {};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 2;
+    layoutInfo.pBindings = bindings;
+    check_vk_result(vkCreateDescriptorSetLayout(engine.device, &layoutInfo, nullptr, &setLayout));
+}
+
+void ObjectBuffer::destroy() {
+    VulkanEngine* eng = &engine;
+
+    for (auto& data : frames) {
+        VkDescriptorSet set = data.set;
+        AllocatedBuffer objects = data.objects;
+        AllocatedBuffer cameraBuffer = data.cameras;
+        engine.retire([=] () mutable {
+            if (set != VK_NULL_HANDLE) vkFreeDescriptorSets(eng->device, eng->descriptorPool, 1, &set);
+            if (objects.buffer != VK_NULL_HANDLE) {
+                vmaUnmapMemory(eng->allocator, objects.allocation);
+                eng->destroyBuffer(objects);
+                vmaUnmapMemory(eng->allocator, cameraBuffer.allocation);
+                eng->destroyBuffer(cameraBuffer);
+            }
+        });
+    }
+    frames.clear();
+
+    VkDevice device = engine.device;
+    VkDescriptorSetLayout layout = setLayout;
+    engine.retire([=] () {
+        vkDestroyDescriptorSetLayout(device, layout, nullptr);
+    });
+}
+
+void ObjectBuffer::beginFrame(uint32_t frameIdx) {
+    frame = frameIdx;
+    cameras.clear();
+}
+
+uint32_t ObjectBuffer::addView(const glm::mat4& viewProj) {
+    cameras.push_back({viewProj});
+    return (uint32_t) (cameras.size() - 1);
+}
+
+void ObjectBuffer::update(const std::vector<RenderObject>& objects, const SceneGraph& scene) {
+    FrameData& data = frames[frame];
+    growFrame(data, (uint32_t) objects.size(), (uint32_t) cameras.size());
+
+    for (size_t i = 0; i < cameras.size(); i++) {
+        memcpy((char*) data.mappedCameras + i * cameraStride, &cameras[i], sizeof(GpuCamera));
+    }
+
+    // Jobs write disjoint ranges of the mapped buffer
+    GpuObject* gpuObjects = (GpuObject*) data.mappedObjects;
+    getJobs().parallelFor((uint32_t) objects.size(), OBJECTS_PER_JOB, [&] (uint32_t begin, uint32_t end) {
+        writeObjects(objects, scene, gpuObjects, begin, end);
+    });
+
+    if (!objects.empty()) vmaFlushAllocation(engine.allocator, data.objects.allocation, 0, objects.size() * sizeof(GpuObject));
+    if (!cameras.empty()) vmaFlushAllocation(engine.allocator, data.cameras.allocation, 0, cameras.size() * cameraStride);
+    if (data.dirty) writeSet(data);
+}
+
+void ObjectBuffer::growFrame(FrameData& data, uint32_t objectCount, uint32_t cameraCount) {
+    if (objectCount > data.objectCapacity || data.objects.buffer == VK_NULL_HANDLE) {
+        uint32_t capacity = std::max(objectCount, std::max(data.objectCapacity * 2, 1024u));
+        data.mappedObjects = engine.growMappedBuffer(data.objects, capacity * sizeof(GpuObject), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, "Objects");
+        data.objectCapacity = capacity;
+        data.dirty = true;
+    }
+
+    if (cameraCount > data.cameraCapacity || data.cameras.buffer == VK_NULL_HANDLE) {
+        uint32_t capacity = std::max(cameraCount, std::max(data.cameraCapacity * 2, 4u));
+        data.mappedCameras = engine.growMappedBuffer(data.cameras, capacity * cameraStride, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, "Objects");
+        data.cameraCapacity = capacity;
+        data.dirty = true;
+    }
+}
+
+void ObjectBuffer::writeSet(FrameData& data) {
+    if (data.set == VK_NULL_HANDLE) {
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = engine.descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &setLayout;
+        check_vk_result(vkAllocateDescriptorSets(engine.device, &allocInfo, &data.set));
+    }
+
+    // The camera binding covers one view, the offset selects it
+    VkDescriptorBufferInfo bufferInfos[2] = {
+        {data.objects.buffer, 0, VK_WHOLE_SIZE},
+        {data.cameras.buffer, 0, sizeof(GpuCamera)},
+    };
+    VkDescriptorType types[2] = {
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+    };
+
+    VkWriteDescriptorSet writes[2] = {};
+    for (uint32_t i = 0; i < 2; i++) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = data.set;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = types[i];
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets(engine.device, 2, writes, 0, nullptr);
+    data.dirty = false;
+}
+
+void ObjectBuffer::bindView(VkCommandBuffer cmd, VkPipelineLayout layout, uint32_t setIndex, uint32_t slot) {
+    uint32_t offset = (uint32_t) (slot * cameraStride);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, setIndex, 1, &frames[frame].set, 1, &offset);
+}
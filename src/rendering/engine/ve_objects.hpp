@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+#include "ve_types.hpp"
+#include "ve_scene.hpp"
+
+class VulkanEngine;
+class SceneGraph;
+
+// std430 layout of the Objects buffer in the mesh vertex shaders, one per render object at the same index.
+// Rows of the affine transform keep every entry at four aligned vec4s, a cache line per object.
+struct alignas(64) GpuObject {
+    glm::vec4 model[3];
+    uint32_t material;
+    uint32_t pad[3];
+};
+
+// Per frame object and camera data of the mesh pipelines. Every render object's transform, the scene graph's world
+// for objects a node places, and material are written once per frame into a persistently mapped storage buffer,
+// split into jobs for large scenes, and draws select theirs with the instance index. Cameras are a dynamic uniform
+// bound once per view, so recording a draw is nothing but the draw call.
+class ObjectBuffer {
+public:
+    // Objects per job when filling the buffer, smaller scenes are written on the calling thread
+    static const uint32_t OBJECTS_PER_JOB = 4096;
+
+    ObjectBuffer(VulkanEngine& engine, uint32_t framesInFlight);
+    void destroy();
+
+    // Set 3 of the mesh pipelines, objects at binding 0 and the view's camera at binding 1
+    VkDescriptorSetLayout getSetLayout() const { return setLayout; }
+
+    // The frame's slot must not be in use by the GPU anymore
+    void beginFrame(uint32_t frame);
+    // Returns the slot to bind the view with
+    uint32_t addView(const glm::mat4& viewProj);
+    // Writes all objects and the frame's views, after the last addView and the scene's update
+    void update(const std::vector<RenderObject>& objects, const SceneGraph& scene);
+
+    void bindView(VkCommandBuffer cmd, VkPipelineLayout layout, uint32_t setIndex, uint32_t slot);
+
+private:
+    struct FrameData {
+        AllocatedBuffer objects = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+        void* mappedObjects = nullptr;
+        uint32_t objectCapacity = 0;
+        AllocatedBuffer cameras = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+        void* mappedCameras = nullptr;
+        uint32_t cameraCapacity = 0;
+
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        bool dirty = true;
+    };
+
+    // std140 layout of the Camera uniform
+    struct GpuCamera {
+        glm::mat4 viewProj;
+    };
+
+    VulkanEngine& engine;
+    std::vector<FrameData> frames;
+    uint32_t frame = 0;
+    std::vector<GpuCamera> cameras; // Of the current frame, copied at update
+
+    VkDeviceSize cameraStride; // Dynamic offsets, aligned for the device
+    VkDescriptorSetLayout setLayout;
+
+    void growFrame(FrameData& data, uint32_t objectCount, uint32_t cameraCount);
+    void writeSet(FrameData& data);
+};
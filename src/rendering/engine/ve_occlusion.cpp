@@ -0,0 +1,471 @@
+#include "ve_occlusion.hpp"
+#include "vk_engine.hpp"
+#include "ve_pipeline.hpp"
+
+#include <cmath>
+
+struct CullPushConstants {
+    uint32_t drawCount;
+    uint32_t pyramidValid;
+    uint32_t levels;
+    uint32_t pad;
+    glm::vec2 size;
+};
+
+struct PyramidPushConstants {
+    glm::ivec2 srcSize;
+    glm::ivec2 dstSize;
+    uint32_t copy;
+};
+
+OcclusionCuller::OcclusionCuller(VulkanEngine& engine, uint32_t framesInFlight) : engine(engine) {
+    frames.resize(framesInFlight);
+
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    check_vk_result(vkCreateSampler(engine.device, &samplerInfo, nullptr, &sampler));
+
+    createPipelines();
+}
+
+void OcclusionCuller::createPipelines() {
+    VkDescriptorSetLayoutBinding cullBindings[4] = {};
+    for (uint32_t i = 0; i < 3; i++) {
+        cullBindings[i].binding = i;
+        cullBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        cullBindings[i].descriptorCount = 1;
+        cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    cullBindings[3].binding = 3;
+    cullBindings[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    cullBindings[3].descriptorCount = 1;
+    cullBindings[3].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 4;
+    layoutInfo.pBindings = cullBindings;
+    check_vk_result(vkCreateDescriptorSetLayout(engine.device, &layoutInfo, nullptr, &cullSetLayout));
+
+    VkDescriptorSetLayoutBinding pyramidBindings[2] = {};
+    pyramidBindings[0].binding = 0;
+    pyramidBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pyramidBindings[0].descriptorCount = 1;
+    pyramidBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pyramidBindings[1].binding = 1;
+    pyramidBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    pyramidBindings[1].descriptorCount = 1;
+    pyramidBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    layoutInfo.bindingCount = 2;
+    layoutInfo.pBindings = pyramidBindings;
+    check_vk_result(vkCreateDescriptorSetLayout(engine.device, &layoutInfo, nullptr, &pyramidSetLayout));
+
+    auto createLayout = [&] (VkDescriptorSetLayout setLayout, uint32_t pushSize, VkPipelineLayout* layout) {
+        VkPushConstantRange range = {};
+        range.offset = 0;
+        range.size = pushSize;
+        range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &setLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &range;
+
+        if (vkCreatePipelineLayout(engine.device, &pipelineLayoutInfo, nullptr, layout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
+    };
+    createLayout(cullSetLayout, sizeof(CullPushConstants), &cullLayout);
+    createLayout(pyramidSetLayout, sizeof(PyramidPushConstants), &pyramidLayout);
+
+    auto createPipeline = [&] (const std::string& path, VkPipelineLayout layout) {
+        VkShaderModule shader = loadCompiledShader(path, engine.device);
+
+        VkComputePipelineCreateInfo pipelineInfo = {};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage = shaderStageInfo(shader, VK_SHADER_STAGE_COMPUTE_BIT);
+        pipelineInfo.layout = layout;
+
+        VkPipeline pipeline;
+        if (vkCreateComputePipelines(engine.device, engine.pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create compute pipeline " + path + "!");
+        }
+
+        vkDestroyShaderModule(engine.device, shader, nullptr);
+        return pipeline;
+    };
+    cullPipeline = createPipeline("../shaders/occlusion_cull.comp.spv", cullLayout);
+    pyramidPipeline = createPipeline("../shaders/hiz_build.comp.spv", pyramidLayout);
+}
+
+void OcclusionCuller::destroy() {
+    releasePyramid();
+
+    for (auto& data : frames) {
+        std::vector<VkDescriptorSet> sets = data.pyramidSets;
+        if (data.cullSet != VK_NULL_HANDLE) sets.push_back(data.cullSet);
+
+        VulkanEngine* eng = &engine;
+        AllocatedBuffer drawsBuffer = data.draws;
+        AllocatedBuffer commands = data.commands;
+        AllocatedBuffer counters = data.counters;
+        engine.retire([=] () mutable {
+            if (!sets.empty()) vkFreeDescriptorSets(eng->device, eng->descriptorPool, (uint32_t) sets.size(), sets.data());
+            if (drawsBuffer.buffer != VK_NULL_HANDLE) {
+                vmaUnmapMemory(eng->allocator, drawsBuffer.allocation);
+                eng->destroyBuffer(drawsBuffer);
+                eng->destroyBuffer(commands);
+            }
+            if (counters.buffer != VK_NULL_HANDLE) {
+                vmaUnmapMemory(eng->allocator, counters.allocation);
+                eng->destroyBuffer(counters);
+            }
+        });
+    }
+    frames.clear();
+
+    VkDevice device = engine.device;
+    VkSampler s = sampler;
+    VkDescriptorSetLayout cullSets = cullSetLayout, pyramidSets = pyramidSetLayout;
+    VkPipelineLayout layouts[2] = {cullLayout, pyramidLayout};
+    VkPipeline pipelines[2] = {cullPipeline, pyramidPipeline};
+    engine.retire([=] () {
+        for (auto pipeline : pipelines) vkDestroyPipeline(device, pipeline, nullptr);
+        for (auto layout : layouts) vkDestroyPipelineLayout(device, layout, nullptr);
+        vkDestroyDescriptorSetLayout(device, cullSets, nullptr);
+        vkDestroyDescriptorSetLayout(device, pyramidSets, nullptr);
+        vkDestroySampler(device, s, nullptr);
+    });
+}
+
+void OcclusionCuller::releasePyramid() {
+    if (pyramid._image == VK_NULL_HANDLE) return;
+
+    VkDevice device = engine.device;
+    VkImageView view = pyramidView;
+    std::vector<VkImageView> views = levelViews;
+    AllocatedImage image = pyramid;
+    VulkanEngine* eng = &engine;
+    engine.retire([=] () mutable {
+        for (auto levelView : views) vkDestroyImageView(device, levelView, nullptr);
+        vkDestroyImageView(device, view, nullptr);
+        eng->destroyImage(image);
+    });
+
+    pyramid = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+    pyramidView = VK_NULL_HANDLE;
+    levelViews.clear();
+}
+
+void OcclusionCuller::resize(VkExtent2D newExtent) {
+    releasePyramid();
+
+    extent = newExtent;
+    levels = (uint32_t) std::floor(std::log2((float) std::max(extent.width, extent.height))) + 1;
+
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = VK_FORMAT_R32_SFLOAT;
+    imageInfo.extent = {extent.width, extent.height, 1};
+    imageInfo.mipLevels = levels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+
+    VmaAllocationCreateInfo allocInfo = {};
+    allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+    pyramid = engine.createImage(imageInfo, allocInfo, "DepthPyramid");
+
+    VkImageViewCreateInfo viewInfo = {};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.image = pyramid._image;
+    viewInfo.format = VK_FORMAT_R32_SFLOAT;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = levels;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+    check_vk_result(vkCreateImageView(engine.device, &viewInfo, nullptr, &pyramidView));
+
+    // Storage image views are limited to a single level
+    levelViews.resize(levels);
+    for (uint32_t level = 0; level < levels; level++) {
+        viewInfo.subresourceRange.baseMipLevel = level;
+        viewInfo.subresourceRange.levelCount = 1;
+        check_vk_result(vkCreateImageView(engine.device, &viewInfo, nullptr, &levelViews[level]));
+    }
+
+    pyramidInitialized = false;
+    pyramidValid = false;
+    for (auto& data : frames) data.dirty = true;
+}
+
+void OcclusionCuller::beginFrame(uint32_t frameIdx) {
+    frame = frameIdx;
+    draws.clear();
+
+    FrameData& data = frames[frame];
+    if (data.pending) {
+        vmaInvalidateAllocation(engine.allocator, data.counters.allocation, 0, VK_WHOLE_SIZE);
+        stats.tested = data.mappedCounters[0];
+        stats.culled = data.mappedCounters[1];
+        data.pending = false;
+    }
+}
+
+uint32_t OcclusionCuller::addDraw(const glm::vec4& sphere, const glm::mat4& viewProj, const glm::vec4& viewport, const GeometryRange& range, uint32_t firstInstance) {
+    OcclusionDraw draw = {};
+    draw.sphere = sphere;
+    draw.viewProj = viewProj;
+    draw.viewport = viewport;
+    draw.indexCount = range.indexCount;
+    draw.firstIndex = range.firstIndex;
+    draw.vertexOffset = (int32_t) range.vertexOffset;
+    draw.firstInstance = firstInstance;
+    draws.push_back(draw);
+    return (uint32_t) (draws.size() - 1);
+}
+
+void OcclusionCuller::growFrame(FrameData& data, uint32_t count) {
+    if (count <= data.capacity && data.draws.buffer != VK_NULL_HANDLE) return;
+
+    uint32_t capacity = std::max(count, std::max(data.capacity * 2, 256u));
+    // The commands are written by the GPU from the draws, they grow together
+    if (data.commands.buffer != VK_NULL_HANDLE) engine.retireBuffer(data.commands);
+
+    data.mappedDraws = engine.growMappedBuffer(data.draws, capacity * sizeof(OcclusionDraw), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, "Occlusion");
+    data.commands = engine.createBuffer(capacity * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY, "Occlusion");
+    data.capacity = capacity;
+
+    if (data.counters.buffer == VK_NULL_HANDLE) {
+        data.counters = engine.createBuffer(2 * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU, "Occlusion");
+        void* mapped;
+        check_vk_result(vmaMapMemory(engine.allocator, data.counters.allocation, &mapped));
+        data.mappedCounters = (uint32_t*) mapped;
+    }
+
+    data.dirty = true;
+}
+
+void OcclusionCuller::allocateSets(FrameData& data) {
+    if (data.cullSet != VK_NULL_HANDLE && data.pyramidSets.size() == levels) return;
+
+    // Sets of this slot are no longer in use, the caller waited for its last frame
+    std::vector<VkDescriptorSet> old = data.pyramidSets;
+    if (data.cullSet != VK_NULL_HANDLE) old.push_back(data.cullSet);
+    if (!old.empty()) vkFreeDescriptorSets(engine.device, engine.descriptorPool, (uint32_t) old.size(), old.data());
+
+    std::vector<VkDescriptorSetLayout> layouts(levels, pyramidSetLayout);
+    layouts.push_back(cullSetLayout);
+
+    std::vector<VkDescriptorSet> sets(layouts.size());
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = engine.descriptorPool;
+    allocInfo.descriptorSetCount = (uint32_t) layouts.size();
+    allocInfo.pSetLayouts = layouts.data();
+    check_vk_result(vkAllocateDescriptorSets(engine.device, &allocInfo, sets.data()));
+
+    data.cullSet = sets.back();
+    sets.pop_back();
+    data.pyramidSets = sets;
+}
+
+void OcclusionCuller::writeSets(FrameData& data) {
+    allocateSets(data);
+
+    std::vector<VkWriteDescriptorSet> writes;
+    std::vector<VkDescriptorImageInfo> imageInfos;
+    std::vector<VkDescriptorBufferInfo> bufferInfos;
+    imageInfos.reserve(2 * levels + 1);
+    bufferInfos.reserve(3);
+
+    auto write = [&] (VkDescriptorSet set, uint32_t binding, VkDescriptorType type) -> VkWriteDescriptorSet& {
+        VkWriteDescriptorSet w = {};
+        w.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        w.dstSet = set;
+        w.dstBinding = binding;
+        w.descriptorCount = 1;
+        w.descriptorType = type;
+        writes.push_back(w);
+        return writes.back();
+    };
+
+    VkBuffer buffers[3] = {data.draws.buffer, data.commands.buffer, data.counters.buffer};
+    for (uint32_t i = 0; i < 3; i++) {
+        bufferInfos.push_back({buffers[i], 0, VK_WHOLE_SIZE});
+        write(data.cullSet, i, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER).pBufferInfo = &bufferInfos.back();
+    }
+
+    imageInfos.push_back({sampler, pyramidView, VK_IMAGE_LAYOUT_GENERAL});
+    write(data.cullSet, 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER).pImageInfo = &imageInfos.back();
+
+    for (uint32_t level = 0; level < levels; level++) {
+        if (level == 0) {
+            imageInfos.push_back({sampler, depthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL});
+        } else {
+            imageInfos.push_back({sampler, levelViews[level - 1], VK_IMAGE_LAYOUT_GENERAL});
+        }
+        write(data.pyramidSets[level], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER).pImageInfo = &imageInfos.back();
+
+        imageInfos.push_back({VK_NULL_HANDLE, levelViews[level], VK_IMAGE_LAYOUT_GENERAL});
+        write(data.pyramidSets[level], 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE).pImageInfo = &imageInfos.back();
+    }
+
+    vkUpdateDescriptorSets(engine.device, (uint32_t) writes.size(), writes.data(), 0, nullptr);
+    data.dirty = false;
+}
+
+void OcclusionCuller::addCullPass(RenderGraph& graph) {
+    RGBufferDesc drawsDesc;
+    drawsResource = graph.importBuffer("OcclusionDraws", drawsDesc);
+
+    RGImageDesc pyramidDesc;
+    pyramidDesc.format = VK_FORMAT_R32_SFLOAT;
+    pyramidDesc.extent = extent;
+    pyramidDesc.mipLevels = levels;
+    pyramidDesc.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+    pyramidResource = graph.importImage("DepthPyramid", pyramidDesc, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
+
+    // The pyramid is bound as a sampled image, but in the general layout it is written in
+    graph.addPass("occlusion_cull", RGPassType::Compute)
+        .read(pyramidResource, RGAccess::StorageImageRead)
+        .write(drawsResource, RGAccess::StorageBufferWrite)
+        .execute([this] (VkCommandBuffer cmd, const RGPassContext& context) { recordCull(cmd); });
+}
+
+void OcclusionCuller::addPyramidPass(RenderGraph& graph, RGResource depth) {
+    graph.addPass("depth_pyramid", RGPassType::Compute)
+        .read(depth, RGAccess::SampledCompute)
+        .write(pyramidResource, RGAccess::StorageImageWrite)
+        .execute([this] (VkCommandBuffer cmd, const RGPassContext& context) { recordPyramid(cmd); });
+}
+
+void OcclusionCuller::updateDescriptors(RenderGraph& graph, RGResource depth) {
+    depthView = graph.getImageView(depth);
+    pyramidValid = false;
+    for (auto& data : frames) data.dirty = true;
+}
+
+void OcclusionCuller::bindFrame(RenderGraph& graph, VkCommandBuffer cmd) {
+    FrameData& data = frames[frame];
+
+    growFrame(data, (uint32_t) draws.size());
+    if (!draws.empty()) {
+        memcpy(data.mappedDraws, draws.data(), draws.size() * sizeof(OcclusionDraw));
+        vmaFlushAllocation(engine.allocator, data.draws.allocation, 0, draws.size() * sizeof(OcclusionDraw));
+    }
+    if (data.dirty) writeSets(data);
+
+    // The graph expects the pyramid in the general layout from the start
+    if (!pyramidInitialized) {
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = pyramid._image;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levels, 0, 1};
+
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            0, nullptr, 0, nullptr, 1, &barrier);
+        pyramidInitialized = true;
+    }
+
+    graph.setBuffer(drawsResource, data.commands.buffer);
+    graph.setImage(pyramidResource, pyramid._image, pyramidView);
+}
+
+void OcclusionCuller::recordCull(VkCommandBuffer cmd) {
+    FrameData& data = frames[frame];
+
+    vkCmdFillBuffer(cmd, data.counters.buffer, 0, VK_WHOLE_SIZE, 0);
+
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = data.counters.buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    if (!draws.empty()) {
+        CullPushConstants constants = {};
+        constants.drawCount = (uint32_t) draws.size();
+        constants.pyramidValid = pyramidValid ? 1 : 0;
+        constants.levels = levels;
+        constants.size = glm::vec2(extent.width, extent.height);
+
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cullLayout, 0, 1, &data.cullSet, 0, nullptr);
+        vkCmdPushConstants(cmd, cullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &constants);
+        vkCmdDispatch(cmd, (constants.drawCount + 63) / 64, 1, 1);
+    }
+
+    // Counters are read on the host once the frame's timeline value is reached
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    data.pending = true;
+}
+
+void OcclusionCuller::recordPyramid(VkCommandBuffer cmd) {
+    FrameData& data = frames[frame];
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pyramidPipeline);
+
+    glm::ivec2 srcSize = glm::ivec2(extent.width, extent.height);
+    for (uint32_t level = 0; level < levels; level++) {
+        glm::ivec2 dstSize = glm::max(glm::ivec2(extent.width >> level, extent.height >> level), glm::ivec2(1));
+
+        PyramidPushConstants constants = {};
+        constants.srcSize = srcSize;
+        constants.dstSize = dstSize;
+        constants.copy = level == 0 ? 1 : 0;
+
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pyramidLayout, 0, 1, &data.pyramidSets[level], 0, nullptr);
+        vkCmdPushConstants(cmd, pyramidLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PyramidPushConstants), &constants);
+        vkCmdDispatch(cmd, (dstSize.x + 7) / 8, (dstSize.y + 7) / 8, 1);
+
+        // The next level reads this one
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = pyramid._image;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        srcSize = dstSize;
+    }
+
+    pyramidValid = true;
+}
+
+void OcclusionCuller::recordDraw(VkCommandBuffer cmd, uint32_t draw) {
+    vkCmdDrawIndexedIndirect(cmd, frames[frame].commands.buffer, draw * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+}
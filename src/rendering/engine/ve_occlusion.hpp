@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+#include "ve_types.hpp"
+#include "ve_render_graph.hpp"
+#include "ve_geometry.hpp"
+
+class VulkanEngine;
+
+// Input of one draw, std430 layout of occlusion_cull.comp
+struct OcclusionDraw {
+    glm::vec4 sphere;   // World space center and radius
+    glm::mat4 viewProj;
+    glm::vec4 viewport; // Normalized region of the output the view renders to
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    uint32_t firstInstance; // Object index of the draw
+};
+
+struct OcclusionStats {
+    uint32_t tested = 0;
+    uint32_t culled = 0;
+};
+
+// Hierarchical-Z occlusion culling. Draws that survived frustum culling are tested on the GPU against
+// a max-depth pyramid built from the previous frame's depth and turned into indirect commands with an
+// instance count of 0 or 1, so the CPU records the same draws either way.
+class OcclusionCuller {
+public:
+    OcclusionCuller(VulkanEngine& engine, uint32_t framesInFlight);
+    void destroy();
+
+    // Recreates the pyramid for an output of this size, the next frame draws everything
+    void resize(VkExtent2D extent);
+
+    // The frame's slot must not be in use by the GPU anymore, reads back its last counters
+    void beginFrame(uint32_t frame);
+    uint32_t addDraw(const glm::vec4& sphere, const glm::mat4& viewProj, const glm::vec4& viewport, const GeometryRange& range, uint32_t firstInstance);
+
+    // Graph setup, the cull pass has to come before and the pyramid pass after the passes drawing with the results
+    void addCullPass(RenderGraph& graph);
+    void addPyramidPass(RenderGraph& graph, RGResource depth);
+    // After every compile, the depth view may have changed
+    void updateDescriptors(RenderGraph& graph, RGResource depth);
+
+    // Uploads the frame's draws and binds its buffers to the graph
+    void bindFrame(RenderGraph& graph, VkCommandBuffer cmd);
+    void recordDraw(VkCommandBuffer cmd, uint32_t draw);
+
+    RGResource drawsResource = RG_NONE;
+    RGResource pyramidResource = RG_NONE;
+
+    OcclusionStats stats; // Of the most recently completed frame
+    bool pyramidValid = false;
+
+private:
+    struct FrameData {
+        AllocatedBuffer draws = {VK_NULL_HANDLE, VK_NULL_HANDLE}; // Host written inputs
+        void* mappedDraws = nullptr;
+        uint32_t capacity = 0;
+        AllocatedBuffer commands = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+        AllocatedBuffer counters = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+        uint32_t* mappedCounters = nullptr;
+
+        VkDescriptorSet cullSet = VK_NULL_HANDLE;
+        std::vector<VkDescriptorSet> pyramidSets; // One per level
+        bool dirty = true;   // Descriptors need rewriting before the next use
+        bool pending = false; // Counters hold results of a submitted frame
+    };
+
+    VulkanEngine& engine;
+    std::vector<FrameData> frames;
+    uint32_t frame = 0;
+    std::vector<OcclusionDraw> draws;
+
+    VkExtent2D extent = {0, 0};
+    uint32_t levels = 0;
+    AllocatedImage pyramid = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+    VkImageView pyramidView = VK_NULL_HANDLE;
+    std::vector<VkImageView> levelViews;
+    bool pyramidInitialized = false;
+    VkImageView depthView = VK_NULL_HANDLE;
+
+    VkSampler sampler;
+    VkDescriptorSetLayout cullSetLayout;
+    VkDescriptorSetLayout pyramidSetLayout;
+    VkPipelineLayout cullLayout;
+    VkPipelineLayout pyramidLayout;
+    VkPipeline cullPipeline;
+    VkPipeline pyramidPipeline;
+
+    void createPipelines();
+    void growFrame(FrameData& data, uint32_t count);
+    void allocateSets(FrameData& data);
+    void writeSets(FrameData& data);
+    void releasePyramid();
+    void recordCull(VkCommandBuffer cmd);
+    void recordPyramid(VkCommandBuffer cmd);
+};
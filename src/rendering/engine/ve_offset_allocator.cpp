@@ -0,0 +1,175 @@
+#include "ve_offset_allocator.hpp"
+
+#include <algorithm>
+
+const uint32_t OffsetAllocator::NO_SPACE;
+
+static uint32_t floorLog2(uint32_t value) {
+    uint32_t log = 0;
+    while (value >>= 1) log++;
+    return log;
+}
+
+static uint32_t lowestBit(uint32_t mask) {
+    uint32_t bit = 0;
+    while (!(mask & 1u)) {
+        mask >>= 1;
+        bit++;
+    }
+    return bit;
+}
+
+// Sizes below 16 get a bin each, above that every power of two is split into 16 bins of equal width
+static void mapSize(uint32_t size, uint32_t& firstLevel, uint32_t& secondLevel) {
+    if (size < 16) {
+        firstLevel = 0;
+        secondLevel = size;
+        return;
+    }
+    uint32_t log = floorLog2(size);
+    firstLevel = log - 3;
+    secondLevel = (size >> (log - 4)) & 15;
+}
+
+OffsetAllocator::OffsetAllocator(uint32_t size) {
+    reset(size);
+}
+
+void OffsetAllocator::reset(uint32_t newSize) {
+    size = newSize;
+    freeSpace = 0;
+    nodes.clear();
+    unusedNodes.clear();
+    firstLevelMask = 0;
+    std::fill(std::begin(secondLevelMasks), std::end(secondLevelMasks), 0u);
+    std::fill(std::begin(heads), std::end(heads), NO_SPACE);
+
+    if (size == 0) return;
+    uint32_t node = newNode();
+    nodes[node].size = size;
+    insertFree(node);
+}
+
+uint32_t OffsetAllocator::newNode() {
+    if (!unusedNodes.empty()) {
+        uint32_t node = unusedNodes.back();
+        unusedNodes.pop_back();
+        nodes[node] = Node();
+        return node;
+    }
+    nodes.emplace_back();
+    return (uint32_t) (nodes.size() - 1);
+}
+
+void OffsetAllocator::insertFree(uint32_t node) {
+    uint32_t firstLevel, secondLevel;
+    mapSize(nodes[node].size, firstLevel, secondLevel);
+    uint32_t bin = firstLevel * SUB_BINS + secondLevel;
+
+    nodes[node].used = false;
+    nodes[node].prevFree = NO_SPACE;
+    nodes[node].nextFree = heads[bin];
+    if (heads[bin] != NO_SPACE) nodes[heads[bin]].prevFree = node;
+    heads[bin] = node;
+
+    firstLevelMask |= 1u << firstLevel;
+    secondLevelMasks[firstLevel] |= 1u << secondLevel;
+    freeSpace += nodes[node].size;
+}
+
+void OffsetAllocator::removeFree(uint32_t node) {
+    Node& n = nodes[node];
+    uint32_t firstLevel, secondLevel;
+    mapSize(n.size, firstLevel, secondLevel);
+    uint32_t bin = firstLevel * SUB_BINS + secondLevel;
+
+    if (n.prevFree != NO_SPACE) nodes[n.prevFree].nextFree = n.nextFree;
+    else heads[bin] = n.nextFree;
+    if (n.nextFree != NO_SPACE) nodes[n.nextFree].prevFree = n.prevFree;
+
+    if (heads[bin] == NO_SPACE) {
+        secondLevelMasks[firstLevel] &= ~(1u << secondLevel);
+        if (secondLevelMasks[firstLevel] == 0) firstLevelMask &= ~(1u << firstLevel);
+    }
+    freeSpace -= n.size;
+}
+
+OffsetAllocator::Allocation OffsetAllocator::allocate(uint32_t request) {
+    Allocation allocation;
+    if (request == 0 || request > freeSpace) return allocation;
+
+    // Rounding up to the next bin start makes every range in the found bin large enough, at the cost of
+    // skipping ranges in the request's own bin that might have fit
+    uint64_t rounded = request;
+    if (request >= 16) rounded += (1u << (floorLog2(request) - SUB_BIN_BITS)) - 1;
+    if (rounded > UINT32_MAX) return allocation;
+
+    uint32_t firstLevel, secondLevel;
+    mapSize((uint32_t) rounded, firstLevel, secondLevel);
+
+    uint32_t secondMask = secondLevelMasks[firstLevel] & (~0u << secondLevel);
+    if (secondMask == 0) {
+        uint32_t firstMask = firstLevel + 1 < FIRST_LEVELS ? firstLevelMask & (~0u << (firstLevel + 1)) : 0;
+        if (firstMask == 0) return allocation;
+        firstLevel = lowestBit(firstMask);
+        secondMask = secondLevelMasks[firstLevel];
+    }
+    secondLevel = lowestBit(secondMask);
+
+    uint32_t node = heads[firstLevel * SUB_BINS + secondLevel];
+    removeFree(node);
+
+    // The rest of the range goes back into the bins as its own node
+    if (nodes[node].size > request) {
+        uint32_t rest = newNode();
+        Node& n = nodes[node];
+        nodes[rest].offset = n.offset + request;
+        nodes[rest].size = n.size - request;
+        nodes[rest].prevPhysical = node;
+        nodes[rest].nextPhysical = n.nextPhysical;
+        if (n.nextPhysical != NO_SPACE) nodes[n.nextPhysical].prevPhysical = rest;
+        n.nextPhysical = rest;
+        n.size = request;
+        insertFree(rest);
+    }
+
+    nodes[node].used = true;
+    allocation.offset = nodes[node].offset;
+    allocation.node = node;
+    return allocation;
+}
+
+void OffsetAllocator::free(uint32_t node) {
+    uint32_t prev = nodes[node].prevPhysical;
+    if (prev != NO_SPACE && !nodes[prev].used) {
+        removeFree(prev);
+        nodes[prev].size += nodes[node].size;
+        nodes[prev].nextPhysical = nodes[node].nextPhysical;
+        if (nodes[node].nextPhysical != NO_SPACE) nodes[nodes[node].nextPhysical].prevPhysical = prev;
+        unusedNodes.push_back(node);
+        node = prev;
+    }
+
+    uint32_t next = nodes[node].nextPhysical;
+    if (next != NO_SPACE && !nodes[next].used) {
+        removeFree(next);
+        nodes[node].size += nodes[next].size;
+        nodes[node].nextPhysical = nodes[next].nextPhysical;
+        if (nodes[next].nextPhysical != NO_SPACE) nodes[nodes[next].nextPhysical].prevPhysical = node;
+        unusedNodes.push_back(next);
+    }
+
+    insertFree(node);
+}
+
+uint32_t OffsetAllocator::largestFree() const {
+    if (firstLevelMask == 0) return 0;
+
+    uint32_t firstLevel = floorLog2(firstLevelMask);
+    uint32_t secondLevel = floorLog2(secondLevelMasks[firstLevel]);
+    uint32_t largest = 0;
+    for (uint32_t node = heads[firstLevel * SUB_BINS + secondLevel]; node != NO_SPACE; node = nodes[node].nextFree) {
+        largest = std::max(largest, nodes[node].size);
+    }
+    return largest;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+// Hands out ranges of an abstract space (vertices, indices, bytes) in constant time, in the manner of TLSF.
+// Free ranges are kept in bins by size: a first level per power of two split into 16 linear second level bins,
+// with a bitmask per level so the smallest bin that fits is found with bit scans instead of list walks.
+// Freed ranges merge with free neighbours right away. Nothing here touches the GPU.
+class OffsetAllocator {
+public:
+    static const uint32_t NO_SPACE = UINT32_MAX;
+
+    struct Allocation {
+        uint32_t offset = NO_SPACE;
+        uint32_t node = NO_SPACE; // Passed back to free()
+    };
+
+    OffsetAllocator(uint32_t size = 0);
+
+    // Forgets all allocations
+    void reset(uint32_t size);
+
+    // NO_SPACE offset if no free range is large enough
+    Allocation allocate(uint32_t size);
+    void free(uint32_t node);
+
+    uint32_t getSize() const { return size; }
+    uint32_t getFree() const { return freeSpace; }
+    uint32_t largestFree() const;
+
+private:
+    static const uint32_t SUB_BINS = 16;
+    static const uint32_t SUB_BIN_BITS = 4;
+    static const uint32_t FIRST_LEVELS = 32;
+
+    struct Node {
+        uint32_t offset = 0;
+        uint32_t size = 0;
+        uint32_t prevPhysical = NO_SPACE; // Neighbours in the space
+        uint32_t nextPhysical = NO_SPACE;
+        uint32_t prevFree = NO_SPACE;     // Neighbours in the bin
+        uint32_t nextFree = NO_SPACE;
+        bool used = false;
+    };
+
+    uint32_t size = 0;
+    uint32_t freeSpace = 0;
+    std::vector<Node> nodes;
+    std::vector<uint32_t> unusedNodes;
+
+    uint32_t firstLevelMask = 0;
+    uint32_t secondLevelMasks[FIRST_LEVELS] = {};
+    uint32_t heads[FIRST_LEVELS * SUB_BINS];
+
+    uint32_t newNode();
+    void insertFree(uint32_t node);
+    void removeFree(uint32_t node);
+};
@@ -0,0 +1,360 @@
+#include "ve_particles.hpp"
+#include "vk_engine.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// std430 layout of the particle shaders
+struct GpuParticle {
+    glm::vec4 position; // xyz, w = age
+    glm::vec4 velocity; // xyz, w = lifetime
+    glm::vec4 color;
+};
+
+const VkDeviceSize STATE_SIZE = 48;
+const VkDeviceSize SIMULATE_DISPATCH_OFFSET = 16;
+const VkDeviceSize DRAW_COMMAND_OFFSET = 32;
+
+enum ArgsMode : uint32_t {
+    ARGS_INIT = 0,
+    ARGS_SIMULATE = 1,
+    ARGS_DRAW = 2,
+};
+
+struct EmitConstants {
+    glm::vec4 position;
+    glm::vec4 velocity;
+    glm::vec4 color;
+    float lifetime;
+    uint32_t count;
+    uint32_t seed;
+    uint32_t current;
+    uint32_t capacity;
+};
+
+struct SimulateConstants {
+    glm::vec4 gravity; // xyz, w = drag
+    float dt;
+    uint32_t current;
+    uint32_t capacity;
+};
+
+struct ArgsConstants {
+    uint32_t mode;
+    uint32_t current;
+    uint32_t capacity;
+    uint32_t frame;
+};
+
+struct DrawConstants {
+    glm::mat4 viewProj;
+    glm::vec4 right; // xyz, w = size
+    glm::vec4 up;
+    uint32_t listOffset;
+};
+
+// Every particle pass is a one dimensional dispatch of 64 wide groups, the capacity stays within the guaranteed group count
+ParticleSystem::ParticleSystem(VulkanEngine& engine, uint32_t capacity, uint32_t framesInFlight)
+    : engine(engine), capacity(std::clamp(capacity, 1u, 65535u * 64u)), framesInFlight(framesInFlight) {
+    pending.assign(framesInFlight, false);
+    stats.capacity = this->capacity;
+
+    particles = engine.createBuffer(this->capacity * sizeof(GpuParticle), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY, "Particles");
+    indices = engine.createBuffer(3 * this->capacity * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY, "Particles");
+    state = engine.createBuffer(STATE_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY, "Particles");
+    readback = engine.createBuffer(framesInFlight * 4 * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU, "Particles");
+
+    void* mapped;
+    check_vk_result(vmaMapMemory(engine.allocator, readback.allocation, &mapped));
+    mappedReadback = (uint32_t*) mapped;
+
+    engine.vkLogger->debug("Particle buffers for {} particles: {:.1f} MiB", this->capacity,
+        (this->capacity * (sizeof(GpuParticle) + 3 * sizeof(uint32_t))) / (1024.0 * 1024.0));
+
+    createComputePipelines();
+    writeSet();
+
+    lastFrame = std::chrono::steady_clock::now();
+}
+
+void ParticleSystem::createComputePipelines() {
+    VkDescriptorSetLayoutBinding bindings[4] = {};
+    for (uint32_t i = 0; i < 4; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    // Particles and alive lists are pulled by the vertex shader
+    bindings[0].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+    bindings[1].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 4;
+    layoutInfo.pBindings = bindings;
+    check_vk_result(vkCreateDescriptorSetLayout(engine.device, &layoutInfo, nullptr, &setLayout));
+
+    auto createLayout = [&] (VkShaderStageFlags stages, uint32_t pushSize, VkPipelineLayout* layout) {
+        VkPushConstantRange range = {};
+        range.offset = 0;
+        range.size = pushSize;
+        range.stageFlags = stages;
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &setLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &range;
+
+        if (vkCreatePipelineLayout(engine.device, &pipelineLayoutInfo, nullptr, layout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
+    };
+    // The emit constants are the largest, the other compute shaders push a prefix of the range
+    createLayout(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(EmitConstants), &computeLayout);
+    createLayout(VK_SHADER_STAGE_VERTEX_BIT, sizeof(DrawConstants), &drawLayout);
+
+    auto createPipeline = [&] (const std::string& path) {
+        VkShaderModule shader = loadCompiledShader(path, engine.device);
+
+        VkComputePipelineCreateInfo pipelineInfo = {};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage = shaderStageInfo(shader, VK_SHADER_STAGE_COMPUTE_BIT);
+        pipelineInfo.layout = computeLayout;
+
+        VkPipeline pipeline;
+        if (vkCreateComputePipelines(engine.device, engine.pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create compute pipeline " + path + "!");
+        }
+
+        vkDestroyShaderModule(engine.device, shader, nullptr);
+        return pipeline;
+    };
+    emitPipeline = createPipeline("../shaders/particle_emit.comp.spv");
+    simulatePipeline = createPipeline("../shaders/particle_simulate.comp.spv");
+    argsPipeline = createPipeline("../shaders/particle_args.comp.spv");
+}
+
+void ParticleSystem::writeSet() {
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = engine.descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &setLayout;
+    check_vk_result(vkAllocateDescriptorSets(engine.device, &allocInfo, &set));
+
+    VkDescriptorBufferInfo bufferInfos[4] = {
+        {particles.buffer, 0, VK_WHOLE_SIZE},
+        {indices.buffer, 0, VK_WHOLE_SIZE},
+        {state.buffer, 0, VK_WHOLE_SIZE},
+        {readback.buffer, 0, VK_WHOLE_SIZE},
+    };
+
+    VkWriteDescriptorSet writes[4] = {};
+    for (uint32_t i = 0; i < 4; i++) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = set;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets(engine.device, 4, writes, 0, nullptr);
+}
+
+void ParticleSystem::createPipeline(PipelineBuilder builder, const PipelineTarget& target) {
+    if (drawPipeline != VK_NULL_HANDLE) return;
+
+    VkShaderModule vertexShader = loadCompiledShader("../shaders/particle.vert.spv", engine.device);
+    VkShaderModule fragmentShader = loadCompiledShader("../shaders/particle.frag.spv", engine.device);
+
+    builder.shaderStages.clear();
+    builder.shaderStages.push_back(shaderStageInfo(vertexShader, VK_SHADER_STAGE_VERTEX_BIT));
+    builder.shaderStages.push_back(shaderStageInfo(fragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT));
+
+    // Vertices are generated from the instance and vertex index
+    builder.vertexInputInfo.vertexBindingDescriptionCount = 0;
+    builder.vertexInputInfo.vertexAttributeDescriptionCount = 0;
+
+    // Additive and unsorted, tested against but not written to depth
+    builder.rasterizer.cullMode = VK_CULL_MODE_NONE;
+    builder.depthStencil.depthWriteEnable = VK_FALSE;
+    builder.colorBlendAttachment.blendEnable = VK_TRUE;
+    builder.colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    builder.colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    builder.colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    builder.colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    builder.colorBlending.attachmentCount = 1;
+
+    drawPipeline = builder.buildPipeline(engine.device, target, drawLayout);
+
+    vkDestroyShaderModule(engine.device, vertexShader, nullptr);
+    vkDestroyShaderModule(engine.device, fragmentShader, nullptr);
+}
+
+void ParticleSystem::destroy() {
+    VulkanEngine* eng = &engine;
+    AllocatedBuffer buffers[3] = {particles, indices, state};
+    AllocatedBuffer readbackBuffer = readback;
+    VkDescriptorSet descriptorSet = set;
+    VkDescriptorSetLayout layout = setLayout;
+    VkPipelineLayout layouts[2] = {computeLayout, drawLayout};
+    VkPipeline pipelines[4] = {emitPipeline, simulatePipeline, argsPipeline, drawPipeline};
+
+    engine.retire([=] () mutable {
+        VkDevice device = eng->device;
+        for (auto pipeline : pipelines) {
+            if (pipeline != VK_NULL_HANDLE) vkDestroyPipeline(device, pipeline, nullptr);
+        }
+        for (auto pipelineLayout : layouts) vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        vkFreeDescriptorSets(device, eng->descriptorPool, 1, &descriptorSet);
+        vkDestroyDescriptorSetLayout(device, layout, nullptr);
+
+        for (auto& buffer : buffers) eng->destroyBuffer(buffer);
+        vmaUnmapMemory(eng->allocator, readbackBuffer.allocation);
+        eng->destroyBuffer(readbackBuffer);
+    });
+}
+
+void ParticleSystem::beginFrame(uint32_t frameIdx) {
+    frame = frameIdx;
+
+    // Long stalls (window drags, breakpoints) would otherwise throw every particle across the scene
+    auto now = std::chrono::steady_clock::now();
+    float elapsed = fixedTimeStep > 0.f ? fixedTimeStep : std::chrono::duration<float>(now - lastFrame).count();
+    dt = std::min(elapsed, 0.1f);
+    lastFrame = now;
+
+    if (pending[frame]) {
+        vmaInvalidateAllocation(engine.allocator, readback.allocation, 0, VK_WHOLE_SIZE);
+        stats.alive = mappedReadback[frame * 4 + 0];
+        stats.emitted = mappedReadback[frame * 4 + 1];
+        pending[frame] = false;
+    }
+}
+
+void ParticleSystem::addSimulationPass(RenderGraph& graph) {
+    RGBufferDesc desc;
+    particlesResource = graph.importBuffer("Particles", desc);
+    indicesResource = graph.importBuffer("ParticleIndices", desc);
+    stateResource = graph.importBuffer("ParticleState", desc);
+
+    graph.addPass("particles", RGPassType::Compute)
+        .write(particlesResource, RGAccess::StorageBufferWrite)
+        .write(indicesResource, RGAccess::StorageBufferWrite)
+        .write(stateResource, RGAccess::StorageBufferWrite)
+        .execute([this] (VkCommandBuffer cmd, const RGPassContext& context) { recordSimulation(cmd); });
+}
+
+void ParticleSystem::readForDraw(RGPassBuilder& pass) {
+    pass.read(stateResource, RGAccess::IndirectBuffer)
+        .read(particlesResource, RGAccess::StorageBufferReadGraphics)
+        .read(indicesResource, RGAccess::StorageBufferReadGraphics);
+}
+
+void ParticleSystem::bindFrame(RenderGraph& graph) {
+    graph.setBuffer(particlesResource, particles.buffer);
+    graph.setBuffer(indicesResource, indices.buffer);
+    graph.setBuffer(stateResource, state.buffer);
+}
+
+void ParticleSystem::computeBarrier(VkCommandBuffer cmd, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+// Emit into the current alive list, simulate it into the other one, then write the draw for the survivors
+void ParticleSystem::recordSimulation(VkCommandBuffer cmd) {
+    const VkAccessFlags shaderAccess = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, computeLayout, 0, 1, &set, 0, nullptr);
+
+    ArgsConstants args = {};
+    args.current = current;
+    args.capacity = capacity;
+    args.frame = frame;
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, argsPipeline);
+    if (!initialized) {
+        args.mode = ARGS_INIT;
+        vkCmdPushConstants(cmd, computeLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ArgsConstants), &args);
+        vkCmdDispatch(cmd, (capacity + 63) / 64, 1, 1);
+        computeBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, shaderAccess);
+        initialized = true;
+    }
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, emitPipeline);
+    for (auto& emitter : emitters) {
+        if (!emitter.enabled) continue;
+
+        emitter.pending += emitter.rate * dt;
+        float whole = std::floor(emitter.pending);
+        emitter.pending -= whole;
+        uint32_t count = (uint32_t) std::min(whole, (float) capacity);
+        if (count == 0) continue;
+
+        EmitConstants constants = {};
+        constants.position = glm::vec4(emitter.position, emitter.radius);
+        constants.velocity = glm::vec4(emitter.velocity, emitter.spread);
+        constants.color = emitter.color;
+        constants.lifetime = emitter.lifetime;
+        constants.count = count;
+        constants.seed = seed++;
+        constants.current = current;
+        constants.capacity = capacity;
+
+        vkCmdPushConstants(cmd, computeLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(EmitConstants), &constants);
+        vkCmdDispatch(cmd, (count + 63) / 64, 1, 1);
+    }
+    computeBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, shaderAccess);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, argsPipeline);
+    args.mode = ARGS_SIMULATE;
+    vkCmdPushConstants(cmd, computeLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ArgsConstants), &args);
+    vkCmdDispatch(cmd, 1, 1, 1);
+    computeBarrier(cmd, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | shaderAccess);
+
+    SimulateConstants simulate = {};
+    simulate.gravity = glm::vec4(gravity, drag);
+    simulate.dt = dt;
+    simulate.current = current;
+    simulate.capacity = capacity;
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, simulatePipeline);
+    vkCmdPushConstants(cmd, computeLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SimulateConstants), &simulate);
+    vkCmdDispatchIndirect(cmd, state.buffer, SIMULATE_DISPATCH_OFFSET);
+    computeBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, shaderAccess);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, argsPipeline);
+    args.mode = ARGS_DRAW;
+    vkCmdPushConstants(cmd, computeLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ArgsConstants), &args);
+    vkCmdDispatch(cmd, 1, 1, 1);
+
+    // Counters are read on the host once the frame's timeline value is reached, the graph orders the draw
+    computeBarrier(cmd, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+    pending[frame] = true;
+
+    drawList = 1 - current;
+    current = drawList;
+}
+
+void ParticleSystem::recordDraw(VkCommandBuffer cmd, const glm::mat4& viewProj, const glm::mat4& view) {
+    if (drawPipeline == VK_NULL_HANDLE) return;
+
+    DrawConstants constants = {};
+    constants.viewProj = viewProj;
+    // Rows of the view rotation are the camera axes in world space
+    constants.right = glm::vec4(view[0][0], view[1][0], view[2][0], size);
+    constants.up = glm::vec4(view[0][1], view[1][1], view[2][1], 0.f);
+    constants.listOffset = capacity * (1 + drawList);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, drawPipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, drawLayout, 0, 1, &set, 0, nullptr);
+    vkCmdPushConstants(cmd, drawLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawConstants), &constants);
+    vkCmdDrawIndirect(cmd, state.buffer, DRAW_COMMAND_OFFSET, 1, sizeof(VkDrawIndirectCommand));
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+#include "ve_types.hpp"
+#include "ve_pipeline.hpp"
+#include "ve_render_graph.hpp"
+
+class VulkanEngine;
+
+struct ParticleEmitter {
+    bool enabled = true;
+    glm::vec3 position = glm::vec3(0.f);
+    float radius = 0.5f;               // Of the sphere particles spawn in
+    float rate = 10000.f;              // Particles per second
+    float lifetime = 2.f;              // Seconds, varies by +-25% per particle
+    glm::vec3 velocity = glm::vec3(0.f, 5.f, 0.f);
+    float spread = 2.f;                // Random speed added in any direction
+    glm::vec4 color = glm::vec4(1.f, 0.6f, 0.2f, 1.f);
+
+    float pending = 0.f; // Fraction of a particle carried over to the next frame
+};
+
+struct ParticleStats {
+    uint32_t capacity = 0;
+    uint32_t alive = 0;   // After the simulation of the most recently completed frame
+    uint32_t emitted = 0; // During that frame
+};
+
+// GPU particles. Emitting, simulating and compacting the alive list run in compute shaders on storage
+// buffers, the draw is indirect with one instance per alive particle, so the CPU only records a fixed
+// number of commands per frame regardless of the particle count.
+class ParticleSystem {
+public:
+    ParticleSystem(VulkanEngine& engine, uint32_t capacity, uint32_t framesInFlight);
+    void destroy();
+
+    // The builder is copied and turned into an additive, depth tested billboard pipeline
+    void createPipeline(PipelineBuilder builder, const PipelineTarget& target);
+
+    // The frame's slot must not be in use by the GPU anymore, reads back its last counters
+    void beginFrame(uint32_t frame);
+
+    // Graph setup, the simulation pass has to come before the passes drawing particles
+    void addSimulationPass(RenderGraph& graph);
+    void readForDraw(RGPassBuilder& pass);
+    void bindFrame(RenderGraph& graph);
+
+    // Inside a render pass, with the view's viewport set
+    void recordDraw(VkCommandBuffer cmd, const glm::mat4& viewProj, const glm::mat4& view);
+
+    std::vector<ParticleEmitter> emitters;
+    glm::vec3 gravity = glm::vec3(0.f, -9.81f, 0.f);
+    float drag = 0.1f; // Fraction of the velocity lost per second
+    float size = 0.05f;
+    float fixedTimeStep = 0.f; // Seconds each frame advances instead of the clock's, unless 0. Replays set it.
+
+    ParticleStats stats;
+
+    RGResource particlesResource = RG_NONE;
+    RGResource indicesResource = RG_NONE;
+    RGResource stateResource = RG_NONE;
+
+private:
+    VulkanEngine& engine;
+    uint32_t capacity;
+    uint32_t framesInFlight;
+    uint32_t frame = 0;
+    uint32_t seed = 0;
+
+    uint32_t current = 0;  // Alive list the next emit appends to
+    uint32_t drawList = 0; // Alive list written by the last recorded simulation
+    bool initialized = false;
+    std::vector<bool> pending; // Readback slot holds results of a submitted frame
+
+    float dt = 0.f;
+    std::chrono::steady_clock::time_point lastFrame;
+
+    AllocatedBuffer particles = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+    AllocatedBuffer indices = {VK_NULL_HANDLE, VK_NULL_HANDLE}; // Dead list, then both alive lists
+    AllocatedBuffer state = {VK_NULL_HANDLE, VK_NULL_HANDLE};   // Counters and indirect commands
+    AllocatedBuffer readback = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+    uint32_t* mappedReadback = nullptr;
+
+    VkDescriptorSetLayout setLayout;
+    VkDescriptorSet set;
+    VkPipelineLayout computeLayout;
+    VkPipelineLayout drawLayout;
+    VkPipeline emitPipeline;
+    VkPipeline simulatePipeline;
+    VkPipeline argsPipeline;
+    VkPipeline drawPipeline = VK_NULL_HANDLE;
+
+    void createComputePipelines();
+    void writeSet();
+    void recordSimulation(VkCommandBuffer cmd);
+    void computeBarrier(VkCommandBuffer cmd, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+};
@@ -5,6 +5,22 @@
 
 
 VkPipeline PipelineBuilder::buildPipeline(VkDevice device, VkRenderPass renderPass, VkPipelineLayout layout) {
+    PipelineTarget target;
+    target.renderPass = renderPass;
+    return buildPipeline(device, target, layout);
+}
+
+static bool hasStencil(VkFormat format) {
+    return format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT ||
+        format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+VkPipeline PipelineBuilder::buildPipeline(VkDevice device, const PipelineTarget& target, VkPipelineLayout layout) {
+
+    // Copies of a builder would otherwise still point at the original's state
+    viewportState.pViewports = &viewport;
+    viewportState.pScissors = &scissor;
+    colorBlending.pAttachments = &colorBlendAttachment;
 
     VkGraphicsPipelineCreateInfo pipelineInfo{};
     pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -18,13 +34,29 @@ VkPipeline PipelineBuilder::buildPipeline(VkDevice device, VkRenderPass renderPa
     pipelineInfo.pMultisampleState = &multisampling;
     pipelineInfo.pDepthStencilState = nullptr; // Optional
     pipelineInfo.pColorBlendState = &colorBlending;
-    pipelineInfo.pDynamicState = nullptr; // Optional
+
+    VkPipelineDynamicStateCreateInfo dynamicState {};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = (uint32_t) dynamicStates.size();
+    dynamicState.pDynamicStates = dynamicStates.data();
+    pipelineInfo.pDynamicState = dynamicStates.empty() ? nullptr : &dynamicState;
 
     pipelineInfo.layout = layout;
 
-    pipelineInfo.renderPass = renderPass;
+    pipelineInfo.renderPass = target.renderPass;
     pipelineInfo.subpass = 0;
 
+    // Without a render pass the formats come from dynamic rendering
+    VkPipelineRenderingCreateInfoKHR renderingInfo {};
+    if (target.renderPass == VK_NULL_HANDLE) {
+        renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+        renderingInfo.colorAttachmentCount = (uint32_t) target.colorFormats.size();
+        renderingInfo.pColorAttachmentFormats = target.colorFormats.data();
+        renderingInfo.depthAttachmentFormat = target.depthFormat;
+        renderingInfo.stencilAttachmentFormat = hasStencil(target.depthFormat) ? target.depthFormat : VK_FORMAT_UNDEFINED;
+        pipelineInfo.pNext = &renderingInfo;
+    }
+
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
     pipelineInfo.basePipelineIndex = -1; // Optional
 
@@ -125,6 +157,8 @@ void PipelineBuilder::initBasic() {
     depthStencil.minDepthBounds = 0.0f; // Optional
     depthStencil.maxDepthBounds = 1.0f; // Optional
     depthStencil.stencilTestEnable = VK_FALSE;
+
+    dynamicStates.clear();
 }
 
 VkShaderModule loadCompiledShader(const std::string &filename, VkDevice device)
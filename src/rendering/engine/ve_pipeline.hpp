@@ -4,6 +4,14 @@
 #include <vector>
 #include <string>
 
+// What a graphics pipeline renders into: a render pass, or with dynamic rendering only the attachment formats
+struct PipelineTarget
+{
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    std::vector<VkFormat> colorFormats;
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+};
+
 struct PipelineBuilder
 {
     public: 
@@ -18,6 +26,7 @@ struct PipelineBuilder
 	VkPipelineColorBlendStateCreateInfo colorBlending;
 	VkPipelineMultisampleStateCreateInfo multisampling;
 	VkPipelineDepthStencilStateCreateInfo depthStencil;
+	std::vector<VkDynamicState> dynamicStates; // Empty if the pipeline is fully static
 
 	PipelineBuilder() {}
 	~PipelineBuilder() {}
@@ -25,6 +34,7 @@ struct PipelineBuilder
     void initBasic();
 
     VkPipeline buildPipeline(VkDevice device, VkRenderPass renderPass, VkPipelineLayout layout);
+    VkPipeline buildPipeline(VkDevice device, const PipelineTarget& target, VkPipelineLayout layout);
 };
 
 VkShaderModule loadCompiledShader(const std::string &filename, VkDevice device);
@@ -0,0 +1,1021 @@
+#include "ve_render_graph.hpp"
+#include "vk_engine.hpp"
+
+#include <algorithm>
+
+struct RGAccessInfo {
+    VkPipelineStageFlags stage;
+    VkAccessFlags access;
+    VkImageLayout layout;
+    bool write;
+    VkImageUsageFlags imageUsage;
+    VkBufferUsageFlags bufferUsage;
+};
+
+static RGAccessInfo getAccessInfo(RGAccess access)
+{
+    const VkPipelineStageFlags fragmentTests = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    const VkPipelineStageFlags graphicsShaders = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+    switch (access)
+    {
+    case RGAccess::ColorAttachment:
+        return {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, 0};
+    case RGAccess::DepthAttachment:
+        return {fragmentTests, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0};
+    case RGAccess::DepthRead:
+        return {fragmentTests, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, false, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0};
+    case RGAccess::SampledFragment:
+        return {VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false, VK_IMAGE_USAGE_SAMPLED_BIT, 0};
+    case RGAccess::SampledCompute:
+        return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false, VK_IMAGE_USAGE_SAMPLED_BIT, 0};
+    case RGAccess::StorageImageRead:
+        return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+            VK_IMAGE_LAYOUT_GENERAL, false, VK_IMAGE_USAGE_STORAGE_BIT, 0};
+    case RGAccess::StorageImageWrite:
+        return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_GENERAL, true, VK_IMAGE_USAGE_STORAGE_BIT, 0};
+    case RGAccess::TransferSrc:
+        return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false, VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT};
+    case RGAccess::TransferDst:
+        return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true, VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_BUFFER_USAGE_TRANSFER_DST_BIT};
+    case RGAccess::VertexBuffer:
+        return {VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED, false, 0, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT};
+    case RGAccess::IndexBuffer:
+        return {VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED, false, 0, VK_BUFFER_USAGE_INDEX_BUFFER_BIT};
+    case RGAccess::IndirectBuffer:
+        return {VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED, false, 0, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT};
+    case RGAccess::UniformBuffer:
+        return {graphicsShaders | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_UNIFORM_READ_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED, false, 0, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT};
+    case RGAccess::StorageBufferRead:
+        return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED, false, 0, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT};
+    case RGAccess::StorageBufferWrite:
+        return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED, true, 0, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT};
+    case RGAccess::StorageBufferReadGraphics:
+        return {graphicsShaders, VK_ACCESS_SHADER_READ_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED, false, 0, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT};
+    case RGAccess::HostRead:
+        return {VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED, false, 0, 0};
+    }
+    throw std::runtime_error("unknown render graph access!");
+}
+
+static bool isAttachmentAccess(RGAccess access)
+{
+    return access == RGAccess::ColorAttachment || access == RGAccess::DepthAttachment || access == RGAccess::DepthRead;
+}
+
+static RGAccess attachmentAccess(const RGPass& pass, RGResource resource)
+{
+    for (auto& use : pass.uses)
+    {
+        if (use.resource == resource && isAttachmentAccess(use.access)) return use.access;
+    }
+    return RGAccess::ColorAttachment;
+}
+
+// Whether the pass depends on the previous contents of the resource
+static bool readsContents(const RGUse& use)
+{
+    if (isAttachmentAccess(use.access))
+    {
+        return use.access == RGAccess::DepthRead || use.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD;
+    }
+    return !getAccessInfo(use.access).write || use.access == RGAccess::StorageImageWrite || use.access == RGAccess::StorageBufferWrite;
+}
+
+// ============== DECLARATION ==============
+
+RGPassBuilder& RGPassBuilder::color(RGResource image, VkAttachmentLoadOp loadOp, VkClearValue clear)
+{
+    graph.passes[pass].uses.push_back({image, RGAccess::ColorAttachment, loadOp, clear});
+    return *this;
+}
+
+RGPassBuilder& RGPassBuilder::depth(RGResource image, VkAttachmentLoadOp loadOp, bool write)
+{
+    VkClearValue clear;
+    clear.depthStencil.depth = 1.f;
+    clear.depthStencil.stencil = 0;
+    graph.passes[pass].uses.push_back({image, write ? RGAccess::DepthAttachment : RGAccess::DepthRead, loadOp, clear});
+    return *this;
+}
+
+RGPassBuilder& RGPassBuilder::read(RGResource resource, RGAccess access)
+{
+    graph.passes[pass].uses.push_back({resource, access});
+    return *this;
+}
+
+RGPassBuilder& RGPassBuilder::write(RGResource resource, RGAccess access)
+{
+    graph.passes[pass].uses.push_back({resource, access});
+    return *this;
+}
+
+RGPassBuilder& RGPassBuilder::sideEffect()
+{
+    graph.passes[pass].sideEffect = true;
+    return *this;
+}
+
+RGPassBuilder& RGPassBuilder::legacyRenderPass()
+{
+    graph.passes[pass].legacyRenderPass = true;
+    return *this;
+}
+
+RGPassBuilder& RGPassBuilder::execute(RGExecuteFunc func)
+{
+    graph.passes[pass].execute = func;
+    return *this;
+}
+
+RenderGraph::RenderGraph(VulkanEngine& engine) : engine(engine) {}
+
+RGResource RenderGraph::addResource(RGResourceNode node)
+{
+    resources.push_back(node);
+    return (RGResource) (resources.size() - 1);
+}
+
+RGResource RenderGraph::createImage(const std::string& name, const RGImageDesc& desc)
+{
+    RGResourceNode node;
+    node.name = name;
+    node.image = desc;
+    return addResource(node);
+}
+
+RGResource RenderGraph::createBuffer(const std::string& name, const RGBufferDesc& desc)
+{
+    RGResourceNode node;
+    node.name = name;
+    node.isImage = false;
+    node.buffer = desc;
+    return addResource(node);
+}
+
+RGResource RenderGraph::importImage(const std::string& name, const RGImageDesc& desc, VkImageLayout initialLayout, VkImageLayout finalLayout)
+{
+    RGResourceNode node;
+    node.name = name;
+    node.image = desc;
+    node.imported = true;
+    node.initialLayout = initialLayout;
+    node.finalLayout = finalLayout;
+    return addResource(node);
+}
+
+RGResource RenderGraph::importBuffer(const std::string& name, const RGBufferDesc& desc)
+{
+    RGResourceNode node;
+    node.name = name;
+    node.isImage = false;
+    node.imported = true;
+    node.buffer = desc;
+    return addResource(node);
+}
+
+void RenderGraph::setImage(RGResource resource, VkImage image, VkImageView view)
+{
+    resources[resource].vkImage = image;
+    resources[resource].view = view;
+}
+
+void RenderGraph::setBuffer(RGResource resource, VkBuffer buffer)
+{
+    resources[resource].vkBuffer = buffer;
+}
+
+void RenderGraph::markOutput(RGResource resource)
+{
+    resources[resource].output = true;
+}
+
+RGPassBuilder RenderGraph::addPass(const std::string& name, RGPassType type)
+{
+    RGPass pass;
+    pass.name = name;
+    pass.type = type;
+    passes.push_back(pass);
+    return RGPassBuilder(*this, (uint32_t) (passes.size() - 1));
+}
+
+// ============== COMPILATION ==============
+
+void RenderGraph::compile()
+{
+    if (compiled) releaseCompiled();
+
+    cullPasses();
+    computeLifetimes();
+    allocateTransients();
+
+    for (auto& pass : passes)
+    {
+        if (!pass.alive || pass.type != RGPassType::Graphics) continue;
+
+        collectAttachments(pass);
+        if (!engine.dynamicRendering || pass.legacyRenderPass) createRenderPass(pass);
+    }
+
+    computeBarriers();
+    compiled = true;
+
+    engine.vkLogger->debug("Render graph compiled: {} passes ({} culled), {} transient images ({} lazy), {} of {} bytes after aliasing",
+        passes.size(), culledPassCount, transientImageCount, lazyImageCount, transientBytes, transientBytesNaive);
+}
+
+// Walks the passes backwards, a pass survives if something downstream consumes one of its writes
+void RenderGraph::cullPasses()
+{
+    std::vector<bool> needed(resources.size(), false);
+    for (size_t i = 0; i < resources.size(); i++)
+    {
+        needed[i] = resources[i].output || resources[i].imported;
+    }
+
+    culledPassCount = 0;
+    for (int i = (int) passes.size() - 1; i >= 0; i--)
+    {
+        RGPass& pass = passes[i];
+        pass.alive = pass.sideEffect;
+
+        for (auto& use : pass.uses)
+        {
+            if (getAccessInfo(use.access).write && needed[use.resource]) pass.alive = true;
+        }
+
+        if (!pass.alive)
+        {
+            culledPassCount++;
+            engine.vkLogger->debug("Render graph: culling pass {}", pass.name);
+            continue;
+        }
+
+        for (auto& use : pass.uses)
+        {
+            if (readsContents(use)) needed[use.resource] = true;
+        }
+    }
+}
+
+void RenderGraph::computeLifetimes()
+{
+    for (auto& resource : resources)
+    {
+        resource.firstPass = -1;
+        resource.lastPass = -1;
+        resource.imageUsage = resource.image.usage;
+        resource.bufferUsage = resource.buffer.usage;
+    }
+
+    for (size_t i = 0; i < passes.size(); i++)
+    {
+        if (!passes[i].alive) continue;
+
+        for (auto& use : passes[i].uses)
+        {
+            auto& resource = resources[use.resource];
+            auto info = getAccessInfo(use.access);
+
+            if (resource.firstPass < 0) resource.firstPass = (int) i;
+            resource.lastPass = (int) i;
+            resource.imageUsage |= info.imageUsage;
+            resource.bufferUsage |= info.bufferUsage;
+        }
+    }
+}
+
+void RenderGraph::allocateTransients()
+{
+    const VkImageUsageFlags attachmentUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+    transientImageCount = 0;
+    lazyImageCount = 0;
+    transientBytes = 0;
+    transientBytesNaive = 0;
+
+    struct AliasCandidate {
+        RGResource resource;
+        VkMemoryRequirements requirements;
+    };
+    std::vector<AliasCandidate> candidates;
+
+    for (size_t i = 0; i < resources.size(); i++)
+    {
+        auto& resource = resources[i];
+        if (resource.imported || resource.firstPass < 0) continue;
+
+        if (!resource.isImage)
+        {
+            resource.ownedBuffer = engine.createBuffer(resource.buffer.size, resource.bufferUsage, VMA_MEMORY_USAGE_GPU_ONLY, "RenderGraph");
+            resource.vkBuffer = resource.ownedBuffer.buffer;
+            continue;
+        }
+
+        transientImageCount++;
+
+        VkImageCreateInfo imageInfo = {};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = resource.image.format;
+        imageInfo.extent = {resource.image.extent.width, resource.image.extent.height, 1};
+        imageInfo.mipLevels = resource.image.mipLevels;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = resource.imageUsage;
+
+        // Attachments that live within a single pass never need their contents in memory
+        bool lazyCandidate = (resource.imageUsage & ~attachmentUsage) == 0 && resource.firstPass == resource.lastPass && !resource.output;
+        if (lazyCandidate)
+        {
+            VkImageCreateInfo lazyInfo = imageInfo;
+            lazyInfo.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+
+            VmaAllocationCreateInfo lazyAlloc = {};
+            lazyAlloc.usage = VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED;
+
+            uint32_t memoryType;
+            if (vmaFindMemoryTypeIndexForImageInfo(engine.allocator, &lazyInfo, &lazyAlloc, &memoryType) == VK_SUCCESS)
+            {
+                resource.ownedImage = engine.createImage(lazyInfo, lazyAlloc, "RenderGraph");
+                resource.vkImage = resource.ownedImage._image;
+                resource.lazy = true;
+                lazyImageCount++;
+                continue;
+            }
+        }
+
+        if (vkCreateImage(engine.device, &imageInfo, nullptr, &resource.vkImage) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create render graph image " + resource.name + "!");
+        }
+
+        AliasCandidate candidate;
+        candidate.resource = (RGResource) i;
+        vkGetImageMemoryRequirements(engine.device, resource.vkImage, &candidate.requirements);
+        candidates.push_back(candidate);
+    }
+
+    // Greedy aliasing, largest images first so a slot's size is set by its first member
+    std::sort(candidates.begin(), candidates.end(), [] (const AliasCandidate& a, const AliasCandidate& b) {
+        return a.requirements.size > b.requirements.size;
+    });
+
+    struct MemorySlot {
+        VkMemoryRequirements requirements;
+        std::vector<RGResource> members;
+    };
+    std::vector<MemorySlot> slots;
+
+    for (auto& candidate : candidates)
+    {
+        auto& resource = resources[candidate.resource];
+        transientBytesNaive += candidate.requirements.size;
+
+        MemorySlot* target = nullptr;
+        for (auto& slot : slots)
+        {
+            if ((slot.requirements.memoryTypeBits & candidate.requirements.memoryTypeBits) == 0) continue;
+
+            bool overlaps = false;
+            for (auto member : slot.members)
+            {
+                auto& other = resources[member];
+                if (resource.firstPass <= other.lastPass && other.firstPass <= resource.lastPass) overlaps = true;
+            }
+
+            if (!overlaps)
+            {
+                target = &slot;
+                break;
+            }
+        }
+
+        if (target == nullptr)
+        {
+            slots.push_back({candidate.requirements, {}});
+            target = &slots.back();
+        }
+
+        target->requirements.memoryTypeBits &= candidate.requirements.memoryTypeBits;
+        target->requirements.alignment = std::max(target->requirements.alignment, candidate.requirements.alignment);
+        target->members.push_back(candidate.resource);
+    }
+
+    for (auto& slot : slots)
+    {
+        VmaAllocationCreateInfo allocInfo = {};
+        allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+        VmaAllocation allocation;
+        if (vmaAllocateMemory(engine.allocator, &slot.requirements, &allocInfo, &allocation, nullptr) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate render graph memory!");
+        }
+        engine.tagAllocation(allocation, "RenderGraph");
+        transientBytes += slot.requirements.size;
+
+        for (auto member : slot.members)
+        {
+            check_vk_result(vmaBindImageMemory(engine.allocator, allocation, resources[member].vkImage));
+            resources[member].memorySlot = (int) memorySlots.size();
+        }
+        memorySlots.push_back(allocation);
+    }
+
+    for (auto& resource : resources)
+    {
+        if (resource.imported || !resource.isImage || resource.vkImage == VK_NULL_HANDLE) continue;
+
+        VkImageViewCreateInfo viewInfo = {};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.image = resource.vkImage;
+        viewInfo.format = resource.image.format;
+        viewInfo.subresourceRange.aspectMask = resource.image.aspect;
+        viewInfo.subresourceRange.baseMipLevel = 0;
+        viewInfo.subresourceRange.levelCount = resource.image.mipLevels;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        if (vkCreateImageView(engine.device, &viewInfo, nullptr, &resource.view) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create render graph image view " + resource.name + "!");
+        }
+    }
+}
+
+// Layout transitions are done by the graph's barriers, so attachments stay in one layout for the whole render pass
+// Attachments in declaration order with the load and store ops both render passes and dynamic rendering use
+void RenderGraph::collectAttachments(RGPass& pass)
+{
+    int passIdx = (int) (&pass - passes.data());
+
+    pass.attachments.clear();
+    pass.clearValues.clear();
+    pass.loadOps.clear();
+    pass.storeOps.clear();
+
+    for (auto& use : pass.uses)
+    {
+        if (!isAttachmentAccess(use.access)) continue;
+
+        auto& resource = resources[use.resource];
+        bool store = resource.imported || resource.output || resource.lastPass > passIdx;
+
+        pass.attachments.push_back(use.resource);
+        pass.clearValues.push_back(use.clear);
+        pass.loadOps.push_back(use.access == RGAccess::DepthRead ? VK_ATTACHMENT_LOAD_OP_LOAD : use.loadOp);
+        pass.storeOps.push_back(store ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE);
+    }
+}
+
+void RenderGraph::createRenderPass(RGPass& pass)
+{
+    std::vector<VkAttachmentDescription> attachments;
+    std::vector<VkAttachmentReference> colorRefs;
+    VkAttachmentReference depthRef = {};
+    bool hasDepth = false;
+
+    for (size_t i = 0; i < pass.attachments.size(); i++)
+    {
+        auto& resource = resources[pass.attachments[i]];
+        RGAccess access = attachmentAccess(pass, pass.attachments[i]);
+        auto info = getAccessInfo(access);
+
+        VkAttachmentDescription attachment = {};
+        attachment.format = resource.image.format;
+        attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        attachment.loadOp = pass.loadOps[i];
+        attachment.storeOp = pass.storeOps[i];
+        attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachment.initialLayout = info.layout;
+        attachment.finalLayout = info.layout;
+
+        VkAttachmentReference ref = {};
+        ref.attachment = (uint32_t) attachments.size();
+        ref.layout = info.layout;
+
+        if (access == RGAccess::ColorAttachment)
+        {
+            colorRefs.push_back(ref);
+        }
+        else
+        {
+            depthRef = ref;
+            hasDepth = true;
+        }
+
+        attachments.push_back(attachment);
+    }
+
+    VkSubpassDescription subpass = {};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = (uint32_t) colorRefs.size();
+    subpass.pColorAttachments = colorRefs.data();
+    subpass.pDepthStencilAttachment = hasDepth ? &depthRef : nullptr;
+
+    VkRenderPassCreateInfo renderPassInfo = {};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = (uint32_t) attachments.size();
+    renderPassInfo.pAttachments = attachments.data();
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+
+    if (vkCreateRenderPass(engine.device, &renderPassInfo, nullptr, &pass.renderPass) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create render pass " + pass.name + "!");
+    }
+}
+
+// Tracks the last writes and reads of every resource and only emits a barrier for real hazards or layout changes
+void RenderGraph::computeBarriers()
+{
+    struct State {
+        bool used = false;
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags writeStage = 0;
+        VkAccessFlags writeAccess = 0;
+        VkPipelineStageFlags readStages = 0;
+    };
+    std::vector<State> states(resources.size());
+    std::vector<std::pair<int, size_t>> firstBarriers(resources.size(), {-1, 0}); // Pass and barrier index of the first use of imports and buffers
+
+    for (size_t passIdx = 0; passIdx < passes.size(); passIdx++)
+    {
+        RGPass& pass = passes[passIdx];
+        pass.barriers.clear();
+        if (!pass.alive) continue;
+
+        for (auto& use : pass.uses)
+        {
+            auto& resource = resources[use.resource];
+            auto& state = states[use.resource];
+            auto info = getAccessInfo(use.access);
+            VkImageLayout layout = resource.isImage ? info.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+
+            if (!state.used)
+            {
+                state.used = true;
+
+                if (resource.imported)
+                {
+                    // Waits on the stage itself so it chains with semaphore waits of the submission,
+                    // writes of the previous execution are added once the whole graph is known
+                    RGBarrier barrier;
+                    barrier.resource = use.resource;
+                    barrier.srcStage = info.stage;
+                    barrier.srcAccess = 0;
+                    barrier.dstStage = info.stage;
+                    barrier.dstAccess = info.access;
+                    barrier.oldLayout = resource.isImage ? resource.initialLayout : VK_IMAGE_LAYOUT_UNDEFINED;
+                    barrier.newLayout = layout;
+
+                    firstBarriers[use.resource] = {(int) passIdx, pass.barriers.size()};
+                    pass.barriers.push_back(barrier);
+                }
+                else if (!resource.isImage)
+                {
+                    // Created buffers keep their memory between executions, so like imports they wait for the
+                    // previous execution's accesses, added below
+                    RGBarrier barrier;
+                    barrier.resource = use.resource;
+                    barrier.srcStage = info.stage;
+                    barrier.srcAccess = info.write ? info.access : 0;
+                    barrier.dstStage = info.stage;
+                    barrier.dstAccess = info.access;
+                    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+                    barrier.newLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+                    firstBarriers[use.resource] = {(int) passIdx, pass.barriers.size()};
+                    pass.barriers.push_back(barrier);
+                }
+                else
+                {
+                    RGBarrier barrier;
+                    barrier.resource = use.resource;
+                    barrier.dstStage = info.stage;
+                    barrier.dstAccess = info.access;
+                    barrier.newLayout = layout;
+
+                    // Aliased memory may still be in use by the previous occupant, otherwise only the
+                    // same pass of the previous frame has to finish with the image
+                    bool aliased = resource.memorySlot >= 0;
+                    barrier.srcStage = aliased ? VK_PIPELINE_STAGE_ALL_COMMANDS_BIT : info.stage;
+                    barrier.srcAccess = aliased ? VK_ACCESS_MEMORY_WRITE_BIT : (info.write ? info.access : 0);
+                    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+                    if (barrier.oldLayout != barrier.newLayout || barrier.srcAccess != 0)
+                    {
+                        pass.barriers.push_back(barrier);
+                    }
+                }
+
+                state.layout = layout;
+                state.writeStage = info.write || resource.isImage ? info.stage : 0;
+                state.writeAccess = info.write ? info.access : 0;
+                state.readStages = info.write ? 0 : info.stage;
+                continue;
+            }
+
+            bool layoutChange = resource.isImage && state.layout != layout;
+
+            if (info.write || layoutChange)
+            {
+                RGBarrier barrier;
+                barrier.resource = use.resource;
+                barrier.srcStage = state.writeStage | state.readStages;
+                barrier.srcAccess = state.writeAccess;
+                barrier.dstStage = info.stage;
+                barrier.dstAccess = info.access;
+                barrier.oldLayout = state.layout;
+                barrier.newLayout = layout;
+                pass.barriers.push_back(barrier);
+
+                // A layout transition behaves like a write for later readers in other stages
+                state.layout = layout;
+                state.writeStage = info.stage;
+                state.writeAccess = info.write ? info.access : 0;
+                state.readStages = info.write ? 0 : info.stage;
+            }
+            else
+            {
+                if (state.writeStage != 0 && (info.stage & ~state.readStages) != 0)
+                {
+                    RGBarrier barrier;
+                    barrier.resource = use.resource;
+                    barrier.srcStage = state.writeStage;
+                    barrier.srcAccess = state.writeAccess;
+                    barrier.dstStage = info.stage;
+                    barrier.dstAccess = info.access;
+                    barrier.oldLayout = layout;
+                    barrier.newLayout = layout;
+                    pass.barriers.push_back(barrier);
+                }
+                state.readStages |= info.stage;
+            }
+        }
+    }
+
+    // Imports and buffers written by the graph are used again by its next execution, e.g. last frame's depth pyramid
+    for (size_t i = 0; i < resources.size(); i++)
+    {
+        if (firstBarriers[i].first < 0) continue;
+
+        auto& barriers = passes[firstBarriers[i].first].barriers;
+        RGBarrier& barrier = barriers[firstBarriers[i].second];
+        barrier.srcStage |= states[i].writeStage | states[i].readStages;
+        barrier.srcAccess |= states[i].writeAccess;
+    }
+
+    for (auto& pass : passes)
+    {
+        pass.barriers.erase(std::remove_if(pass.barriers.begin(), pass.barriers.end(), [] (const RGBarrier& barrier) {
+            return barrier.oldLayout == barrier.newLayout && barrier.srcAccess == 0 && barrier.srcStage == barrier.dstStage;
+        }), pass.barriers.end());
+    }
+
+    finalBarriers.clear();
+    for (size_t i = 0; i < resources.size(); i++)
+    {
+        auto& resource = resources[i];
+        auto& state = states[i];
+        if (!resource.imported || !resource.isImage || !state.used) continue;
+        if (resource.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED || resource.finalLayout == state.layout) continue;
+
+        RGBarrier barrier;
+        barrier.resource = (RGResource) i;
+        barrier.srcStage = state.writeStage | state.readStages;
+        barrier.srcAccess = state.writeAccess;
+        barrier.dstStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        barrier.dstAccess = 0;
+        barrier.oldLayout = state.layout;
+        barrier.newLayout = resource.finalLayout;
+        finalBarriers.push_back(barrier);
+    }
+}
+
+// ============== EXECUTION ==============
+
+void RenderGraph::recordBarriers(VkCommandBuffer cmd, const std::vector<RGBarrier>& barriers)
+{
+    if (barriers.empty()) return;
+
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    std::vector<VkBufferMemoryBarrier> bufferBarriers;
+    VkPipelineStageFlags srcStages = 0;
+    VkPipelineStageFlags dstStages = 0;
+
+    for (auto& barrier : barriers)
+    {
+        auto& resource = resources[barrier.resource];
+        srcStages |= barrier.srcStage;
+        dstStages |= barrier.dstStage;
+
+        if (resource.isImage)
+        {
+            VkImageMemoryBarrier imageBarrier = {};
+            imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            imageBarrier.srcAccessMask = barrier.srcAccess;
+            imageBarrier.dstAccessMask = barrier.dstAccess;
+            imageBarrier.oldLayout = barrier.oldLayout;
+            imageBarrier.newLayout = barrier.newLayout;
+            imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imageBarrier.image = resource.vkImage;
+            imageBarrier.subresourceRange.aspectMask = resource.image.aspect;
+            imageBarrier.subresourceRange.baseMipLevel = 0;
+            imageBarrier.subresourceRange.levelCount = resource.image.mipLevels;
+            imageBarrier.subresourceRange.baseArrayLayer = 0;
+            imageBarrier.subresourceRange.layerCount = 1;
+            imageBarriers.push_back(imageBarrier);
+        }
+        else
+        {
+            VkBufferMemoryBarrier bufferBarrier = {};
+            bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            bufferBarrier.srcAccessMask = barrier.srcAccess;
+            bufferBarrier.dstAccessMask = barrier.dstAccess;
+            bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            bufferBarrier.buffer = resource.vkBuffer;
+            bufferBarrier.offset = 0;
+            bufferBarrier.size = VK_WHOLE_SIZE;
+            bufferBarriers.push_back(bufferBarrier);
+        }
+    }
+
+    if (srcStages == 0) srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+
+    vkCmdPipelineBarrier(cmd, srcStages, dstStages, 0,
+        0, nullptr,
+        (uint32_t) bufferBarriers.size(), bufferBarriers.data(),
+        (uint32_t) imageBarriers.size(), imageBarriers.data());
+}
+
+VkFramebuffer RenderGraph::getFramebuffer(RGPass& pass)
+{
+    std::vector<VkImageView> views;
+    for (auto attachment : pass.attachments)
+    {
+        views.push_back(resources[attachment].view);
+    }
+
+    auto it = pass.framebuffers.find(views);
+    if (it != pass.framebuffers.end()) return it->second;
+
+    const RGImageDesc& desc = resources[pass.attachments[0]].image;
+
+    VkFramebufferCreateInfo framebufferInfo = {};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = pass.renderPass;
+    framebufferInfo.attachmentCount = (uint32_t) views.size();
+    framebufferInfo.pAttachments = views.data();
+    framebufferInfo.width = desc.extent.width;
+    framebufferInfo.height = desc.extent.height;
+    framebufferInfo.layers = 1;
+
+    VkFramebuffer framebuffer;
+    if (vkCreateFramebuffer(engine.device, &framebufferInfo, nullptr, &framebuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create framebuffer for " + pass.name + "!");
+    }
+
+    pass.framebuffers[views] = framebuffer;
+    return framebuffer;
+}
+
+void RenderGraph::execute(VkCommandBuffer cmd)
+{
+    for (auto& pass : passes)
+    {
+        if (!pass.alive) continue;
+
+        recordBarriers(cmd, pass.barriers);
+
+        RGPassContext context;
+
+        if (pass.type == RGPassType::Graphics && pass.renderPass == VK_NULL_HANDLE)
+        {
+            context.extent = resources[pass.attachments[0]].image.extent;
+
+            std::vector<VkRenderingAttachmentInfoKHR> colorAttachments;
+            VkRenderingAttachmentInfoKHR depthAttachment = {};
+            bool hasDepth = false;
+
+            for (size_t i = 0; i < pass.attachments.size(); i++)
+            {
+                RGAccess access = attachmentAccess(pass, pass.attachments[i]);
+
+                // Barriers already moved the image into the attachment layout
+                VkRenderingAttachmentInfoKHR attachment = {};
+                attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+                attachment.imageView = resources[pass.attachments[i]].view;
+                attachment.imageLayout = getAccessInfo(access).layout;
+                attachment.loadOp = pass.loadOps[i];
+                attachment.storeOp = pass.storeOps[i];
+                attachment.clearValue = pass.clearValues[i];
+
+                if (access == RGAccess::ColorAttachment)
+                {
+                    colorAttachments.push_back(attachment);
+                }
+                else
+                {
+                    depthAttachment = attachment;
+                    hasDepth = true;
+                }
+            }
+
+            VkRenderingInfoKHR renderingInfo = {};
+            renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+            renderingInfo.renderArea.offset = {0, 0};
+            renderingInfo.renderArea.extent = context.extent;
+            renderingInfo.layerCount = 1;
+            renderingInfo.colorAttachmentCount = (uint32_t) colorAttachments.size();
+            renderingInfo.pColorAttachments = colorAttachments.data();
+            renderingInfo.pDepthAttachment = hasDepth ? &depthAttachment : nullptr;
+
+            engine.cmdBeginRendering(cmd, &renderingInfo);
+            if (pass.execute) pass.execute(cmd, context);
+            engine.cmdEndRendering(cmd);
+        }
+        else if (pass.type == RGPassType::Graphics)
+        {
+            context.renderPass = pass.renderPass;
+            context.extent = resources[pass.attachments[0]].image.extent;
+
+            VkRenderPassBeginInfo renderPassInfo = {};
+            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            renderPassInfo.renderPass = pass.renderPass;
+            renderPassInfo.framebuffer = getFramebuffer(pass);
+            renderPassInfo.renderArea.offset = {0, 0};
+            renderPassInfo.renderArea.extent = context.extent;
+            renderPassInfo.clearValueCount = (uint32_t) pass.clearValues.size();
+            renderPassInfo.pClearValues = pass.clearValues.data();
+
+            vkCmdBeginRenderPass(cmd, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+            if (pass.execute) pass.execute(cmd, context);
+            vkCmdEndRenderPass(cmd);
+        }
+        else if (pass.execute)
+        {
+            pass.execute(cmd, context);
+        }
+    }
+
+    recordBarriers(cmd, finalBarriers);
+}
+
+// ============== LIFETIME ==============
+
+void RenderGraph::releaseCompiled()
+{
+    VkDevice device = engine.device;
+    VulkanEngine* eng = &engine;
+
+    for (auto& pass : passes)
+    {
+        VkRenderPass renderPass = pass.renderPass;
+        auto framebuffers = pass.framebuffers;
+        engine.retire([=] () {
+            for (auto& [views, framebuffer] : framebuffers) vkDestroyFramebuffer(device, framebuffer, nullptr);
+            if (renderPass != VK_NULL_HANDLE) vkDestroyRenderPass(device, renderPass, nullptr);
+        });
+
+        pass.renderPass = VK_NULL_HANDLE;
+        pass.framebuffers.clear();
+        pass.barriers.clear();
+    }
+
+    for (auto& resource : resources)
+    {
+        if (resource.imported) continue;
+
+        VkImageView view = resource.view;
+        VkImage image = resource.vkImage;
+        AllocatedImage ownedImage = resource.ownedImage;
+        AllocatedBuffer ownedBuffer = resource.ownedBuffer;
+
+        engine.retire([=] () mutable {
+            if (view != VK_NULL_HANDLE) vkDestroyImageView(device, view, nullptr);
+            if (ownedImage._image != VK_NULL_HANDLE) eng->destroyImage(ownedImage);
+            else if (image != VK_NULL_HANDLE) vkDestroyImage(device, image, nullptr);
+            if (ownedBuffer.buffer != VK_NULL_HANDLE) eng->destroyBuffer(ownedBuffer);
+        });
+
+        resource.view = VK_NULL_HANDLE;
+        resource.vkImage = VK_NULL_HANDLE;
+        resource.vkBuffer = VK_NULL_HANDLE;
+        resource.ownedImage = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+        resource.ownedBuffer = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+        resource.memorySlot = -1;
+        resource.lazy = false;
+    }
+
+    auto slots = memorySlots;
+    engine.retire([=] () {
+        for (auto allocation : slots)
+        {
+            eng->untagAllocation(allocation);
+            vmaFreeMemory(eng->allocator, allocation);
+        }
+    });
+    memorySlots.clear();
+    finalBarriers.clear();
+
+    compiled = false;
+}
+
+void RenderGraph::reset()
+{
+    if (compiled) releaseCompiled();
+    passes.clear();
+    resources.clear();
+}
+
+void RenderGraph::destroy()
+{
+    reset();
+}
+
+bool RenderGraph::isCompiled() const
+{
+    return compiled;
+}
+
+bool RenderGraph::isPassAlive(const std::string& name) const
+{
+    for (auto& pass : passes)
+    {
+        if (pass.name == name) return pass.alive;
+    }
+    return false;
+}
+
+VkRenderPass RenderGraph::getRenderPass(const std::string& name) const
+{
+    for (auto& pass : passes)
+    {
+        if (pass.name == name) return pass.renderPass;
+    }
+    return VK_NULL_HANDLE;
+}
+
+PipelineTarget RenderGraph::getPipelineTarget(const std::string& name) const
+{
+    PipelineTarget target;
+    for (auto& pass : passes)
+    {
+        if (pass.name != name) continue;
+
+        target.renderPass = pass.renderPass;
+        for (auto attachment : pass.attachments)
+        {
+            VkFormat format = resources[attachment].image.format;
+            if (attachmentAccess(pass, attachment) == RGAccess::ColorAttachment) target.colorFormats.push_back(format);
+            else target.depthFormat = format;
+        }
+        break;
+    }
+    return target;
+}
+
+VkImage RenderGraph::getImage(RGResource resource) const
+{
+    return resources[resource].vkImage;
+}
+
+VkImageView RenderGraph::getImageView(RGResource resource) const
+{
+    return resources[resource].view;
+}
+
+VkBuffer RenderGraph::getBuffer(RGResource resource) const
+{
+    return resources[resource].vkBuffer;
+}
+
+const RGImageDesc& RenderGraph::getImageDesc(RGResource resource) const
+{
+    return resources[resource].image;
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vk_mem_alloc.h>
+#include <vector>
+#include <string>
+#include <map>
+#include <functional>
+#include <cstdint>
+
+#include "ve_types.hpp"
+#include "ve_pipeline.hpp"
+
+class VulkanEngine;
+
+typedef uint32_t RGResource; // Index of a resource within its RenderGraph
+const RGResource RG_NONE = UINT32_MAX;
+
+// How a pass uses a resource, determines pipeline stages, access masks and image layouts
+enum class RGAccess {
+    ColorAttachment,
+    DepthAttachment,
+    DepthRead,          // Depth test without writes
+    SampledFragment,
+    SampledCompute,
+    StorageImageRead,
+    StorageImageWrite,
+    TransferSrc,
+    TransferDst,
+    VertexBuffer,
+    IndexBuffer,
+    IndirectBuffer,
+    UniformBuffer,
+    StorageBufferRead,  // Compute shader
+    StorageBufferWrite, // Compute shader
+    StorageBufferReadGraphics, // Vertex and fragment shaders
+    HostRead,
+};
+
+enum class RGPassType {
+    Graphics,
+    Compute,
+    Transfer,
+};
+
+struct RGImageDesc {
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent = {0, 0};
+    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+    uint32_t mipLevels = 1;
+    VkImageUsageFlags usage = 0; // Added to the usage derived from the passes
+};
+
+struct RGBufferDesc {
+    VkDeviceSize size = 0;
+    VkBufferUsageFlags usage = 0; // Added to the usage derived from the passes
+};
+
+struct RGPassContext {
+    VkRenderPass renderPass = VK_NULL_HANDLE; // Null for compute and transfer passes and with dynamic rendering
+    VkExtent2D extent = {0, 0};
+};
+
+typedef std::function<void(VkCommandBuffer, const RGPassContext&)> RGExecuteFunc;
+
+struct RGUse {
+    RGResource resource;
+    RGAccess access;
+    VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    VkClearValue clear = {};
+};
+
+struct RGBarrier {
+    RGResource resource;
+    VkPipelineStageFlags srcStage;
+    VkAccessFlags srcAccess;
+    VkPipelineStageFlags dstStage;
+    VkAccessFlags dstAccess;
+    VkImageLayout oldLayout;
+    VkImageLayout newLayout;
+};
+
+struct RGPass {
+    std::string name;
+    RGPassType type;
+    std::vector<RGUse> uses; // Attachments first in declaration order, then other resources
+    RGExecuteFunc execute;
+    bool sideEffect = false; // Never culled, e.g. passes writing to host visible memory
+    bool legacyRenderPass = false; // Uses a VkRenderPass even with dynamic rendering
+
+    // Compiled
+    bool alive = false;
+    VkRenderPass renderPass = VK_NULL_HANDLE; // Null if the pass uses dynamic rendering
+    std::vector<RGResource> attachments;
+    std::vector<VkClearValue> clearValues;
+    std::vector<VkAttachmentLoadOp> loadOps;
+    std::vector<VkAttachmentStoreOp> storeOps;
+    std::map<std::vector<VkImageView>, VkFramebuffer> framebuffers;
+    std::vector<RGBarrier> barriers;
+};
+
+struct RGResourceNode {
+    std::string name;
+    bool isImage = true;
+    bool imported = false;
+    bool output = false; // Contents are consumed outside of the graph
+
+    RGImageDesc image;
+    RGBufferDesc buffer;
+    VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED; // Imported images only
+    VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    // Compiled / bound
+    VkImageUsageFlags imageUsage = 0;
+    VkBufferUsageFlags bufferUsage = 0;
+    int firstPass = -1;
+    int lastPass = -1;
+    bool lazy = false;    // Backed by lazily allocated memory, may never get physical pages on tilers
+    int memorySlot = -1;  // Aliased allocation the image is bound to
+    VkImage vkImage = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    VkBuffer vkBuffer = VK_NULL_HANDLE;
+    AllocatedImage ownedImage = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+    AllocatedBuffer ownedBuffer = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+};
+
+class RenderGraph;
+
+// Fluent helper returned by RenderGraph::addPass to declare what the pass reads and writes
+class RGPassBuilder {
+public:
+    RGPassBuilder(RenderGraph& graph, uint32_t pass) : graph(graph), pass(pass) {}
+
+    RGPassBuilder& color(RGResource image, VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR, VkClearValue clear = {});
+    RGPassBuilder& depth(RGResource image, VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR, bool write = true);
+    RGPassBuilder& read(RGResource resource, RGAccess access);
+    RGPassBuilder& write(RGResource resource, RGAccess access);
+    RGPassBuilder& sideEffect();
+    // For code that can only build pipelines against a render pass, e.g. the dear imgui backend
+    RGPassBuilder& legacyRenderPass();
+    RGPassBuilder& execute(RGExecuteFunc func);
+
+private:
+    RenderGraph& graph;
+    uint32_t pass;
+};
+
+// Frame graph of passes and the resources they use. Compiling culls passes whose results are not consumed,
+// creates render passes and transient resources (aliasing their memory where lifetimes do not overlap)
+// and precomputes the barriers executed between passes. With dynamic rendering graphics passes begin
+// rendering directly on the image views, there are no render pass or framebuffer objects to keep around.
+class RenderGraph {
+public:
+    RenderGraph(VulkanEngine& engine);
+
+    RGResource createImage(const std::string& name, const RGImageDesc& desc);
+    RGResource createBuffer(const std::string& name, const RGBufferDesc& desc);
+    // External resources are bound every frame with setImage / setBuffer
+    RGResource importImage(const std::string& name, const RGImageDesc& desc, VkImageLayout initialLayout, VkImageLayout finalLayout);
+    RGResource importBuffer(const std::string& name, const RGBufferDesc& desc);
+
+    void setImage(RGResource resource, VkImage image, VkImageView view);
+    void setBuffer(RGResource resource, VkBuffer buffer);
+    void markOutput(RGResource resource);
+
+    RGPassBuilder addPass(const std::string& name, RGPassType type);
+
+    void compile();
+    void execute(VkCommandBuffer cmd);
+
+    // Retires all compiled objects and declarations so the graph can be rebuilt
+    void reset();
+    void destroy();
+
+    bool isCompiled() const;
+    bool isPassAlive(const std::string& name) const;
+    VkRenderPass getRenderPass(const std::string& pass) const;
+    // What pipelines drawing in the pass are built against
+    PipelineTarget getPipelineTarget(const std::string& pass) const;
+    VkImage getImage(RGResource resource) const;
+    VkImageView getImageView(RGResource resource) const;
+    VkBuffer getBuffer(RGResource resource) const;
+    const RGImageDesc& getImageDesc(RGResource resource) const;
+
+    // Statistics of the last compile
+    uint32_t culledPassCount = 0;
+    uint32_t transientImageCount = 0;
+    uint32_t lazyImageCount = 0;
+    VkDeviceSize transientBytes = 0;     // Memory actually allocated for aliased transient images
+    VkDeviceSize transientBytesNaive = 0; // Memory the same images would take without aliasing
+
+private:
+    friend class RGPassBuilder;
+
+    VulkanEngine& engine;
+    bool compiled = false;
+
+    std::vector<RGPass> passes;
+    std::vector<RGResourceNode> resources;
+    std::vector<RGBarrier> finalBarriers;
+    std::vector<VmaAllocation> memorySlots;
+
+    RGResource addResource(RGResourceNode node);
+
+    void cullPasses();
+    void computeLifetimes();
+    void allocateTransients();
+    void collectAttachments(RGPass& pass);
+    void createRenderPass(RGPass& pass);
+    void computeBarriers();
+    VkFramebuffer getFramebuffer(RGPass& pass);
+    void recordBarriers(VkCommandBuffer cmd, const std::vector<RGBarrier>& barriers);
+    void releaseCompiled();
+};
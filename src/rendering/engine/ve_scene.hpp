@@ -0,0 +1,16 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+
+// An instance of one of the engine's meshes placed in the world, drawn by every view that sees it
+struct RenderObject {
+    uint32_t meshIndex = 0;
+    uint32_t materialIndex = 0; // Into the engine's material table
+    glm::mat4 transform = glm::mat4(1.f);
+
+    // Static objects never move once VulkanEngine::buildStaticBatches ran, it merges them into batch objects
+    bool isStatic = false;
+    bool batched = false;        // Drawn as part of a batch object, skipped by culling
+    uint32_t batchedObjects = 1; // Objects merged into this one, 1 for everything but batches
+};
@@ -0,0 +1,307 @@
+#include "ve_scene_graph.hpp"
+
+#include <RoseJobs.hpp>
+#include <RoseMath.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+static_assert(sizeof(AffineTransform) == 12 * sizeof(float), "AffineTransform must match RoseMath's affine transforms");
+
+const SceneNode SceneGraph::NO_NODE;
+const uint32_t SceneGraph::NO_OBJECT;
+
+SceneNode SceneGraph::add(SceneNode parent, uint32_t renderObject) {
+    SceneNode node;
+    if (!freeNodes.empty()) {
+        node = freeNodes.back();
+        freeNodes.pop_back();
+    } else {
+        node = (SceneNode) slots.size();
+        slots.push_back(NO_NODE);
+    }
+
+    uint32_t parentSlot = parent == NO_NODE ? NO_NODE : slots[parent];
+    uint32_t slot = (uint32_t) nodes.size();
+    slots[node] = slot;
+
+    parents.push_back(parentSlot);
+    positions.push_back(glm::vec3(0.f));
+    rotations.push_back(glm::quat(1.f, 0.f, 0.f, 0.f));
+    scales.push_back(glm::vec3(1.f));
+    worlds.push_back({{glm::vec4(1.f, 0.f, 0.f, 0.f), glm::vec4(0.f, 1.f, 0.f, 0.f), glm::vec4(0.f, 0.f, 1.f, 0.f)}});
+    renderObjects.push_back(renderObject);
+    depths.push_back(parentSlot == NO_NODE ? 0 : depths[parentSlot] + 1);
+    dirty.push_back(1);
+    nodes.push_back(node);
+
+    layoutDirty = true;
+    return node;
+}
+
+// Descendants are dropped once the slots are sorted again, their parent's slot is gone by then
+void SceneGraph::remove(SceneNode node) {
+    uint32_t slot = slots[node];
+    nodes[slot] = NO_NODE;
+    slots[node] = NO_NODE;
+    freeNodes.push_back(node);
+    layoutDirty = true;
+}
+
+bool SceneGraph::isValid(SceneNode node) const {
+    return node < slots.size() && slots[node] != NO_NODE;
+}
+
+SceneNode SceneGraph::getParent(SceneNode node) const {
+    uint32_t parent = parents[slots[node]];
+    return parent == NO_NODE ? NO_NODE : nodes[parent];
+}
+
+void SceneGraph::markDirty(uint32_t slot) {
+    dirty[slot] = 1;
+    if (layoutDirty) return;
+
+    uint32_t depth = depths[slot];
+    dirtyBegins[depth] = std::min(dirtyBegins[depth], slot);
+    dirtyEnds[depth] = std::max(dirtyEnds[depth], slot + 1);
+}
+
+void SceneGraph::setPosition(SceneNode node, const glm::vec3& position) {
+    uint32_t slot = slots[node];
+    positions[slot] = position;
+    markDirty(slot);
+}
+
+void SceneGraph::setRotation(SceneNode node, const glm::quat& rotation) {
+    uint32_t slot = slots[node];
+    rotations[slot] = rotation;
+    markDirty(slot);
+}
+
+void SceneGraph::setScale(SceneNode node, const glm::vec3& scale) {
+    uint32_t slot = slots[node];
+    scales[slot] = scale;
+    markDirty(slot);
+}
+
+void SceneGraph::setLocal(SceneNode node, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale) {
+    uint32_t slot = slots[node];
+    positions[slot] = position;
+    rotations[slot] = rotation;
+    scales[slot] = scale;
+    markDirty(slot);
+}
+
+// Breadth first from the roots, in the order of the old slots. Nodes below a removed one are never reached and
+// dropped as well.
+void SceneGraph::sortLevels() {
+    uint32_t count = (uint32_t) nodes.size();
+
+    // Children of every slot, in slot order
+    std::vector<uint32_t> firstChild(count + 1, 0);
+    for (uint32_t slot = 0; slot < count; slot++) {
+        if (parents[slot] != NO_NODE) firstChild[parents[slot] + 1]++;
+    }
+    for (uint32_t slot = 0; slot < count; slot++) {
+        firstChild[slot + 1] += firstChild[slot];
+    }
+    std::vector<uint32_t> children(firstChild[count]);
+    std::vector<uint32_t> next(firstChild.begin(), firstChild.end() - 1);
+    for (uint32_t slot = 0; slot < count; slot++) {
+        if (parents[slot] != NO_NODE) children[next[parents[slot]]++] = slot;
+    }
+
+    std::vector<uint32_t> order;
+    order.reserve(count);
+    for (uint32_t slot = 0; slot < count; slot++) {
+        if (nodes[slot] != NO_NODE && parents[slot] == NO_NODE) order.push_back(slot);
+    }
+    std::vector<uint32_t> newSlots(count, NO_NODE);
+    std::vector<uint32_t> newChildStarts(count + 1);
+    for (uint32_t i = 0; i < order.size(); i++) {
+        uint32_t slot = order[i];
+        newSlots[slot] = i;
+        newChildStarts[i] = (uint32_t) order.size();
+        for (uint32_t c = firstChild[slot]; c < firstChild[slot + 1]; c++) {
+            if (nodes[children[c]] != NO_NODE) order.push_back(children[c]);
+        }
+    }
+    newChildStarts.resize(order.size() + 1);
+    newChildStarts[order.size()] = (uint32_t) order.size();
+
+    for (uint32_t slot = 0; slot < count; slot++) {
+        if (nodes[slot] != NO_NODE && newSlots[slot] == NO_NODE) {
+            slots[nodes[slot]] = NO_NODE;
+            freeNodes.push_back(nodes[slot]);
+        }
+    }
+
+    std::vector<uint32_t> newParents;
+    std::vector<glm::vec3> newPositions;
+    std::vector<glm::quat> newRotations;
+    std::vector<glm::vec3> newScales;
+    std::vector<AffineTransform> newWorlds;
+    std::vector<uint32_t> newRenderObjects;
+    std::vector<uint32_t> newDepths;
+    std::vector<uint8_t> newDirty;
+    std::vector<SceneNode> newNodes;
+    newParents.reserve(order.size());
+    newPositions.reserve(order.size());
+    newRotations.reserve(order.size());
+    newScales.reserve(order.size());
+    newWorlds.reserve(order.size());
+    newRenderObjects.reserve(order.size());
+    newDepths.reserve(order.size());
+    newDirty.reserve(order.size());
+    newNodes.reserve(order.size());
+
+    uint32_t objectCount = 0;
+    for (uint32_t slot : order) {
+        uint32_t parent = parents[slot];
+        uint32_t depth = parent == NO_NODE ? 0 : newDepths[newSlots[parent]] + 1;
+        slots[nodes[slot]] = (uint32_t) newNodes.size();
+        if (renderObjects[slot] != NO_OBJECT) objectCount = std::max(objectCount, renderObjects[slot] + 1);
+
+        newParents.push_back(parent == NO_NODE ? NO_NODE : newSlots[parent]);
+        newPositions.push_back(positions[slot]);
+        newRotations.push_back(rotations[slot]);
+        newScales.push_back(scales[slot]);
+        newWorlds.push_back(worlds[slot]);
+        newRenderObjects.push_back(renderObjects[slot]);
+        newDepths.push_back(depth);
+        newDirty.push_back(dirty[slot]);
+        newNodes.push_back(nodes[slot]);
+    }
+
+    parents.swap(newParents);
+    positions.swap(newPositions);
+    rotations.swap(newRotations);
+    scales.swap(newScales);
+    worlds.swap(newWorlds);
+    renderObjects.swap(newRenderObjects);
+    depths.swap(newDepths);
+    dirty.swap(newDirty);
+    nodes.swap(newNodes);
+    childStarts.swap(newChildStarts);
+
+    uint32_t levelCount = nodes.empty() ? 0 : depths.back() + 1;
+    dirtyBegins.assign(levelCount, UINT32_MAX);
+    dirtyEnds.assign(levelCount, 0);
+    for (uint32_t slot = 0; slot < nodes.size(); slot++) {
+        if (!dirty[slot]) continue;
+        dirtyBegins[depths[slot]] = std::min(dirtyBegins[depths[slot]], slot);
+        dirtyEnds[depths[slot]] = slot + 1;
+    }
+
+    objectSlots.assign(objectCount, NO_NODE);
+    for (uint32_t slot = 0; slot < renderObjects.size(); slot++) {
+        if (renderObjects[slot] != NO_OBJECT) objectSlots[renderObjects[slot]] = slot;
+    }
+    layoutDirty = false;
+}
+
+// Parents lie in the level before and are final, so jobs of one level only write their own slots.
+// Jobs go through their range in chunks small enough to stay in cache: the changed nodes and their parents' worlds
+// are gathered, composed and multiplied in one batch kernel and the results scattered back. Chunks where every
+// node changed read and write the arrays in place.
+uint32_t SceneGraph::updateRange(uint32_t level, uint32_t begin, uint32_t end) {
+    uint32_t count = end - begin;
+    std::atomic<uint32_t> updated{0};
+
+    getJobs().parallelFor(count, NODES_PER_JOB, [&] (uint32_t first, uint32_t last) {
+        uint32_t indices[NODES_PER_CHUNK];
+        glm::vec3 chunkPositions[NODES_PER_CHUNK];
+        glm::quat chunkRotations[NODES_PER_CHUNK];
+        glm::vec3 chunkScales[NODES_PER_CHUNK];
+        AffineTransform parentWorlds[NODES_PER_CHUNK];
+        AffineTransform results[NODES_PER_CHUNK];
+
+        uint32_t batchUpdated = 0;
+        for (uint32_t chunk = begin + first; chunk < begin + last; chunk += NODES_PER_CHUNK) {
+            uint32_t chunkEnd = std::min(chunk + NODES_PER_CHUNK, begin + last);
+            uint32_t changedCount = 0;
+            for (uint32_t slot = chunk; slot < chunkEnd; slot++) {
+                uint32_t parent = parents[slot];
+                if (parent != NO_NODE && dirty[parent]) dirty[slot] = 1;
+                if (dirty[slot]) indices[changedCount++] = slot;
+            }
+            if (changedCount == 0) continue;
+
+            bool inPlace = changedCount == chunkEnd - chunk;
+            const glm::vec3* localPositions = &positions[chunk];
+            const glm::quat* localRotations = &rotations[chunk];
+            const glm::vec3* localScales = &scales[chunk];
+            if (!inPlace) {
+                for (uint32_t i = 0; i < changedCount; i++) {
+                    chunkPositions[i] = positions[indices[i]];
+                    chunkRotations[i] = rotations[indices[i]];
+                    chunkScales[i] = scales[indices[i]];
+                }
+                localPositions = chunkPositions;
+                localRotations = chunkRotations;
+                localScales = chunkScales;
+            }
+            AffineTransform* out = inPlace ? &worlds[chunk] : results;
+
+            // Levels are sorted by depth, so the first one holds all roots and no other level has any
+            const float* parentRows = nullptr;
+            if (level > 0) {
+                for (uint32_t i = 0; i < changedCount; i++) {
+                    parentWorlds[i] = worlds[parents[indices[i]]];
+                }
+                parentRows = &parentWorlds[0].rows[0].x;
+            }
+            composeAffineTransforms(parentRows, &localPositions[0].x, &localRotations[0].x, &localScales[0].x, &out[0].rows[0].x, changedCount);
+
+            if (!inPlace) {
+                for (uint32_t i = 0; i < changedCount; i++) {
+                    worlds[indices[i]] = results[i];
+                }
+            }
+            batchUpdated += changedCount;
+        }
+        if (batchUpdated > 0) updated.fetch_add(batchUpdated, std::memory_order_relaxed);
+    });
+
+    return updated.load(std::memory_order_relaxed);
+}
+
+void SceneGraph::update() {
+    if (layoutDirty) sortLevels();
+
+    uint32_t levelCount = (uint32_t) dirtyBegins.size();
+    uint32_t updated = 0;
+    uint32_t changedBegin = 0; // Range of the level before that held updated nodes, their children follow
+    uint32_t changedEnd = 0;
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    for (uint32_t level = 0; level < levelCount; level++) {
+        uint32_t begin = dirtyBegins[level];
+        uint32_t end = dirtyEnds[level];
+        if (changedBegin < changedEnd) {
+            begin = std::min(begin, childStarts[changedBegin]);
+            end = std::max(end, childStarts[changedEnd]);
+        }
+        dirtyBegins[level] = UINT32_MAX;
+        dirtyEnds[level] = 0;
+
+        changedBegin = changedEnd = 0;
+        if (begin >= end) continue;
+
+        uint32_t rangeUpdated = updateRange(level, begin, end);
+        ranges.push_back({begin, end});
+        if (rangeUpdated == 0) continue;
+
+        updated += rangeUpdated;
+        changedBegin = begin;
+        changedEnd = end;
+    }
+
+    for (auto& range : ranges) {
+        memset(dirty.data() + range.first, 0, range.second - range.first);
+    }
+
+    stats.nodes = (uint32_t) nodes.size();
+    stats.levels = levelCount;
+    stats.updated = updated;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+#include <cstdint>
+
+#include "ve_scene.hpp"
+
+// Stable handle of a scene graph node, valid until the node or one of its ancestors is removed
+typedef uint32_t SceneNode;
+
+// Affine transform as the top three rows of its matrix, the bottom row is always 0 0 0 1. The layout of the
+// object buffer's model rows and RoseMath's affine transforms.
+struct AffineTransform {
+    glm::vec4 rows[3];
+
+    glm::mat4 toMatrix() const {
+        glm::mat4 matrix(1.f);
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 4; c++) matrix[c][r] = rows[r][c];
+        }
+        return matrix;
+    }
+};
+
+struct SceneGraphStats {
+    uint32_t nodes = 0;
+    uint32_t levels = 0;
+    uint32_t updated = 0; // World transforms recomputed by the last update
+};
+
+// Hierarchy of local transforms that places render objects. World transforms stay in the graph, the object buffer
+// and culling read them for the objects a node places in place of the objects' own transform, which is left as
+// it is. Such objects should not be static, static batches are merged from the objects' transforms.
+// Nodes are stored as structure of arrays in breadth first order, so every level is one contiguous range whose
+// parents all lie in the level before it and the children of consecutive nodes are consecutive as well. Changing a
+// node flags it dirty, update() walks the levels in order and splits each into jobs, but only over the range
+// holding the flagged nodes and the children of the range updated in the level before, so a moved subtree costs
+// about its own size. Adding and removing nodes re-sorts the arrays on the next update.
+class SceneGraph {
+public:
+    static const SceneNode NO_NODE = UINT32_MAX;
+    static const uint32_t NO_OBJECT = UINT32_MAX;
+    static const uint32_t NODES_PER_JOB = 16384;
+    static const uint32_t NODES_PER_CHUNK = 128; // Composed and multiplied together, small enough for the stack
+
+    // renderObject is the index of the render object the node places, one node per object
+    SceneNode add(SceneNode parent = NO_NODE, uint32_t renderObject = NO_OBJECT);
+    // Removes the node and everything below it
+    void remove(SceneNode node);
+    bool isValid(SceneNode node) const;
+
+    void setPosition(SceneNode node, const glm::vec3& position);
+    void setRotation(SceneNode node, const glm::quat& rotation);
+    void setScale(SceneNode node, const glm::vec3& scale);
+    void setLocal(SceneNode node, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale);
+
+    const glm::vec3& getPosition(SceneNode node) const { return positions[slots[node]]; }
+    const glm::quat& getRotation(SceneNode node) const { return rotations[slots[node]]; }
+    const glm::vec3& getScale(SceneNode node) const { return scales[slots[node]]; }
+    // As of the last update
+    const AffineTransform& getWorld(SceneNode node) const { return worlds[slots[node]]; }
+    SceneNode getParent(SceneNode node) const;
+    uint32_t getRenderObject(SceneNode node) const { return renderObjects[slots[node]]; }
+
+    // World of the node placing the render object as of the last update, nullptr for objects without one
+    const AffineTransform* getObjectWorld(uint32_t object) const {
+        return object < objectSlots.size() && objectSlots[object] != NO_NODE ? &worlds[objectSlots[object]] : nullptr;
+    }
+
+    // Recomputes changed world transforms
+    void update();
+
+    SceneGraphStats stats;
+
+private:
+    // Per slot, in breadth first order after an update
+    std::vector<uint32_t> parents; // Slot of the parent, NO_NODE for roots
+    std::vector<glm::vec3> positions;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+    std::vector<AffineTransform> worlds;
+    std::vector<uint32_t> renderObjects;
+    std::vector<uint32_t> depths;
+    std::vector<uint8_t> dirty;
+    std::vector<SceneNode> nodes; // Handle of the slot, NO_NODE once removed
+
+    std::vector<uint32_t> slots; // Per handle
+    std::vector<uint32_t> objectSlots; // Per render object, NO_NODE for objects no node places
+    std::vector<SceneNode> freeNodes;
+
+    std::vector<uint32_t> childStarts; // Per slot the first slot of its children, the slot count at the end
+    std::vector<uint32_t> dirtyBegins; // Per level the range of the nodes flagged since the last update
+    std::vector<uint32_t> dirtyEnds;
+    bool layoutDirty = false; // Slots are not sorted, set by add and remove
+
+    void markDirty(uint32_t slot);
+    void sortLevels();
+    uint32_t updateRange(uint32_t level, uint32_t begin, uint32_t end);
+};
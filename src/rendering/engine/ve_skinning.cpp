@@ -0,0 +1,324 @@
+#include "ve_skinning.hpp"
+#include "ve_pipeline.hpp"
+#include "vk_engine.hpp"
+
+#include <RoseMath.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static_assert(sizeof(VertexSkin) == 32, "VertexSkin must match the skinning shader's Skin struct");
+static_assert(sizeof(Vertex) == 11 * sizeof(float), "The skinning shader reads Vertex as 11 floats");
+static_assert(sizeof(PackedVertex) == 6 * sizeof(uint32_t), "The skinning shader reads PackedVertex as 6 words");
+
+const uint32_t INITIAL_SKINS = 1 << 16;
+
+struct SkinConstants {
+    uint32_t sourceVertex;
+    uint32_t outputVertex;
+    uint32_t vertexCount;
+    uint32_t skinOffset;
+    uint32_t paletteOffset;
+};
+
+// Around the posed spheres of the joints that move vertices, centered on their average
+static glm::vec4 enclosingSphere(const std::vector<glm::vec4>& spheres) {
+    glm::vec3 center = glm::vec3(0.f);
+    uint32_t count = 0;
+    for (auto& sphere : spheres) {
+        if (sphere.w < 0.f) continue;
+        center += glm::vec3(sphere);
+        count++;
+    }
+    if (count == 0) return glm::vec4(0.f);
+    center /= (float) count;
+
+    float radius = 0.f;
+    for (auto& sphere : spheres) {
+        if (sphere.w < 0.f) continue;
+        radius = std::max(radius, glm::length(glm::vec3(sphere) - center) + sphere.w);
+    }
+    return glm::vec4(center, radius);
+}
+
+SkinningSystem::SkinningSystem(VulkanEngine& engine, uint32_t framesInFlight) : engine(engine) {
+    frames.resize(framesInFlight);
+
+    // Vertices, packed vertices, skins and skinning matrices
+    VkDescriptorSetLayoutBinding bindings[4] = {};
+    for (uint32_t i = 0; i < 4; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 4;
+    layoutInfo.pBindings = bindings;
+    check_vk_result(vkCreateDescriptorSetLayout(engine.device, &layoutInfo, nullptr, &setLayout));
+
+    VkPushConstantRange range = {};
+    range.offset = 0;
+    range.size = sizeof(SkinConstants);
+    range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &range;
+
+    if (vkCreatePipelineLayout(engine.device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+
+    VkShaderModule shader = loadCompiledShader("../shaders/skinning.comp.spv", engine.device);
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = shaderStageInfo(shader, VK_SHADER_STAGE_COMPUTE_BIT);
+    pipelineInfo.layout = pipelineLayout;
+
+    if (vkCreateComputePipelines(engine.device, engine.pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create compute pipeline ../shaders/skinning.comp.spv!");
+    }
+    vkDestroyShaderModule(engine.device, shader, nullptr);
+
+    growSkins(INITIAL_SKINS);
+    lastFrame = std::chrono::steady_clock::now();
+}
+
+void SkinningSystem::destroy() {
+    VulkanEngine* eng = &engine;
+
+    for (auto& data : frames) {
+        VkDescriptorSet set = data.set;
+        AllocatedBuffer palette = data.palette;
+        engine.retire([=] () mutable {
+            if (set != VK_NULL_HANDLE) vkFreeDescriptorSets(eng->device, eng->descriptorPool, 1, &set);
+            if (palette.buffer != VK_NULL_HANDLE) {
+                vmaUnmapMemory(eng->allocator, palette.allocation);
+                eng->destroyBuffer(palette);
+            }
+        });
+    }
+    frames.clear();
+
+    AllocatedBuffer skinBuffer = skins;
+    VkDescriptorSetLayout layout = setLayout;
+    VkPipelineLayout computeLayout = pipelineLayout;
+    VkPipeline computePipeline = pipeline;
+    engine.retire([=] () mutable {
+        vkDestroyPipeline(eng->device, computePipeline, nullptr);
+        vkDestroyPipelineLayout(eng->device, computeLayout, nullptr);
+        vkDestroyDescriptorSetLayout(eng->device, layout, nullptr);
+        eng->destroyBuffer(skinBuffer);
+    });
+}
+
+uint32_t SkinningSystem::add(std::shared_ptr<const Model> model, uint32_t sourceMesh) {
+    uint32_t source = addSource(model, sourceMesh);
+
+    // The copy keeps the bind pose on the CPU, which is what a repack of the pool uploads before the next skinning
+    Mesh mesh = engine.meshes[sourceMesh];
+    mesh.skin.clear();
+    mesh.geometry = NO_GEOMETRY;
+    engine.meshes.push_back(std::move(mesh));
+    engine.uploadMesh(engine.meshes.back());
+
+    SkinnedInstance instance;
+    instance.mesh = (uint32_t) (engine.meshes.size() - 1);
+    instance.sourceMesh = sourceMesh;
+    instances.push_back(instance);
+    instanceData.push_back({source, paletteSize});
+    paletteSize += model->skeleton.size();
+
+    stats.instances = (uint32_t) instances.size();
+    stats.joints = paletteSize;
+    stats.vertices += (uint32_t) engine.meshes[sourceMesh].vertices.size();
+    return (uint32_t) (instances.size() - 1);
+}
+
+uint32_t SkinningSystem::addSource(std::shared_ptr<const Model> model, uint32_t sourceMesh) {
+    for (size_t i = 0; i < sources.size(); i++) {
+        if (sources[i].mesh == sourceMesh) return (uint32_t) i;
+    }
+
+    const Mesh& mesh = engine.meshes[sourceMesh];
+    if (model->skeleton.size() == 0 || mesh.skin.empty() || mesh.skin.size() != mesh.vertices.size() || mesh.geometry == NO_GEOMETRY) {
+        throw std::runtime_error("failed to skin a mesh without skin or geometry!");
+    }
+
+    uint32_t count = (uint32_t) mesh.skin.size();
+    if (skinCount + count > skinCapacity) growSkins(skinCount + count);
+
+    engine.transfer->uploadBuffer(mesh.skin.data(), (VkDeviceSize) count * sizeof(VertexSkin), skins.buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, (VkDeviceSize) skinCount * sizeof(VertexSkin));
+    sources.push_back({model, sourceMesh, skinCount});
+    skinCount += count;
+    return (uint32_t) (sources.size() - 1);
+}
+
+// The skins of all sources are uploaded again into the larger buffer, frames in flight keep reading the old one
+void SkinningSystem::growSkins(uint32_t count) {
+    VulkanEngine* eng = &engine;
+
+    if (skins.buffer != VK_NULL_HANDLE) {
+        AllocatedBuffer old = skins;
+        engine.retire([=] () mutable { eng->destroyBuffer(old); });
+    }
+
+    skinCapacity = std::max(count, skinCapacity * 2);
+    skins = engine.createBuffer((VkDeviceSize) skinCapacity * sizeof(VertexSkin), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY, "Skinning");
+
+    for (auto& source : sources) {
+        const Mesh& mesh = engine.meshes[source.mesh];
+        engine.transfer->uploadBuffer(mesh.skin.data(), (VkDeviceSize) mesh.skin.size() * sizeof(VertexSkin), skins.buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, (VkDeviceSize) source.skinOffset * sizeof(VertexSkin));
+    }
+}
+
+void SkinningSystem::beginFrame(uint32_t frameIdx) {
+    frame = frameIdx;
+
+    // Long stalls would otherwise skip ahead in every animation
+    auto now = std::chrono::steady_clock::now();
+    float elapsed = fixedTimeStep > 0.f ? fixedTimeStep : std::chrono::duration<float>(now - lastFrame).count();
+    dt = std::min(elapsed, 0.1f);
+    lastFrame = now;
+}
+
+void SkinningSystem::update() {
+    FrameData& data = frames[frame];
+    growFrame(data, paletteSize);
+    if (instances.empty()) return;
+
+    // Poses are built in scratch memory, the mapped buffer is only written to
+    glm::mat4* palette = (glm::mat4*) data.mappedPalette;
+    getJobs().parallelFor((uint32_t) instances.size(), INSTANCES_PER_JOB, [&] (uint32_t begin, uint32_t end) {
+        PoseScratch scratch;
+        std::vector<glm::mat4> pose;
+        std::vector<glm::vec4> spheres;
+
+        for (uint32_t i = begin; i < end; i++) {
+            SkinnedInstance& instance = instances[i];
+            const Model& model = *sources[instanceData[i].source].model;
+            const Skeleton& skeleton = model.skeleton;
+            const AnimationClip* clip = instance.clip < model.animations.size() ? &model.animations[instance.clip] : nullptr;
+
+            if (instance.playing) instance.time += dt * instance.speed;
+            if (clip != nullptr && clip->duration > 0.f) instance.time = std::fmod(instance.time, clip->duration);
+
+            uint32_t joints = skeleton.size();
+            pose.resize(joints);
+            spheres.resize(joints);
+            samplePose(skeleton, clip, instance.time, scratch, pose.data());
+            memcpy(palette + instanceData[i].paletteOffset, pose.data(), joints * sizeof(glm::mat4));
+
+            // Instances write disjoint meshes, nothing adds meshes while the jobs run
+            transformSpheres(&pose[0][0][0], 16, &skeleton.bounds[0].x, &spheres[0].x, joints);
+            engine.meshes[instance.mesh].bounds = enclosingSphere(spheres);
+        }
+    });
+
+    vmaFlushAllocation(engine.allocator, data.palette.allocation, 0, (VkDeviceSize) paletteSize * sizeof(glm::mat4));
+}
+
+void SkinningSystem::growFrame(FrameData& data, uint32_t joints) {
+    if (joints <= data.paletteCapacity && data.palette.buffer != VK_NULL_HANDLE) return;
+
+    uint32_t capacity = std::max(joints, std::max(data.paletteCapacity * 2, 1024u));
+    data.mappedPalette = engine.growMappedBuffer(data.palette, (VkDeviceSize) capacity * sizeof(glm::mat4), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, "Skinning");
+    data.paletteCapacity = capacity;
+    data.dirty = true;
+}
+
+void SkinningSystem::writeSet(FrameData& data) {
+    if (data.set == VK_NULL_HANDLE) {
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = engine.descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &setLayout;
+        check_vk_result(vkAllocateDescriptorSets(engine.device, &allocInfo, &data.set));
+    }
+
+    data.boundBuffers[0] = engine.geometry->getVertexBuffer();
+    data.boundBuffers[1] = engine.geometry->getPackedBuffer();
+    data.boundBuffers[2] = skins.buffer;
+
+    VkDescriptorBufferInfo bufferInfos[4] = {
+        {data.boundBuffers[0], 0, VK_WHOLE_SIZE},
+        {data.boundBuffers[1], 0, VK_WHOLE_SIZE},
+        {data.boundBuffers[2], 0, VK_WHOLE_SIZE},
+        {data.palette.buffer, 0, VK_WHOLE_SIZE},
+    };
+
+    VkWriteDescriptorSet writes[4] = {};
+    for (uint32_t i = 0; i < 4; i++) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = data.set;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets(engine.device, 4, writes, 0, nullptr);
+    data.dirty = false;
+}
+
+// Both vertex buffers of the pool are written, the passes drawing meshes read whichever their pipelines use
+void SkinningSystem::addPass(RenderGraph& graph) {
+    RGBufferDesc desc;
+    verticesResource = graph.importBuffer("GeometryVertices", desc);
+    packedResource = graph.importBuffer("GeometryPackedVertices", desc);
+
+    graph.addPass("skinning", RGPassType::Compute)
+        .write(verticesResource, RGAccess::StorageBufferWrite)
+        .write(packedResource, RGAccess::StorageBufferWrite)
+        .execute([this] (VkCommandBuffer cmd, const RGPassContext& context) { recordSkinning(cmd); });
+}
+
+void SkinningSystem::readForDraw(RGPassBuilder& pass) {
+    pass.read(verticesResource, RGAccess::VertexBuffer)
+        .read(packedResource, RGAccess::StorageBufferReadGraphics);
+}
+
+// The pool's buffers change when it grows or defragments, the frame's set is rewritten once they differ
+void SkinningSystem::bindFrame(RenderGraph& graph) {
+    VkBuffer vertices = engine.geometry->getVertexBuffer();
+    VkBuffer packed = engine.geometry->getPackedBuffer();
+    graph.setBuffer(verticesResource, vertices);
+    graph.setBuffer(packedResource, packed);
+
+    FrameData& data = frames[frame];
+    if (data.boundBuffers[0] != vertices || data.boundBuffers[1] != packed || data.boundBuffers[2] != skins.buffer) data.dirty = true;
+    if (data.dirty) writeSet(data);
+}
+
+// Every instance writes its own range of the pool, so the dispatches need no barriers between them
+void SkinningSystem::recordSkinning(VkCommandBuffer cmd) {
+    if (instances.empty()) return;
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &frames[frame].set, 0, nullptr);
+
+    for (size_t i = 0; i < instances.size(); i++) {
+        const Source& source = sources[instanceData[i].source];
+        const GeometryRange& input = engine.geometry->get(engine.meshes[source.mesh].geometry);
+        const GeometryRange& output = engine.geometry->get(engine.meshes[instances[i].mesh].geometry);
+
+        SkinConstants constants = {};
+        constants.sourceVertex = input.vertexOffset;
+        constants.outputVertex = output.vertexOffset;
+        constants.vertexCount = input.vertexCount;
+        constants.skinOffset = source.skinOffset;
+        constants.paletteOffset = instanceData[i].paletteOffset;
+
+        vkCmdPushConstants(cmd, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SkinConstants), &constants);
+        vkCmdDispatch(cmd, (input.vertexCount + 63) / 64, 1, 1);
+    }
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+
+#include "ve_types.hpp"
+#include "ve_render_graph.hpp"
+
+class VulkanEngine;
+struct Model;
+
+// One animated copy of a skinned mesh, render objects draw it through its mesh like any other
+struct SkinnedInstance {
+    uint32_t mesh = 0;  // Into the engine's meshes
+    uint32_t sourceMesh = 0; // The engine's mesh it is skinned from
+    uint32_t clip = 0;  // Into the model's animations, the bind pose without any
+    float time = 0.f;   // Seconds into the clip, looped
+    float speed = 1.f;
+    bool playing = true;
+};
+
+struct SkinningStats {
+    uint32_t instances = 0;
+    uint32_t joints = 0;   // Skinning matrices written per frame
+    uint32_t vertices = 0; // Skinned per frame
+};
+
+// Skeletal animation for many instances. Poses are sampled on jobs and the skinning matrices written to a per frame
+// buffer, then one compute pass skins every instance from its source mesh into the instance's own range of the
+// geometry pool, the full and the packed vertex. Every later pass of the frame draws those ranges as plain meshes,
+// so vertices are skinned once per frame however many passes and views draw them.
+class SkinningSystem {
+public:
+    // Instances per job when sampling poses, fewer are sampled on the calling thread
+    static const uint32_t INSTANCES_PER_JOB = 16;
+
+    SkinningSystem(VulkanEngine& engine, uint32_t framesInFlight);
+    void destroy();
+
+    // Copies the source mesh, one of the engine's meshes with a skin, into a new mesh of the engine and returns the
+    // instance index. The model holds the skeleton and animations the source mesh's skin refers to.
+    uint32_t add(std::shared_ptr<const Model> model, uint32_t sourceMesh);
+
+    // Of the instance's skeleton and animations
+    std::shared_ptr<const Model> getModel(uint32_t instance) const { return sources[instanceData[instance].source].model; }
+
+    // The frame's slot must not be in use by the GPU anymore
+    void beginFrame(uint32_t frame);
+    // Advances and samples every instance, also moves the bounds of the instance meshes, so it runs before culling
+    void update();
+
+    // Graph setup, the skinning pass has to come before the passes drawing meshes
+    void addPass(RenderGraph& graph);
+    void readForDraw(RGPassBuilder& pass);
+    void bindFrame(RenderGraph& graph);
+
+    std::vector<SkinnedInstance> instances;
+    float fixedTimeStep = 0.f; // Seconds each frame advances instead of the clock's, unless 0. Replays set it.
+    SkinningStats stats;
+
+    RGResource verticesResource = RG_NONE;
+    RGResource packedResource = RG_NONE;
+
+private:
+    // A mesh instances are skinned from, its skin is uploaded once
+    struct Source {
+        std::shared_ptr<const Model> model;
+        uint32_t mesh;
+        uint32_t skinOffset; // Into the skin buffer
+    };
+
+    struct InstanceData {
+        uint32_t source;
+        uint32_t paletteOffset; // Into the frame's skinning matrices
+    };
+
+    struct FrameData {
+        AllocatedBuffer palette = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+        void* mappedPalette = nullptr;
+        uint32_t paletteCapacity = 0;
+
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        VkBuffer boundBuffers[3] = {VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE}; // Vertices, packed, skins
+        bool dirty = true;
+    };
+
+    VulkanEngine& engine;
+    std::vector<FrameData> frames;
+    uint32_t frame = 0;
+
+    std::vector<Source> sources;
+    std::vector<InstanceData> instanceData; // Parallel to instances
+    uint32_t paletteSize = 0; // Joints of all instances
+
+    AllocatedBuffer skins = {VK_NULL_HANDLE, VK_NULL_HANDLE}; // VertexSkin of all sources
+    uint32_t skinCapacity = 0;
+    uint32_t skinCount = 0;
+
+    float dt = 0.f;
+    std::chrono::steady_clock::time_point lastFrame;
+
+    VkDescriptorSetLayout setLayout;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline pipeline;
+
+    uint32_t addSource(std::shared_ptr<const Model> model, uint32_t sourceMesh);
+    void growSkins(uint32_t count);
+    void growFrame(FrameData& data, uint32_t joints);
+    void writeSet(FrameData& data);
+    void recordSkinning(VkCommandBuffer cmd);
+};
@@ -0,0 +1,60 @@
+#include "ve_static_batching.hpp"
+
+#include <glm/gtc/matrix_inverse.hpp>
+#include <map>
+#include <tuple>
+
+StaticBatchStats mergeStaticObjects(std::vector<RenderObject>& objects, std::vector<Mesh>& meshes, float cellSize) {
+    // Material first so batches of one material end up next to each other in the object list
+    typedef std::tuple<uint32_t, int32_t, int32_t, int32_t> BatchKey;
+    std::map<BatchKey, std::vector<uint32_t>> cells;
+
+    for (uint32_t i = 0; i < objects.size(); i++) {
+        const RenderObject& object = objects[i];
+        if (!object.isStatic || object.batched || object.batchedObjects > 1) continue;
+
+        glm::vec3 center = glm::vec3(object.transform * glm::vec4(glm::vec3(meshes[object.meshIndex].bounds), 1.f));
+        glm::ivec3 cell = glm::ivec3(glm::floor(center / cellSize));
+        cells[BatchKey(object.materialIndex, cell.x, cell.y, cell.z)].push_back(i);
+    }
+
+    StaticBatchStats stats;
+    for (auto& [key, members] : cells) {
+        if (members.size() < 2) continue;
+
+        Mesh batch;
+        for (uint32_t index : members) {
+            const RenderObject& object = objects[index];
+            const Mesh& mesh = meshes[object.meshIndex];
+            glm::mat3 normalMatrix = glm::inverseTranspose(glm::mat3(object.transform));
+
+            uint32_t base = (uint32_t) batch.vertices.size();
+            for (const Vertex& vertex : mesh.vertices) {
+                Vertex transformed = vertex;
+                transformed.pos = glm::vec3(object.transform * glm::vec4(vertex.pos, 1.f));
+                transformed.normal = glm::normalize(normalMatrix * vertex.normal);
+                batch.vertices.push_back(transformed);
+            }
+            for (uint32_t vertexIndex : mesh.indices) {
+                batch.indices.push_back(base + vertexIndex);
+            }
+        }
+
+        meshes.push_back(std::move(batch));
+
+        RenderObject batchObject;
+        batchObject.meshIndex = (uint32_t) (meshes.size() - 1);
+        batchObject.materialIndex = std::get<0>(key);
+        batchObject.isStatic = true;
+        batchObject.batchedObjects = (uint32_t) members.size();
+        for (uint32_t index : members) {
+            objects[index].batched = true;
+        }
+        objects.push_back(batchObject);
+
+        stats.sourceObjects += (uint32_t) members.size();
+        stats.batches++;
+        stats.vertices += (uint32_t) meshes.back().vertices.size();
+    }
+    return stats;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "ve_scene.hpp"
+#include "vk_mesh.hpp"
+
+struct StaticBatchStats {
+    uint32_t sourceObjects = 0; // Merged into batches, no longer drawn on their own
+    uint32_t batches = 0;
+    uint32_t vertices = 0;      // Of all batch meshes
+};
+
+// Merges static objects that share a material and a cell of a cellSize grid into one mesh per cell, with their
+// transforms applied to the vertices. The cells keep batches small enough for culling to still reject most
+// of them. Batch meshes are appended to meshes without being uploaded, batch objects to objects. Objects
+// already batched and cells with a single object are left alone.
+StaticBatchStats mergeStaticObjects(std::vector<RenderObject>& objects, std::vector<Mesh>& meshes, float cellSize);
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+// Cooked texture file (.rtex) written by the TextureCooker tool, modelled on KTX2. A fixed header is followed
+// by one index entry per level from the largest down. The level data is stored from the smallest level up,
+// so streaming in the low levels of a texture only reads the front of the file.
+const char TEXTURE_CONTAINER_MAGIC[8] = {'R', 'O', 'S', 'E', 'T', 'E', 'X', '1'};
+const char* const TEXTURE_CONTAINER_EXTENSION = ".rtex";
+
+struct TextureContainerHeader {
+    char magic[8];
+    uint32_t vkFormat;
+    uint32_t width;  // Of level 0
+    uint32_t height;
+    uint32_t levelCount;
+};
+
+struct TextureContainerLevel {
+    uint64_t byteOffset; // From the start of the file
+    uint64_t byteLength;
+};
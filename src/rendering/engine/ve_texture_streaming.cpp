@@ -0,0 +1,231 @@
+#include "ve_texture_streaming.hpp"
+#include "vk_engine.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+static uint32_t levelSide(uint32_t width, uint32_t height, uint32_t level) {
+    return std::max(std::max(width >> level, 1u), std::max(height >> level, 1u));
+}
+
+TextureStreamer::TextureStreamer(VulkanEngine& engine, TextureArrays& arrays) : engine(engine), arrays(arrays) {
+    // Geometry and render targets share the heap, textures get a part of it
+    VkDeviceSize heapBudget = 0;
+    for (auto& heap : engine.getMemoryStats().heaps) {
+        if (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) heapBudget = std::max(heapBudget, heap.budget);
+    }
+    budget = heapBudget / 4;
+    engine.vkLogger->debug("Texture streaming budget: {:.1f} MiB", budget / (1024.0 * 1024.0));
+}
+
+// Loads still running refer to the streamer, they finish before it goes away
+void TextureStreamer::destroy() {
+    while (running > 0) {
+        engine.tasks->update();
+        std::this_thread::yield();
+    }
+    results.clear();
+}
+
+uint32_t TextureStreamer::add(const std::string& path, bool srgb) {
+    StreamedTexture texture;
+    texture.path = path;
+    texture.srgb = srgb;
+    textures.push_back(texture);
+
+    uint32_t index = (uint32_t) (textures.size() - 1);
+    schedule(index, UINT32_MAX);
+    stats.textures = (uint32_t) textures.size();
+    return index;
+}
+
+TextureHandle TextureStreamer::getHandle(uint32_t texture) const {
+    TextureHandle handle = textures[texture].handle;
+    return handle == NO_TEXTURE ? 0 : handle;
+}
+
+void TextureStreamer::requestSize(uint32_t texture, float pixels) {
+    StreamedTexture& streamed = textures[texture];
+    streamed.screenSize = std::max(streamed.screenSize, pixels);
+    streamed.lastRequested = frame;
+}
+
+// UINT32_MAX loads the levels up to INITIAL_SIZE, the size is unknown before the first load
+void TextureStreamer::schedule(uint32_t texture, uint32_t level) {
+    StreamedTexture& streamed = textures[texture];
+
+    LoadJob job;
+    job.texture = texture;
+    job.path = streamed.path;
+    job.srgb = streamed.srgb;
+    job.maxSize = level == UINT32_MAX ? INITIAL_SIZE : levelSide(streamed.width, streamed.height, level);
+
+    streamed.loading = true;
+    streamed.loadingLevel = level;
+    loading++;
+    streamed.loadingArrayBytes = level == UINT32_MAX ? 0 : arrayBytes(streamed, level);
+    loadingArrayBytes += streamed.loadingArrayBytes;
+
+    running++;
+    engine.tasks->spawn(load(std::move(job)));
+}
+
+// Reading and decoding happen on an I/O thread, the main thread only copies the result into a staging buffer
+Task<void> TextureStreamer::load(LoadJob job) {
+    co_await engine.tasks->io();
+
+    LoadResult result;
+    result.texture = job.texture;
+    result.ok = loadTextureLevels(job.path, job.srgb, job.maxSize, result.data, result.width, result.height);
+
+    co_await engine.tasks->mainThread();
+    results.push_back(std::move(result));
+    running--;
+}
+
+uint32_t TextureStreamer::wantedLevel(const StreamedTexture& texture) const {
+    uint32_t size = INITIAL_SIZE;
+    if (frame - texture.lastRequested <= unusedFrames) {
+        while ((float) size < texture.screenSize) {
+            size *= 2;
+        }
+    }
+    return textureLevelForSize(texture.width, texture.height, size);
+}
+
+VkDeviceSize TextureStreamer::chainBytes(const StreamedTexture& texture, uint32_t level) const {
+    if (level == UINT32_MAX) return 0;
+    return textureChainSize(texture.format, std::max(texture.width >> level, 1u), std::max(texture.height >> level, 1u));
+}
+
+// New array the chain from the level down would need, 0 if its group has room
+VkDeviceSize TextureStreamer::arrayBytes(const StreamedTexture& texture, uint32_t level) const {
+    uint32_t levels = textureLevelCount(texture.width, texture.height) - level;
+    return arrays.addedBytes(texture.format, std::max(texture.width >> level, 1u), std::max(texture.height >> level, 1u), levels);
+}
+
+bool TextureStreamer::update() {
+    bool changed = false;
+
+    std::vector<LoadResult> finished;
+    finished.swap(results);
+
+    for (auto& result : finished) {
+        StreamedTexture& texture = textures[result.texture];
+        loadingArrayBytes -= texture.loadingArrayBytes;
+        texture.loadingArrayBytes = 0;
+        texture.loading = false;
+        texture.loadingLevel = UINT32_MAX;
+        loading--;
+
+        if (!result.ok) {
+            engine.vkLogger->warn("Failed to load texture {}", texture.path);
+            continue;
+        }
+
+        texture.format = result.data.format;
+        texture.width = result.width;
+        texture.height = result.height;
+
+        // Arrays may have filled up since the load was scheduled, a larger chain must not push them past the budget
+        uint32_t level = textureLevelCount(texture.width, texture.height) - result.data.levels;
+        bool larger = texture.residentLevel != UINT32_MAX && level < texture.residentLevel;
+        if (larger && arrays.stats.bytes + arrayBytes(texture, level) > budget) {
+            texture.retryFrame = frame + unusedFrames;
+            continue;
+        }
+
+        TextureHandle handle = arrays.add(result.data);
+        if (texture.handle == NO_TEXTURE && handle == NO_TEXTURE) {
+            engine.vkLogger->warn("No texture array left for {}", texture.path);
+            continue;
+        }
+        if (handle == NO_TEXTURE) {
+            // Keeps its current chain and tries again later
+            texture.retryFrame = frame + unusedFrames;
+            continue;
+        }
+
+        if (texture.handle != NO_TEXTURE) arrays.release(texture.handle);
+        stats.residentBytes -= chainBytes(texture, texture.residentLevel);
+
+        texture.handle = handle;
+        texture.residentLevel = level;
+        stats.residentBytes += chainBytes(texture, texture.residentLevel);
+        stats.loads++;
+        changed = true;
+    }
+
+    struct Candidate {
+        uint32_t texture;
+        uint32_t level;
+        float priority;
+    };
+    std::vector<Candidate> upgrades;
+    std::vector<Candidate> downgrades;
+    std::vector<Candidate> victims;
+
+    stats.full = 0;
+    stats.wantedBytes = 0;
+    for (uint32_t i = 0; i < textures.size(); i++) {
+        StreamedTexture& texture = textures[i];
+        float priority = texture.screenSize;
+        uint32_t level = texture.residentLevel == UINT32_MAX ? UINT32_MAX : wantedLevel(texture);
+        texture.screenSize = 0.f;
+        if (texture.residentLevel == UINT32_MAX) continue;
+
+        stats.wantedBytes += chainBytes(texture, level);
+        if (texture.residentLevel == 0) stats.full++;
+        if (texture.loading || frame < texture.retryFrame) continue;
+
+        // Shrinking only after the wanted size fell below a quarter keeps textures near a threshold from bouncing
+        if (level < texture.residentLevel) {
+            upgrades.push_back({i, level, priority});
+        } else if (level > texture.residentLevel + 1) {
+            downgrades.push_back({i, level, priority});
+        } else if (texture.residentLevel + 1 < textureLevelCount(texture.width, texture.height)) {
+            victims.push_back({i, texture.residentLevel + 1, priority});
+        }
+    }
+
+    for (auto& candidate : downgrades) {
+        if (loading >= MAX_LOADING) break;
+        schedule(candidate.texture, candidate.level);
+    }
+
+    std::sort(upgrades.begin(), upgrades.end(), [] (const Candidate& a, const Candidate& b) { return a.priority > b.priority; });
+    std::sort(victims.begin(), victims.end(), [] (const Candidate& a, const Candidate& b) { return a.priority < b.priority; });
+    size_t nextVictim = 0;
+
+    // Evictions only lower it once arrays are left empty and destroyed
+    auto projected = [&] () { return arrays.stats.bytes + loadingArrayBytes; };
+
+    // Drops the least visible texture by one level, only below the given priority
+    auto evict = [&] (float below) -> bool {
+        if (nextVictim >= victims.size() || victims[nextVictim].priority >= below || loading >= MAX_LOADING) return false;
+        schedule(victims[nextVictim].texture, victims[nextVictim].level);
+        nextVictim++;
+        stats.evictions++;
+        return true;
+    };
+
+    // A lowered budget is enforced even without anything to upgrade
+    while (projected() > budget && evict(INFINITY)) {}
+
+    for (auto& candidate : upgrades) {
+        if (loading >= MAX_LOADING) break;
+
+        // Without room the less visible textures make way, this one waits until their arrays are gone
+        if (projected() + arrayBytes(textures[candidate.texture], candidate.level) > budget) {
+            evict(candidate.priority);
+            break;
+        }
+        schedule(candidate.texture, candidate.level);
+    }
+
+    stats.loading = loading;
+    stats.allocatedBytes = arrays.stats.bytes;
+    frame++;
+    return changed;
+}
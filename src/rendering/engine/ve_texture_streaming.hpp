@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include <RoseTasks.hpp>
+
+#include "ve_textures.hpp"
+
+class VulkanEngine;
+
+struct TextureStreamingStats {
+    uint32_t textures = 0;
+    uint32_t loading = 0;      // Queued or running on an I/O thread
+    uint32_t full = 0;         // With level 0 resident
+    VkDeviceSize residentBytes = 0;  // Of the resident chains
+    VkDeviceSize allocatedBytes = 0; // Of the array images holding them, what the budget limits
+    VkDeviceSize wantedBytes = 0; // If every texture had the levels its screen size asks for
+    uint32_t loads = 0;        // Since the start
+    uint32_t evictions = 0;
+};
+
+// Streams the mip chains of textures into the texture arrays. A texture starts with its levels up to
+// INITIAL_SIZE and coroutines on the engine's I/O threads load larger chains as the renderer reports bigger screen sizes for it.
+// A resident chain lives in the array group of its top level, so moving between sizes swaps the layer.
+// The budget limits the array images, which hold whole groups of layers: a larger chain is only loaded if the
+// array it needs fits, and above the budget the textures with the smallest screen sizes drop to half their
+// resolution first until arrays empty out. First chains and those evictions may still allocate past it.
+class TextureStreamer {
+public:
+    static const uint32_t INITIAL_SIZE = 64; // Largest side of the top level loaded first
+    static const uint32_t MAX_LOADING = 4;   // Upgrades and evictions loading at once
+
+    TextureStreamer(VulkanEngine& engine, TextureArrays& arrays);
+    void destroy();
+
+    uint32_t add(const std::string& path, bool srgb);
+    // The white default until the first chain is resident
+    TextureHandle getHandle(uint32_t texture) const;
+
+    // Texels across the screen the texture should have this frame, the largest request wins
+    void requestSize(uint32_t texture, float pixels);
+
+    // Applies finished loads and schedules the next ones, true if any handle changed
+    bool update();
+
+    VkDeviceSize budget; // A quarter of the largest device local heap's budget unless set
+    uint32_t unusedFrames = 120; // Textures not requested for this long go back to INITIAL_SIZE
+
+    TextureStreamingStats stats;
+
+private:
+    struct StreamedTexture {
+        std::string path;
+        bool srgb;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        uint32_t width = 0;  // Of level 0, 0 until the first load finished
+        uint32_t height = 0;
+
+        TextureHandle handle = NO_TEXTURE;
+        uint32_t residentLevel = UINT32_MAX; // Top level of the resident chain
+        uint32_t loadingLevel = UINT32_MAX;  // Of the load queued or running, UINT32_MAX for the first one
+        bool loading = false;
+        VkDeviceSize loadingArrayBytes = 0; // Expected to be allocated once the load is applied
+        uint32_t retryFrame = 0; // After running out of array slots
+
+        float screenSize = 0.f;
+        uint32_t lastRequested = 0;
+    };
+
+    struct LoadJob {
+        uint32_t texture;
+        std::string path;
+        bool srgb;
+        uint32_t maxSize; // Largest side of the top level to load
+    };
+
+    struct LoadResult {
+        uint32_t texture;
+        bool ok;
+        uint32_t width; // Of level 0
+        uint32_t height;
+        TextureData data;
+    };
+
+    VulkanEngine& engine;
+    TextureArrays& arrays;
+    std::vector<StreamedTexture> textures;
+    uint32_t frame = 0;
+    uint32_t loading = 0;
+    VkDeviceSize loadingArrayBytes = 0; // Of all loads queued or running
+
+    std::vector<LoadResult> results; // Handed back on the main thread, applied by update()
+    uint32_t running = 0; // Load coroutines not finished yet
+
+    Task<void> load(LoadJob job);
+    void schedule(uint32_t texture, uint32_t level);
+    uint32_t wantedLevel(const StreamedTexture& texture) const;
+    VkDeviceSize chainBytes(const StreamedTexture& texture, uint32_t level) const;
+    VkDeviceSize arrayBytes(const StreamedTexture& texture, uint32_t level) const;
+};
@@ -0,0 +1,420 @@
+#include "ve_textures.hpp"
+#include "ve_texture_container.hpp"
+#include "vk_engine.hpp"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+
+const uint32_t TextureArrays::MAX_ARRAYS;
+const uint32_t TextureArrays::MAX_LAYERS;
+
+// Bytes per pixel, or per 4x4 block for block compressed formats. 0 for formats textures cannot use.
+static uint32_t textureFormatBytes(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+            return 4;
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+            return 8;
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+bool isBlockCompressed(VkFormat format) {
+    return format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK;
+}
+
+VkDeviceSize textureLevelSize(VkFormat format, uint32_t width, uint32_t height) {
+    uint32_t bytes = textureFormatBytes(format);
+    if (bytes == 0) {
+        throw std::runtime_error("unsupported texture format!");
+    }
+
+    if (isBlockCompressed(format)) {
+        return (VkDeviceSize) ((width + 3) / 4) * ((height + 3) / 4) * bytes;
+    }
+    return (VkDeviceSize) width * height * bytes;
+}
+
+uint32_t textureLevelCount(uint32_t width, uint32_t height) {
+    uint32_t levels = 1;
+    for (uint32_t size = std::max(width, height); size > 1; size /= 2) {
+        levels++;
+    }
+    return levels;
+}
+
+uint32_t textureLevelForSize(uint32_t width, uint32_t height, uint32_t size) {
+    uint32_t levels = textureLevelCount(width, height);
+    uint32_t level = 0;
+    while (level + 1 < levels && std::max(std::max(width >> level, 1u), std::max(height >> level, 1u)) > size) {
+        level++;
+    }
+    return level;
+}
+
+VkDeviceSize textureChainSize(VkFormat format, uint32_t width, uint32_t height, uint32_t levels) {
+    VkDeviceSize size = 0;
+    for (uint32_t level = 0; level < levels; level++) {
+        size += textureLevelSize(format, width, height);
+        if (width == 1 && height == 1) break;
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+    }
+    return size;
+}
+
+void dropTextureLevels(TextureData& data, uint32_t count) {
+    count = std::min(count, data.levels - 1);
+
+    VkDeviceSize offset = 0;
+    for (uint32_t level = 0; level < count; level++) {
+        offset += textureLevelSize(data.format, data.width, data.height);
+        data.width = std::max(data.width / 2, 1u);
+        data.height = std::max(data.height / 2, 1u);
+    }
+
+    data.pixels.erase(data.pixels.begin(), data.pixels.begin() + offset);
+    data.levels -= count;
+}
+
+// Averages 2x2 blocks, the last row or column of odd sized levels is repeated
+static void downsample(const uint8_t* src, uint32_t width, uint32_t height, uint8_t* dst) {
+    uint32_t dstWidth = std::max(width / 2, 1u);
+    uint32_t dstHeight = std::max(height / 2, 1u);
+
+    for (uint32_t y = 0; y < dstHeight; y++) {
+        uint32_t y0 = std::min(y * 2, height - 1);
+        uint32_t y1 = std::min(y * 2 + 1, height - 1);
+        for (uint32_t x = 0; x < dstWidth; x++) {
+            uint32_t x0 = std::min(x * 2, width - 1);
+            uint32_t x1 = std::min(x * 2 + 1, width - 1);
+            for (uint32_t c = 0; c < 4; c++) {
+                uint32_t sum = src[(y0 * width + x0) * 4 + c] + src[(y0 * width + x1) * 4 + c]
+                             + src[(y1 * width + x0) * 4 + c] + src[(y1 * width + x1) * 4 + c];
+                dst[(y * dstWidth + x) * 4 + c] = (uint8_t) ((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+bool loadTextureFile(const std::string& path, bool srgb, TextureData& data) {
+    int width, height, channels;
+    stbi_uc* pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (pixels == nullptr) return false;
+
+    data.format = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+    data.width = (uint32_t) width;
+    data.height = (uint32_t) height;
+    data.levels = textureLevelCount(data.width, data.height);
+
+    data.pixels.resize(textureChainSize(data.format, data.width, data.height, data.levels));
+    memcpy(data.pixels.data(), pixels, textureLevelSize(data.format, data.width, data.height));
+    stbi_image_free(pixels);
+
+    // Filtered in the stored encoding, slightly darkens sRGB textures in the smaller levels
+    VkDeviceSize offset = 0;
+    uint32_t w = data.width, h = data.height;
+    for (uint32_t level = 1; level < data.levels; level++) {
+        VkDeviceSize size = textureLevelSize(data.format, w, h);
+        downsample(data.pixels.data() + offset, w, h, data.pixels.data() + offset + size);
+        offset += size;
+        w = std::max(w / 2, 1u);
+        h = std::max(h / 2, 1u);
+    }
+    return true;
+}
+
+bool loadTextureContainer(const std::string& path, uint32_t maxSize, TextureData& data, uint32_t& width, uint32_t& height) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    TextureContainerHeader header;
+    file.read((char*) &header, sizeof(header));
+    if (!file || memcmp(header.magic, TEXTURE_CONTAINER_MAGIC, sizeof(header.magic)) != 0) return false;
+
+    VkFormat format = (VkFormat) header.vkFormat;
+    if (textureFormatBytes(format) == 0 || header.width == 0 || header.height == 0) return false;
+    if (header.levelCount == 0 || header.levelCount > textureLevelCount(header.width, header.height)) return false;
+
+    std::vector<TextureContainerLevel> index(header.levelCount);
+    file.read((char*) index.data(), index.size() * sizeof(TextureContainerLevel));
+    if (!file) return false;
+
+    uint32_t firstLevel = std::min(textureLevelForSize(header.width, header.height, maxSize), header.levelCount - 1);
+
+    data.format = format;
+    data.width = std::max(header.width >> firstLevel, 1u);
+    data.height = std::max(header.height >> firstLevel, 1u);
+    data.levels = header.levelCount - firstLevel;
+    data.pixels.resize(textureChainSize(format, data.width, data.height, data.levels));
+
+    // Smallest levels first in the file, largest first in the data
+    VkDeviceSize offset = 0;
+    for (uint32_t level = firstLevel; level < header.levelCount; level++) {
+        VkDeviceSize size = textureLevelSize(format, std::max(header.width >> level, 1u), std::max(header.height >> level, 1u));
+        if (index[level].byteLength != size) return false;
+
+        file.seekg((std::streamoff) index[level].byteOffset);
+        file.read((char*) data.pixels.data() + offset, (std::streamsize) size);
+        if (!file) return false;
+        offset += size;
+    }
+
+    width = header.width;
+    height = header.height;
+    return true;
+}
+
+bool loadTextureLevels(const std::string& path, bool srgb, uint32_t maxSize, TextureData& data, uint32_t& width, uint32_t& height) {
+    if (std::filesystem::path(path).extension() == TEXTURE_CONTAINER_EXTENSION) {
+        return loadTextureContainer(path, maxSize, data, width, height);
+    }
+
+    if (!loadTextureFile(path, srgb, data)) return false;
+    width = data.width;
+    height = data.height;
+    dropTextureLevels(data, textureLevelForSize(width, height, maxSize));
+    return true;
+}
+
+TextureArrays::TextureArrays(VulkanEngine& engine) : engine(engine) {
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    check_vk_result(vkCreateSampler(engine.device, &samplerInfo, nullptr, &sampler));
+
+    // Handle 0, fills the unused descriptor slots and stands in for materials without a texture
+    TextureData white;
+    white.format = VK_FORMAT_R8G8B8A8_UNORM;
+    white.width = 1;
+    white.height = 1;
+    white.pixels = {255, 255, 255, 255};
+    add(white);
+}
+
+void TextureArrays::destroy() {
+    for (auto& array : arrays) {
+        if (array.view == VK_NULL_HANDLE) continue;
+        vkDestroyImageView(engine.device, array.view, nullptr);
+        engine.destroyImage(array.image);
+    }
+    arrays.clear();
+    vkDestroySampler(engine.device, sampler, nullptr);
+}
+
+TextureHandle TextureArrays::add(const TextureData& data) {
+    uint32_t index = findArray(data);
+    if (index == UINT32_MAX) return NO_TEXTURE;
+
+    TextureArray& array = arrays[index];
+    uint32_t layer;
+    if (!array.freeLayers.empty()) {
+        layer = array.freeLayers.back();
+        array.freeLayers.pop_back();
+    } else {
+        layer = array.layers++;
+    }
+    array.used++;
+
+    std::vector<VkBufferImageCopy> regions(data.levels);
+    VkDeviceSize offset = 0;
+    uint32_t w = data.width, h = data.height;
+    for (uint32_t level = 0; level < data.levels; level++) {
+        VkBufferImageCopy& region = regions[level];
+        region = {};
+        region.bufferOffset = offset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = level;
+        region.imageSubresource.baseArrayLayer = layer;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = {w, h, 1};
+
+        offset += textureLevelSize(data.format, w, h);
+        w = std::max(w / 2, 1u);
+        h = std::max(h / 2, 1u);
+    }
+
+    if (offset > data.pixels.size()) {
+        throw std::runtime_error("texture data is smaller than its mip chain!");
+    }
+
+    VkImageSubresourceRange range = {};
+    range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    range.baseMipLevel = 0;
+    range.levelCount = data.levels;
+    range.baseArrayLayer = layer;
+    range.layerCount = 1;
+
+    // Every layer is shader read only from creation on, the descriptor covers all of them
+    engine.transfer->uploadImage(data.pixels.data(), offset, array.image._image, regions, range, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    stats.textures++;
+
+    return (index << 16) | layer;
+}
+
+// Frames in flight may still sample the layer, it only becomes free for new textures once they are done
+void TextureArrays::release(TextureHandle handle) {
+    uint32_t index = textureArrayIndex(handle);
+    uint32_t layer = textureLayer(handle);
+    TextureArray& array = arrays[index];
+
+    array.used--;
+    stats.textures--;
+
+    if (array.used == 0 && index != 0) {
+        destroyArray(index);
+        return;
+    }
+
+    uint32_t generation = array.generation;
+    engine.retire([this, index, layer, generation] () {
+        if (index < arrays.size() && arrays[index].generation == generation) {
+            arrays[index].freeLayers.push_back(layer);
+        }
+    });
+}
+
+// An array of the group with a free layer, otherwise UINT32_MAX and the capacity of the group's next array:
+// twice that of its largest
+uint32_t TextureArrays::findSpace(VkFormat format, uint32_t width, uint32_t height, uint32_t levels, uint32_t& capacity) const {
+    capacity = 4;
+    for (uint32_t i = 0; i < arrays.size(); i++) {
+        const TextureArray& array = arrays[i];
+        if (array.view == VK_NULL_HANDLE) continue;
+        if (array.format != format || array.width != width || array.height != height || array.levels != levels) continue;
+
+        if (!array.freeLayers.empty() || array.layers < array.capacity) return i;
+        capacity = std::max(capacity, std::min(array.capacity * 2, MAX_LAYERS));
+    }
+    return UINT32_MAX;
+}
+
+uint32_t TextureArrays::findArray(const TextureData& data) {
+    uint32_t capacity;
+    uint32_t index = findSpace(data.format, data.width, data.height, data.levels, capacity);
+    if (index != UINT32_MAX) return index;
+
+    uint32_t freeSlot = arrays.size() < MAX_ARRAYS ? (uint32_t) arrays.size() : UINT32_MAX;
+    for (uint32_t i = 0; i < arrays.size(); i++) {
+        if (arrays[i].view == VK_NULL_HANDLE) {
+            freeSlot = i;
+            break;
+        }
+    }
+
+    if (freeSlot == UINT32_MAX) return UINT32_MAX;
+    return createArray(data.format, data.width, data.height, data.levels, capacity, freeSlot);
+}
+
+VkDeviceSize TextureArrays::addedBytes(VkFormat format, uint32_t width, uint32_t height, uint32_t levels) const {
+    uint32_t capacity;
+    if (findSpace(format, width, height, levels, capacity) != UINT32_MAX) return 0;
+    return textureChainSize(format, width, height, levels) * capacity;
+}
+
+uint32_t TextureArrays::createArray(VkFormat format, uint32_t width, uint32_t height, uint32_t levels, uint32_t capacity, uint32_t slot) {
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = format;
+    imageInfo.extent = {width, height, 1};
+    imageInfo.mipLevels = levels;
+    imageInfo.arrayLayers = capacity;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VmaAllocationCreateInfo allocInfo = {};
+    allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+    if (slot == arrays.size()) arrays.emplace_back();
+    TextureArray& array = arrays[slot];
+
+    array.image = engine.createImage(imageInfo, allocInfo, "Textures");
+    array.format = format;
+    array.width = width;
+    array.height = height;
+    array.levels = levels;
+    array.capacity = capacity;
+    array.layers = 0;
+    array.used = 0;
+    array.freeLayers.clear();
+
+    VkImageViewCreateInfo viewInfo = {};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = array.image._image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+    viewInfo.format = format;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = levels;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = capacity;
+    check_vk_result(vkCreateImageView(engine.device, &viewInfo, nullptr, &array.view));
+
+    // Sampled as a whole, layers without a texture yet included
+    engine.transfer->transitionImage(array.image._image, viewInfo.subresourceRange, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+    stats.arrays++;
+    stats.bytes += textureChainSize(format, width, height, levels) * capacity;
+    version++;
+
+    engine.vkLogger->debug("Texture array {}: {}x{}, {} levels, {} layers", slot, width, height, levels, capacity);
+    return slot;
+}
+
+void TextureArrays::destroyArray(uint32_t index) {
+    TextureArray& array = arrays[index];
+
+    VulkanEngine* eng = &engine;
+    AllocatedImage image = array.image;
+    VkImageView view = array.view;
+    engine.retire([=] () mutable {
+        vkDestroyImageView(eng->device, view, nullptr);
+        eng->destroyImage(image);
+    });
+
+    stats.arrays--;
+    stats.bytes -= textureChainSize(array.format, array.width, array.height, array.levels) * array.capacity;
+    version++;
+
+    array.view = VK_NULL_HANDLE;
+    array.freeLayers.clear();
+    array.generation++;
+}
+
+void TextureArrays::getImageInfos(std::vector<VkDescriptorImageInfo>& infos) const {
+    infos.resize(MAX_ARRAYS);
+    for (uint32_t i = 0; i < MAX_ARRAYS; i++) {
+        bool valid = i < arrays.size() && arrays[i].view != VK_NULL_HANDLE;
+        infos[i].sampler = VK_NULL_HANDLE;
+        infos[i].imageView = arrays[valid ? i : 0].view;
+        infos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "ve_types.hpp"
+
+class VulkanEngine;
+
+// Array slot in the high 16 bits, layer in the low 16 bits
+using TextureHandle = uint32_t;
+const TextureHandle NO_TEXTURE = UINT32_MAX;
+
+inline uint32_t textureArrayIndex(TextureHandle handle) { return handle >> 16; }
+inline uint32_t textureLayer(TextureHandle handle) { return handle & 0xFFFF; }
+
+// Pixels of a texture and its mip chain, tightly packed from the largest level down
+struct TextureData {
+    VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t levels = 1;
+    std::vector<uint8_t> pixels;
+};
+
+bool isBlockCompressed(VkFormat format);
+VkDeviceSize textureLevelSize(VkFormat format, uint32_t width, uint32_t height);
+uint32_t textureLevelCount(uint32_t width, uint32_t height);
+// Largest level whose larger side fits into size, the last level if none does
+uint32_t textureLevelForSize(uint32_t width, uint32_t height, uint32_t size);
+// Of the levels from width x height down to the given count, or to 1x1 with UINT32_MAX
+VkDeviceSize textureChainSize(VkFormat format, uint32_t width, uint32_t height, uint32_t levels = UINT32_MAX);
+// Removes the largest levels, the smallest one is always kept
+void dropTextureLevels(TextureData& data, uint32_t count);
+
+// Decodes an image file to RGBA8 and box filters the full mip chain, false if the file could not be read
+bool loadTextureFile(const std::string& path, bool srgb, TextureData& data);
+// Reads the levels of a cooked container from the largest fitting into maxSize down, seeking past the others.
+// width and height receive the size of level 0.
+bool loadTextureContainer(const std::string& path, uint32_t maxSize, TextureData& data, uint32_t& width, uint32_t& height);
+// Either of the above by file extension, a cooked container keeps its own format and ignores srgb
+bool loadTextureLevels(const std::string& path, bool srgb, uint32_t maxSize, TextureData& data, uint32_t& width, uint32_t& height);
+
+struct TextureStats {
+    uint32_t arrays = 0;
+    uint32_t textures = 0;
+    VkDeviceSize bytes = 0; // Of all array images, including unused layers
+};
+
+// Textures of the same format, size and mip count share a 2D array image, the shaders select one with an
+// array index and a layer instead of a descriptor per texture. A full array is followed by a larger one of
+// the same group, the views of all arrays are bound together as one descriptor array. Released layers are
+// reused once the frames in flight are done with them, arrays without textures are destroyed.
+class TextureArrays {
+public:
+    static const uint32_t MAX_ARRAYS = 32;
+    static const uint32_t MAX_LAYERS = 64; // Per array, the first array of a group starts smaller
+
+    TextureArrays(VulkanEngine& engine);
+    void destroy();
+
+    // Uploaded through the engine's transfer context, usable by frames recorded after its next flush.
+    // The handle of the white default texture is 0. NO_TEXTURE if the texture needs a new array and
+    // all MAX_ARRAYS slots are taken.
+    TextureHandle add(const TextureData& data);
+    void release(TextureHandle handle);
+    // Image memory add() would allocate for a texture of this kind, 0 if an array of its group has a free layer
+    VkDeviceSize addedBytes(VkFormat format, uint32_t width, uint32_t height, uint32_t levels) const;
+
+    // MAX_ARRAYS entries, slots without an array repeat the default array
+    void getImageInfos(std::vector<VkDescriptorImageInfo>& infos) const;
+    VkSampler getSampler() const { return sampler; }
+    // Changes whenever an array was created or destroyed, descriptors written before are out of date
+    uint32_t getVersion() const { return version; }
+
+    TextureStats stats;
+
+private:
+    struct TextureArray {
+        AllocatedImage image;
+        VkImageView view = VK_NULL_HANDLE; // Null for free slots
+        VkFormat format;
+        uint32_t width;
+        uint32_t height;
+        uint32_t levels;
+        uint32_t capacity;
+        uint32_t layers = 0; // Ever used, layers past it have never been written
+        uint32_t used = 0;
+        std::vector<uint32_t> freeLayers;
+        uint32_t generation = 0; // Of the slot, layers released into a destroyed array are dropped
+    };
+
+    VulkanEngine& engine;
+    std::vector<TextureArray> arrays;
+    VkSampler sampler;
+    uint32_t version = 0;
+
+    uint32_t findSpace(VkFormat format, uint32_t width, uint32_t height, uint32_t levels, uint32_t& capacity) const;
+    uint32_t findArray(const TextureData& data);
+    uint32_t createArray(VkFormat format, uint32_t width, uint32_t height, uint32_t levels, uint32_t capacity, uint32_t slot);
+    void destroyArray(uint32_t index);
+};
@@ -7,6 +7,11 @@ struct AllocatedBuffer {
     VmaAllocation allocation;
 };
 
+struct AllocatedImage {
+    VkImage _image;
+    VmaAllocation _allocation;
+};
+
 class Initializable {
     public:
     virtual void init() = 0;
@@ -13,6 +13,8 @@ VulkanEngine::VulkanEngine(std::set<std::string> instanceExtensions)
     createInstance();
     setupDebugMessenger();
     requestQueue([&] (const VkQueueFamilyProperties& prop, uint32_t idx, VkPhysicalDevice device) -> bool {return isGraphicsFamily(prop);}, &graphicsQueueFamily, &graphicsQueue);
+    requestQueue([&] (const VkQueueFamilyProperties& prop, uint32_t idx, VkPhysicalDevice device) -> bool {return isTransferOnlyFamily(prop);}, &transferQueueFamily, &transferQueue, true);
+    requestDeviceRequirement([&] (VkPhysicalDevice device) -> bool {return supportsTimelineSemaphores(device);});
     
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -48,6 +50,21 @@ void VulkanEngine::compileInstanceExtensions(std::set<std::string> external) {
         extensions.insert(ext);
     }
 
+    // Optional extensions are only requested if the loader reports them
+    uint32_t availableCount = 0;
+    vkEnumerateInstanceExtensionProperties(nullptr, &availableCount, nullptr);
+    std::vector<VkExtensionProperties> available(availableCount);
+    vkEnumerateInstanceExtensionProperties(nullptr, &availableCount, available.data());
+
+    for(auto ext : engineOptionalInstanceExtensions) {
+        for(const auto& prop : available) {
+            if (strcmp(prop.extensionName, ext) == 0) {
+                extensions.insert(ext);
+                break;
+            }
+        }
+    }
+
     // Validation Layers
     if (enableValidationLayers)
     {
@@ -68,9 +85,20 @@ void VulkanEngine::init() {
     createLogicalDevice();
     createMemoryAllocator();
     createCommandPool();
+    transfer = std::make_unique<TransferContext>(*this);
+    tasks = std::make_unique<TaskScheduler>();
+    tasks->onError = [this] (std::exception_ptr exception) {
+        try {
+            std::rethrow_exception(exception);
+        } catch (const std::exception& e) {
+            vkLogger->error("Task failed: {}", e.what());
+        }
+    };
     createPipelineCache();
     createDescriptorPool();
     initImgui();
+    materials = std::make_unique<MaterialSystem>(*this);
+    geometry = std::make_unique<GeometryPool>(*this);
     loadMeshes();
 
     for(auto obj : postInitObjects)
@@ -81,18 +109,25 @@ void VulkanEngine::init() {
 
 void VulkanEngine::destroy() {
 
-    ImGui_ImplVulkan_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
+    materials->destroy();
+    geometry->destroy();
+
+    // Everything retired at runtime, the device is idle after stop()
+    deletionQueue.flush();
+
+    transfer->destroy();
+    tasks.reset();
 
-    for(auto mesh : meshes)
-    {
-        vmaDestroyBuffer(allocator, mesh.vertexBuffer.buffer, mesh.vertexBuffer.allocation);
-    }
     vkDestroyCommandPool(device, commandPool, nullptr);
 
     vkDestroyPipelineCache(device, pipelineCache, nullptr);
     vkDestroyDescriptorPool(device, descriptorPool, nullptr);
 
+    for(auto& [queue, queueTimeline] : timelines)
+    {
+        queueTimeline.destroy();
+    }
+
     //for(auto output : outputs) {removeOutput(output);}
     vmaDestroyAllocator(allocator);
     vkDestroyDevice(device, nullptr);
@@ -120,7 +155,17 @@ void VulkanEngine::createInstance()
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine"; 
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+
+    // Use Vulkan 1.3 if the loader supports it, older loaders get timeline semaphores from VK_KHR_timeline_semaphore
+    // and dynamic rendering from VK_KHR_dynamic_rendering
+    auto enumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion) vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion");
+    if (enumerateInstanceVersion != nullptr)
+    {
+        uint32_t loaderVersion = VK_API_VERSION_1_0;
+        enumerateInstanceVersion(&loaderVersion);
+        apiVersion = std::min(loaderVersion, (uint32_t) VK_API_VERSION_1_3);
+    }
+    appInfo.apiVersion = apiVersion;
 
     VkInstanceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -173,11 +218,17 @@ void VulkanEngine::requestDeviceRequirement(std::function<bool(VkPhysicalDevice)
 void VulkanEngine::requestDeviceExtensions(std::set<std::string> extensions) {
     deviceExtensions.insert(extensions.begin(), extensions.end());
 }
+void VulkanEngine::requestOptionalDeviceExtensions(std::set<std::string> extensions) {
+    optionalDeviceExtensions.insert(extensions.begin(), extensions.end());
+}
 
-void  VulkanEngine::requestQueue(queueCriteriaFunc criteria, uint32_t* familyIdx, VkQueue* queue) {
+// Optional queues do not disqualify a device, if no family matches *familyIdx is left as VK_QUEUE_FAMILY_IGNORED
+void  VulkanEngine::requestQueue(queueCriteriaFunc criteria, uint32_t* familyIdx, VkQueue* queue, bool optional) {
+    *familyIdx = VK_QUEUE_FAMILY_IGNORED;
     queueRequirements.push_back(criteria);
     queues.push_back(queue);
     queueFamilies.push_back(familyIdx); //just to keep size
+    queueOptional.push_back(optional);
 }
 
 void VulkanEngine::setupDebugMessenger()
@@ -230,6 +281,23 @@ void VulkanEngine::compileDeviceExtensions() {
     {
         deviceExtensions.insert(ext);
     }
+
+    // VK_EXT_memory_budget is queried through vkGetPhysicalDeviceMemoryProperties2KHR on a 1.0 instance
+    if (isInstanceExtensionEnabled(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME))
+    {
+        for(const auto& ext : engineOptionalDeviceExtensions)
+        {
+            optionalDeviceExtensions.insert(ext);
+        }
+    }
+}
+
+bool VulkanEngine::isInstanceExtensionEnabled(const std::string& extension) {
+    return std::find(instanceExtensions.begin(), instanceExtensions.end(), extension) != instanceExtensions.end();
+}
+
+bool VulkanEngine::isDeviceExtensionEnabled(const std::string& extension) {
+    return enabledDeviceExtensions.count(extension) > 0;
 }
 
 void VulkanEngine::createLogicalDevice()
@@ -238,7 +306,9 @@ void VulkanEngine::createLogicalDevice()
     std::set<uint32_t> uniqueQueueFamilies;
     for(auto familyPtr : queueFamilies)
     {
-        uniqueQueueFamilies.insert(*familyPtr);
+        if (*familyPtr != VK_QUEUE_FAMILY_IGNORED) {
+            uniqueQueueFamilies.insert(*familyPtr);
+        }
     }
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
@@ -255,18 +325,97 @@ void VulkanEngine::createLogicalDevice()
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    // Material textures are picked per draw from an array of descriptors, indirect draws carry the material as their first instance.
+    // Cooked textures are BC compressed and only used where the device samples those formats.
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
     VkPhysicalDeviceFeatures deviceFeatures{};
+    deviceFeatures.shaderSampledImageArrayDynamicIndexing = supportedFeatures.shaderSampledImageArrayDynamicIndexing;
+    deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+    deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+    enabledFeatures = deviceFeatures;
+
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    timelineFeatures.timelineSemaphore = VK_TRUE;
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pNext = &timelineFeatures;
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
     createInfo.pEnabledFeatures = &deviceFeatures;
 
+    enabledDeviceExtensions = deviceExtensions;
+
+    coreTimelineSemaphores = getDeviceApiVersion(physicalDevice) >= VK_API_VERSION_1_2;
+    if (!coreTimelineSemaphores)
+    {
+        enabledDeviceExtensions.insert(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+    }
+
+    uint32_t availableCount = 0;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &availableCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(availableCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &availableCount, availableExtensions.data());
+
+    for(auto& ext : optionalDeviceExtensions)
+    {
+        for(const auto& prop : availableExtensions)
+        {
+            if (ext == prop.extensionName) {
+                enabledDeviceExtensions.insert(ext);
+                break;
+            }
+        }
+    }
+
+    // Requested by outputs as optional extensions, only useful with their features
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+    presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    presentWaitFeatures.presentWait = VK_TRUE;
+
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+    presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    presentIdFeatures.presentId = VK_TRUE;
+    presentIdFeatures.pNext = &presentWaitFeatures;
+
+    presentWait = enabledDeviceExtensions.count(VK_KHR_PRESENT_ID_EXTENSION_NAME) > 0 &&
+        enabledDeviceExtensions.count(VK_KHR_PRESENT_WAIT_EXTENSION_NAME) > 0 && supportsPresentWait(physicalDevice);
+    if (presentWait)
+    {
+        timelineFeatures.pNext = &presentIdFeatures;
+    }
+    else
+    {
+        enabledDeviceExtensions.erase(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+        enabledDeviceExtensions.erase(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+    }
+
+    // Core in 1.3, the extension's dependencies are core in 1.2
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures{};
+    dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+    dynamicRenderingFeatures.dynamicRendering = VK_TRUE;
+
+    uint32_t deviceApiVersion = getDeviceApiVersion(physicalDevice);
+    bool coreDynamicRendering = deviceApiVersion >= VK_API_VERSION_1_3;
+    dynamicRendering = (coreDynamicRendering || (deviceApiVersion >= VK_API_VERSION_1_2 &&
+        enabledDeviceExtensions.count(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME) > 0)) && supportsDynamicRendering(physicalDevice);
+    if (dynamicRendering)
+    {
+        dynamicRenderingFeatures.pNext = createInfo.pNext;
+        createInfo.pNext = &dynamicRenderingFeatures;
+    }
+    if (!dynamicRendering || coreDynamicRendering)
+    {
+        enabledDeviceExtensions.erase(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+    }
+
     std::vector<const char*> extensions;
-    extensions.reserve(deviceExtensions.size());
-    for(auto& ext : deviceExtensions)    
+    extensions.reserve(enabledDeviceExtensions.size());
+    for(auto& ext : enabledDeviceExtensions)    
     {
         vkLogger->debug("Requesting Device Extension: {}", ext);
         extensions.push_back(ext.data());
@@ -293,6 +442,138 @@ void VulkanEngine::createLogicalDevice()
     }
 
     fulfillQueueRequests();
+
+    timelineFunctions.load(device, coreTimelineSemaphores);
+
+    if (dynamicRendering)
+    {
+        bool core = getDeviceApiVersion(physicalDevice) >= VK_API_VERSION_1_3;
+        cmdBeginRendering = (PFN_vkCmdBeginRenderingKHR) vkGetDeviceProcAddr(device, core ? "vkCmdBeginRendering" : "vkCmdBeginRenderingKHR");
+        cmdEndRendering = (PFN_vkCmdEndRenderingKHR) vkGetDeviceProcAddr(device, core ? "vkCmdEndRendering" : "vkCmdEndRenderingKHR");
+        vkLogger->info("Using dynamic rendering{}", core ? "" : " from VK_KHR_dynamic_rendering");
+    }
+
+    if (transferQueueFamily == VK_QUEUE_FAMILY_IGNORED)
+    {
+        vkLogger->info("No dedicated transfer queue, uploads run on the graphics queue");
+        transferQueueFamily = graphicsQueueFamily;
+        transferQueue = graphicsQueue;
+    }
+    else
+    {
+        vkLogger->info("Using dedicated transfer queue family {}", transferQueueFamily);
+    }
+
+    timeline(graphicsQueue);
+    timeline(transferQueue);
+}
+
+GpuTimeline& VulkanEngine::timeline(VkQueue queue)
+{
+    auto it = timelines.find(queue);
+    if (it != timelines.end()) return it->second;
+
+    auto& created = timelines[queue];
+    created.init(device, &timelineFunctions);
+    return created;
+}
+
+// Version usable on the device, limited by the version the instance was created with
+uint32_t VulkanEngine::getDeviceApiVersion(VkPhysicalDevice device)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+    return std::min(properties.apiVersion, apiVersion);
+}
+
+// Querying features needs Vulkan 1.1 or VK_KHR_get_physical_device_properties2
+PFN_vkGetPhysicalDeviceFeatures2 VulkanEngine::loadGetFeatures2()
+{
+    if (apiVersion >= VK_API_VERSION_1_1)
+    {
+        return (PFN_vkGetPhysicalDeviceFeatures2) vkGetInstanceProcAddr(vkInstance, "vkGetPhysicalDeviceFeatures2");
+    }
+    if (isInstanceExtensionEnabled(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME))
+    {
+        return (PFN_vkGetPhysicalDeviceFeatures2) vkGetInstanceProcAddr(vkInstance, "vkGetPhysicalDeviceFeatures2KHR");
+    }
+    return nullptr;
+}
+
+bool VulkanEngine::supportsPresentWait(VkPhysicalDevice device)
+{
+    PFN_vkGetPhysicalDeviceFeatures2 getFeatures2 = loadGetFeatures2();
+    if (getFeatures2 == nullptr) return false;
+
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+    presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+    presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    presentIdFeatures.pNext = &presentWaitFeatures;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &presentIdFeatures;
+    getFeatures2(device, &features);
+
+    return presentIdFeatures.presentId == VK_TRUE && presentWaitFeatures.presentWait == VK_TRUE;
+}
+
+bool VulkanEngine::supportsDynamicRendering(VkPhysicalDevice device)
+{
+    PFN_vkGetPhysicalDeviceFeatures2 getFeatures2 = loadGetFeatures2();
+    if (getFeatures2 == nullptr) return false;
+
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures{};
+    dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &dynamicRenderingFeatures;
+    getFeatures2(device, &features);
+
+    return dynamicRenderingFeatures.dynamicRendering == VK_TRUE;
+}
+
+bool VulkanEngine::supportsTimelineSemaphores(VkPhysicalDevice device)
+{
+    bool core = getDeviceApiVersion(device) >= VK_API_VERSION_1_2;
+    if (!core)
+    {
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> available(extensionCount);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, available.data());
+
+        bool found = false;
+        for (const auto& ext : available)
+        {
+            if (strcmp(ext.extensionName, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) == 0) found = true;
+        }
+        if (!found)
+        {
+            vkLogger->debug("Device does not support timeline semaphores");
+            return false;
+        }
+    }
+
+    PFN_vkGetPhysicalDeviceFeatures2 getFeatures2 = loadGetFeatures2();
+    if (getFeatures2 == nullptr)
+    {
+        vkLogger->debug("Cannot query timeline semaphore support");
+        return false;
+    }
+
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &timelineFeatures;
+    getFeatures2(device, &features);
+
+    return timelineFeatures.timelineSemaphore == VK_TRUE;
 }
 
 void VulkanEngine::createCommandPool() 
@@ -324,46 +605,24 @@ std::vector<const char *> VulkanEngine::getInstanceExtensions()
     return extensions;
 }
 
-void VulkanEngine::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = commandPool;
-    allocInfo.commandBufferCount = 1;
-
-    VkCommandBuffer commandBuffer;
-    vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-    vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-    VkBufferCopy copyRegion{};
-    copyRegion.srcOffset = 0; // Optional
-    copyRegion.dstOffset = 0; // Optional
-    copyRegion.size = size;
-    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-    vkEndCommandBuffer(commandBuffer);
-
-    VkSubmitInfo submitInfo {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-
-    vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-
-    vkQueueWaitIdle(graphicsQueue); // Bad but ok here for now 
+// Queues the copy on the transfer queue, the destination becomes usable by the first frame recorded after the copy is flushed.
+// Returns the transfer timeline value to await with transferComplete() instead of waiting for the queue.
+uint64_t VulkanEngine::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
+    transfer->copyBuffer(srcBuffer, dstBuffer, size, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT);
+    return transfer->flush();
+}
 
-    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+TaskScheduler::ConditionAwaiter VulkanEngine::transferComplete(uint64_t timelineValue) {
+    return tasks->until([this, timelineValue] () { return transfer->isComplete(timelineValue); });
 }
 
 bool VulkanEngine::isDeviceSuitable(VkPhysicalDevice device)
 {
 
-    checkQueueCompatibility(device);
+    if (!checkQueueCompatibility(device)) {
+        vkLogger->debug("Device does not provide all required queues");
+        return false;
+    }
     
     for(auto func : deviceReqCallbacks)
     {
@@ -419,9 +678,9 @@ bool VulkanEngine::checkQueueCompatibility(VkPhysicalDevice device) {
         familyIdx++;
     }
 
-    for(auto& b : familyFound)
+    for (size_t reqIdx = 0; reqIdx < familyFound.size(); reqIdx++)
     {
-        if(!b) {return false;}
+        if(!familyFound[reqIdx] && !queueOptional[reqIdx]) {return false;}
     }
 
     return true;
@@ -452,6 +711,7 @@ void VulkanEngine::compileQueueFamilyIndicies() {
 void VulkanEngine::fulfillQueueRequests() {
     for (size_t queueIdx = 0; queueIdx < queues.size(); queueIdx++)
     {
+        if (*queueFamilies[queueIdx] == VK_QUEUE_FAMILY_IGNORED) continue;
         vkGetDeviceQueue(device, *queueFamilies[queueIdx], 0, queues[queueIdx]);
     }
 }
@@ -469,55 +729,283 @@ void VulkanEngine::createMemoryAllocator() {
     allocatorInfo.physicalDevice = physicalDevice;
     allocatorInfo.device = device;
     allocatorInfo.instance = vkInstance;
-    vmaCreateAllocator(&allocatorInfo, &allocator);
+    // Without it VMA assumes 1.0 and leaves out the core budget and properties2 queries
+    allocatorInfo.vulkanApiVersion = getDeviceApiVersion(physicalDevice);
+
+    if (isDeviceExtensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+    {
+        allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+        vkLogger->info("Using VK_EXT_memory_budget for memory budgets");
+    }
+
+    check_vk_result(vmaCreateAllocator(&allocatorInfo, &allocator));
+    lastMemoryLog = std::chrono::steady_clock::now();
 }
 
 void VulkanEngine::loadMeshes() {
     modelMan = std::make_unique<ModelManager>(allocator, device);
 
-    auto teapot = modelMan->load("../assets/teapot.obj");
+    tasks->wait(loadModel("../assets/teapot.obj"));
 
-    meshes.push_back(teapot->mesh);
+    buildStaticBatches();
+    materials->update();
+    transfer->flush();
+}
+
+Task<uint32_t> VulkanEngine::loadModel(std::string path) {
+    co_await tasks->background();
+    auto model = modelMan->load(path);
+    if (model == nullptr) {
+        throw std::runtime_error("failed to load model " + path + "!");
+    }
+
+    // Vulkan objects and the engine's lists belong to the main thread
+    co_await tasks->mainThread();
+    meshes.push_back(model->mesh);
     uploadMesh(meshes.back());
+
+    Material material = model->material;
+    if (!model->baseColorTexture.empty()) {
+        material.baseColorTexture = materials->loadTexture(model->baseColorTexture);
+    }
+
+    RenderObject object;
+    object.meshIndex = (uint32_t) (meshes.size() - 1);
+    object.materialIndex = materials->add(material);
+    renderObjects.push_back(object);
+    uint32_t objectIndex = (uint32_t) (renderObjects.size() - 1);
+
+    co_await transferComplete(transfer->flush());
+    co_return objectIndex;
 }
 
 void VulkanEngine::uploadMesh(Mesh& mesh)
 {
-	//allocate vertex buffer
+    vkLogger->debug("Uploading mesh: {} Vertices, {} Indices", mesh.vertices.size(), mesh.indices.size());
+
+    mesh.computeBounds();
+
+	//the geometry is sub-allocated from the shared buffers and filled through a staging buffer on the transfer queue
+    geometry->add(mesh);
+}
+
+AllocatedBuffer VulkanEngine::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, const std::string& tag)
+{
 	VkBufferCreateInfo bufferInfo = {};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	//this is the total size, in bytes, of the buffer we are allocating
-	bufferInfo.size = mesh.vertices.size() * sizeof(Vertex);
-	//this buffer is going to be used as a Vertex Buffer
-	bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	bufferInfo.size = size;
+	bufferInfo.usage = usage;
 
-    vkLogger->debug("Allocating Vertex buffer: {} Verticies ({} bytes)", mesh.vertices.size(), bufferInfo.size);
-
-	//let the VMA library know that this data should be writeable by CPU, but also readable by GPU
 	VmaAllocationCreateInfo vmaallocInfo = {};
-	vmaallocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+	vmaallocInfo.usage = memoryUsage;
 
-	//allocate the buffer
-	auto result = (vmaCreateBuffer(allocator, &bufferInfo, &vmaallocInfo,
-		&mesh.vertexBuffer.buffer,
-		&mesh.vertexBuffer.allocation,
-		nullptr));
-    
-    if(result != VK_SUCCESS) {}
+    AllocatedBuffer buffer;
+    if (vmaCreateBuffer(allocator, &bufferInfo, &vmaallocInfo, &buffer.buffer, &buffer.allocation, nullptr) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate buffer for " + tag + "!");
+    }
+
+    tagAllocation(buffer.allocation, tag);
+    return buffer;
+}
+
+void VulkanEngine::destroyBuffer(AllocatedBuffer& buffer)
+{
+    untagAllocation(buffer.allocation);
+    vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
+    buffer.buffer = VK_NULL_HANDLE;
+    buffer.allocation = VK_NULL_HANDLE;
+}
+
+void* VulkanEngine::growMappedBuffer(AllocatedBuffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, const std::string& tag)
+{
+    if (buffer.buffer != VK_NULL_HANDLE) retireMappedBuffer(buffer);
+
+    buffer = createBuffer(size, usage, memoryUsage, tag);
+    void* mapped;
+    check_vk_result(vmaMapMemory(allocator, buffer.allocation, &mapped));
+    return mapped;
+}
+
+AllocatedImage VulkanEngine::createImage(const VkImageCreateInfo& imageInfo, const VmaAllocationCreateInfo& allocInfo, const std::string& tag)
+{
+    AllocatedImage image;
+    if (vmaCreateImage(allocator, &imageInfo, &allocInfo, &image._image, &image._allocation, nullptr) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate image for " + tag + "!");
+    }
+
+    tagAllocation(image._allocation, tag);
+    return image;
+}
 
-    //copy vertex data
-	void* data;
-	vmaMapMemory(allocator, mesh.vertexBuffer.allocation, &data);
+void VulkanEngine::destroyImage(AllocatedImage& image)
+{
+    untagAllocation(image._allocation);
+    vmaDestroyImage(allocator, image._image, image._allocation);
+    image._image = VK_NULL_HANDLE;
+    image._allocation = VK_NULL_HANDLE;
+}
+
+// Names the allocation after the subsystem that owns it, the name is kept by VMA and shows up in its JSON dumps
+void VulkanEngine::tagAllocation(VmaAllocation allocation, const std::string& tag)
+{
+    vmaSetAllocationName(allocator, allocation, tag.c_str());
+
+    VmaAllocationInfo info;
+    vmaGetAllocationInfo(allocator, allocation, &info);
+
+    auto& stats = allocationTags[tag];
+    stats.bytes += info.size;
+    stats.allocationCount++;
+}
+
+void VulkanEngine::untagAllocation(VmaAllocation allocation)
+{
+    if (allocation == VK_NULL_HANDLE) return;
+
+    VmaAllocationInfo info;
+    vmaGetAllocationInfo(allocator, allocation, &info);
+    if (info.pName == nullptr) return;
+
+    auto it = allocationTags.find(info.pName);
+    if (it == allocationTags.end()) return;
+
+    it->second.bytes -= info.size;
+    it->second.allocationCount--;
+}
 
-	memcpy(data, mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+MemoryStats VulkanEngine::getMemoryStats()
+{
+    MemoryStats stats;
+    stats.budgetExtension = isDeviceExtensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    stats.tags = allocationTags;
+
+    const VkPhysicalDeviceMemoryProperties* memProps;
+    vmaGetMemoryProperties(allocator, &memProps);
+
+    std::vector<VmaBudget> budgets(memProps->memoryHeapCount);
+    vmaGetHeapBudgets(allocator, budgets.data());
+
+    VmaTotalStatistics total;
+    vmaCalculateStatistics(allocator, &total);
+
+    for (uint32_t i = 0; i < memProps->memoryHeapCount; i++)
+    {
+        const VmaDetailedStatistics& detailed = total.memoryHeap[i];
+
+        HeapStats heap;
+        heap.heapIndex = i;
+        heap.flags = memProps->memoryHeaps[i].flags;
+        heap.size = memProps->memoryHeaps[i].size;
+        heap.budget = budgets[i].budget;
+        heap.usage = budgets[i].usage;
+        heap.blockBytes = detailed.statistics.blockBytes;
+        heap.allocationBytes = detailed.statistics.allocationBytes;
+        heap.blockCount = detailed.statistics.blockCount;
+        heap.allocationCount = detailed.statistics.allocationCount;
+
+        VkDeviceSize freeBytes = heap.blockBytes - heap.allocationBytes;
+        heap.largestFreeRange = detailed.unusedRangeCount > 0 ? detailed.unusedRangeSizeMax : 0;
+        heap.fragmentation = freeBytes > 0 ? 1.0f - (float) heap.largestFreeRange / (float) freeBytes : 0.0f;
+
+        stats.totalUsage += heap.usage;
+        stats.totalBudget += heap.budget;
+        stats.heaps.push_back(heap);
+    }
+
+    return stats;
+}
+
+void VulkanEngine::logMemoryStats()
+{
+    auto stats = getMemoryStats();
+    const double MiB = 1024.0 * 1024.0;
+
+    vkLogger->info("GPU memory: {:.1f}/{:.1f} MiB used{}", stats.totalUsage / MiB, stats.totalBudget / MiB, stats.budgetExtension ? "" : " (estimated)");
+    for (const auto& heap : stats.heaps)
+    {
+        if (heap.blockCount == 0 && heap.usage == 0) continue;
+        vkLogger->info("  Heap {}{}: {:.1f}/{:.1f} MiB, {} allocations in {} blocks, {:.0f}% fragmented",
+            heap.heapIndex, (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " (device local)" : "",
+            heap.usage / MiB, heap.budget / MiB, heap.allocationCount, heap.blockCount, heap.fragmentation * 100.0f);
+    }
+    for (const auto& [tag, tagStats] : stats.tags)
+    {
+        vkLogger->debug("  {}: {:.2f} MiB in {} allocations", tag, tagStats.bytes / MiB, tagStats.allocationCount);
+    }
+}
 
-	vmaUnmapMemory(allocator, mesh.vertexBuffer.allocation);
+// Per frame housekeeping, to be called once per frame by the main loop
+void VulkanEngine::update()
+{
+    vmaSetCurrentFrameIndex(allocator, ++frameIndex);
+
+    // Jobs finishing on other threads hand their Vulkan work back to this one
+    getJobs().runMainThreadJobs();
+    tasks->update();
+    materials->update();
+    geometry->update();
+    transfer->flush();
+    transfer->collect();
+    deletionQueue.collect();
+
+    auto now = std::chrono::steady_clock::now();
+    if (memoryLogInterval.count() > 0 && now - lastMemoryLog >= memoryLogInterval)
+    {
+        lastMemoryLog = now;
+        logMemoryStats();
+    }
 }
 
 void VulkanEngine::deferDestroy(std::function<void()> foo) {
     destroyStack.push(foo);
 }
 
+// Destroys the resource from update() once all work submitted so far has completed on every queue
+void VulkanEngine::retire(std::function<void()> destroy) {
+    std::vector<TimelinePoint> waits;
+    for (auto& [queue, queueTimeline] : timelines)
+    {
+        waits.emplace_back(&queueTimeline, queueTimeline.lastSubmitted());
+    }
+    deletionQueue.push(std::move(destroy), std::move(waits), frameIndex);
+}
+
+void VulkanEngine::retireBuffer(AllocatedBuffer buffer) {
+    retire([this, buffer] () mutable { destroyBuffer(buffer); });
+}
+
+void VulkanEngine::retireMappedBuffer(AllocatedBuffer buffer) {
+    retire([this, buffer] () mutable {
+        vmaUnmapMemory(allocator, buffer.allocation);
+        destroyBuffer(buffer);
+    });
+}
+
+void VulkanEngine::retireImage(AllocatedImage image) {
+    retire([this, image] () mutable { destroyImage(image); });
+}
+
+void VulkanEngine::retireMesh(Mesh& mesh) {
+    geometry->remove(mesh);
+}
+
+void VulkanEngine::buildStaticBatches() {
+    size_t firstBatch = meshes.size();
+    StaticBatchStats built = mergeStaticObjects(renderObjects, meshes, staticBatchCellSize);
+    for (size_t i = firstBatch; i < meshes.size(); i++) {
+        uploadMesh(meshes[i]);
+    }
+
+    staticBatchStats.sourceObjects += built.sourceObjects;
+    staticBatchStats.batches += built.batches;
+    staticBatchStats.vertices += built.vertices;
+    if (built.batches > 0) {
+        vkLogger->info("Merged {} static objects into {} batches", built.sourceObjects, built.batches);
+    }
+}
+
 void VulkanEngine::createDescriptorPool() {
     VkDescriptorPoolSize pool_sizes[] =
     {
@@ -554,6 +1042,10 @@ bool isGraphicsFamily(const VkQueueFamilyProperties& prop) {
     return prop.queueFlags & VK_QUEUE_GRAPHICS_BIT;
 }
 
+bool isTransferOnlyFamily(const VkQueueFamilyProperties& prop) {
+    return (prop.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(prop.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT));
+}
+
 void check_vk_result(VkResult err)
 {
     static auto logger = getLogger("VulkanEngine");
@@ -15,6 +15,8 @@
 #include <map>
 #include <functional> 
 #include <stack>
+#include <chrono>
+#include <cstring>
 
 // External Dependencies
 #include <vulkan/vulkan.h>
@@ -26,10 +28,21 @@
 
 // Local Dependencies
 #include <RoseLogging.hpp>
+#include <RoseJobs.hpp>
+#include <RoseTasks.hpp>
 
 #include "vk_mesh.hpp"
 #include "models.hpp"
 #include "ve_types.hpp"
+#include "ve_scene.hpp"
+#include "ve_scene_graph.hpp"
+#include "ve_memory.hpp"
+#include "vk_transfer.hpp"
+#include "ve_materials.hpp"
+#include "ve_geometry.hpp"
+#include "ve_static_batching.hpp"
+#include "vk_timeline.hpp"
+#include "ve_deletion.hpp"
 
 #ifdef NDEBUG
 const bool enableValidationLayers = false;
@@ -44,12 +57,16 @@ const bool enableValidationLayers = true;
 const std::vector<const char*> engineInstanceExtensions = {}; // Instance extensions required by the Engine
 const std::vector<const char*> engineDeviceExtensions = {}; // Device extensions required by the Engine
 
-typedef std::function<bool(const VkQueueFamilyProperties&, uint32_t, VkPhysicalDevice)> queueCriteriaFunc;
-
-struct AllocatedImage {
-    VkImage _image;
-    VmaAllocation _allocation;
+// Extensions the Engine uses when available but can run without
+const std::vector<const char*> engineOptionalInstanceExtensions = {
+    VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME
 };
+const std::vector<const char*> engineOptionalDeviceExtensions = {
+    VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
+    VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME
+};
+
+typedef std::function<bool(const VkQueueFamilyProperties&, uint32_t, VkPhysicalDevice)> queueCriteriaFunc;
 
 class VulkanEngine
 {
@@ -68,6 +85,7 @@ public:
 
     // Vulkan instance
     VkInstance vkInstance;
+    uint32_t apiVersion = VK_API_VERSION_1_0; // Highest version up to 1.3 supported by the loader
 
     // Messaging for Validation Layers  
     VkDebugUtilsMessengerEXT debugMessenger;  
@@ -75,6 +93,8 @@ public:
     std::vector<std::string> instanceExtensions; 
     
     std::set<std::string> deviceExtensions; // Vulkan device extentions to enable
+    std::set<std::string> optionalDeviceExtensions; // Enabled only if the selected device supports them
+    std::set<std::string> enabledDeviceExtensions; // Extensions the logical device was actually created with
     
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
     VkDevice device;
@@ -83,8 +103,20 @@ public:
     VkDescriptorPool descriptorPool;
 
     VmaAllocator allocator;
+    std::map<std::string, TagStats> allocationTags;
+
+    // Memory statistics are written to vkLogger at this interval, zero disables
+    std::chrono::seconds memoryLogInterval = std::chrono::seconds(30);
+    std::chrono::steady_clock::time_point lastMemoryLog;
+    uint32_t frameIndex = 0;
 
     std::vector<Mesh> meshes; 
+    std::unique_ptr<GeometryPool> geometry; // Vertices and indices of all meshes
+    std::vector<RenderObject> renderObjects; // Drawn by every output view that sees them
+    SceneGraph scene;                        // Moves the render objects attached to its nodes
+    float staticBatchCellSize = 32.f;        // World units, the grid static batches are bucketed by
+    StaticBatchStats staticBatchStats;       // Summed over all builds
+    std::unique_ptr<MaterialSystem> materials;
     std::unique_ptr<ModelManager> modelMan;
 
     std::vector<std::function<bool(VkPhysicalDevice)>> deviceReqCallbacks;
@@ -92,17 +124,42 @@ public:
     std::vector<queueCriteriaFunc> queueRequirements;
     std::vector<VkQueue*> queues;
     std::vector<uint32_t*> queueFamilies;
+    std::vector<bool> queueOptional;
 
     VkQueue graphicsQueue;
     uint32_t graphicsQueueFamily;
 
+    // Dedicated transfer queue if the device has one, otherwise aliases the graphics queue
+    VkQueue transferQueue;
+    uint32_t transferQueueFamily;
+    std::unique_ptr<TransferContext> transfer;
+
+    // Coroutines of the engine resume on the main thread from update()
+    std::unique_ptr<TaskScheduler> tasks;
+
+    // Optional core features, enabled where the device supports them
+    VkPhysicalDeviceFeatures enabledFeatures{};
+
+    // Synchronisation, one timeline semaphore per queue
+    bool coreTimelineSemaphores = false; // false if VK_KHR_timeline_semaphore provides them
+    bool presentWait = false; // VK_KHR_present_id and VK_KHR_present_wait are enabled with their features
+    TimelineFunctions timelineFunctions;
+
+    // Graphics passes begin rendering on image views without render pass and framebuffer objects,
+    // from core Vulkan 1.3 or VK_KHR_dynamic_rendering. The render graph falls back to render passes without it.
+    bool dynamicRendering = false;
+    PFN_vkCmdBeginRenderingKHR cmdBeginRendering = nullptr;
+    PFN_vkCmdEndRenderingKHR cmdEndRendering = nullptr;
+    std::map<VkQueue, GpuTimeline> timelines;
+
     VkCommandPool commandPool;
 
     VkBuffer vertexBuffer;
     VkDeviceMemory vertexBufferMemory;
 
     std::vector<Initializable*> postInitObjects;
-    std::stack<std::function<void()>> destroyStack;
+    std::stack<std::function<void()>> destroyStack; // Runs on shutdown
+    DeletionQueue deletionQueue; // Runs once the GPU no longer uses the resource
 
     ImGuiIO* imguiIO;
 
@@ -121,13 +178,25 @@ public:
     
     void loadMeshes();
     void uploadMesh(Mesh& mesh);
+    // Imports on a job, uploads from the main thread and finishes once the geometry is on the GPU.
+    // Returns the index of the model's render object.
+    Task<uint32_t> loadModel(std::string path);
     
     void compileInstanceExtensions(std::set<std::string> external);
     void compileDeviceExtensions();
     bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+    bool isInstanceExtensionEnabled(const std::string& extension);
+    bool isDeviceExtensionEnabled(const std::string& extension);
     uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
     bool isDeviceSuitable(VkPhysicalDevice device);
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+    bool supportsTimelineSemaphores(VkPhysicalDevice device);
+    bool supportsPresentWait(VkPhysicalDevice device);
+    bool supportsDynamicRendering(VkPhysicalDevice device);
+    PFN_vkGetPhysicalDeviceFeatures2 loadGetFeatures2();
+    uint32_t getDeviceApiVersion(VkPhysicalDevice device);
+    uint64_t copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+    // Awaits a transfer timeline value returned by TransferContext::flush(), continues on the main thread
+    TaskScheduler::ConditionAwaiter transferComplete(uint64_t timelineValue);
 
     VulkanEngine(std::set<std::string> instanceExtensions);
     ~VulkanEngine();
@@ -140,12 +209,40 @@ public:
 
     bool isInit();
 
+    void update();
+
+    AllocatedBuffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, const std::string& tag);
+    void destroyBuffer(AllocatedBuffer& buffer);
+    // Replaces a persistently mapped buffer with a new one of the size and returns its mapping. The old one is
+    // retired, as a submitted frame may still read it.
+    void* growMappedBuffer(AllocatedBuffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, const std::string& tag);
+    AllocatedImage createImage(const VkImageCreateInfo& imageInfo, const VmaAllocationCreateInfo& allocInfo, const std::string& tag);
+    void destroyImage(AllocatedImage& image);
+    void tagAllocation(VmaAllocation allocation, const std::string& tag);
+    void untagAllocation(VmaAllocation allocation);
+
+    MemoryStats getMemoryStats();
+    void logMemoryStats();
+
     void deferDestroy(std::function<void()> foo);
+    void retire(std::function<void()> destroy);
+    void retireBuffer(AllocatedBuffer buffer);
+    // Unmaps the buffer as well
+    void retireMappedBuffer(AllocatedBuffer buffer);
+    void retireImage(AllocatedImage image);
+    void retireMesh(Mesh& mesh);
+
+    // Merges the static render objects added since the last call into batches and uploads their meshes.
+    // Call it once a scene's objects are placed, before the next update().
+    void buildStaticBatches();
 
     void requestDeviceRequirement(std::function<bool(VkPhysicalDevice)> condition);
     void requestDeviceExtensions(std::set<std::string> extensions);
+    void requestOptionalDeviceExtensions(std::set<std::string> extensions);
+
+    void requestQueue(queueCriteriaFunc criteria, uint32_t* familyIdx, VkQueue* queue, bool optional = false);
 
-    void requestQueue(queueCriteriaFunc criteria, uint32_t* familyIdx, VkQueue* queue);
+    GpuTimeline& timeline(VkQueue queue);
 
     void requestPostInitialization(Initializable* obj);
 
@@ -155,6 +252,7 @@ public:
 };
 
 bool isGraphicsFamily(const VkQueueFamilyProperties& prop); 
+bool isTransferOnlyFamily(const VkQueueFamilyProperties& prop);
 
 void check_vk_result(VkResult err);
 
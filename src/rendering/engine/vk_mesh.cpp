@@ -2,6 +2,7 @@
 #include <vector>
 #include "ve_loader.hpp"
 #include <assimp/mesh.h>
+#include <glm/gtc/packing.hpp>
 
 VertexInputDescription Vertex::getVertexDescription() {
     VertexInputDescription description;
@@ -35,12 +36,67 @@ VertexInputDescription Vertex::getVertexDescription() {
 	colorAttribute.format = VK_FORMAT_R32G32B32_SFLOAT;
 	colorAttribute.offset = offsetof(Vertex, color);
 
+	//Texture coordinates will be stored at Location 3
+	VkVertexInputAttributeDescription uvAttribute = {};
+	uvAttribute.binding = 0;
+	uvAttribute.location = 3;
+	uvAttribute.format = VK_FORMAT_R32G32_SFLOAT;
+	uvAttribute.offset = offsetof(Vertex, uv);
+
 	description.attributes.push_back(posAttribute);
 	description.attributes.push_back(normalAttribute);
 	description.attributes.push_back(colorAttribute);
+	description.attributes.push_back(uvAttribute);
 	return description;
 }
 
+// Projects the unit sphere onto an octahedron unfolded into the [-1, 1] square, the lower half folds over the corners
+static glm::vec2 encodeOctahedral(glm::vec3 n) {
+    float sum = glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z);
+    if (sum == 0.f) return glm::vec2(0.f);
+    n /= sum;
+
+    if (n.z < 0.f) {
+        glm::vec2 signs = glm::vec2(n.x >= 0.f ? 1.f : -1.f, n.y >= 0.f ? 1.f : -1.f);
+        return (1.f - glm::abs(glm::vec2(n.y, n.x))) * signs;
+    }
+    return glm::vec2(n.x, n.y);
+}
+
+PackedVertex PackedVertex::pack(const Vertex& vertex) {
+    PackedVertex packed;
+    packed.pos[0] = vertex.pos.x;
+    packed.pos[1] = vertex.pos.y;
+    packed.pos[2] = vertex.pos.z;
+    packed.normal = glm::packSnorm2x16(encodeOctahedral(vertex.normal));
+    packed.uv = glm::packHalf2x16(vertex.uv);
+    packed.color = glm::packUnorm4x8(glm::vec4(glm::clamp(vertex.color, 0.f, 1.f), 1.f));
+    return packed;
+}
+
 Mesh::Mesh(std::string path) {}
 
 Mesh::Mesh() {}
+
+// Sphere around the center of the axis aligned bounds, not minimal but cheap and stable
+void Mesh::computeBounds() {
+    if (vertices.empty()) {
+        bounds = glm::vec4(0.f);
+        return;
+    }
+
+    glm::vec3 minPos = vertices[0].pos;
+    glm::vec3 maxPos = vertices[0].pos;
+    for (auto& vertex : vertices) {
+        minPos = glm::min(minPos, vertex.pos);
+        maxPos = glm::max(maxPos, vertex.pos);
+    }
+
+    glm::vec3 center = (minPos + maxPos) * 0.5f;
+    float radius = 0.f;
+    for (auto& vertex : vertices) {
+        radius = glm::max(radius, glm::length(vertex.pos - center));
+    }
+
+    bounds = glm::vec4(center, radius);
+}
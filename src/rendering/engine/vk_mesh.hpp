@@ -5,6 +5,7 @@
 #include <vulkan/vulkan.h>
 #include <glm/glm.hpp>
 #include <string>
+#include <cstdint>
 
 struct VertexInputDescription {
 
@@ -19,16 +20,43 @@ struct Vertex
     glm::vec3 pos;
     glm::vec3 normal;
     glm::vec3 color;
+    glm::vec2 uv;
 
     static VertexInputDescription getVertexDescription();
 };
 
 
+// Compressed vertex the pulled_mesh shader decodes itself, 24 instead of 44 bytes. Scalars only,
+// so the std430 array in the shader has the same layout.
+struct PackedVertex
+{
+    float pos[3];
+    uint32_t normal; // Octahedral encoding, snorm16x2
+    uint32_t uv;     // half2
+    uint32_t color;  // unorm8x4, clamped to 0..1
+
+    static PackedVertex pack(const Vertex& vertex);
+};
+
+// Joints of a skinned mesh's skeleton that move a vertex, up to four with weights summing to 1.
+// Unused slots have weight 0. Same layout as the skinning shader's std430 array.
+struct VertexSkin
+{
+    glm::uvec4 joints = glm::uvec4(0);
+    glm::vec4 weights = glm::vec4(0.f);
+};
+
+const uint32_t NO_GEOMETRY = UINT32_MAX;
+
 struct Mesh
 {
     std::vector<Vertex> vertices;
-	AllocatedBuffer vertexBuffer;
+    std::vector<uint32_t> indices; // Triangle list
+    uint32_t geometry = NO_GEOMETRY; // Range in the engine's GeometryPool once uploaded
+    glm::vec4 bounds = glm::vec4(0.f); // Bounding sphere in model space, xyz center and w radius
+    std::vector<VertexSkin> skin; // Parallel to vertices, empty for meshes without a skeleton
 
     Mesh();
+    void computeBounds();
     Mesh(std::string path);
 };
@@ -1,5 +1,7 @@
 #include "vk_swapchain.hpp"
 
+#include <algorithm>
+
 SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device, VkSurfaceKHR surface)
 {
     SwapChainSupportDetails details;
@@ -39,15 +41,78 @@ VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>
     return availableFormats[0];
 }
 
-VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes)
+static bool hasPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes, VkPresentModeKHR mode)
 {
     for (const auto &availablePresentMode : availablePresentModes)
     {
-        if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR)
+        if (availablePresentMode == mode)
         {
-            return availablePresentMode;
+            return true;
         }
     }
+    return false;
+}
+
+// Throughput keeps the previous choice: MAILBOX if available, FIFO otherwise, one image more than the minimum
+// and a queue of frames the GPU can work through without waiting for the CPU.
+// Low latency also accepts tearing over FIFO's queue, uses the fewest images and a single frame in flight.
+PresentConfig choosePresentConfig(LatencyPolicy policy, const SwapChainSupportDetails &support, uint32_t framesInFlight, uint32_t maxFramesInFlight)
+{
+    const auto &capabilities = support.capabilities;
+    PresentConfig config;
+
+    if (policy == LatencyPolicy::LowLatency)
+    {
+        if (hasPresentMode(support.presentModes, VK_PRESENT_MODE_MAILBOX_KHR))
+            config.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+        else if (hasPresentMode(support.presentModes, VK_PRESENT_MODE_IMMEDIATE_KHR))
+            config.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+        else
+            config.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+
+        // MAILBOX needs a spare image to replace queued ones without blocking
+        config.imageCount = capabilities.minImageCount + (config.presentMode == VK_PRESENT_MODE_MAILBOX_KHR ? 1 : 0);
+        config.framesInFlight = 1;
+    }
+    else
+    {
+        config.presentMode = hasPresentMode(support.presentModes, VK_PRESENT_MODE_MAILBOX_KHR) ? VK_PRESENT_MODE_MAILBOX_KHR : VK_PRESENT_MODE_FIFO_KHR;
+        config.imageCount = capabilities.minImageCount + 1;
+        config.framesInFlight = 3;
+    }
 
-    return VK_PRESENT_MODE_FIFO_KHR;
-}
\ No newline at end of file
+    if (capabilities.maxImageCount > 0 && config.imageCount > capabilities.maxImageCount)
+    {
+        config.imageCount = capabilities.maxImageCount;
+    }
+
+    if (framesInFlight > 0)
+    {
+        config.framesInFlight = framesInFlight;
+    }
+    config.framesInFlight = std::clamp(config.framesInFlight, 1u, maxFramesInFlight);
+
+    return config;
+}
+
+const char* latencyPolicyName(LatencyPolicy policy)
+{
+    switch (policy)
+    {
+    case LatencyPolicy::Throughput: return "Throughput";
+    case LatencyPolicy::LowLatency: return "Low latency";
+    }
+    return "Unknown";
+}
+
+const char* presentModeName(VkPresentModeKHR mode)
+{
+    switch (mode)
+    {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR: return "Immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR: return "Mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR: return "FIFO";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "FIFO relaxed";
+    default: return "Other";
+    }
+}
@@ -12,4 +12,22 @@ struct SwapChainSupportDetails
 
 SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device, VkSurfaceKHR surface);
 VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR> &availableFormats);
-VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes);
+// Trades latency against throughput when choosing how deep the queue of frames and images is
+enum class LatencyPolicy
+{
+    Throughput, // The CPU runs ahead of the GPU and the display, which never wait on each other
+    LowLatency, // At most one frame queued, frames start as late as possible
+};
+
+struct PresentConfig
+{
+    VkPresentModeKHR presentMode;
+    uint32_t imageCount;
+    uint32_t framesInFlight;
+};
+
+const char* latencyPolicyName(LatencyPolicy policy);
+const char* presentModeName(VkPresentModeKHR mode);
+
+// framesInFlight 0 picks the policy's default, the result is at most maxFramesInFlight
+PresentConfig choosePresentConfig(LatencyPolicy policy, const SwapChainSupportDetails &support, uint32_t framesInFlight, uint32_t maxFramesInFlight);
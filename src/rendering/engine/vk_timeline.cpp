@@ -0,0 +1,132 @@
+#include "vk_timeline.hpp"
+#include <stdexcept>
+#include <vector>
+
+// Submissions older than this are dropped from the latency average if they are never observed
+const size_t MAX_TRACKED_SUBMITS = 64;
+
+void TimelineFunctions::load(VkDevice device, bool core)
+{
+    waitSemaphores = (PFN_vkWaitSemaphores) vkGetDeviceProcAddr(device, core ? "vkWaitSemaphores" : "vkWaitSemaphoresKHR");
+    getSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValue) vkGetDeviceProcAddr(device, core ? "vkGetSemaphoreCounterValue" : "vkGetSemaphoreCounterValueKHR");
+    signalSemaphore = (PFN_vkSignalSemaphore) vkGetDeviceProcAddr(device, core ? "vkSignalSemaphore" : "vkSignalSemaphoreKHR");
+
+    if (!waitSemaphores || !getSemaphoreCounterValue || !signalSemaphore)
+    {
+        throw std::runtime_error("failed to load timeline semaphore functions!");
+    }
+}
+
+void GpuTimeline::init(VkDevice device, const TimelineFunctions* functions)
+{
+    this->device = device;
+    fn = functions;
+
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    createInfo.pNext = &typeInfo;
+
+    if (vkCreateSemaphore(device, &createInfo, nullptr, &semaphore) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create timeline semaphore!");
+    }
+}
+
+void GpuTimeline::destroy()
+{
+    vkDestroySemaphore(device, semaphore, nullptr);
+    semaphore = VK_NULL_HANDLE;
+}
+
+uint64_t GpuTimeline::nextValue()
+{
+    submitted++;
+
+    submitTimes.emplace_back(submitted, std::chrono::steady_clock::now());
+    if (submitTimes.size() > MAX_TRACKED_SUBMITS)
+    {
+        submitTimes.pop_front();
+    }
+
+    return submitted;
+}
+
+uint64_t GpuTimeline::lastSubmitted() const
+{
+    return submitted;
+}
+
+uint64_t GpuTimeline::completedValue()
+{
+    uint64_t value;
+    if (fn->getSemaphoreCounterValue(device, semaphore, &value) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to query timeline semaphore!");
+    }
+
+    if (value > completed)
+    {
+        completed = value;
+
+        auto now = std::chrono::steady_clock::now();
+        while (!submitTimes.empty() && submitTimes.front().first <= completed)
+        {
+            double ms = std::chrono::duration<double, std::milli>(now - submitTimes.front().second).count();
+            latencyMs = latencyMs == 0.0 ? ms : latencyMs * 0.9 + ms * 0.1;
+            submitTimes.pop_front();
+        }
+    }
+
+    return completed;
+}
+
+bool GpuTimeline::isComplete(uint64_t value)
+{
+    if (value <= completed) return true;
+    return value <= completedValue();
+}
+
+void GpuTimeline::wait(uint64_t value, uint64_t timeout)
+{
+    if (isComplete(value)) return;
+
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &semaphore;
+    waitInfo.pValues = &value;
+
+    VkResult result = fn->waitSemaphores(device, &waitInfo, timeout);
+    if (result == VK_TIMEOUT) {
+        throw std::runtime_error("failed to wait for timeline semaphore, timed out!");
+    }
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to wait for timeline semaphore!");
+    }
+    completedValue();
+}
+
+uint64_t GpuTimeline::pendingCount()
+{
+    return submitted - completedValue();
+}
+
+double GpuTimeline::averageLatencyMs() const
+{
+    return latencyMs;
+}
+
+void timelineSubmitInfo(VkTimelineSemaphoreSubmitInfo& info, const std::vector<uint64_t>& waitValues, const std::vector<uint64_t>& signalValues)
+{
+    info = {};
+    info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    info.waitSemaphoreValueCount = (uint32_t) waitValues.size();
+    info.pWaitSemaphoreValues = waitValues.data();
+    info.signalSemaphoreValueCount = (uint32_t) signalValues.size();
+    info.pSignalSemaphoreValues = signalValues.data();
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <deque>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Timeline semaphore entry points, resolved from core Vulkan 1.2 or VK_KHR_timeline_semaphore
+struct TimelineFunctions {
+    PFN_vkWaitSemaphores waitSemaphores = nullptr;
+    PFN_vkGetSemaphoreCounterValue getSemaphoreCounterValue = nullptr;
+    PFN_vkSignalSemaphore signalSemaphore = nullptr;
+
+    void load(VkDevice device, bool core);
+};
+
+// One monotonic timeline semaphore per queue. Every submission to the queue signals the next value,
+// so "has GPU work N completed?" is a comparison against the semaphore's counter.
+class GpuTimeline {
+public:
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+
+    void init(VkDevice device, const TimelineFunctions* functions);
+    void destroy();
+
+    // Reserve the value the next submission to the queue signals. Values must be submitted in the order they were reserved.
+    uint64_t nextValue();
+    uint64_t lastSubmitted() const;
+
+    // Queries the semaphore, also updates the latency statistics
+    uint64_t completedValue();
+    bool isComplete(uint64_t value);
+    // Throws if the device was lost or the timeout passed first
+    void wait(uint64_t value, uint64_t timeout = UINT64_MAX);
+
+    // Number of submitted values the GPU has not completed yet, i.e. how far the CPU runs ahead
+    uint64_t pendingCount();
+    // Time from reserving a value until its completion was observed, averaged over recent submissions
+    double averageLatencyMs() const;
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    const TimelineFunctions* fn = nullptr;
+
+    uint64_t submitted = 0;
+    uint64_t completed = 0;
+
+    std::deque<std::pair<uint64_t, std::chrono::steady_clock::time_point>> submitTimes;
+    double latencyMs = 0.0;
+};
+
+// Helper to fill VkTimelineSemaphoreSubmitInfo, binary semaphores take a value of 0
+void timelineSubmitInfo(VkTimelineSemaphoreSubmitInfo& info, const std::vector<uint64_t>& waitValues, const std::vector<uint64_t>& signalValues);
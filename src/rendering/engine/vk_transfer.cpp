@@ -0,0 +1,269 @@
+#include "vk_transfer.hpp"
+#include "vk_engine.hpp"
+
+TransferContext::TransferContext(VulkanEngine& engine) : engine(engine)
+{
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = engine.transferQueueFamily;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    if (vkCreateCommandPool(engine.device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create transfer command pool!");
+    }
+}
+
+void TransferContext::destroy()
+{
+    for (auto& batch : inFlight)
+    {
+        freeBatch(batch);
+    }
+    inFlight.clear();
+
+    for (auto& buffer : recording.staging)
+    {
+        engine.destroyBuffer(buffer);
+    }
+
+    vkDestroyCommandPool(engine.device, commandPool, nullptr);
+}
+
+bool TransferContext::isDedicated() const
+{
+    return engine.transferQueueFamily != engine.graphicsQueueFamily;
+}
+
+void TransferContext::beginBatch()
+{
+    if (recording.cmd != VK_NULL_HANDLE) return;
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = 1;
+
+    check_vk_result(vkAllocateCommandBuffers(engine.device, &allocInfo, &recording.cmd));
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    check_vk_result(vkBeginCommandBuffer(recording.cmd, &beginInfo));
+}
+
+VkBuffer TransferContext::createStaging(const void* data, VkDeviceSize size)
+{
+    AllocatedBuffer staging = engine.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, "Staging");
+
+    void* mapped;
+    vmaMapMemory(engine.allocator, staging.allocation, &mapped);
+    memcpy(mapped, data, size);
+    vmaUnmapMemory(engine.allocator, staging.allocation);
+
+    recording.staging.push_back(staging);
+    return staging.buffer;
+}
+
+void TransferContext::uploadBuffer(const void* data, VkDeviceSize size, VkBuffer dst, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess, VkDeviceSize dstOffset)
+{
+    copyBuffer(createStaging(data, size), dst, size, dstStage, dstAccess, dstOffset);
+}
+
+void TransferContext::uploadImage(const void* data, VkDeviceSize size, VkImage dst, const std::vector<VkBufferImageCopy>& regions, const VkImageSubresourceRange& range, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess, VkImageLayout oldLayout)
+{
+    VkBuffer staging = createStaging(data, size);
+    beginBatch();
+
+    // The copy overwrites the subresources, so nothing from before has to be made visible or kept
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = dst;
+    barrier.subresourceRange = range;
+
+    vkCmdPipelineBarrier(recording.cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    vkCmdCopyBufferToImage(recording.cmd, staging, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t) regions.size(), regions.data());
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    releaseImage(barrier, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, dstAccess);
+}
+
+void TransferContext::transitionImage(VkImage dst, const VkImageSubresourceRange& range, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+    beginBatch();
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.image = dst;
+    barrier.subresourceRange = range;
+    releaseImage(barrier, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage, dstAccess);
+}
+
+void TransferContext::releaseImage(VkImageMemoryBarrier barrier, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+    recording.waitStages |= dstStage;
+
+    // The layout transition is part of the release, the acquire repeats it. Without a dedicated family
+    // the timeline wait makes the copy visible and the transition is all that is left to do here.
+    barrier.dstAccessMask = 0;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    if (isDedicated()) {
+        barrier.srcQueueFamilyIndex = engine.transferQueueFamily;
+        barrier.dstQueueFamilyIndex = engine.graphicsQueueFamily;
+    }
+
+    vkCmdPipelineBarrier(recording.cmd, srcStage, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    if (!isDedicated()) return;
+
+    PendingAcquire acquire;
+    acquire.imageBarrier = barrier;
+    acquire.imageBarrier.srcAccessMask = 0;
+    acquire.imageBarrier.dstAccessMask = dstAccess;
+    acquire.image = true;
+    acquire.dstStage = dstStage;
+    recording.acquires.push_back(acquire);
+}
+
+void TransferContext::copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess, VkDeviceSize dstOffset)
+{
+    beginBatch();
+
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = 0;
+    copyRegion.dstOffset = dstOffset;
+    copyRegion.size = size;
+    vkCmdCopyBuffer(recording.cmd, src, dst, 1, &copyRegion);
+
+    recording.waitStages |= dstStage;
+
+    if (!isDedicated()) return;
+
+    // Release the buffer to the graphics family, the matching acquire is recorded by acquire()
+    VkBufferMemoryBarrier release{};
+    release.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    release.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    release.dstAccessMask = 0;
+    release.srcQueueFamilyIndex = engine.transferQueueFamily;
+    release.dstQueueFamilyIndex = engine.graphicsQueueFamily;
+    release.buffer = dst;
+    release.offset = dstOffset;
+    release.size = size;
+
+    vkCmdPipelineBarrier(recording.cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &release, 0, nullptr);
+
+    PendingAcquire acquire;
+    acquire.barrier = release;
+    acquire.barrier.srcAccessMask = 0;
+    acquire.barrier.dstAccessMask = dstAccess;
+    acquire.dstStage = dstStage;
+    recording.acquires.push_back(acquire);
+}
+
+uint64_t TransferContext::flush()
+{
+    GpuTimeline& timeline = engine.timeline(engine.transferQueue);
+    if (recording.cmd == VK_NULL_HANDLE) return timeline.lastSubmitted();
+
+    check_vk_result(vkEndCommandBuffer(recording.cmd));
+
+    recording.timelineValue = timeline.nextValue();
+
+    std::vector<uint64_t> waitValues;
+    std::vector<uint64_t> signalValues = {recording.timelineValue};
+    VkTimelineSemaphoreSubmitInfo timelineInfo;
+    timelineSubmitInfo(timelineInfo, waitValues, signalValues);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &recording.cmd;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &timeline.semaphore;
+
+    check_vk_result(vkQueueSubmit(engine.transferQueue, 1, &submitInfo, VK_NULL_HANDLE));
+
+    uint64_t value = recording.timelineValue;
+    inFlight.push_back(std::move(recording));
+    recording = UploadBatch();
+    return value;
+}
+
+bool TransferContext::isComplete(uint64_t timelineValue)
+{
+    return engine.timeline(engine.transferQueue).isComplete(timelineValue);
+}
+
+void TransferContext::acquire(VkCommandBuffer cmd, std::vector<VkSemaphore>& waitSemaphores, std::vector<uint64_t>& waitValues, std::vector<VkPipelineStageFlags>& waitStages)
+{
+    uint64_t waitValue = 0;
+    VkPipelineStageFlags stages = 0;
+
+    for (auto& batch : inFlight)
+    {
+        if (batch.acquired) continue;
+
+        for (auto& acquire : batch.acquires)
+        {
+            if (acquire.image) {
+                vkCmdPipelineBarrier(cmd, acquire.dstStage, acquire.dstStage, 0, 0, nullptr, 0, nullptr, 1, &acquire.imageBarrier);
+            } else {
+                vkCmdPipelineBarrier(cmd, acquire.dstStage, acquire.dstStage, 0, 0, nullptr, 1, &acquire.barrier, 0, nullptr);
+            }
+        }
+
+        waitValue = std::max(waitValue, batch.timelineValue);
+        stages |= batch.waitStages;
+        batch.acquired = true;
+    }
+
+    // A single wait on the highest value covers all batches, the timeline only moves forward
+    if (waitValue > 0)
+    {
+        waitSemaphores.push_back(engine.timeline(engine.transferQueue).semaphore);
+        waitValues.push_back(waitValue);
+        waitStages.push_back(stages);
+    }
+}
+
+void TransferContext::collect()
+{
+    GpuTimeline& timeline = engine.timeline(engine.transferQueue);
+
+    for (auto it = inFlight.begin(); it != inFlight.end();)
+    {
+        if (it->acquired && timeline.isComplete(it->timelineValue))
+        {
+            freeBatch(*it);
+            it = inFlight.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void TransferContext::freeBatch(UploadBatch& batch)
+{
+    for (auto& buffer : batch.staging)
+    {
+        engine.destroyBuffer(buffer);
+    }
+    batch.staging.clear();
+
+    vkFreeCommandBuffers(engine.device, commandPool, 1, &batch.cmd);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+#include "ve_types.hpp"
+
+class VulkanEngine;
+
+// Ownership acquire that has to be recorded on the graphics queue before the uploaded buffer or image is used
+struct PendingAcquire {
+    VkBufferMemoryBarrier barrier;
+    VkImageMemoryBarrier imageBarrier; // Used instead of barrier for image uploads
+    bool image = false;
+    VkPipelineStageFlags dstStage;
+};
+
+// One submission to the transfer queue and everything that has to stay alive until it completed
+struct UploadBatch {
+    VkCommandBuffer cmd = VK_NULL_HANDLE;
+    uint64_t timelineValue = 0; // Value the transfer queue's timeline reaches once the batch completed
+    VkPipelineStageFlags waitStages = 0;
+    std::vector<PendingAcquire> acquires;
+    std::vector<AllocatedBuffer> staging;
+    bool acquired = false;
+};
+
+// Records uploads on the engine's transfer queue without stalling the graphics queue.
+// With a dedicated transfer family buffers are released by the transfer queue and acquired
+// by the graphics queue, otherwise both sides run on the same queue and only the timeline wait is used.
+class TransferContext {
+public:
+    TransferContext(VulkanEngine& engine);
+
+    void destroy();
+
+    bool isDedicated() const;
+
+    // Copy from a host visible staging buffer owned by this context. Only the written range changes owner,
+    // the graphics queue may keep reading the rest of dst meanwhile.
+    void uploadBuffer(const void* data, VkDeviceSize size, VkBuffer dst, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess, VkDeviceSize dstOffset = 0);
+    void copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess, VkDeviceSize dstOffset = 0);
+    // Regions index into data, the subresources in range go from oldLayout to shader read only and their
+    // previous contents are discarded. Other subresources of the image keep their contents and layout.
+    void uploadImage(const void* data, VkDeviceSize size, VkImage dst, const std::vector<VkBufferImageCopy>& regions, const VkImageSubresourceRange& range, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess, VkImageLayout oldLayout = VK_IMAGE_LAYOUT_UNDEFINED);
+    // Moves the subresources in range from undefined to shader read only without writing them, for images
+    // that are sampled as a whole but uploaded a part at a time
+    void transitionImage(VkImage dst, const VkImageSubresourceRange& range, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+    // Submit everything recorded since the last flush, returns the transfer timeline value that marks its completion
+    uint64_t flush();
+    bool isComplete(uint64_t timelineValue);
+
+    // Record the graphics side of all flushed batches into cmd and add the transfer timeline wait to the submission
+    void acquire(VkCommandBuffer cmd, std::vector<VkSemaphore>& waitSemaphores, std::vector<uint64_t>& waitValues, std::vector<VkPipelineStageFlags>& waitStages);
+
+    // Release staging memory of finished batches
+    void collect();
+
+private:
+    VulkanEngine& engine;
+    VkCommandPool commandPool;
+
+    UploadBatch recording;
+    std::vector<UploadBatch> inFlight;
+
+    void beginBatch();
+    VkBuffer createStaging(const void* data, VkDeviceSize size);
+    void freeBatch(UploadBatch& batch);
+    // Records the barrier into shader read only, with a dedicated family as the release the graphics side acquires
+    void releaseImage(VkImageMemoryBarrier barrier, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+};
@@ -3,18 +3,43 @@
 layout (location = 0) in vec3 vPosition;
 layout (location = 1) in vec3 vNormal;
 layout (location = 2) in vec3 vColor;
+layout (location = 3) in vec2 vUV;
 
 layout (location = 0) out vec3 outColor;
+layout (location = 1) out vec3 outWorldPos;
+layout (location = 2) out vec3 outNormal;
+layout (location = 3) out vec2 outUV;
+layout (location = 4) flat out uint outMaterial;
+
+struct Object {
+	vec4 model[3]; // Rows of the object's affine transform
+	uint material;
+};
+
+layout (std430, set = 3, binding = 0) readonly buffer Objects { Object objects[]; };
+layout (std140, set = 3, binding = 1) uniform Camera {
+	mat4 viewProj;
+} camera;
 
 //push constants block
 layout( push_constant ) uniform constants
 {
-	vec4 offset;
-	mat4 render_matrix;
+	uint objectOffset; // Only set when indirect draws cannot pass the object as their first instance
 } PushConstants;
 
 void main()
 {
-	gl_Position = PushConstants.render_matrix * (vec4(vPosition, 1.0f) + PushConstants.offset);
+	// Draws pass their object index as the first instance
+	Object object = objects[gl_InstanceIndex + PushConstants.objectOffset];
+
+	vec4 position = vec4(vPosition, 1.0f);
 	outColor = vColor;
-}
\ No newline at end of file
+	outUV = vUV;
+	outMaterial = object.material;
+
+	vec3 world = vec3(dot(object.model[0], position), dot(object.model[1], position), dot(object.model[2], position));
+	gl_Position = camera.viewProj * vec4(world, 1.0f);
+	outWorldPos = world;
+	// Assumes uniform scale
+	outNormal = vec3(dot(object.model[0].xyz, vNormal), dot(object.model[1].xyz, vNormal), dot(object.model[2].xyz, vNormal));
+}
@@ -0,0 +1,97 @@
+#version 450
+
+// Material colour lit by the point and spot lights listed for the fragment's cluster
+
+const uint GRID_X = 16;
+const uint GRID_Y = 9;
+const uint GRID_Z = 24;
+const uint CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+const uint MAX_LIGHTS_PER_CLUSTER = 64;
+const uint MAX_TEXTURE_ARRAYS = 32;
+
+const float LIGHT_SPOT = 1.0;
+
+struct Light {
+	vec4 positionRange;  // xyz, w = range
+	vec4 colorIntensity;
+	vec4 directionCos;   // xyz, w = cosine of the outer angle
+	vec4 spot;           // x = cosine of the inner angle, y = type
+};
+
+layout (std430, set = 0, binding = 0) readonly buffer Lights { Light lights[]; };
+layout (std140, set = 0, binding = 1) uniform ClusterView {
+	mat4 view;
+	mat4 invProjection;
+	vec4 viewport;
+	vec4 depth; // Near, far, slice scale and bias
+	vec4 ambient;
+} cv;
+layout (std430, set = 0, binding = 2) readonly buffer Clusters {
+	uint counts[CLUSTER_COUNT];
+	uint indices[];
+};
+
+struct Material {
+	vec4 baseColor;
+	vec4 emissive;
+	uint baseColorTexture; // Array in the high 16 bits, layer in the low 16 bits
+	uint pad0;
+	uint pad1;
+	uint pad2;
+};
+
+layout (std430, set = 1, binding = 0) readonly buffer Materials { Material materials[]; };
+layout (set = 1, binding = 1) uniform sampler textureSampler;
+layout (set = 1, binding = 2) uniform texture2DArray textureArrays[MAX_TEXTURE_ARRAYS];
+
+layout (location = 0) in vec3 inColor;
+layout (location = 1) in vec3 inWorldPos;
+layout (location = 2) in vec3 inNormal;
+layout (location = 3) in vec2 inUV;
+layout (location = 4) flat in uint inMaterial;
+
+layout (location = 0) out vec4 outFragColor;
+
+uint findCluster()
+{
+	float viewDepth = -(cv.view * vec4(inWorldPos, 1.0)).z;
+	float slice = log(max(viewDepth, cv.depth.x)) * cv.depth.z + cv.depth.w;
+
+	vec2 tile = (gl_FragCoord.xy - cv.viewport.xy) / cv.viewport.zw * vec2(GRID_X, GRID_Y);
+	uvec3 cell = uvec3(clamp(vec3(tile, slice), vec3(0.0), vec3(GRID_X - 1, GRID_Y - 1, GRID_Z - 1)));
+	return cell.x + cell.y * GRID_X + cell.z * GRID_X * GRID_Y;
+}
+
+void main()
+{
+	vec3 normal = normalize(inNormal);
+	vec3 lighting = cv.ambient.rgb;
+
+	uint cluster = findCluster();
+	uint count = counts[cluster];
+
+	for (uint i = 0; i < count; i++) {
+		Light light = lights[indices[cluster * MAX_LIGHTS_PER_CLUSTER + i]];
+
+		vec3 toLight = light.positionRange.xyz - inWorldPos;
+		float dist = length(toLight);
+		vec3 dir = toLight / max(dist, 1e-4);
+
+		// Inverse square, windowed to reach zero at the range
+		float window = clamp(1.0 - pow(dist / light.positionRange.w, 4.0), 0.0, 1.0);
+		float attenuation = window * window / (dist * dist + 1.0);
+
+		if (light.spot.y == LIGHT_SPOT) {
+			attenuation *= smoothstep(light.directionCos.w, light.spot.x, dot(-dir, light.directionCos.xyz));
+		}
+
+		lighting += light.colorIntensity.rgb * attenuation * max(dot(normal, dir), 0.0);
+	}
+
+	// The material index is the same for the whole draw, so indexing the arrays with it stays dynamically uniform
+	Material material = materials[inMaterial];
+	uint handle = material.baseColorTexture;
+	vec4 albedo = material.baseColor * texture(sampler2DArray(textureArrays[handle >> 16], textureSampler), vec3(inUV, float(handle & 0xFFFFu)));
+
+	outFragColor = vec4(inColor * albedo.rgb * lighting + material.emissive.rgb, albedo.a);
+}
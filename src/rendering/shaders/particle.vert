@@ -0,0 +1,41 @@
+#version 450
+
+// Camera facing quads pulled from the alive list, one instance per particle
+
+struct Particle {
+	vec4 position; // xyz, w = age in seconds
+	vec4 velocity; // xyz, w = lifetime in seconds
+	vec4 color;
+};
+
+layout (std430, set = 0, binding = 0) readonly buffer Particles { Particle particles[]; };
+layout (std430, set = 0, binding = 1) readonly buffer Indices { uint indices[]; };
+
+layout (location = 0) out vec4 outColor;
+layout (location = 1) out vec2 outCorner;
+
+layout( push_constant ) uniform constants
+{
+	mat4 viewProj;
+	vec4 right; // xyz, w = particle size
+	vec4 up;
+	uint listOffset; // Alive list written by the last simulation
+} params;
+
+const vec2 corners[6] = vec2[](
+	vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0),
+	vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0));
+
+void main()
+{
+	Particle p = particles[indices[params.listOffset + gl_InstanceIndex]];
+	vec2 corner = corners[gl_VertexIndex];
+
+	// Shrink and fade out over the last part of the lifetime
+	float remaining = clamp((p.velocity.w - p.position.w) / max(p.velocity.w * 0.25, 0.001), 0.0, 1.0);
+	vec3 offset = (params.right.xyz * corner.x + params.up.xyz * corner.y) * params.right.w * remaining;
+
+	gl_Position = params.viewProj * vec4(p.position.xyz + offset, 1.0);
+	outColor = vec4(p.color.rgb, p.color.a * remaining);
+	outCorner = corner;
+}
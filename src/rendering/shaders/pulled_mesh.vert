@@ -0,0 +1,65 @@
+#version 450
+
+// basic_mesh.vert without vertex input bindings, vertices are fetched from the geometry pool by index
+struct PackedVertex {
+	float px;
+	float py;
+	float pz;
+	uint normal; // Octahedral, snorm16x2
+	uint uv;     // half2
+	uint color;  // unorm8x4
+};
+
+layout (std430, set = 2, binding = 0) readonly buffer Vertices { PackedVertex vertices[]; };
+
+layout (location = 0) out vec3 outColor;
+layout (location = 1) out vec3 outWorldPos;
+layout (location = 2) out vec3 outNormal;
+layout (location = 3) out vec2 outUV;
+layout (location = 4) flat out uint outMaterial;
+
+struct Object {
+	vec4 model[3]; // Rows of the object's affine transform
+	uint material;
+};
+
+layout (std430, set = 3, binding = 0) readonly buffer Objects { Object objects[]; };
+layout (std140, set = 3, binding = 1) uniform Camera {
+	mat4 viewProj;
+} camera;
+
+//push constants block
+layout( push_constant ) uniform constants
+{
+	uint objectOffset; // Only set when indirect draws cannot pass the object as their first instance
+} PushConstants;
+
+vec3 decodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+void main()
+{
+	// Indexed draws add their vertex offset to gl_VertexIndex
+	PackedVertex v = vertices[gl_VertexIndex];
+	vec3 vNormal = decodeOctahedral(unpackSnorm2x16(v.normal));
+
+	// Draws pass their object index as the first instance
+	Object object = objects[gl_InstanceIndex + PushConstants.objectOffset];
+
+	vec4 position = vec4(v.px, v.py, v.pz, 1.0f);
+	outColor = unpackUnorm4x8(v.color).rgb;
+	outUV = unpackHalf2x16(v.uv);
+	outMaterial = object.material;
+
+	vec3 world = vec3(dot(object.model[0], position), dot(object.model[1], position), dot(object.model[2], position));
+	gl_Position = camera.viewProj * vec4(world, 1.0f);
+	outWorldPos = world;
+	// Assumes uniform scale
+	outNormal = vec3(dot(object.model[0].xyz, vNormal), dot(object.model[1].xyz, vNormal), dot(object.model[2].xyz, vNormal));
+}
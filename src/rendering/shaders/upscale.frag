@@ -0,0 +1,20 @@
+#version 450
+
+// Stretches the rendered region of the scene target over the output
+
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out vec4 outFragColor;
+
+layout (set = 0, binding = 0) uniform sampler2D scene;
+
+layout( push_constant ) uniform constants
+{
+	vec2 uvScale; // Rendered region of the target
+	vec2 uvMax;   // Half a texel inside the region, keeps bilinear taps off stale texels
+} params;
+
+void main()
+{
+	outFragColor = texture(scene, min(inUV * params.uvScale, params.uvMax));
+}
@@ -11,4 +11,11 @@
 
 #pragma once
 
-class Rule {};
\ No newline at end of file
+class World;
+
+// Rules of a world step in parallel, each may only write state it owns
+class Rule {
+public:
+    virtual ~Rule() = default;
+    virtual void step(World& world) {}
+};
\ No newline at end of file
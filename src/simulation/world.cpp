@@ -0,0 +1,12 @@
+#include "world.hpp"
+
+#include <RoseJobs.hpp>
+
+// Rules are independent within a step, every rule runs as its own job
+void World::step() {
+    JobCounter counter;
+    for (auto& rule : rules) {
+        getJobs().run([this, rule] () { rule->step(*this); }, &counter);
+    }
+    getJobs().wait(counter);
+}
@@ -0,0 +1,295 @@
+#include "bc_encoder.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+
+// Writes fields least significant bit first, the order of every BC format
+struct BitWriter {
+    uint8_t* out;
+    uint32_t position = 0;
+
+    void write(uint32_t value, uint32_t bits) {
+        for (uint32_t i = 0; i < bits; i++, position++) {
+            if (value & (1u << i)) out[position / 8] |= (uint8_t) (1u << (position % 8));
+        }
+    }
+};
+
+static uint32_t distance(const uint8_t* a, const int* b, uint32_t channels) {
+    uint32_t sum = 0;
+    for (uint32_t c = 0; c < channels; c++) {
+        int d = (int) a[c] - b[c];
+        sum += (uint32_t) (d * d);
+    }
+    return sum;
+}
+
+// Bounding box of the block in its first channels. The box diagonal is flipped per channel that falls
+// while red rises, so the endpoints follow the block's main gradient instead of always min to max.
+static void fitEndpoints(const uint8_t block[64], uint32_t channels, int insetDivisor, int minColor[4], int maxColor[4]) {
+    int mean[4] = {};
+    for (uint32_t i = 0; i < 16; i++) {
+        for (uint32_t c = 0; c < channels; c++) mean[c] += block[i * 4 + c];
+    }
+
+    int covariance[4] = {};
+    for (uint32_t c = 0; c < channels; c++) {
+        mean[c] = (mean[c] + 8) / 16;
+        minColor[c] = 255;
+        maxColor[c] = 0;
+    }
+    for (uint32_t i = 0; i < 16; i++) {
+        for (uint32_t c = 0; c < channels; c++) {
+            int value = block[i * 4 + c];
+            minColor[c] = std::min(minColor[c], value);
+            maxColor[c] = std::max(maxColor[c], value);
+            covariance[c] += (value - mean[c]) * (block[i * 4] - mean[0]);
+        }
+    }
+
+    for (uint32_t c = 0; c < channels; c++) {
+        // Insetting by a fraction of the range lowers the average error, the coarser the palette the more
+        int inset = (maxColor[c] - minColor[c]) / insetDivisor;
+        minColor[c] += inset;
+        maxColor[c] -= inset;
+        if (c > 0 && covariance[c] < 0) std::swap(minColor[c], maxColor[c]);
+    }
+}
+
+static uint16_t packRGB565(const int color[4]) {
+    uint32_t r = (uint32_t) (color[0] * 31 + 127) / 255;
+    uint32_t g = (uint32_t) (color[1] * 63 + 127) / 255;
+    uint32_t b = (uint32_t) (color[2] * 31 + 127) / 255;
+    return (uint16_t) ((r << 11) | (g << 5) | b);
+}
+
+static void unpackRGB565(uint16_t packed, int color[4]) {
+    uint32_t r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (int) ((r << 3) | (r >> 2));
+    color[1] = (int) ((g << 2) | (g >> 4));
+    color[2] = (int) ((b << 3) | (b >> 2));
+    color[3] = 255;
+}
+
+void encodeBC1(const uint8_t block[64], uint8_t out[8]) {
+    int minColor[4], maxColor[4];
+    fitEndpoints(block, 3, 16, minColor, maxColor);
+
+    uint16_t color0 = packRGB565(maxColor);
+    uint16_t color1 = packRGB565(minColor);
+    // The four colour mode needs color0 above color1, equal endpoints decode every index to color0
+    if (color0 < color1) std::swap(color0, color1);
+
+    int palette[4][4];
+    unpackRGB565(color0, palette[0]);
+    unpackRGB565(color1, palette[1]);
+    for (uint32_t c = 0; c < 3; c++) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+    }
+
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        for (uint32_t i = 0; i < 16; i++) {
+            uint32_t best = 0, bestError = UINT32_MAX;
+            for (uint32_t p = 0; p < 4; p++) {
+                uint32_t error = distance(block + i * 4, palette[p], 3);
+                if (error < bestError) {
+                    best = p;
+                    bestError = error;
+                }
+            }
+            indices |= best << (i * 2);
+        }
+    }
+
+    memcpy(out, &color0, 2);
+    memcpy(out + 2, &color1, 2);
+    memcpy(out + 4, &indices, 4);
+}
+
+void encodeBC4(const uint8_t block[64], uint32_t channel, uint8_t out[8]) {
+    int low = 255, high = 0;
+    for (uint32_t i = 0; i < 16; i++) {
+        low = std::min(low, (int) block[i * 4 + channel]);
+        high = std::max(high, (int) block[i * 4 + channel]);
+    }
+
+    memset(out, 0, 8);
+    out[0] = (uint8_t) high;
+    out[1] = (uint8_t) low;
+    if (high == low) return;
+
+    // Eight value mode, endpoint 0 above endpoint 1 and six interpolated values between them
+    int palette[8];
+    palette[0] = high;
+    palette[1] = low;
+    for (int i = 2; i < 8; i++) {
+        palette[i] = ((8 - i) * high + (i - 1) * low + 3) / 7;
+    }
+
+    BitWriter writer{out};
+    writer.position = 16;
+    for (uint32_t i = 0; i < 16; i++) {
+        int value = block[i * 4 + channel];
+        uint32_t best = 0;
+        int bestError = 256;
+        for (uint32_t p = 0; p < 8; p++) {
+            int error = std::abs(value - palette[p]);
+            if (error < bestError) {
+                best = p;
+                bestError = error;
+            }
+        }
+        writer.write(best, 3);
+    }
+}
+
+void encodeBC3(const uint8_t block[64], uint8_t out[16]) {
+    encodeBC4(block, 3, out);
+    encodeBC1(block, out + 8);
+}
+
+void encodeBC5(const uint8_t block[64], uint8_t out[16]) {
+    encodeBC4(block, 0, out);
+    encodeBC4(block, 1, out + 8);
+}
+
+static const int BC7_WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// Mode 6 endpoints are 7 bits per channel plus one shared low bit, the p-bit with less error wins
+static void quantizeBC7(const int color[4], int quantized[4], uint32_t& pBit) {
+    uint32_t bestError = UINT32_MAX;
+    for (uint32_t p = 0; p < 2; p++) {
+        int candidate[4];
+        uint32_t error = 0;
+        for (uint32_t c = 0; c < 4; c++) {
+            candidate[c] = std::clamp((color[c] - (int) p + 1) / 2, 0, 127);
+            int d = ((candidate[c] << 1) | (int) p) - color[c];
+            error += (uint32_t) (d * d);
+        }
+        if (error < bestError) {
+            bestError = error;
+            pBit = p;
+            std::copy(candidate, candidate + 4, quantized);
+        }
+    }
+}
+
+void encodeBC7(const uint8_t block[64], uint8_t out[16]) {
+    int minColor[4], maxColor[4];
+    fitEndpoints(block, 4, 64, minColor, maxColor);
+
+    int endpoints[2][4];
+    uint32_t pBits[2];
+    quantizeBC7(minColor, endpoints[0], pBits[0]);
+    quantizeBC7(maxColor, endpoints[1], pBits[1]);
+
+    int expanded[2][4];
+    for (uint32_t e = 0; e < 2; e++) {
+        for (uint32_t c = 0; c < 4; c++) expanded[e][c] = (endpoints[e][c] << 1) | (int) pBits[e];
+    }
+
+    int palette[16][4];
+    for (uint32_t p = 0; p < 16; p++) {
+        for (uint32_t c = 0; c < 4; c++) {
+            palette[p][c] = ((64 - BC7_WEIGHTS[p]) * expanded[0][c] + BC7_WEIGHTS[p] * expanded[1][c] + 32) >> 6;
+        }
+    }
+
+    uint32_t indices[16];
+    for (uint32_t i = 0; i < 16; i++) {
+        uint32_t bestError = UINT32_MAX;
+        for (uint32_t p = 0; p < 16; p++) {
+            uint32_t error = distance(block + i * 4, palette[p], 4);
+            if (error < bestError) {
+                indices[i] = p;
+                bestError = error;
+            }
+        }
+    }
+
+    // The first index is stored without its top bit, swapping the endpoints keeps that bit zero
+    if (indices[0] >= 8) {
+        std::swap(endpoints[0], endpoints[1]);
+        std::swap(pBits[0], pBits[1]);
+        for (uint32_t i = 0; i < 16; i++) indices[i] = 15 - indices[i];
+    }
+
+    memset(out, 0, 16);
+    BitWriter writer{out};
+    writer.write(1u << 6, 7);
+    for (uint32_t c = 0; c < 4; c++) {
+        writer.write((uint32_t) endpoints[0][c], 7);
+        writer.write((uint32_t) endpoints[1][c], 7);
+    }
+    writer.write(pBits[0], 1);
+    writer.write(pBits[1], 1);
+    for (uint32_t i = 0; i < 16; i++) {
+        writer.write(indices[i], i == 0 ? 3 : 4);
+    }
+}
+
+void encodeLevel(VkFormat format, const uint8_t* rgba, uint32_t width, uint32_t height, std::vector<uint8_t>& out) {
+    uint32_t blockBytes;
+    switch (format) {
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+            out.assign(rgba, rgba + (size_t) width * height * 4);
+            return;
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+            blockBytes = 8;
+            break;
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            blockBytes = 16;
+            break;
+        default:
+            throw std::runtime_error("unsupported texture format!");
+    }
+
+    uint32_t blocksX = (width + 3) / 4;
+    uint32_t blocksY = (height + 3) / 4;
+    out.assign((size_t) blocksX * blocksY * blockBytes, 0);
+
+    uint8_t block[64];
+    for (uint32_t by = 0; by < blocksY; by++) {
+        for (uint32_t bx = 0; bx < blocksX; bx++) {
+            for (uint32_t y = 0; y < 4; y++) {
+                uint32_t sy = std::min(by * 4 + y, height - 1);
+                for (uint32_t x = 0; x < 4; x++) {
+                    uint32_t sx = std::min(bx * 4 + x, width - 1);
+                    memcpy(block + (y * 4 + x) * 4, rgba + ((size_t) sy * width + sx) * 4, 4);
+                }
+            }
+
+            uint8_t* dst = out.data() + ((size_t) by * blocksX + bx) * blockBytes;
+            switch (format) {
+                case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+                case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+                    encodeBC1(block, dst);
+                    break;
+                case VK_FORMAT_BC4_UNORM_BLOCK:
+                    encodeBC4(block, 0, dst);
+                    break;
+                case VK_FORMAT_BC3_UNORM_BLOCK:
+                case VK_FORMAT_BC3_SRGB_BLOCK:
+                    encodeBC3(block, dst);
+                    break;
+                case VK_FORMAT_BC5_UNORM_BLOCK:
+                    encodeBC5(block, dst);
+                    break;
+                default:
+                    encodeBC7(block, dst);
+                    break;
+            }
+        }
+    }
+}
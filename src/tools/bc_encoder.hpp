@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <cstdint>
+
+// CPU block compression for the texture cooker. The block encoders take a 4x4 block of RGBA8 texels row by row.
+// They fit endpoints to the block's bounding box and pick the nearest palette entry per texel, which is fast
+// and good enough for offline cooking without a search over partitions or modes.
+
+// 565 colour endpoints and 2 bit indices, alpha ignored
+void encodeBC1(const uint8_t block[64], uint8_t out[8]);
+// One channel, 8 bit endpoints and 3 bit indices. Channel selects the component of the RGBA block.
+void encodeBC4(const uint8_t block[64], uint32_t channel, uint8_t out[8]);
+// BC4 alpha followed by BC1 colour
+void encodeBC3(const uint8_t block[64], uint8_t out[16]);
+// BC4 red followed by BC4 green, for normal maps
+void encodeBC5(const uint8_t block[64], uint8_t out[16]);
+// Mode 6 only, a single RGBA subset with 7 bit endpoints, p-bits and 4 bit indices
+void encodeBC7(const uint8_t block[64], uint8_t out[16]);
+
+// Compresses a whole level, edge blocks repeat the last row and column. Uncompressed formats are copied.
+void encodeLevel(VkFormat format, const uint8_t* rgba, uint32_t width, uint32_t height, std::vector<uint8_t>& out);
@@ -0,0 +1,35 @@
+# Cooks source images into block compressed .rtex containers next to the other assets in the build directory.
+# add_textures(TARGET FORMAT bc7 [LINEAR] image.png ...) with image paths relative to the assets directory.
+
+set(TEXTURE_SRC_DIR ${CMAKE_CURRENT_SOURCE_DIR}/assets)
+
+function(add_textures TARGET)
+    cmake_parse_arguments(COOK "LINEAR" "FORMAT" "" ${ARGN})
+    if(NOT COOK_FORMAT)
+        set(COOK_FORMAT bc7)
+    endif()
+    set(cook-flags --format ${COOK_FORMAT})
+    if(COOK_LINEAR)
+        list(APPEND cook-flags --linear)
+    endif()
+
+    foreach(TEXTURE IN LISTS COOK_UNPARSED_ARGUMENTS)
+        set(current-texture-path ${TEXTURE_SRC_DIR}/${TEXTURE})
+        get_filename_component(current-texture-dir ${TEXTURE} DIRECTORY)
+        get_filename_component(current-texture-name ${TEXTURE} NAME_WE)
+        set(current-output-path ${CMAKE_BINARY_DIR}/assets/${current-texture-dir}/${current-texture-name}.rtex)
+
+        get_filename_component(current-output-dir ${current-output-path} DIRECTORY)
+        file(MAKE_DIRECTORY ${current-output-dir})
+
+        add_custom_command(
+            OUTPUT ${current-output-path}
+            COMMAND TextureCooker ${current-texture-path} ${current-output-path} ${cook-flags}
+            DEPENDS ${current-texture-path} TextureCooker
+            VERBATIM)
+
+        set_source_files_properties(${current-output-path} PROPERTIES GENERATED TRUE)
+        target_sources(${TARGET} PRIVATE ${current-output-path})
+    endforeach()
+
+endfunction(add_textures)
@@ -0,0 +1,127 @@
+// Replays a session recorded with ROSE_CAPTURE through a headless output, as fast as the device allows, and reports
+// frame times. Needs no window system, so it runs on CI machines with a software driver such as lavapipe.
+// Usage: ReplaySession <session> [--warmup <frames>]
+
+#include "VulkanEngine.hpp"
+#include <RoseJobs.hpp>
+#include <RoseLogging.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct FrameTimes {
+    float average = 0.f;
+    float p50 = 0.f;
+    float p95 = 0.f;
+    float p99 = 0.f;
+    float max = 0.f;
+};
+
+static FrameTimes summarize(std::vector<float> times) {
+    FrameTimes result;
+    if (times.empty()) return result;
+
+    std::sort(times.begin(), times.end());
+    auto percentile = [&] (float p) { return times[std::min(times.size() - 1, (size_t) (p * times.size()))]; };
+
+    for (float time : times) result.average += time;
+    result.average /= (float) times.size();
+    result.p50 = percentile(0.5f);
+    result.p95 = percentile(0.95f);
+    result.p99 = percentile(0.99f);
+    result.max = times.back();
+    return result;
+}
+
+static void print(const std::string& name, const FrameTimes& times) {
+    std::cout << std::fixed << std::setprecision(2) << name << ": avg " << times.average << " ms, p50 " << times.p50
+              << " ms, p95 " << times.p95 << " ms, p99 " << times.p99 << " ms, max " << times.max << " ms" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> paths;
+    uint32_t warmup = 10; // Frames left out of the statistics, pipelines and uploads settle first
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--warmup" && i + 1 < argc) warmup = (uint32_t) std::strtoul(argv[++i], nullptr, 10);
+        else paths.push_back(arg);
+    }
+    if (paths.size() != 1) {
+        std::cerr << "Usage: ReplaySession <session> [--warmup <frames>]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    const std::string& path = paths[0];
+
+    initLogging();
+    initJobs();
+    auto logger = getLogger("Rose");
+
+    std::unique_ptr<SessionPlayer> player;
+    try {
+        player = std::make_unique<SessionPlayer>(path);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        shutdownJobs();
+        return EXIT_FAILURE;
+    }
+
+    auto& header = player->getHeader();
+    // Without a window the instance needs no surface extensions
+    VulkanEngine engine(std::set<std::string>{});
+    VkGlfwOutput output(VkExtent2D{header.width, header.height}, engine);
+
+    try {
+        engine.init();
+        player->begin(engine);
+    } catch (const std::exception& e) {
+        logger->critical(e.what());
+        shutdownJobs();
+        return EXIT_FAILURE;
+    }
+
+    engine.start();
+
+    // Wall time of each frame as the application would see it, and the GPU time of the frame last finished
+    std::vector<float> frameTimes;
+    std::vector<float> gpuTimes;
+    bool failed = false;
+    auto replayStart = std::chrono::steady_clock::now();
+
+    try {
+        while (true) {
+            auto frameStart = std::chrono::steady_clock::now();
+            if (!player->nextFrame(engine, output)) break;
+
+            output.draw();
+            engine.update();
+
+            if (player->frames > warmup) {
+                frameTimes.push_back(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+                gpuTimes.push_back(output.getGpuFrameTime());
+            }
+        }
+    } catch (const std::exception& e) {
+        logger->critical(e.what());
+        failed = true;
+    }
+
+    float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - replayStart).count();
+    engine.stop();
+
+    std::cout << path << ": " << player->frames << " frames at " << header.width << "x" << header.height << " in "
+              << std::fixed << std::setprecision(2) << seconds << " s, " << frameTimes.size() << " measured" << std::endl;
+    print("Frame", summarize(frameTimes));
+    print("GPU", summarize(gpuTimes));
+
+    output.destroy();
+    engine.destroy();
+    shutdownJobs();
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,80 @@
+// Times SceneGraph::update on a large hierarchy: everything below a moved root, one moved subtree and nothing
+// changed. Every node has a render object, as in a scene the graph places entirely. For scale, a copy of as many
+// world transforms as the graph holds bounds what a moved root can cost on this machine's memory bandwidth.
+// Usage: SceneGraphBenchmark [nodes]
+
+#include "ve_scene_graph.hpp"
+#include <RoseJobs.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <thread>
+#include <vector>
+
+#define RUNS 10
+#define BRANCHING 4
+
+// Best of several runs, in ms
+static double measure(const std::function<void()>& change, const std::function<void()>& run) {
+    double best = 1e30;
+    for (int i = 0; i < RUNS; i++) {
+        change();
+        auto start = std::chrono::steady_clock::now();
+        run();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    uint32_t count = argc > 1 ? (uint32_t) std::strtoul(argv[1], nullptr, 10) : 1000000;
+    if (count == 0) {
+        std::fprintf(stderr, "Usage: SceneGraphBenchmark [nodes]\n");
+        return EXIT_FAILURE;
+    }
+
+    initJobs();
+    {
+        std::mt19937 random(1234);
+        std::uniform_real_distribution<float> value(-1.f, 1.f);
+
+        SceneGraph graph;
+        std::vector<SceneNode> nodes;
+        nodes.reserve(count);
+        for (uint32_t i = 0; i < count; i++) {
+            SceneNode parent = i == 0 ? SceneGraph::NO_NODE : nodes[(i - 1) / BRANCHING];
+            nodes.push_back(graph.add(parent, i));
+            glm::quat rotation = glm::normalize(glm::quat(value(random), value(random), value(random), value(random)));
+            graph.setLocal(nodes.back(), glm::vec3(value(random), value(random), value(random)), rotation, glm::vec3(1.f));
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        graph.update();
+        double first = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        float offset = 0.f;
+        double all = measure([&] () { graph.setPosition(nodes[0], glm::vec3(offset += 1.f, 0.f, 0.f)); }, [&] () { graph.update(); });
+        uint32_t allUpdated = graph.stats.updated;
+        double subtree = measure([&] () { graph.setPosition(nodes[std::min(count - 1, 1u)], glm::vec3(offset += 1.f, 0.f, 0.f)); }, [&] () { graph.update(); });
+        uint32_t subtreeUpdated = graph.stats.updated;
+        double unchanged = measure([] () {}, [&] () { graph.update(); });
+
+        std::vector<AffineTransform> source(count), destination(count);
+        double copy = measure([] () {}, [&] () { std::memcpy(destination.data(), source.data(), count * sizeof(AffineTransform)); });
+
+        std::printf("%u nodes in %u levels, %u hardware threads, best of %u runs\n\n", graph.stats.nodes, graph.stats.levels, std::thread::hardware_concurrency(), RUNS);
+        std::printf("%-24s %10.3f ms\n", "first (sort and all)", first);
+        std::printf("%-24s %10.3f ms (%u nodes)\n", "moved root", all, allUpdated);
+        std::printf("%-24s %10.3f ms (%u nodes)\n", "moved subtree", subtree, subtreeUpdated);
+        std::printf("%-24s %10.3f ms\n", "unchanged", unchanged);
+        std::printf("%-24s %10.3f ms\n", "copy of all worlds", copy);
+    }
+    shutdownJobs();
+
+    return EXIT_SUCCESS;
+}
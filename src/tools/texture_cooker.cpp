@@ -0,0 +1,139 @@
+// Cooks a source image into a block compressed .rtex container with its full mip chain, see ve_texture_container.hpp.
+// Usage: TextureCooker <input> <output> [--format bc1|bc3|bc5|bc7|rgba8] [--linear]
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "bc_encoder.hpp"
+#include "ve_texture_container.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static float toLinear(uint8_t value) {
+    float c = value / 255.f;
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static uint8_t fromLinear(float c) {
+    c = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.f / 2.4f) - 0.055f;
+    return (uint8_t) std::clamp(c * 255.f + 0.5f, 0.f, 255.f);
+}
+
+// Box filter, sRGB colour is averaged in linear space so the small levels keep their brightness
+static void downsample(const std::vector<uint8_t>& src, uint32_t width, uint32_t height, bool srgb, std::vector<uint8_t>& dst) {
+    uint32_t dstWidth = std::max(width / 2, 1u);
+    uint32_t dstHeight = std::max(height / 2, 1u);
+    dst.resize((size_t) dstWidth * dstHeight * 4);
+
+    for (uint32_t y = 0; y < dstHeight; y++) {
+        uint32_t ys[2] = {std::min(y * 2, height - 1), std::min(y * 2 + 1, height - 1)};
+        for (uint32_t x = 0; x < dstWidth; x++) {
+            uint32_t xs[2] = {std::min(x * 2, width - 1), std::min(x * 2 + 1, width - 1)};
+            for (uint32_t c = 0; c < 4; c++) {
+                bool gamma = srgb && c < 3;
+                float sum = 0.f;
+                for (uint32_t sy : ys) {
+                    for (uint32_t sx : xs) {
+                        uint8_t value = src[((size_t) sy * width + sx) * 4 + c];
+                        sum += gamma ? toLinear(value) : value / 255.f;
+                    }
+                }
+                sum *= 0.25f;
+                dst[((size_t) y * dstWidth + x) * 4 + c] = gamma ? fromLinear(sum) : (uint8_t) (sum * 255.f + 0.5f);
+            }
+        }
+    }
+}
+
+static bool parseFormat(const std::string& name, bool linear, VkFormat& format) {
+    if (name == "bc1") format = linear ? VK_FORMAT_BC1_RGB_UNORM_BLOCK : VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+    else if (name == "bc3") format = linear ? VK_FORMAT_BC3_UNORM_BLOCK : VK_FORMAT_BC3_SRGB_BLOCK;
+    else if (name == "bc5") format = VK_FORMAT_BC5_UNORM_BLOCK;
+    else if (name == "bc7") format = linear ? VK_FORMAT_BC7_UNORM_BLOCK : VK_FORMAT_BC7_SRGB_BLOCK;
+    else if (name == "rgba8") format = linear ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R8G8B8A8_SRGB;
+    else return false;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> paths;
+    std::string formatName = "bc7";
+    bool linear = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--format" && i + 1 < argc) formatName = argv[++i];
+        else if (arg == "--linear") linear = true;
+        else paths.push_back(arg);
+    }
+
+    VkFormat format;
+    if (paths.size() != 2 || !parseFormat(formatName, linear, format)) {
+        std::cerr << "Usage: TextureCooker <input> <output> [--format bc1|bc3|bc5|bc7|rgba8] [--linear]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    // BC5 holds two independent channels, never colour
+    bool srgb = !linear && format != VK_FORMAT_BC5_UNORM_BLOCK;
+
+    int width, height, channels;
+    stbi_uc* pixels = stbi_load(paths[0].c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (pixels == nullptr) {
+        std::cerr << "Failed to load " << paths[0] << ": " << stbi_failure_reason() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<uint8_t> level(pixels, pixels + (size_t) width * height * 4);
+    stbi_image_free(pixels);
+
+    TextureContainerHeader header;
+    memcpy(header.magic, TEXTURE_CONTAINER_MAGIC, sizeof(header.magic));
+    header.vkFormat = (uint32_t) format;
+    header.width = (uint32_t) width;
+    header.height = (uint32_t) height;
+    header.levelCount = 1;
+    for (uint32_t size = std::max(header.width, header.height); size > 1; size /= 2) {
+        header.levelCount++;
+    }
+
+    // Every level is filtered from the uncompressed one above it, never from compressed data
+    std::vector<std::vector<uint8_t>> encoded(header.levelCount);
+    uint32_t w = header.width, h = header.height;
+    for (uint32_t i = 0; i < header.levelCount; i++) {
+        encodeLevel(format, level.data(), w, h, encoded[i]);
+        if (i + 1 < header.levelCount) {
+            std::vector<uint8_t> next;
+            downsample(level, w, h, srgb, next);
+            level.swap(next);
+            w = std::max(w / 2, 1u);
+            h = std::max(h / 2, 1u);
+        }
+    }
+
+    std::vector<TextureContainerLevel> index(header.levelCount);
+    uint64_t offset = sizeof(TextureContainerHeader) + index.size() * sizeof(TextureContainerLevel);
+    for (uint32_t i = header.levelCount; i-- > 0;) {
+        index[i].byteOffset = offset;
+        index[i].byteLength = encoded[i].size();
+        offset += encoded[i].size();
+    }
+
+    std::ofstream file(paths[1], std::ios::binary);
+    file.write((const char*) &header, sizeof(header));
+    file.write((const char*) index.data(), index.size() * sizeof(TextureContainerLevel));
+    for (uint32_t i = header.levelCount; i-- > 0;) {
+        file.write((const char*) encoded[i].data(), encoded[i].size());
+    }
+    if (!file) {
+        std::cerr << "Failed to write " << paths[1] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << paths[0] << " -> " << paths[1] << " (" << formatName << ", " << header.width << "x" << header.height
+              << ", " << header.levelCount << " levels, " << offset << " bytes)" << std::endl;
+    return EXIT_SUCCESS;
+}